@@ -0,0 +1,250 @@
+#include "alter_pipeline.h"
+#include "metrics.h"
+#include "sample_queue.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+// How long a batch waits for ngspice to confirm the halt before giving up
+#define ALTER_HALT_TIMEOUT_MS 1000
+
+typedef struct {
+    AlterKind kind;
+    char target[ALTER_NAME_LEN];
+    char param[ALTER_NAME_LEN];     // Empty for a device's primary value
+    double value;
+    bool pending;
+    uint64_t posted_ns;             // First post since the last batch
+} AlterEdit;
+
+struct AlterPipeline {
+    SimContext* context;
+    int coalesce_ms;
+
+    pthread_mutex_t lock;           // Guards everything below
+    pthread_cond_t wake;            // Edit posted or stop requested
+    AlterEdit edits[ALTER_MAX_EDITS];
+    int num_edits;                  // Distinct parameters seen so far
+    int num_pending;
+    bool stop;
+    AlterStats stats;
+
+    bool halt_unconfirmed;          // Pipeline thread only: a bg_halt timed out and may still take effect
+    pthread_t thread;
+};
+
+static void deadline_after_ms(struct timespec* deadline, int ms) {
+    clock_gettime(CLOCK_REALTIME, deadline);
+    long long ns = deadline->tv_nsec + (long long)ms * 1000000ll;
+    deadline->tv_sec += ns / 1000000000ll;
+    deadline->tv_nsec = ns % 1000000000ll;
+}
+
+static int format_command(char* buffer, size_t size, const AlterEdit* edit) {
+    const char* verb = edit->kind == ALTER_MODEL ? "altermod" : "alter";
+    if (edit->param[0]) {
+        return snprintf(buffer, size, "%s %s %s = %.9g", verb, edit->target, edit->param, edit->value);
+    }
+    return snprintf(buffer, size, "%s %s = %.9g", verb, edit->target, edit->value);
+}
+
+// Send one batch, halting the background thread around it if it is running.
+// Returns false, with nothing sent, if the halt was not confirmed in time.
+static bool apply_batch(AlterPipeline* pipeline, const AlterEdit* batch, int count) {
+    SimContext* context = pipeline->context;
+    char command[3 * ALTER_NAME_LEN + 48];
+
+    // A halt that timed out last time and has since taken effect is ours to resume
+    bool halted = pipeline->halt_unconfirmed && !atomic_load(&context->is_bg_running);
+    pipeline->halt_unconfirmed = false;
+
+    uint64_t start_ns = monotonic_ns();
+    if (atomic_load(&context->is_bg_running)) {
+        ngSpice_Command("bg_halt");
+        halted = wait_for_halt(context, ALTER_HALT_TIMEOUT_MS);
+        if (!halted) {
+            DEBUG_PRINT(DEBUG_WARN, "Simulation did not halt within %d ms, retrying %d edits",
+                        ALTER_HALT_TIMEOUT_MS, count);
+            pipeline->halt_unconfirmed = true;
+            return false;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        format_command(command, sizeof(command), &batch[i]);
+        DEBUG_PRINT(DEBUG_INFO, "%s", command);
+        if (ngSpice_Command(command) != 0) {
+            DEBUG_PRINT(DEBUG_ERROR, "Command failed: %s", command);
+        }
+    }
+
+    // A simulation that reached --ready-- meanwhile must not be resumed
+    pthread_mutex_lock(&context->state_lock);
+    bool finished = context->simulation_finished;
+    pthread_mutex_unlock(&context->state_lock);
+    if (halted && !finished) {
+        ngSpice_Command("bg_resume");
+    }
+    uint64_t end_ns = monotonic_ns();
+    metrics_add(METRIC_ALTERS, count);
+    if (halted) metrics_record(METRIC_HALT, end_ns - start_ns);
+
+    pthread_mutex_lock(&pipeline->lock);
+    AlterStats* stats = &pipeline->stats;
+    stats->windows++;
+    stats->edits_applied += count;
+    if (halted) {
+        uint64_t halt_ns = end_ns - start_ns;
+        stats->halts++;
+        stats->last_halt_ns = halt_ns;
+        stats->total_halt_ns += halt_ns;
+        if (halt_ns > stats->max_halt_ns) stats->max_halt_ns = halt_ns;
+    }
+    for (int i = 0; i < count; i++) {
+        uint64_t delay_ns = end_ns - batch[i].posted_ns;
+        if (delay_ns > stats->max_edit_delay_ns) stats->max_edit_delay_ns = delay_ns;
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return true;
+}
+
+// Put a batch that could not be sent back into the table, called with lock
+// held. A parameter posted again meanwhile keeps its newer value.
+static void requeue_batch(AlterPipeline* pipeline, const AlterEdit* batch, const int* slots, int count) {
+    for (int i = 0; i < count; i++) {
+        AlterEdit* edit = &pipeline->edits[slots[i]];
+        if (edit->pending) {
+            edit->posted_ns = batch[i].posted_ns;
+            continue;
+        }
+        edit->value = batch[i].value;
+        edit->posted_ns = batch[i].posted_ns;
+        edit->pending = true;
+        pipeline->num_pending++;
+    }
+}
+
+static void* pipeline_thread(void* arg) {
+    AlterPipeline* pipeline = arg;
+    AlterEdit batch[ALTER_MAX_EDITS];
+    int slots[ALTER_MAX_EDITS];
+
+    pthread_mutex_lock(&pipeline->lock);
+    while (!pipeline->stop) {
+        if (pipeline->num_pending == 0) {
+            pthread_cond_wait(&pipeline->wake, &pipeline->lock);
+            continue;
+        }
+
+        // Keep the batch open so that a slider drag or several controls
+        // moved together end up in the same halt window
+        struct timespec deadline;
+        deadline_after_ms(&deadline, pipeline->coalesce_ms);
+        while (!pipeline->stop &&
+               pthread_cond_timedwait(&pipeline->wake, &pipeline->lock, &deadline) != ETIMEDOUT) {
+        }
+        if (pipeline->stop) break;
+
+        int count = 0;
+        for (int i = 0; i < pipeline->num_edits; i++) {
+            if (pipeline->edits[i].pending) {
+                slots[count] = i;
+                batch[count++] = pipeline->edits[i];
+                pipeline->edits[i].pending = false;
+            }
+        }
+        pipeline->num_pending = 0;
+
+        pthread_mutex_unlock(&pipeline->lock);
+        bool applied = apply_batch(pipeline, batch, count);
+        pthread_mutex_lock(&pipeline->lock);
+        if (!applied) {
+            // Retried in the next window, merged with whatever arrives until then
+            requeue_batch(pipeline, batch, slots, count);
+        }
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+AlterPipeline* alter_pipeline_start(SimContext* context, int coalesce_ms) {
+    AlterPipeline* pipeline = calloc(1, sizeof(AlterPipeline));
+    if (!pipeline) return NULL;
+
+    pipeline->context = context;
+    pipeline->coalesce_ms = coalesce_ms > 0 ? coalesce_ms : 0;
+    pthread_mutex_init(&pipeline->lock, NULL);
+    pthread_cond_init(&pipeline->wake, NULL);
+
+    if (pthread_create(&pipeline->thread, NULL, pipeline_thread, pipeline) != 0) {
+        pthread_cond_destroy(&pipeline->wake);
+        pthread_mutex_destroy(&pipeline->lock);
+        free(pipeline);
+        return NULL;
+    }
+    return pipeline;
+}
+
+void alter_pipeline_stop(AlterPipeline* pipeline, AlterStats* stats) {
+    if (!pipeline) return;
+
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->stop = true;
+    pthread_cond_signal(&pipeline->wake);
+    pthread_mutex_unlock(&pipeline->lock);
+    pthread_join(pipeline->thread, NULL);
+
+    if (stats) *stats = pipeline->stats;
+    pthread_cond_destroy(&pipeline->wake);
+    pthread_mutex_destroy(&pipeline->lock);
+    free(pipeline);
+}
+
+int alter_pipeline_post(AlterPipeline* pipeline, AlterKind kind, const char* target,
+                        const char* param, double value) {
+    if (!param) param = "";
+    if (strlen(target) >= ALTER_NAME_LEN || strlen(param) >= ALTER_NAME_LEN) return -1;
+
+    pthread_mutex_lock(&pipeline->lock);
+    AlterEdit* edit = NULL;
+    for (int i = 0; i < pipeline->num_edits; i++) {
+        AlterEdit* e = &pipeline->edits[i];
+        if (e->kind == kind && strcasecmp(e->target, target) == 0 && strcasecmp(e->param, param) == 0) {
+            edit = e;
+            break;
+        }
+    }
+    if (!edit) {
+        if (pipeline->num_edits == ALTER_MAX_EDITS) {
+            pthread_mutex_unlock(&pipeline->lock);
+            return -1;
+        }
+        edit = &pipeline->edits[pipeline->num_edits++];
+        edit->kind = kind;
+        strcpy(edit->target, target);
+        strcpy(edit->param, param);
+    }
+
+    edit->value = value;
+    if (!edit->pending) {
+        edit->pending = true;
+        edit->posted_ns = monotonic_ns();
+        pipeline->num_pending++;
+        if (pipeline->num_pending == 1) {
+            pthread_cond_signal(&pipeline->wake);
+        }
+    }
+    pipeline->stats.edits_posted++;
+    pthread_mutex_unlock(&pipeline->lock);
+    return 0;
+}
+
+AlterStats alter_pipeline_stats(AlterPipeline* pipeline) {
+    pthread_mutex_lock(&pipeline->lock);
+    AlterStats stats = pipeline->stats;
+    pthread_mutex_unlock(&pipeline->lock);
+    return stats;
+}
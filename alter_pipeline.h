@@ -0,0 +1,56 @@
+#ifndef ALTER_PIPELINE_H
+#define ALTER_PIPELINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "simulation.h"
+
+// Parameter edits that cannot go through an `external` source (device values,
+// model parameters) need the background simulation halted while ngspice runs
+// `alter`/`altermod`. The pipeline collects edits from any number of controls
+// and applies them on its own thread: edits to the same parameter are merged
+// (the latest value wins), and everything that arrived within the coalescing
+// interval is sent as one batch between a single bg_halt and bg_resume.
+// If ngspice does not confirm the halt in time, the batch is put back and
+// retried in the next window, with later edits of the same parameter
+// winning. alter_pipeline_post may be called from any thread and never
+// waits for ngspice.
+
+#define ALTER_MAX_EDITS 32
+#define ALTER_NAME_LEN 32
+#define ALTER_DEFAULT_COALESCE_MS 20
+
+typedef enum {
+    ALTER_DEVICE,   // alter <device> [param] = value
+    ALTER_MODEL     // altermod <model> param = value
+} AlterKind;
+
+typedef struct {
+    unsigned long long edits_posted;    // alter_pipeline_post calls
+    unsigned long long edits_applied;   // alter/altermod commands sent
+    unsigned long long windows;         // Batches applied
+    unsigned long long halts;           // Batches that had to halt the simulation
+    uint64_t last_halt_ns;              // bg_halt issued -> bg_resume returned
+    uint64_t max_halt_ns;
+    uint64_t total_halt_ns;
+    uint64_t max_edit_delay_ns;         // Edit posted -> command sent
+} AlterStats;
+
+typedef struct AlterPipeline AlterPipeline;
+
+// Start the pipeline thread; coalesce_ms is how long a batch stays open for
+// further edits after the first one arrives
+AlterPipeline* alter_pipeline_start(SimContext* context, int coalesce_ms);
+
+// Stops the thread and frees the pipeline; edits that were not applied yet
+// are dropped. The final statistics are stored in stats unless it is NULL.
+void alter_pipeline_stop(AlterPipeline* pipeline, AlterStats* stats);
+
+// Queue a new value; param may be NULL for a device's primary value.
+// Returns -1 if the edit table is full.
+int alter_pipeline_post(AlterPipeline* pipeline, AlterKind kind, const char* target,
+                        const char* param, double value);
+
+AlterStats alter_pipeline_stats(AlterPipeline* pipeline);
+
+#endif // ALTER_PIPELINE_H
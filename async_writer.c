@@ -0,0 +1,309 @@
+#include "async_writer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct AsyncWriter {
+    int fd;
+    AsyncWriterPolicy policy;
+
+    // Block being filled by the producer. The I/O thread reads its committed
+    // part for timed flushes, so moving it (swap, realloc) takes lock.
+    char* active;
+    atomic_size_t active_used; // Committed bytes, stored by the producer only
+    size_t active_cap;
+    size_t active_flushed;   // Prefix already written by a timed flush, guarded by lock
+    uint64_t offset;
+
+    // Second block, guarded by lock: either queued for the I/O thread
+    // (pending != NULL), idle (spare != NULL), or neither while a timed
+    // flush writes from it
+    pthread_mutex_t lock;
+    pthread_cond_t wake;     // Producer -> I/O thread: block queued or stop
+    pthread_cond_t done;     // I/O thread -> producer: block written
+    char* pending;
+    size_t pending_from;     // Bytes before this were written by a timed flush
+    size_t pending_used;
+    size_t pending_cap;
+    char* spare;
+    size_t spare_cap;
+    bool stop;
+
+    atomic_uint_least64_t bytes_written;
+    atomic_uint_least64_t stalls;
+    atomic_int error;
+
+    pthread_t thread;
+};
+
+AsyncWriterPolicy async_writer_default_policy(void) {
+    AsyncWriterPolicy policy = {
+        .block_size = 4 << 20,
+        .flush_bytes = 1 << 20,
+        .flush_interval_ms = 500
+    };
+    return policy;
+}
+
+static void write_all(AsyncWriter* writer, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(writer->fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            atomic_store(&writer->error, errno);
+            return;
+        }
+        data += n;
+        len -= (size_t)n;
+        atomic_fetch_add_explicit(&writer->bytes_written, (uint64_t)n, memory_order_relaxed);
+    }
+}
+
+// Called with lock held when no block was handed over for a whole interval.
+// Copies the committed but unwritten part of the active block into the spare
+// one and writes it, so the producer's block stays where it is.
+static void timed_flush(AsyncWriter* writer) {
+    if (writer->pending || !writer->spare) return;
+
+    size_t used = atomic_load_explicit(&writer->active_used, memory_order_acquire);
+    if (used <= writer->active_flushed) return;
+    size_t len = used - writer->active_flushed;
+    if (len > writer->spare_cap) {
+        char* grown = realloc(writer->spare, len);
+        if (!grown) return;  // The producer hands the block over later
+        writer->spare = grown;
+        writer->spare_cap = len;
+    }
+    char* block = writer->spare;
+    memcpy(block, writer->active + writer->active_flushed, len);
+    writer->active_flushed = used;
+
+    // Without a spare the producer keeps filling its block meanwhile
+    writer->spare = NULL;
+    pthread_mutex_unlock(&writer->lock);
+
+    write_all(writer, block, len);
+
+    pthread_mutex_lock(&writer->lock);
+    writer->spare = block;
+    pthread_cond_broadcast(&writer->done);
+}
+
+static void* io_thread(void* arg) {
+    AsyncWriter* writer = (AsyncWriter*)arg;
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (!writer->pending && !writer->stop) {
+            if (writer->policy.flush_interval_ms > 0) {
+                struct timespec deadline;
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                long long ns = deadline.tv_nsec + (long long)writer->policy.flush_interval_ms * 1000000ll;
+                deadline.tv_sec += ns / 1000000000ll;
+                deadline.tv_nsec = ns % 1000000000ll;
+                if (pthread_cond_timedwait(&writer->wake, &writer->lock, &deadline) == ETIMEDOUT) {
+                    timed_flush(writer);
+                }
+            } else {
+                pthread_cond_wait(&writer->wake, &writer->lock);
+            }
+        }
+        if (!writer->pending) break;  // Stopping with nothing left to write
+
+        char* block = writer->pending;
+        size_t from = writer->pending_from;
+        size_t used = writer->pending_used;
+        pthread_mutex_unlock(&writer->lock);
+
+        write_all(writer, block + from, used - from);
+
+        pthread_mutex_lock(&writer->lock);
+        writer->spare = block;
+        writer->spare_cap = writer->pending_cap;
+        writer->pending = NULL;
+        pthread_cond_broadcast(&writer->done);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+// Queue the active block for writing if the I/O thread is idle.
+// Returns false, without waiting, if the previous block is still in flight.
+static bool submit_active(AsyncWriter* writer) {
+    size_t used = atomic_load_explicit(&writer->active_used, memory_order_relaxed);
+    if (used == 0) return true;
+
+    pthread_mutex_lock(&writer->lock);
+    if (used == writer->active_flushed) {
+        // A timed flush already wrote all of it: start the block over
+        atomic_store_explicit(&writer->active_used, 0, memory_order_relaxed);
+        writer->active_flushed = 0;
+        pthread_mutex_unlock(&writer->lock);
+        return true;
+    }
+    if (writer->pending || !writer->spare) {
+        pthread_mutex_unlock(&writer->lock);
+        atomic_fetch_add_explicit(&writer->stalls, 1, memory_order_relaxed);
+        return false;
+    }
+    writer->pending = writer->active;
+    writer->pending_from = writer->active_flushed;
+    writer->pending_used = used;
+    writer->pending_cap = writer->active_cap;
+    writer->active = writer->spare;
+    writer->active_cap = writer->spare_cap;
+    atomic_store_explicit(&writer->active_used, 0, memory_order_relaxed);
+    writer->active_flushed = 0;
+    writer->spare = NULL;
+    pthread_cond_signal(&writer->wake);
+    pthread_mutex_unlock(&writer->lock);
+    return true;
+}
+
+AsyncWriter* async_writer_open(const char* path, const AsyncWriterPolicy* policy) {
+    AsyncWriter* writer = calloc(1, sizeof(AsyncWriter));
+    if (!writer) return NULL;
+
+    writer->policy = policy ? *policy : async_writer_default_policy();
+    if (writer->policy.block_size < 4096) writer->policy.block_size = 4096;
+    if (writer->policy.flush_bytes == 0 || writer->policy.flush_bytes > writer->policy.block_size) {
+        writer->policy.flush_bytes = writer->policy.block_size;
+    }
+
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        free(writer);
+        return NULL;
+    }
+
+    writer->active_cap = writer->spare_cap = writer->policy.block_size;
+    writer->active = malloc(writer->active_cap);
+    writer->spare = malloc(writer->spare_cap);
+    if (!writer->active || !writer->spare) {
+        free(writer->active);
+        free(writer->spare);
+        close(writer->fd);
+        free(writer);
+        return NULL;
+    }
+
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->wake, NULL);
+    pthread_cond_init(&writer->done, NULL);
+    atomic_init(&writer->active_used, 0);
+    atomic_init(&writer->bytes_written, 0);
+    atomic_init(&writer->stalls, 0);
+    atomic_init(&writer->error, 0);
+
+    if (pthread_create(&writer->thread, NULL, io_thread, writer) != 0) {
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->wake);
+        pthread_cond_destroy(&writer->done);
+        free(writer->active);
+        free(writer->spare);
+        close(writer->fd);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+char* async_writer_reserve(AsyncWriter* writer, size_t len) {
+    size_t used = atomic_load_explicit(&writer->active_used, memory_order_relaxed);
+    if (used + len <= writer->active_cap) {
+        return writer->active + used;
+    }
+
+    bool submitted = submit_active(writer);
+    used = atomic_load_explicit(&writer->active_used, memory_order_relaxed);
+    if (!submitted || used + len > writer->active_cap) {
+        // Disk is behind: grow the block instead of waiting for it
+        size_t cap = writer->active_cap * 2;
+        while (cap < used + len) cap *= 2;
+        pthread_mutex_lock(&writer->lock);
+        char* grown = realloc(writer->active, cap);
+        if (grown) {
+            writer->active = grown;
+            writer->active_cap = cap;
+        }
+        pthread_mutex_unlock(&writer->lock);
+        if (!grown) return NULL;
+    }
+    return writer->active + used;
+}
+
+void async_writer_commit(AsyncWriter* writer, size_t len) {
+    // Release: a timed flush on the I/O thread may read these bytes
+    size_t used = atomic_load_explicit(&writer->active_used, memory_order_relaxed) + len;
+    atomic_store_explicit(&writer->active_used, used, memory_order_release);
+    writer->offset += len;
+
+    if (used >= writer->policy.flush_bytes) {
+        submit_active(writer);
+    }
+}
+
+void async_writer_write(AsyncWriter* writer, const void* data, size_t len) {
+    char* dst = async_writer_reserve(writer, len);
+    if (!dst) {
+        atomic_store(&writer->error, ENOMEM);
+        return;
+    }
+    memcpy(dst, data, len);
+    async_writer_commit(writer, len);
+}
+
+// Wait until no block is queued and no timed flush is in progress
+static void wait_idle(AsyncWriter* writer) {
+    pthread_mutex_lock(&writer->lock);
+    while (writer->pending || !writer->spare) {
+        pthread_cond_wait(&writer->done, &writer->lock);
+    }
+    pthread_mutex_unlock(&writer->lock);
+}
+
+void async_writer_flush(AsyncWriter* writer) {
+    wait_idle(writer);
+    submit_active(writer);
+    wait_idle(writer);
+}
+
+int async_writer_close(AsyncWriter* writer) {
+    if (!writer) return 0;
+
+    async_writer_flush(writer);
+
+    pthread_mutex_lock(&writer->lock);
+    writer->stop = true;
+    pthread_cond_signal(&writer->wake);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    int error = atomic_load(&writer->error);
+    if (close(writer->fd) != 0 && !error) error = errno;
+
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->wake);
+    pthread_cond_destroy(&writer->done);
+    free(writer->active);
+    free(writer->spare);
+    free(writer);
+    return error ? -1 : 0;
+}
+
+uint64_t async_writer_offset(const AsyncWriter* writer) {
+    return writer->offset;
+}
+
+uint64_t async_writer_bytes_written(AsyncWriter* writer) {
+    return atomic_load_explicit(&writer->bytes_written, memory_order_relaxed);
+}
+
+uint64_t async_writer_stalls(AsyncWriter* writer) {
+    return atomic_load_explicit(&writer->stalls, memory_order_relaxed);
+}
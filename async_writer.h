@@ -0,0 +1,54 @@
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Append-only file writer backed by a dedicated I/O thread.
+// The producer fills one large block while the I/O thread writes the other
+// one to disk. A block is handed over once it reaches policy.flush_bytes.
+// If nothing was handed over for policy.flush_interval_ms, the I/O thread
+// copies out and writes what has been committed so far by itself, so a
+// paused or halted producer still reaches the disk. If the I/O thread is
+// still busy with the previous block, the producer keeps filling (and if
+// needed grows) its current block rather than waiting, so it never blocks
+// on disk.
+// All functions except the statistics getters must be called from the
+// producer thread, or while the producer is stopped.
+
+typedef struct {
+    size_t block_size;       // Initial size of each of the two blocks
+    size_t flush_bytes;      // Hand a block to the I/O thread at this fill level
+    int flush_interval_ms;   // Write committed data after this long without a handover, 0 disables
+} AsyncWriterPolicy;
+
+typedef struct AsyncWriter AsyncWriter;
+
+AsyncWriterPolicy async_writer_default_policy(void);
+
+AsyncWriter* async_writer_open(const char* path, const AsyncWriterPolicy* policy);
+
+// Flushes everything, stops the I/O thread and closes the file.
+// Returns -1 if any write failed.
+int async_writer_close(AsyncWriter* writer);
+
+// Copy len bytes into the stream
+void async_writer_write(AsyncWriter* writer, const void* data, size_t len);
+
+// Reserve room for up to len bytes to format into directly, then commit the
+// number of bytes actually used
+char* async_writer_reserve(AsyncWriter* writer, size_t len);
+void async_writer_commit(AsyncWriter* writer, size_t len);
+
+// Write out everything appended so far and wait until it reached the kernel
+void async_writer_flush(AsyncWriter* writer);
+
+// Bytes appended so far, i.e. the file offset of the next byte written
+uint64_t async_writer_offset(const AsyncWriter* writer);
+
+// Statistics, safe to read from any thread
+uint64_t async_writer_bytes_written(AsyncWriter* writer);
+uint64_t async_writer_stalls(AsyncWriter* writer);
+
+#endif // ASYNC_WRITER_H
@@ -0,0 +1,765 @@
+// Callback-path benchmarks, run with `make bench`.
+// Drives simulation.c through bench/mock_ngspice.c, so no libngspice is needed.
+
+#include "plot.h"
+#include "simulation.h"
+#include "sample_queue.h"
+#include "mock_ngspice.h"
+#include "pixel_transform.h"
+#include "complex_polar.h"
+#include "replay.h"
+#include "measure.h"
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+    long steps;
+    int vectors;
+    int complex_vectors;
+    int branches;
+    int frames;
+    HistoryStorage storage;
+} BenchOptions;
+
+static double seconds_since(uint64_t start_ns) {
+    return (double)(monotonic_ns() - start_ns) * 1e-9;
+}
+
+static int null_data(pvecvaluesall vecdata, int numvecs, int ident, void* userdata) {
+    (void)vecdata;
+    (void)numvecs;
+    (void)ident;
+    (void)userdata;
+    return 0;
+}
+
+static int quiet_getchar(char* outputchar, int ident, void* userdata) {
+    (void)outputchar;
+    (void)ident;
+    (void)userdata;
+    return 0;
+}
+
+static void configure_mock(const BenchOptions* options) {
+    MockNgspiceConfig mock = {
+        .steps = options->steps,
+        .real_vectors = options->vectors,
+        .complex_vectors = options->complex_vectors,
+        .branch_vectors = options->branches,
+        .rate = 0.0
+    };
+    mock_ngspice_configure(&mock);
+}
+
+// Time one synchronous mock run with the given data callback
+static double time_run(SendData* data_fn, SimContext* context) {
+    ngSpice_Init(quiet_getchar, ng_getstat, ng_exit, data_fn, ng_initdata, ng_bgrunning, context);
+    uint64_t start = monotonic_ns();
+    ngSpice_Command("run");
+    return seconds_since(start);
+}
+
+static void bench_ng_data(const BenchOptions* options, const char* dir) {
+    char csv_path[512], result_path[512], packed_path[512];
+    snprintf(csv_path, sizeof(csv_path), "%s/bench.csv", dir);
+    snprintf(result_path, sizeof(result_path), "%s/bench.ngres", dir);
+    snprintf(packed_path, sizeof(packed_path), "%s/bench-packed.ngres", dir);
+
+    // Cost of the mock itself, subtracted from the measurements below
+    SimContext context;
+    init_simulation_context(&context);
+    double baseline = time_run(null_data, &context);
+    cleanup_simulation(&context);
+
+    init_simulation_context(&context);
+    double bare = time_run(ng_data, &context);
+    cleanup_simulation(&context);
+
+    init_simulation_context(&context);
+    context.csv_file = async_writer_open(csv_path, NULL);
+    context.result_file = result_writer_open(result_path, NULL, RESULT_DEFAULT_CHUNK_ROWS, 0);
+    double with_outputs = time_run(ng_data, &context);
+    uint64_t csv_bytes = async_writer_offset(context.csv_file);
+    uint64_t start = monotonic_ns();
+    cleanup_simulation(&context);  // Includes flushing both files
+    double flush = seconds_since(start);
+
+    printf("ng_data, no outputs        %10.1f ns/call\n",
+           (bare - baseline) * 1e9 / options->steps);
+    printf("ng_data, CSV + result file %10.1f ns/call\n",
+           (with_outputs - baseline) * 1e9 / options->steps);
+    printf("CSV throughput             %10.1f MB/s (%llu bytes, incl. final flush)\n",
+           csv_bytes / (with_outputs - baseline + flush) / 1e6, (unsigned long long)csv_bytes);
+
+    // Same rows, every value encoded on the simulation thread as it is put
+    init_simulation_context(&context);
+    context.result_file = result_writer_open(packed_path, NULL, RESULT_DEFAULT_CHUNK_ROWS, RESULT_FLAG_COMPRESSED);
+    double packed = time_run(ng_data, &context);
+    cleanup_simulation(&context);
+    struct stat raw_stat, packed_stat;
+    if (stat(result_path, &raw_stat) == 0 && stat(packed_path, &packed_stat) == 0) {
+        printf("ng_data, compressed result %10.1f ns/call (%.2fx smaller than raw)\n",
+               (packed - baseline) * 1e9 / options->steps, (double)raw_stat.st_size / packed_stat.st_size);
+    }
+
+    // The files just written, fed back through ng_data as fast as it goes
+    const char* replay_paths[] = {result_path, packed_path};
+    for (int p = 0; p < 2; p++) {
+        Replay* replay = replay_open(replay_paths[p]);
+        if (!replay) continue;
+        init_simulation_context(&context);
+        context.replay = replay;
+        replay_set_speed(replay, REPLAY_MAX_SPEED);
+        start = monotonic_ns();
+        if (replay_start(replay, &context) == 0) {
+            wait_for_simulation(&context);
+            double replayed = seconds_since(start);
+            cleanup_simulation(&context);
+            printf("replay of the %s file %7.2f Mrows/s\n", p ? "compressed" : "raw       ",
+                   replay_rows_sent(replay) / replayed / 1e6);
+        }
+        replay_close(replay);
+    }
+
+    // Large layouts pay only for what is subscribed: one vector, every 10th step
+    Subscription subscription = {0};
+    if (subscription_parse_line(&subscription, "record n1") == 0 &&
+        subscription_parse_line(&subscription, "decimate record every 10") == 0) {
+        init_simulation_context(&context);
+        context.subscription = &subscription;
+        context.csv_file = async_writer_open(csv_path, NULL);
+        context.result_file = result_writer_open(result_path, NULL, RESULT_DEFAULT_CHUNK_ROWS, 0);
+        double subscribed = time_run(ng_data, &context);
+        cleanup_simulation(&context);
+        printf("ng_data, n1 every 10th row %10.1f ns/call\n",
+               (subscribed - baseline) * 1e9 / options->steps);
+    }
+    subscription_free(&subscription);
+
+    unlink(csv_path);
+    unlink(result_path);
+    unlink(packed_path);
+}
+
+static void bench_update_buffers(const BenchOptions* options) {
+    PlotConfig config = setup_config();
+    config.num_signals = options->vectors;
+    config.storage = options->storage;
+    SignalHistory* history = init_buffers(&config);
+    double* values = calloc(config.num_signals > 0 ? config.num_signals : 1, sizeof(double));
+
+    long appends = options->steps;
+    uint64_t start = monotonic_ns();
+    for (long i = 0; i < appends; i++) {
+        for (int s = 0; s < config.num_signals; s++) {
+            values[s] = (double)((i + s) & 1023) * 1e-3;
+        }
+        update_buffers(history, values, &config);
+    }
+    double elapsed = seconds_since(start);
+    printf("update_buffers (%2d signals) %9.1f ns/sample\n", config.num_signals, elapsed * 1e9 / appends);
+
+    free(values);
+    history_destroy(history);
+}
+
+static void bench_pixel_transform(const BenchOptions* options) {
+    int count = BUFFER_SIZE;
+    double* values = malloc(count * sizeof(double));
+    int* rows = malloc(count * sizeof(int));
+    if (!values || !rows) {
+        free(values);
+        free(rows);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        values[i] = sin(i * 1e-3) * 3.0;
+    }
+
+    int passes = options->frames;
+    uint64_t start = monotonic_ns();
+    for (int p = 0; p < passes; p++) {
+        pixel_transform(values, count, 240, 100.0, -1, 480, rows);
+    }
+    double elapsed = seconds_since(start);
+    printf("pixel_transform (%-6s)   %9.3f ns/value\n", pixel_transform_kernel(),
+           elapsed * 1e9 / ((double)passes * count));
+
+    free(values);
+    free(rows);
+}
+
+// Every kernel against the scalar one on the same input, including values
+// that the clamps have to catch. Returns the number of differing outputs.
+static long check_pixel_transform(void) {
+    static const char* kernels[] = {"sse2", "avx2"};
+    static const struct {
+        int center;
+        double scale;
+        int y_min;
+        int y_max;
+    } cases[] = {
+        {240, 100.0, -1, 480},
+        {0, 1e7, -100000, 100000},
+        {-50, -3.5, 0, 200},
+        {1000000, 1e-3, -1000000, 3000000}
+    };
+    int count = 4099;  // Not a multiple of any vector width
+    double* values = malloc(count * sizeof(double));
+    int* expected = malloc(count * sizeof(int));
+    int* rows = malloc(count * sizeof(int));
+    if (!values || !expected || !rows) {
+        free(values);
+        free(expected);
+        free(rows);
+        return 0;
+    }
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    for (int i = 0; i < count; i++) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        double u = (double)(state >> 11) * 0x1p-53 * 2.0 - 1.0;
+        switch (i % 12) {
+            case 0: values[i] = NAN; break;
+            case 1: values[i] = i & 1 ? INFINITY : -INFINITY; break;
+            case 2: values[i] = u * 1e300; break;      // Product overflows
+            case 3: values[i] = u * 1e12; break;       // Beyond the pixel limit
+            case 4: values[i] = u * 1e4; break;        // Beyond y_min / y_max
+            case 5: values[i] = -0.0; break;
+            case 6: values[i] = u * 1e-310; break;     // Denormal
+            case 7: values[i] = (double)(i - count / 2) / 100.0; break;  // Whole pixels
+            default: values[i] = u * 5.0; break;
+        }
+    }
+
+    long mismatches = 0;
+    char names[32] = "scalar";
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        pixel_transform_use_kernel("scalar");
+        pixel_transform(values, count, cases[c].center, cases[c].scale, cases[c].y_min, cases[c].y_max, expected);
+        for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+            // Kernels the CPU lacks fall back to another one, skip those
+            if (strcmp(pixel_transform_use_kernel(kernels[k]), kernels[k]) != 0) continue;
+            if (c == 0) {
+                snprintf(names + strlen(names), sizeof(names) - strlen(names), ", %s", kernels[k]);
+            }
+            pixel_transform(values, count, cases[c].center, cases[c].scale, cases[c].y_min, cases[c].y_max, rows);
+            for (int i = 0; i < count; i++) {
+                if (rows[i] == expected[i]) continue;
+                if (mismatches++ == 0) {
+                    printf("pixel_transform %s: value %g, scale %g gives %d, scalar %d\n",
+                           kernels[k], values[i], cases[c].scale, rows[i], expected[i]);
+                }
+            }
+        }
+    }
+    pixel_transform_use_kernel(NULL);
+
+    if (mismatches == 0) {
+        printf("pixel_transform kernels     identical (%s) on %d values incl. NaN, inf\n", names,
+               count * (int)(sizeof(cases) / sizeof(cases[0])));
+    } else {
+        printf("pixel_transform kernels     %ld outputs differ from scalar\n", mismatches);
+    }
+
+    free(values);
+    free(expected);
+    free(rows);
+    return mismatches;
+}
+
+// Same bits, or both NaN
+static bool same_double(double a, double b) {
+    return memcmp(&a, &b, sizeof(double)) == 0 || (isnan(a) && isnan(b));
+}
+
+// Every kernel against the scalar one on a first-order low-pass, with a
+// few values that take the libm path in between. Returns the number of
+// differing outputs.
+static long check_complex_polar(void) {
+    static const char* kernels[] = {"sse2", "avx2"};
+    int count = 4099;  // Not a multiple of any vector width
+    double* re = malloc(count * sizeof(double));
+    double* im = malloc(count * sizeof(double));
+    double* magnitude = malloc(2 * count * sizeof(double));
+    double* phase = malloc(2 * count * sizeof(double));
+    if (!re || !im || !magnitude || !phase) {
+        free(re);
+        free(im);
+        free(magnitude);
+        free(phase);
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        double x = pow(10.0, 9.0 * i / count - 3.0);
+        re[i] = 1.0 / (1.0 + x * x);
+        im[i] = -x / (1.0 + x * x);
+        switch (i % 97) {
+            case 0: re[i] = 0.0; im[i] = 0.0; break;
+            case 1: re[i] = NAN; break;
+            case 2: im[i] = -INFINITY; break;
+            case 3: re[i] *= 1e-160; im[i] *= 1e-160; break;  // Square underflows
+            case 4: re[i] *= 1e160; im[i] *= 1e160; break;    // Square overflows
+            default: break;
+        }
+    }
+
+    long mismatches = 0;
+    char names[32] = "scalar";
+    double* expected_magnitude = magnitude + count;
+    double* expected_phase = phase + count;
+    complex_polar_use_kernel("scalar");
+    complex_polar(re, im, count, expected_magnitude, expected_phase);
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        // Kernels the CPU lacks fall back to another one, skip those
+        if (strcmp(complex_polar_use_kernel(kernels[k]), kernels[k]) != 0) continue;
+        snprintf(names + strlen(names), sizeof(names) - strlen(names), ", %s", kernels[k]);
+        complex_polar(re, im, count, magnitude, phase);
+        for (int i = 0; i < count; i++) {
+            if (same_double(magnitude[i], expected_magnitude[i]) && same_double(phase[i], expected_phase[i])) {
+                continue;
+            }
+            if (mismatches++ == 0) {
+                printf("complex_polar %s: %g%+gj gives %.17g dB %.17g deg, scalar %.17g dB %.17g deg\n",
+                       kernels[k], re[i], im[i], magnitude[i], phase[i], expected_magnitude[i], expected_phase[i]);
+            }
+        }
+    }
+    complex_polar_use_kernel(NULL);
+
+    if (mismatches == 0) {
+        printf("complex_polar kernels       identical (%s) on %d low-pass values incl. NaN, inf\n", names, count);
+    } else {
+        printf("complex_polar kernels       %ld values differ from scalar\n", mismatches);
+    }
+
+    free(re);
+    free(im);
+    free(magnitude);
+    free(phase);
+    return mismatches;
+}
+
+static void bench_complex_polar(const BenchOptions* options) {
+    int count = BUFFER_SIZE;
+    double* re = malloc(count * sizeof(double));
+    double* im = malloc(count * sizeof(double));
+    double* magnitude = malloc(count * sizeof(double));
+    double* phase = malloc(count * sizeof(double));
+    if (!re || !im || !magnitude || !phase) {
+        free(re);
+        free(im);
+        free(magnitude);
+        free(phase);
+        return;
+    }
+    // First-order low-pass over nine decades
+    for (int i = 0; i < count; i++) {
+        double x = pow(10.0, 9.0 * i / count - 3.0);
+        re[i] = 1.0 / (1.0 + x * x);
+        im[i] = -x / (1.0 + x * x);
+    }
+
+    int passes = options->frames;
+    uint64_t start = monotonic_ns();
+    for (int p = 0; p < passes; p++) {
+        complex_polar(re, im, count, magnitude, phase);
+    }
+    double elapsed = seconds_since(start);
+    printf("complex_polar (%-6s)     %9.3f ns/value\n", complex_polar_kernel(),
+           elapsed * 1e9 / ((double)passes * count));
+
+    free(re);
+    free(im);
+    free(magnitude);
+    free(phase);
+}
+
+static void bench_draw_signals(const BenchOptions* options) {
+    PlotConfig config = setup_config();
+    config.num_signals = options->vectors;
+    config.storage = options->storage;
+    SignalHistory* history = init_buffers(&config);
+    double* values = calloc(config.num_signals > 0 ? config.num_signals : 1, sizeof(double));
+    for (int i = 0; i < history->capacity; i++) {
+        for (int s = 0; s < config.num_signals; s++) {
+            values[s] = sin(i * 1e-3 * (s + 1));
+        }
+        history_append(history, values);
+    }
+
+    // Software renderer on an offscreen surface, no window or video driver
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, config.window_width, config.window_height,
+                                                          32, SDL_PIXELFORMAT_ARGB8888);
+    SDL_Renderer* renderer = surface ? SDL_CreateSoftwareRenderer(surface) : NULL;
+    if (!renderer) {
+        printf("draw_signals               skipped: %s\n", SDL_GetError());
+        if (surface) SDL_FreeSurface(surface);
+        free(values);
+        history_destroy(history);
+        return;
+    }
+
+    for (int interpolate = 1; interpolate >= 0; interpolate--) {
+        uint64_t start = monotonic_ns();
+        for (int f = 0; f < options->frames; f++) {
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+            SDL_RenderClear(renderer);
+            draw_signals(renderer, history, &config, interpolate);
+            draw_grid(renderer, history, &config);
+        }
+        double elapsed = seconds_since(start);
+        printf("draw_signals, %s %9.3f ms/frame (%dx%d)\n",
+               interpolate ? "lines      " : "points     ",
+               elapsed * 1e3 / options->frames, config.window_width, config.window_height);
+    }
+
+    // Incremental path: ~1000 new samples per frame (60k samples/s at 60 fps)
+    const int per_frame = 1000;
+    for (int interpolate = 1; interpolate >= 0; interpolate--) {
+        uint64_t draw_ns = 0;
+        for (int f = 0; f < options->frames; f++) {
+            for (int i = 0; i < per_frame; i++) {
+                long long t = history->count;
+                for (int s = 0; s < config.num_signals; s++) {
+                    values[s] = sin(t * 1e-3 * (s + 1));
+                }
+                history_append(history, values);
+            }
+            uint64_t start = monotonic_ns();
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+            SDL_RenderClear(renderer);
+            draw_plot(renderer, history, &config, interpolate);
+            draw_ns += monotonic_ns() - start;
+        }
+        printf("draw_plot, %s    %9.3f ms/frame (%d new samples/frame)\n",
+               interpolate ? "lines      " : "points     ",
+               draw_ns * 1e-6 / options->frames, per_frame);
+    }
+
+    destroy_plot_canvas(&config.canvas);  // Textures go before their renderer
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(surface);
+    free_render_scratch(&config.scratch);
+    free(values);
+    history_destroy(history);
+}
+
+// Whole run in the waveform store, then frames of the zoom/pan view at
+// spans from the full run down to a ten-thousandth of it
+static void bench_waveform_view(const BenchOptions* options, const char* dir) {
+    PlotConfig config = setup_config();
+    config.num_signals = options->vectors;
+    WaveformStore* store = waveform_store_create(config.num_signals, dir);
+    double* values = calloc(config.num_signals > 0 ? config.num_signals : 1, sizeof(double));
+    if (!store || !values) {
+        waveform_store_destroy(store);
+        free(values);
+        return;
+    }
+
+    // Uneven timesteps like ngspice's: 0.1 us on edges, up to 100 us between
+    uint64_t start = monotonic_ns();
+    double time = 0.0;
+    for (long i = 0; i < options->steps; i++) {
+        time += (i % 1000 < 100) ? 1e-7 : 1e-4;
+        for (int s = 0; s < config.num_signals; s++) {
+            values[s] = sin(time * (s + 1));
+        }
+        waveform_store_append(store, time, values);
+    }
+    double elapsed = seconds_since(start);
+    printf("waveform_store_append      %9.1f ns/sample (%.1f MiB in memory, %.1f MiB spilled)\n",
+           elapsed * 1e9 / options->steps,
+           waveform_store_ram_bytes(store) / (1024.0 * 1024.0),
+           waveform_store_spilled_bytes(store) / (1024.0 * 1024.0));
+    free(values);
+
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, config.window_width, config.window_height,
+                                                          32, SDL_PIXELFORMAT_ARGB8888);
+    SDL_Renderer* renderer = surface ? SDL_CreateSoftwareRenderer(surface) : NULL;
+    if (!renderer) {
+        printf("draw_waveform_view         skipped: %s\n", SDL_GetError());
+        if (surface) SDL_FreeSurface(surface);
+        waveform_store_destroy(store);
+        return;
+    }
+
+    config.view.store = store;
+    config.view.active = true;
+    for (double fraction = 1.0; fraction >= 1e-4; fraction *= 0.01) {
+        double span = time * fraction;
+        start = monotonic_ns();
+        for (int f = 0; f < options->frames; f++) {
+            // Pan across the run while drawing
+            config.view.t_start = (time - span) * f / options->frames;
+            config.view.t_end = config.view.t_start + span;
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+            SDL_RenderClear(renderer);
+            draw_waveform_view(renderer, &config, 1);
+        }
+        elapsed = seconds_since(start);
+        printf("draw_waveform_view %-7g %9.3f ms/frame (span %.3g s of %.3g s)\n",
+               fraction, elapsed * 1e3 / options->frames, span, time);
+    }
+
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(surface);
+    free_render_scratch(&config.scratch);
+    waveform_store_destroy(store);
+}
+
+// An AC sweep of the same length as the transient above, converted to dB
+// and degrees in batches as the render loop does, then Bode frames at
+// spans from all nine decades down to a ten-thousandth of them
+static void bench_bode_view(const BenchOptions* options, const char* dir) {
+    enum { BATCH = 256 };
+    PlotConfig config = setup_config();
+    int num_signals = options->vectors > 0 ? options->vectors : 1;
+    config.num_signals = 2 * num_signals;
+    WaveformStore* store = waveform_store_create(config.num_signals, dir);
+    TraceKind* kinds = malloc(config.num_signals * sizeof(TraceKind));
+    int* colors = malloc(config.num_signals * sizeof(int));
+    double* batch = malloc((size_t)(4 * num_signals + 1) * BATCH * sizeof(double));
+    double* row = malloc(config.num_signals * sizeof(double));
+    if (!store || !kinds || !colors || !batch || !row) {
+        waveform_store_destroy(store);
+        free(kinds);
+        free(colors);
+        free(batch);
+        free(row);
+        return;
+    }
+    for (int t = 0; t < config.num_signals; t++) {
+        kinds[t] = t % 2 ? TRACE_PHASE : TRACE_MAGNITUDE;
+        colors[t] = t / 2;
+    }
+
+    // Per signal: real, imaginary, dB and degree columns of the batch
+    double* frequencies = batch + (size_t)4 * num_signals * BATCH;
+    const double decades = 9.0;
+    uint64_t start = monotonic_ns();
+    for (long i = 0; i < options->steps; i += BATCH) {
+        int n = options->steps - i < BATCH ? (int)(options->steps - i) : BATCH;
+        for (int f = 0; f < n; f++) {
+            frequencies[f] = pow(10.0, decades * (i + f) / options->steps);
+        }
+        for (int s = 0; s < num_signals; s++) {
+            double* re = batch + (size_t)4 * s * BATCH;
+            double* im = re + BATCH;
+            for (int f = 0; f < n; f++) {
+                double x = frequencies[f] / pow(10.0, s + 1);
+                re[f] = 1.0 / (1.0 + x * x);
+                im[f] = -x / (1.0 + x * x);
+            }
+            complex_polar(re, im, n, im + BATCH, im + 2 * BATCH);
+        }
+        for (int f = 0; f < n; f++) {
+            for (int s = 0; s < num_signals; s++) {
+                row[2 * s] = batch[(size_t)(4 * s + 2) * BATCH + f];
+                row[2 * s + 1] = batch[(size_t)(4 * s + 3) * BATCH + f];
+            }
+            waveform_store_append(store, frequencies[f], row);
+        }
+    }
+    double elapsed = seconds_since(start);
+    printf("AC sweep into the store    %9.1f ns/point (%d signals as dB and phase)\n",
+           elapsed * 1e9 / options->steps, num_signals);
+    free(batch);
+    free(row);
+
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, config.window_width, config.window_height,
+                                                          32, SDL_PIXELFORMAT_ARGB8888);
+    SDL_Renderer* renderer = surface ? SDL_CreateSoftwareRenderer(surface) : NULL;
+    if (!renderer) {
+        printf("draw_bode_view             skipped: %s\n", SDL_GetError());
+        if (surface) SDL_FreeSurface(surface);
+        waveform_store_destroy(store);
+        free(kinds);
+        free(colors);
+        return;
+    }
+
+    config.view.store = store;
+    config.view.log_scale = true;
+    config.view.active = true;
+    config.trace_kinds = kinds;
+    config.trace_colors = colors;
+    for (double fraction = 1.0; fraction >= 1e-4; fraction *= 0.01) {
+        double span = decades * fraction;
+        start = monotonic_ns();
+        for (int f = 0; f < options->frames; f++) {
+            config.view.t_start = (decades - span) * f / options->frames;
+            config.view.t_end = config.view.t_start + span;
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+            SDL_RenderClear(renderer);
+            draw_bode_view(renderer, &config, 1);
+        }
+        elapsed = seconds_since(start);
+        printf("draw_bode_view %-7g     %9.3f ms/frame (%.3g of %.3g decades)\n",
+               fraction, elapsed * 1e3 / options->frames, span, decades);
+    }
+
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(surface);
+    free_render_scratch(&config.scratch);
+    waveform_store_destroy(store);
+    free(kinds);
+    free(colors);
+}
+
+// Online measurements of every signal on a non-uniform timestep
+static void bench_measure(const BenchOptions* options) {
+    int num_signals = options->vectors > 0 ? options->vectors : 1;
+    MeasureEngine* engine = measure_create(NULL);
+    double* values = malloc(num_signals * sizeof(double));
+    char (*names)[16] = malloc(num_signals * sizeof(*names));
+    const char** name_list = malloc(num_signals * sizeof(char*));
+    if (!engine || !values || !names || !name_list) {
+        measure_destroy(engine);
+        free(values);
+        free(names);
+        free(name_list);
+        return;
+    }
+    for (int s = 0; s < num_signals; s++) {
+        snprintf(names[s], sizeof(names[s]), "n%d", s + 1);
+        name_list[s] = names[s];
+    }
+
+    SimulationData data = {
+        .scale = SCALE_TIME,
+        .num_signals = num_signals,
+        .num_values = num_signals,
+        .signal_names = name_list,
+        .signal_values = values,
+        .layout_version = 1
+    };
+    uint64_t start = monotonic_ns();
+    for (long i = 0; i < options->steps; i++) {
+        for (int s = 0; s < num_signals; s++) {
+            values[s] = s % 2 ? 1.0 - exp(-data.time) : sin(data.time * 100.0 * (s + 1));
+        }
+        measure_push(engine, &data);
+        data.time += (i % 100 < 10) ? 1e-7 : 1e-4;
+    }
+    double elapsed = seconds_since(start);
+    measure_finish(engine);
+    printf("measure_push (%2d signals)   %9.1f ns/sample\n", num_signals, elapsed * 1e9 / options->steps);
+
+    measure_destroy(engine);
+    free(values);
+    free(names);
+    free(name_list);
+}
+
+// Encode and decode one chunk-sized block of typical columns
+static void bench_column_codec(const BenchOptions* options) {
+    enum { ROWS = RESULT_DEFAULT_CHUNK_ROWS };
+    static const char* names[] = {"uniform time", "adaptive time", "rc charge", "held level", "sine"};
+    double* values = malloc(ROWS * sizeof(double));
+    double* decoded = malloc(ROWS * sizeof(double));
+    if (!values || !decoded) {
+        free(values);
+        free(decoded);
+        return;
+    }
+
+    int blocks = (int)(options->steps / ROWS) + 1;
+    for (int kind = 0; kind < 5; kind++) {
+        double time = 0.0;
+        for (int i = 0; i < ROWS; i++) {
+            switch (kind) {
+                case 0: values[i] = i * 1e-4; break;
+                case 1: time += (i % 100 < 10) ? 1e-7 : 1e-4; values[i] = time; break;
+                case 2: values[i] = 1.0 - exp(-i * 1e-3); break;
+                case 3: values[i] = (i / 500) % 2 ? 3.3 : 0.0; break;
+                default: values[i] = sin(i * 1e-2); break;
+            }
+        }
+
+        ColumnEncoder encoder;
+        column_encoder_init(&encoder, kind < 2 ? COLUMN_CODEC_DOD : COLUMN_CODEC_XOR);
+        size_t bytes = 0;
+        const void* block = NULL;
+        uint64_t start = monotonic_ns();
+        for (int b = 0; b < blocks; b++) {
+            column_encoder_reset(&encoder);
+            for (int i = 0; i < ROWS; i++) {
+                column_encoder_put(&encoder, values[i]);
+            }
+            block = column_encoder_finish(&encoder, &bytes);
+        }
+        double encode = seconds_since(start);
+
+        bool lossless = false;
+        start = monotonic_ns();
+        for (int b = 0; b < blocks && block; b++) {
+            lossless = column_block_decode(block, bytes, decoded, ROWS) == ROWS;
+        }
+        double decode = seconds_since(start);
+        lossless = lossless && memcmp(values, decoded, ROWS * sizeof(double)) == 0;
+
+        printf("column codec, %-13s %5.1f / %4.1f ns/value enc/dec, %5.2fx%s\n", names[kind],
+               encode * 1e9 / ((double)blocks * ROWS), decode * 1e9 / ((double)blocks * ROWS),
+               ROWS * sizeof(double) / (double)bytes, lossless ? "" : " (MISMATCH)");
+        column_encoder_free(&encoder);
+    }
+    free(values);
+    free(decoded);
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options = {
+        .steps = 1000000,
+        .vectors = 2,
+        .complex_vectors = 0,
+        .branches = 1,
+        .frames = 200,
+        .storage = HISTORY_FLOAT64
+    };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            options.steps = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--vectors") == 0 && i + 1 < argc) {
+            options.vectors = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--complex") == 0 && i + 1 < argc) {
+            options.complex_vectors = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--branches") == 0 && i + 1 < argc) {
+            options.branches = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            options.frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--float32") == 0) {
+            options.storage = HISTORY_FLOAT32;
+        } else {
+            fprintf(stderr, "Usage: %s [--steps N] [--vectors N] [--complex N] [--branches N] [--frames N] [--float32]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (options.steps < 1) options.steps = 1;
+    if (options.frames < 1) options.frames = 1;
+
+    char dir[] = "/tmp/ngspice-bench.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    printf("%ld steps, %d real + %d complex vectors, %d branches\n\n",
+           options.steps, options.vectors, options.complex_vectors, options.branches);
+    configure_mock(&options);
+    bench_ng_data(&options, dir);
+    bench_column_codec(&options);
+    bench_measure(&options);
+    bench_update_buffers(&options);
+    bench_pixel_transform(&options);
+    long mismatches = check_pixel_transform();
+    bench_complex_polar(&options);
+    mismatches += check_complex_polar();
+    bench_draw_signals(&options);
+    bench_waveform_view(&options, dir);
+    bench_bode_view(&options, dir);
+
+    rmdir(dir);
+    return mismatches == 0 ? 0 : 1;
+}
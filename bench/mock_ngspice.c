@@ -0,0 +1,423 @@
+#include "mock_ngspice.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+static GetVSRCData* get_vsrc_data;
+static SendChar* send_char;
+static SendStat* send_stat;
+static ControlledExit* controlled_exit;
+static SendData* send_data;
+static SendInitData* send_init_data;
+static BGThreadRunning* bg_thread_running;
+static void* user_data;
+
+static MockNgspiceConfig config;
+static bool configured;
+
+// Circuit state
+static double tran_step = 1e-4;
+static double tran_stop = 0.0;
+static double source_level = 1.0;   // Last value set with alter
+static char external_source[64];    // First `external` voltage source, if any
+static char save_list[1024];        // Vector names from .save, space separated; empty saves all
+static long ac_points;              // .ac: points of the sweep, 0 for a transient run
+static bool ac_linear;
+static double ac_start;
+static double ac_stop;
+static long step;
+
+// Vectors in ngspice order: time, node voltages, complex vectors, branches
+static int vec_count;
+static vecinfo* infos;
+static pvecinfo* info_ptrs;
+static vecvalues* values;
+static pvecvalues* value_ptrs;
+static double* phase_re;            // Per-vector phasor, rotated every step
+static double* phase_im;
+static double rot_re, rot_im;
+
+static pthread_t bg_thread;
+static bool bg_started;
+static atomic_bool halt_requested;
+static atomic_bool running;
+
+static long env_long(const char* name, long fallback) {
+    const char* value = getenv(name);
+    return value && *value ? strtol(value, NULL, 10) : fallback;
+}
+
+static double env_double(const char* name, double fallback) {
+    const char* value = getenv(name);
+    return value && *value ? strtod(value, NULL) : fallback;
+}
+
+void mock_ngspice_configure(const MockNgspiceConfig* new_config) {
+    config = *new_config;
+    configured = true;
+}
+
+static void free_vectors(void) {
+    for (int i = 0; i < vec_count; i++) {
+        free(infos[i].vecname);
+    }
+    free(infos);
+    free(info_ptrs);
+    free(values);
+    free(value_ptrs);
+    free(phase_re);
+    free(phase_im);
+    infos = NULL;
+    info_ptrs = NULL;
+    values = NULL;
+    value_ptrs = NULL;
+    phase_re = phase_im = NULL;
+    vec_count = 0;
+}
+
+// Like ngspice, .save limits the vectors to the ones listed (and the scale)
+static bool is_saved(const char* name) {
+    if (!save_list[0]) return true;
+    size_t len = strlen(name);
+    for (const char* p = strstr(save_list, name); p; p = strstr(p + 1, name)) {
+        if ((p == save_list || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) return true;
+    }
+    return false;
+}
+
+static int build_vectors(void) {
+    free_vectors();
+    int candidates = 1 + config.real_vectors + config.complex_vectors + config.branch_vectors;
+    infos = calloc(candidates, sizeof(vecinfo));
+    info_ptrs = calloc(candidates, sizeof(pvecinfo));
+    values = calloc(candidates, sizeof(vecvalues));
+    value_ptrs = calloc(candidates, sizeof(pvecvalues));
+    phase_re = calloc(candidates, sizeof(double));
+    phase_im = calloc(candidates, sizeof(double));
+    if (!infos || !info_ptrs || !values || !value_ptrs || !phase_re || !phase_im) return -1;
+
+    for (int c = 0; c < candidates; c++) {
+        char name[32];
+        bool is_real = true;
+        if (c == 0) {
+            snprintf(name, sizeof(name), ac_points > 0 ? "frequency" : "time");
+            // ngspice's frequency scale is a complex vector too
+            is_real = ac_points == 0;
+        } else if (c <= config.real_vectors) {
+            snprintf(name, sizeof(name), "n%d", c);
+            is_real = ac_points == 0;
+        } else if (c <= config.real_vectors + config.complex_vectors) {
+            snprintf(name, sizeof(name), "c%d", c - config.real_vectors);
+            is_real = false;
+        } else {
+            snprintf(name, sizeof(name), "v%d#branch", c - config.real_vectors - config.complex_vectors);
+            is_real = ac_points == 0;
+        }
+        if (c > 0 && !is_saved(name)) continue;
+
+        int i = vec_count++;
+        infos[i].number = i;
+        infos[i].vecname = strdup(name);
+        infos[i].is_real = is_real;
+        info_ptrs[i] = &infos[i];
+        values[i].name = infos[i].vecname;
+        values[i].is_scale = i == 0;
+        values[i].is_complex = !is_real;
+        value_ptrs[i] = &values[i];
+
+        // Spread the phases so the traces are distinguishable
+        phase_re[i] = cos(c * 0.7);
+        phase_im[i] = sin(c * 0.7);
+    }
+
+    // One full turn of the phasors per simulated second
+    rot_re = cos(2.0 * M_PI * tran_step);
+    rot_im = sin(2.0 * M_PI * tran_step);
+    return 0;
+}
+
+static void send_layout(void) {
+    vecinfoall all = {
+        .name = ac_points > 0 ? "ac1" : "tran1",
+        .title = "mock circuit",
+        .date = "today",
+        .type = ac_points > 0 ? "AC" : "transient",
+        .veccount = vec_count,
+        .vecs = info_ptrs
+    };
+    if (send_init_data) send_init_data(&all, 0, user_data);
+}
+
+static long total_steps(void) {
+    if (config.steps > 0) return config.steps;
+    if (ac_points > 0) return ac_points;
+    if (tran_stop > 0.0 && tran_step > 0.0) return (long)(tran_stop / tran_step);
+    return 100000;
+}
+
+static void sleep_ns(long long ns) {
+    struct timespec ts = { ns / 1000000000ll, ns % 1000000000ll };
+    nanosleep(&ts, NULL);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void set_tran_values(void) {
+    values[0].creal = step * tran_step;
+    if (get_vsrc_data && external_source[0]) {
+        get_vsrc_data(&source_level, values[0].creal, external_source, 0, user_data);
+    }
+    for (int i = 1; i < vec_count; i++) {
+        double re = phase_re[i] * rot_re - phase_im[i] * rot_im;
+        double im = phase_re[i] * rot_im + phase_im[i] * rot_re;
+        phase_re[i] = re;
+        phase_im[i] = im;
+        values[i].creal = source_level * re;
+        values[i].cimag = values[i].is_complex ? source_level * im : 0.0;
+    }
+}
+
+// Vector i is a low-pass with its corner at ac_start * 10^i, odd ones of
+// first, even ones of second order
+static void set_ac_values(long point, long points) {
+    double fraction = points > 1 ? (double)point / (points - 1) : 0.0;
+    double frequency = ac_linear ? ac_start + fraction * (ac_stop - ac_start)
+                                 : ac_start * pow(ac_stop / ac_start, fraction);
+    values[0].creal = frequency;
+    values[0].cimag = 0.0;
+    for (int i = 1; i < vec_count; i++) {
+        double x = frequency / (ac_start * pow(10.0, i));
+        double denominator = 1.0 + x * x;
+        double re = 1.0 / denominator;     // 1 / (1 + jx)
+        double im = -x / denominator;
+        if (i % 2 == 0) {
+            double square = re * re - im * im;
+            im = 2.0 * re * im;
+            re = square;
+        }
+        values[i].creal = source_level * re;
+        values[i].cimag = source_level * im;
+    }
+}
+
+// Run timesteps until done or halted; returns true when the run completed
+static bool run_steps(void) {
+    long steps = total_steps();
+    long percent_step = steps / 100 > 0 ? steps / 100 : 1;
+    double start = now_seconds();
+    long first_step = step;
+    vecvaluesall all = { .veccount = vec_count, .vecindex = 0, .vecsa = value_ptrs };
+
+    for (; step < steps; step++) {
+        if (atomic_load_explicit(&halt_requested, memory_order_relaxed)) return false;
+
+        if (ac_points > 0) {
+            set_ac_values(step, steps);
+        } else {
+            set_tran_values();
+        }
+        if (send_data) send_data(&all, vec_count, 0, user_data);
+
+        if (send_stat && step % percent_step == 0) {
+            char status[64];
+            snprintf(status, sizeof(status), "%s: %.1f%%", ac_points > 0 ? "ac" : "tran", 100.0 * step / steps);
+            send_stat(status, 0, user_data);
+        }
+        if (config.rate > 0.0 && (step & 63) == 0) {
+            double ahead = (step - first_step) / config.rate - (now_seconds() - start);
+            if (ahead > 0.0) sleep_ns((long long)(ahead * 1e9));
+        }
+    }
+    if (send_stat) send_stat("--ready--", 0, user_data);
+    return true;
+}
+
+static void* bg_run_thread(void* arg) {
+    (void)arg;
+    if (bg_thread_running) bg_thread_running(false, 0, user_data);
+    run_steps();
+    atomic_store(&running, false);
+    if (bg_thread_running) bg_thread_running(true, 0, user_data);
+    return NULL;
+}
+
+static void join_bg_thread(void) {
+    if (bg_started) {
+        pthread_join(bg_thread, NULL);
+        bg_started = false;
+    }
+}
+
+static int start_bg_thread(void) {
+    join_bg_thread();
+    atomic_store(&halt_requested, false);
+    atomic_store(&running, true);
+    if (pthread_create(&bg_thread, NULL, bg_run_thread, NULL) != 0) {
+        atomic_store(&running, false);
+        return 1;
+    }
+    bg_started = true;
+    return 0;
+}
+
+int ngSpice_Init(SendChar* printfcn, SendStat* statfcn, ControlledExit* ngexit,
+                 SendData* sdata, SendInitData* sinitdata, BGThreadRunning* bgtrun, void* userData) {
+    send_char = printfcn;
+    send_stat = statfcn;
+    controlled_exit = ngexit;
+    send_data = sdata;
+    send_init_data = sinitdata;
+    bg_thread_running = bgtrun;
+    user_data = userData;
+
+    if (!configured) {
+        config.steps = env_long("MOCK_NGSPICE_STEPS", 0);
+        config.real_vectors = (int)env_long("MOCK_NGSPICE_VECTORS", 2);
+        config.complex_vectors = (int)env_long("MOCK_NGSPICE_COMPLEX", 0);
+        config.branch_vectors = (int)env_long("MOCK_NGSPICE_BRANCHES", 1);
+        config.rate = env_double("MOCK_NGSPICE_RATE", 0.0);
+        configured = true;
+    }
+    if (send_char) send_char("stdout ******", 0, user_data);
+    if (send_char) send_char("stdout ** mock ngspice", 0, user_data);
+    return 0;
+}
+
+int ngSpice_Init_Sync(GetVSRCData* vsrcdat, GetISRCData* isrcdat, GetSyncData* syncdat,
+                      int* ident, void* userData) {
+    (void)isrcdat;
+    (void)syncdat;
+    get_vsrc_data = vsrcdat;
+    if (userData) user_data = userData;
+    if (ident) *ident = 0;
+    return 0;
+}
+
+// Parse a SPICE number with an optional scale suffix ("100u", "1.5meg", "2s")
+static double parse_spice_number(const char* text, const char** end) {
+    char* p;
+    double value = strtod(text, &p);
+    if (strncasecmp(p, "meg", 3) == 0) {
+        value *= 1e6;
+    } else {
+        switch (*p | 0x20) {
+            case 'f': value *= 1e-15; break;
+            case 'p': value *= 1e-12; break;
+            case 'n': value *= 1e-9; break;
+            case 'u': value *= 1e-6; break;
+            case 'm': value *= 1e-3; break;
+            case 'k': value *= 1e3; break;
+            case 'g': value *= 1e9; break;
+            case 't': value *= 1e12; break;
+        }
+    }
+    while (*p && *p != ' ' && *p != '\t') p++;  // Remaining unit letters
+    *end = p;
+    return value;
+}
+
+int ngSpice_Circ(char** circarray) {
+    if (!circarray) return 1;
+    external_source[0] = '\0';
+    save_list[0] = '\0';
+    ac_points = 0;
+    for (char** line = circarray; *line; line++) {
+        if (strncasecmp(*line, ".save", 5) == 0) {
+            // v(x) saves x, i(x) saves x#branch
+            char token[64];
+            int used;
+            for (const char* p = *line + 5; sscanf(p, " %63s%n", token, &used) == 1; p += used) {
+                size_t len = strlen(token);
+                bool probe = len > 3 && token[1] == '(' && token[len - 1] == ')';
+                size_t offset = strlen(save_list);
+                snprintf(save_list + offset, sizeof(save_list) - offset, "%s%.*s%s", offset ? " " : "",
+                         probe ? (int)len - 3 : (int)len, probe ? token + 2 : token,
+                         probe && (token[0] | 0x20) == 'i' ? "#branch" : "");
+            }
+        }
+        if ((**line | 0x20) == 'v' && strstr(*line, "external") && !external_source[0]) {
+            sscanf(*line, "%63s", external_source);
+        }
+        if (strncasecmp(*line, ".ac", 3) == 0) {
+            // .ac dec|oct|lin <points> <fstart> <fstop>
+            char variation[8];
+            int used;
+            if (sscanf(*line + 3, " %7s%n", variation, &used) != 1) continue;
+            const char* p = *line + 3 + used;
+            double points = parse_spice_number(p, &p);
+            double start = parse_spice_number(p, &p);
+            double stop = parse_spice_number(p, &p);
+            if (points < 1.0 || start <= 0.0 || stop <= start) continue;
+            ac_linear = strcasecmp(variation, "lin") == 0;
+            ac_start = start;
+            ac_stop = stop;
+            double per = strcasecmp(variation, "oct") == 0 ? log2(stop / start) : log10(stop / start);
+            ac_points = ac_linear ? (long)points : (long)(points * per) + 1;
+        }
+        if (strncasecmp(*line, ".tran", 5) != 0) continue;
+        const char* p = *line + 5;
+        double tstep = parse_spice_number(p, &p);
+        double tstop = parse_spice_number(p, &p);
+        if (tstep > 0.0 && tstop > 0.0) {
+            tran_step = tstep;
+            tran_stop = tstop;
+        }
+    }
+    return 0;
+}
+
+int ngSpice_Command(char* command) {
+    if (!command) return 1;
+
+    if (strcmp(command, "bg_run") == 0 || strcmp(command, "run") == 0) {
+        join_bg_thread();
+        step = 0;
+        if (build_vectors() != 0) return 1;
+        send_layout();
+        if (command[0] == 'r') {
+            run_steps();
+            return 0;
+        }
+        return start_bg_thread();
+    }
+    if (strcmp(command, "bg_halt") == 0) {
+        atomic_store(&halt_requested, true);
+        join_bg_thread();
+        return 0;
+    }
+    if (strcmp(command, "bg_resume") == 0) {
+        if (atomic_load(&running) || step >= total_steps()) return 0;
+        return start_bg_thread();
+    }
+    if (strncmp(command, "alter", 5) == 0) {
+        // "alter <source> = <value>": every mock waveform follows the last
+        // value set on a voltage or current source, other devices are ignored
+        const char* name = command + 5;
+        while (*name == ' ') name++;
+        const char* eq = strchr(command, '=');
+        if (eq && ((*name | 0x20) == 'v' || (*name | 0x20) == 'i')) source_level = strtod(eq + 1, NULL);
+        return 0;
+    }
+    if (strcmp(command, "quit") == 0) {
+        atomic_store(&halt_requested, true);
+        join_bg_thread();
+        free_vectors();
+        if (controlled_exit) controlled_exit(0, true, true, 0, user_data);
+        return 0;
+    }
+    // remcirc, reset, option, ... are accepted and ignored
+    return 0;
+}
+
+NG_BOOL ngSpice_running(void) {
+    return atomic_load(&running);
+}
@@ -0,0 +1,29 @@
+#ifndef MOCK_NGSPICE_H
+#define MOCK_NGSPICE_H
+
+#include <ngspice/sharedspice.h>
+
+// Stand-in for libngspice that fires the sharedspice callbacks from a
+// synthetic transient run, or an AC sweep if the circuit has an .ac line
+// (every vector complex, low-pass responses with rising corner frequencies).
+// Settings come from mock_ngspice_configure or, if that was never called,
+// from the environment:
+//   MOCK_NGSPICE_STEPS     timesteps or frequency points per run
+//                          (default: from .tran or .ac, else 100000)
+//   MOCK_NGSPICE_VECTORS   real node voltages besides time (default 2)
+//   MOCK_NGSPICE_COMPLEX   complex vectors (default 0)
+//   MOCK_NGSPICE_BRANCHES  #branch currents (default 1)
+//   MOCK_NGSPICE_RATE      timesteps per second, 0 = as fast as possible
+// A .save line in the circuit limits the vectors sent, as in ngspice.
+
+typedef struct {
+    long steps;              // 0 = derive from the circuit's .tran line
+    int real_vectors;
+    int complex_vectors;
+    int branch_vectors;
+    double rate;
+} MockNgspiceConfig;
+
+void mock_ngspice_configure(const MockNgspiceConfig* config);
+
+#endif // MOCK_NGSPICE_H
@@ -0,0 +1,75 @@
+#ifndef NGSPICE_SHAREDSPICE_MOCK_H
+#define NGSPICE_SHAREDSPICE_MOCK_H
+
+// Subset of ngspice's sharedspice.h implemented by bench/mock_ngspice.c.
+// Only used for `make bench`, so the callback paths can be measured on
+// machines without libngspice; the real build uses the installed header.
+
+#include <stdbool.h>
+
+typedef bool NG_BOOL;
+
+typedef struct ngcomplex {
+    double cx_real;
+    double cx_imag;
+} ngcomplex_t;
+
+typedef struct vector_info {
+    char* v_name;
+    int v_type;
+    short v_flags;
+    double* v_realdata;
+    ngcomplex_t* v_compdata;
+    int v_length;
+} vector_info, *pvector_info;
+
+typedef struct vecvalues {
+    char* name;
+    double creal;
+    double cimag;
+    NG_BOOL is_scale;
+    NG_BOOL is_complex;
+} vecvalues, *pvecvalues;
+
+typedef struct vecvaluesall {
+    int veccount;
+    int vecindex;
+    pvecvalues* vecsa;
+} vecvaluesall, *pvecvaluesall;
+
+typedef struct vecinfo {
+    int number;
+    char* vecname;
+    NG_BOOL is_real;
+    void* pdvec;
+    void* pdvecscale;
+} vecinfo, *pvecinfo;
+
+typedef struct vecinfoall {
+    char* name;
+    char* title;
+    char* date;
+    char* type;
+    int veccount;
+    pvecinfo* vecs;
+} vecinfoall, *pvecinfoall;
+
+typedef int (SendChar)(char*, int, void*);
+typedef int (SendStat)(char*, int, void*);
+typedef int (ControlledExit)(int, NG_BOOL, NG_BOOL, int, void*);
+typedef int (SendData)(pvecvaluesall, int, int, void*);
+typedef int (SendInitData)(pvecinfoall, int, void*);
+typedef int (BGThreadRunning)(NG_BOOL, int, void*);
+typedef int (GetVSRCData)(double*, double, char*, int, void*);
+typedef int (GetISRCData)(double*, double, char*, int, void*);
+typedef int (GetSyncData)(double, double*, double, int, int, int, void*);
+
+int ngSpice_Init(SendChar* printfcn, SendStat* statfcn, ControlledExit* ngexit,
+                 SendData* sdata, SendInitData* sinitdata, BGThreadRunning* bgtrun, void* userData);
+int ngSpice_Init_Sync(GetVSRCData* vsrcdat, GetISRCData* isrcdat, GetSyncData* syncdat,
+                      int* ident, void* userData);
+int ngSpice_Command(char* command);
+int ngSpice_Circ(char** circarray);
+NG_BOOL ngSpice_running(void);
+
+#endif // NGSPICE_SHAREDSPICE_MOCK_H
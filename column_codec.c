@@ -0,0 +1,276 @@
+#include "column_codec.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define HEADER_WORDS (sizeof(ColumnBlockHeader) / sizeof(uint64_t))
+
+static inline uint64_t double_bits(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static inline double bits_double(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void column_encoder_init(ColumnEncoder* encoder, ColumnCodec codec) {
+    memset(encoder, 0, sizeof(ColumnEncoder));
+    encoder->codec = codec;
+    encoder->num_words = HEADER_WORDS;
+}
+
+void column_encoder_free(ColumnEncoder* encoder) {
+    free(encoder->words);
+    column_encoder_init(encoder, encoder->codec);
+}
+
+void column_encoder_reset(ColumnEncoder* encoder) {
+    encoder->num_words = HEADER_WORDS;
+    encoder->acc = 0;
+    encoder->used = 0;
+    encoder->count = 0;
+    encoder->prev = 0;
+    encoder->delta = 0;
+    encoder->leading = 0;
+    encoder->meaningful = 0;
+    encoder->failed = false;
+}
+
+static bool grow(ColumnEncoder* encoder) {
+    size_t capacity = encoder->capacity ? 2 * encoder->capacity : 512;
+    uint64_t* words = realloc(encoder->words, capacity * sizeof(uint64_t));
+    if (!words) {
+        encoder->failed = true;
+        return false;
+    }
+    encoder->words = words;
+    encoder->capacity = capacity;
+    return true;
+}
+
+static void push_word(ColumnEncoder* encoder, uint64_t word) {
+    if (encoder->num_words >= encoder->capacity && !grow(encoder)) return;
+    encoder->words[encoder->num_words++] = word;
+}
+
+// Append the low n bits of value, 1 <= n <= 64
+static inline void put_bits(ColumnEncoder* encoder, uint64_t value, int n) {
+    if (n < 64) value &= (1ull << n) - 1;
+    int space = 64 - encoder->used;
+    if (n < space) {
+        encoder->acc |= value << (space - n);
+        encoder->used += n;
+        return;
+    }
+    int rest = n - space;
+    push_word(encoder, encoder->acc | (rest ? value >> rest : value));
+    encoder->acc = rest ? value << (64 - rest) : 0;
+    encoder->used = rest;
+}
+
+static void put_xor(ColumnEncoder* encoder, uint64_t bits) {
+    uint64_t x = bits ^ encoder->prev;
+    encoder->prev = bits;
+    if (x == 0) {
+        put_bits(encoder, 0, 1);
+        return;
+    }
+
+    int leading = __builtin_clzll(x);
+    int trailing = __builtin_ctzll(x);
+    if (leading > 31) leading = 31;  // 5 bits
+    int window_trailing = 64 - encoder->leading - encoder->meaningful;
+    if (encoder->meaningful > 0 && leading >= encoder->leading && trailing >= window_trailing) {
+        put_bits(encoder, 0x2, 2);
+        put_bits(encoder, x >> window_trailing, encoder->meaningful);
+        return;
+    }
+
+    int meaningful = 64 - leading - trailing;
+    put_bits(encoder, 0x3, 2);
+    put_bits(encoder, (uint64_t)leading, 5);
+    put_bits(encoder, (uint64_t)(meaningful - 1), 6);
+    put_bits(encoder, x >> trailing, meaningful);
+    encoder->leading = leading;
+    encoder->meaningful = meaningful;
+}
+
+static inline bool fits_signed(int64_t value, int bits) {
+    int64_t limit = (int64_t)1 << (bits - 1);
+    return value >= -limit && value < limit;
+}
+
+static void put_dod(ColumnEncoder* encoder, uint64_t bits) {
+    uint64_t delta = bits - encoder->prev;
+    int64_t dod = (int64_t)(delta - encoder->delta);
+    encoder->prev = bits;
+    encoder->delta = delta;
+
+    if (dod == 0) {
+        put_bits(encoder, 0, 1);
+    } else if (fits_signed(dod, 7)) {
+        put_bits(encoder, 0x2, 2);
+        put_bits(encoder, (uint64_t)dod, 7);
+    } else if (fits_signed(dod, 9)) {
+        put_bits(encoder, 0x6, 3);
+        put_bits(encoder, (uint64_t)dod, 9);
+    } else if (fits_signed(dod, 12)) {
+        put_bits(encoder, 0xe, 4);
+        put_bits(encoder, (uint64_t)dod, 12);
+    } else if (fits_signed(dod, 32)) {
+        put_bits(encoder, 0x1e, 5);
+        put_bits(encoder, (uint64_t)dod, 32);
+    } else {
+        put_bits(encoder, 0x1f, 5);
+        put_bits(encoder, (uint64_t)dod, 64);
+    }
+}
+
+void column_encoder_put(ColumnEncoder* encoder, double value) {
+    uint64_t bits = double_bits(value);
+    if (encoder->count++ == 0) {
+        put_bits(encoder, bits, 64);
+        encoder->prev = bits;
+    } else if (encoder->codec == COLUMN_CODEC_DOD) {
+        put_dod(encoder, bits);
+    } else {
+        put_xor(encoder, bits);
+    }
+}
+
+const void* column_encoder_finish(ColumnEncoder* encoder, size_t* bytes) {
+    if (encoder->used > 0) {
+        push_word(encoder, encoder->acc);
+        encoder->acc = 0;
+        encoder->used = 0;
+    }
+    // An empty block still needs room for its header
+    if (!encoder->words) grow(encoder);
+    if (encoder->failed) return NULL;
+
+    ColumnBlockHeader header = {
+        .codec = (uint32_t)encoder->codec,
+        .count = encoder->count,
+        .bytes = (uint32_t)((encoder->num_words - HEADER_WORDS) * sizeof(uint64_t))
+    };
+    memcpy(encoder->words, &header, sizeof(header));
+    *bytes = encoder->num_words * sizeof(uint64_t);
+    return encoder->words;
+}
+
+size_t column_block_size(const void* block, size_t size) {
+    if (size < sizeof(ColumnBlockHeader)) return 0;
+    ColumnBlockHeader header;
+    memcpy(&header, block, sizeof(header));
+    size_t total = sizeof(ColumnBlockHeader) + (size_t)header.bytes;
+    if ((header.codec != COLUMN_CODEC_XOR && header.codec != COLUMN_CODEC_DOD) ||
+        header.bytes % sizeof(uint64_t) != 0 || total > size) {
+        return 0;
+    }
+    return total;
+}
+
+// Word-at-a-time reader; reading past the end yields zeros and sets overrun
+typedef struct {
+    const unsigned char* words;
+    size_t num_words;
+    size_t next;
+    uint64_t acc;       // Unread bits, from the top
+    int avail;
+    bool overrun;
+} BitReader;
+
+static inline uint64_t next_word(BitReader* reader) {
+    if (reader->next == reader->num_words) {
+        reader->overrun = true;
+        return 0;
+    }
+    uint64_t word;
+    memcpy(&word, reader->words + reader->next++ * sizeof(uint64_t), sizeof(word));
+    return word;
+}
+
+// Read n bits, 1 <= n <= 64
+static inline uint64_t get_bits(BitReader* reader, int n) {
+    if (n <= reader->avail) {
+        uint64_t value = reader->acc >> (64 - n);
+        reader->acc = n == 64 ? 0 : reader->acc << n;
+        reader->avail -= n;
+        return value;
+    }
+    uint64_t high = reader->avail ? reader->acc >> (64 - reader->avail) : 0;
+    int rest = n - reader->avail;
+    uint64_t word = next_word(reader);
+    uint64_t value = rest == 64 ? word : (high << rest) | (word >> (64 - rest));
+    reader->acc = rest == 64 ? 0 : word << rest;
+    reader->avail = 64 - rest;
+    return value;
+}
+
+static inline int64_t sign_extend(uint64_t value, int bits) {
+    uint64_t sign = 1ull << (bits - 1);
+    return (int64_t)((value ^ sign) - sign);
+}
+
+static void decode_xor(BitReader* reader, uint64_t prev, double* out, uint32_t count) {
+    int leading = 0;
+    int meaningful = 0;
+    for (uint32_t i = 1; i < count && !reader->overrun; i++) {
+        if (get_bits(reader, 1)) {
+            if (get_bits(reader, 1)) {
+                leading = (int)get_bits(reader, 5);
+                meaningful = (int)get_bits(reader, 6) + 1;
+                if (leading + meaningful > 64) {
+                    reader->overrun = true;
+                    return;
+                }
+            } else if (meaningful == 0) {
+                reader->overrun = true;
+                return;
+            }
+            prev ^= get_bits(reader, meaningful) << (64 - leading - meaningful);
+        }
+        out[i] = bits_double(prev);
+    }
+}
+
+static void decode_dod(BitReader* reader, uint64_t prev, double* out, uint32_t count) {
+    static const int widths[] = {7, 9, 12, 32, 64};
+    uint64_t delta = 0;
+    for (uint32_t i = 1; i < count && !reader->overrun; i++) {
+        int ones = 0;
+        while (ones < 5 && get_bits(reader, 1)) ones++;
+        if (ones > 0) {
+            int width = widths[ones - 1];
+            uint64_t dod = get_bits(reader, width);
+            delta += width == 64 ? dod : (uint64_t)sign_extend(dod, width);
+        }
+        prev += delta;
+        out[i] = bits_double(prev);
+    }
+}
+
+long column_block_decode(const void* block, size_t size, double* out, size_t capacity) {
+    size_t total = column_block_size(block, size);
+    if (total == 0) return -1;
+    ColumnBlockHeader header;
+    memcpy(&header, block, sizeof(header));
+    if (header.count > capacity) return -1;
+    if (header.count == 0) return 0;
+
+    BitReader reader = {
+        .words = (const unsigned char*)block + sizeof(ColumnBlockHeader),
+        .num_words = header.bytes / sizeof(uint64_t)
+    };
+    uint64_t first = get_bits(&reader, 64);
+    out[0] = bits_double(first);
+    if (header.codec == COLUMN_CODEC_DOD) {
+        decode_dod(&reader, first, out, header.count);
+    } else {
+        decode_xor(&reader, first, out, header.count);
+    }
+    return reader.overrun ? -1 : (long)header.count;
+}
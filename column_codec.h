@@ -0,0 +1,69 @@
+#ifndef COLUMN_CODEC_H
+#define COLUMN_CODEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lossless compression of float64 columns, one block at a time:
+//   COLUMN_CODEC_XOR  values: each one XORed with its predecessor, stored as
+//                     '0' if equal, else the meaningful bits inside the
+//                     previous leading/trailing zero window ('10') or with a
+//                     new window ('11', 5 bits leading zeros, 6 bits length)
+//   COLUMN_CODEC_DOD  scale (time): delta-of-delta of the IEEE bit patterns,
+//                     '0', '10'+7, '110'+9, '1110'+12, '11110'+32 or
+//                     '11111'+64 bits. Uniform steps cost one bit, adaptive
+//                     steps stay exact.
+// The first value of a block is stored as is, so every block decodes on its
+// own. A block is a ColumnBlockHeader followed by the bit stream, most
+// significant bit first in native 64-bit words.
+
+typedef enum {
+    COLUMN_CODEC_XOR = 1,
+    COLUMN_CODEC_DOD = 2
+} ColumnCodec;
+
+typedef struct {
+    uint32_t codec;     // ColumnCodec
+    uint32_t count;     // Values in the block
+    uint32_t bytes;     // Stream bytes after the header, a multiple of 8
+    uint32_t reserved;
+} ColumnBlockHeader;
+
+// Streaming encoder; the buffer is kept across blocks
+typedef struct {
+    ColumnCodec codec;
+    uint64_t* words;    // Header, then the stream
+    size_t num_words;
+    size_t capacity;
+    uint64_t acc;       // Bits not yet in words, from the top
+    int used;
+    uint32_t count;
+    uint64_t prev;      // Bit pattern of the previous value
+    uint64_t delta;     // COLUMN_CODEC_DOD: previous delta
+    int leading;        // COLUMN_CODEC_XOR: current window
+    int meaningful;
+    bool failed;        // Memory ran out
+} ColumnEncoder;
+
+void column_encoder_init(ColumnEncoder* encoder, ColumnCodec codec);
+void column_encoder_free(ColumnEncoder* encoder);
+
+// Start a new block
+void column_encoder_reset(ColumnEncoder* encoder);
+
+void column_encoder_put(ColumnEncoder* encoder, double value);
+
+// Complete the block and return it, header included; NULL if memory ran out.
+// Valid until the next put or reset.
+const void* column_encoder_finish(ColumnEncoder* encoder, size_t* bytes);
+
+// Bytes of the block at block (header and stream), 0 if size bytes do not
+// hold a complete block
+size_t column_block_size(const void* block, size_t size);
+
+// Decode a whole block into out, which has room for capacity values.
+// Returns the number of values, or -1 for a corrupt or oversized block.
+long column_block_decode(const void* block, size_t size, double* out, size_t capacity);
+
+#endif // COLUMN_CODEC_H
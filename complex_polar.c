@@ -0,0 +1,303 @@
+#include "complex_polar.h"
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu_dispatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define COMPLEX_POLAR_X86 1
+#include <immintrin.h>
+#endif
+
+#define LN2 0.693147180559945309417
+#define DB_PER_LN 4.342944819032518276511     // 10 / ln(10)
+#define DEG_PER_RAD 57.29577951308232087680
+#define MANTISSA_MASK 0x000fffffffffffffull
+#define ONE_BITS 0x3ff0000000000000ull
+#define EXPONENT_MAGIC 4503599627370496.0     // 2^52: (2^52 + e) - 2^52 = e
+#define EXPONENT_MAGIC_BITS 0x4330000000000000ull
+
+// ln(m) = 2 atanh(t) with t = (m - 1) / (m + 1), |t| < 0.172 for m in
+// [sqrt(2)/2, sqrt(2)]: the odd series up to t^17
+#define LN_C3 (2.0 / 3.0)
+#define LN_C5 (2.0 / 5.0)
+#define LN_C7 (2.0 / 7.0)
+#define LN_C9 (2.0 / 9.0)
+#define LN_C11 (2.0 / 11.0)
+#define LN_C13 (2.0 / 13.0)
+#define LN_C15 (2.0 / 15.0)
+#define LN_C17 (2.0 / 17.0)
+
+// atan(a) = a + a z P(z) / Q(z), z = a^2, for |a| <= 0.66 (Cephes atan.c)
+#define ATAN_SPLIT 0.66
+#define ATAN_P0 -8.750608600031904122785e-1
+#define ATAN_P1 -1.615753718733365076637e1
+#define ATAN_P2 -7.500855792314704667340e1
+#define ATAN_P3 -1.228866684490136173410e2
+#define ATAN_P4 -6.485021904942025371773e1
+#define ATAN_Q0 2.485846490142306297962e1
+#define ATAN_Q1 1.650270098316988542046e2
+#define ATAN_Q2 4.328810604912902668951e2
+#define ATAN_Q3 4.853903996359136964868e2
+#define ATAN_Q4 1.945506571482613964425e2
+
+typedef void (*PolarKernel)(const double* re, const double* im, int count, double* magnitude_db, double* phase_deg);
+
+static inline double decibels_one(double re, double im) {
+    double power = re * re + im * im;
+    // Zero, under- or overflowing squares, infinities and NaN; written so
+    // that NaN fails the test as well
+    if (!(power >= DBL_MIN && power <= DBL_MAX)) return 20.0 * log10(hypot(re, im));
+
+    uint64_t bits;
+    memcpy(&bits, &power, sizeof(bits));
+    double e = (double)(int)(bits >> 52) - 1023.0;
+    bits = (bits & MANTISSA_MASK) | ONE_BITS;
+    double m;
+    memcpy(&m, &bits, sizeof(m));
+    if (m > M_SQRT2) {
+        m = m * 0.5;
+        e = e + 1.0;
+    }
+    double t = (m - 1.0) / (m + 1.0);
+    double t2 = t * t;
+    double s = LN_C17;
+    s = s * t2 + LN_C15;
+    s = s * t2 + LN_C13;
+    s = s * t2 + LN_C11;
+    s = s * t2 + LN_C9;
+    s = s * t2 + LN_C7;
+    s = s * t2 + LN_C5;
+    s = s * t2 + LN_C3;
+    s = s * t2 + 2.0;
+    return DB_PER_LN * (e * LN2 + s * t);
+}
+
+static inline double phase_one(double re, double im) {
+    double ax = fabs(re);
+    double ay = fabs(im);
+    double hi = ax > ay ? ax : ay;
+    double lo = ax > ay ? ay : ax;
+    // Both zero, infinite or NaN
+    if (!(hi > 0.0 && hi <= DBL_MAX && lo >= 0.0)) return DEG_PER_RAD * atan2(im, re);
+
+    double a = lo / hi;
+    double base = 0.0;
+    if (a > ATAN_SPLIT) {
+        base = M_PI_4;
+        a = (a - 1.0) / (a + 1.0);
+    }
+    double z = a * a;
+    double p = (((ATAN_P0 * z + ATAN_P1) * z + ATAN_P2) * z + ATAN_P3) * z + ATAN_P4;
+    double q = ((((z + ATAN_Q0) * z + ATAN_Q1) * z + ATAN_Q2) * z + ATAN_Q3) * z + ATAN_Q4;
+    double r = base + (a * (z * p / q) + a);
+    if (ay > ax) r = M_PI_2 - r;
+    if (re < 0.0) r = M_PI - r;
+    return copysign(r, im) * DEG_PER_RAD;
+}
+
+static void polar_scalar(const double* re, const double* im, int count, double* magnitude_db, double* phase_deg) {
+    for (int i = 0; i < count; i++) {
+        magnitude_db[i] = decibels_one(re[i], im[i]);
+        phase_deg[i] = phase_one(re[i], im[i]);
+    }
+}
+
+#ifdef COMPLEX_POLAR_X86
+
+// SSE2 has no blendv; select with the compare mask instead
+static inline __m128d select_sse2(__m128d mask, __m128d a, __m128d b) {
+    return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+__attribute__((target("sse2")))
+static void polar_sse2(const double* re, const double* im, int count, double* magnitude_db, double* phase_deg) {
+    const __m128d sign = _mm_set1_pd(-0.0);
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d half = _mm_set1_pd(0.5);
+    const __m128d dbl_min = _mm_set1_pd(DBL_MIN);
+    const __m128d dbl_max = _mm_set1_pd(DBL_MAX);
+    const __m128i mantissa = _mm_set1_epi64x((long long)MANTISSA_MASK);
+    const __m128i one_bits = _mm_set1_epi64x((long long)ONE_BITS);
+    const __m128i magic_bits = _mm_set1_epi64x((long long)EXPONENT_MAGIC_BITS);
+
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128d x = _mm_loadu_pd(re + i);
+        __m128d y = _mm_loadu_pd(im + i);
+
+        // Magnitude: exponent and mantissa of the power, then the series
+        __m128d power = _mm_add_pd(_mm_mul_pd(x, x), _mm_mul_pd(y, y));
+        __m128d ok = _mm_and_pd(_mm_cmpge_pd(power, dbl_min), _mm_cmple_pd(power, dbl_max));
+        __m128i bits = _mm_castpd_si128(power);
+        __m128d e = _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(_mm_srli_epi64(bits, 52), magic_bits)),
+                               _mm_set1_pd(EXPONENT_MAGIC));
+        e = _mm_sub_pd(e, _mm_set1_pd(1023.0));
+        __m128d m = _mm_castsi128_pd(_mm_or_si128(_mm_and_si128(bits, mantissa), one_bits));
+        __m128d big = _mm_cmpgt_pd(m, _mm_set1_pd(M_SQRT2));
+        m = select_sse2(big, _mm_mul_pd(m, half), m);
+        e = select_sse2(big, _mm_add_pd(e, one), e);
+        __m128d t = _mm_div_pd(_mm_sub_pd(m, one), _mm_add_pd(m, one));
+        __m128d t2 = _mm_mul_pd(t, t);
+        __m128d s = _mm_set1_pd(LN_C17);
+        s = _mm_add_pd(_mm_mul_pd(s, t2), _mm_set1_pd(LN_C15));
+        s = _mm_add_pd(_mm_mul_pd(s, t2), _mm_set1_pd(LN_C13));
+        s = _mm_add_pd(_mm_mul_pd(s, t2), _mm_set1_pd(LN_C11));
+        s = _mm_add_pd(_mm_mul_pd(s, t2), _mm_set1_pd(LN_C9));
+        s = _mm_add_pd(_mm_mul_pd(s, t2), _mm_set1_pd(LN_C7));
+        s = _mm_add_pd(_mm_mul_pd(s, t2), _mm_set1_pd(LN_C5));
+        s = _mm_add_pd(_mm_mul_pd(s, t2), _mm_set1_pd(LN_C3));
+        s = _mm_add_pd(_mm_mul_pd(s, t2), _mm_set1_pd(2.0));
+        __m128d ln = _mm_add_pd(_mm_mul_pd(e, _mm_set1_pd(LN2)), _mm_mul_pd(s, t));
+        _mm_storeu_pd(magnitude_db + i, _mm_mul_pd(_mm_set1_pd(DB_PER_LN), ln));
+
+        // Phase: atan of the smaller over the larger magnitude, then the octant
+        __m128d ax = _mm_andnot_pd(sign, x);
+        __m128d ay = _mm_andnot_pd(sign, y);
+        __m128d swap = _mm_cmpgt_pd(ay, ax);
+        __m128d hi = select_sse2(_mm_cmpgt_pd(ax, ay), ax, ay);
+        __m128d lo = select_sse2(_mm_cmpgt_pd(ax, ay), ay, ax);
+        ok = _mm_and_pd(ok, _mm_and_pd(_mm_and_pd(_mm_cmpgt_pd(hi, zero), _mm_cmple_pd(hi, dbl_max)),
+                                       _mm_cmpge_pd(lo, zero)));
+        __m128d a = _mm_div_pd(lo, hi);
+        __m128d split = _mm_cmpgt_pd(a, _mm_set1_pd(ATAN_SPLIT));
+        __m128d base = _mm_and_pd(split, _mm_set1_pd(M_PI_4));
+        a = select_sse2(split, _mm_div_pd(_mm_sub_pd(a, one), _mm_add_pd(a, one)), a);
+        __m128d z = _mm_mul_pd(a, a);
+        __m128d p = _mm_add_pd(_mm_mul_pd(_mm_set1_pd(ATAN_P0), z), _mm_set1_pd(ATAN_P1));
+        p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(ATAN_P2));
+        p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(ATAN_P3));
+        p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(ATAN_P4));
+        __m128d q = _mm_add_pd(z, _mm_set1_pd(ATAN_Q0));
+        q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(ATAN_Q1));
+        q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(ATAN_Q2));
+        q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(ATAN_Q3));
+        q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(ATAN_Q4));
+        __m128d r = _mm_add_pd(base, _mm_add_pd(_mm_mul_pd(a, _mm_div_pd(_mm_mul_pd(z, p), q)), a));
+        r = select_sse2(swap, _mm_sub_pd(_mm_set1_pd(M_PI_2), r), r);
+        r = select_sse2(_mm_cmplt_pd(x, zero), _mm_sub_pd(_mm_set1_pd(M_PI), r), r);
+        r = _mm_or_pd(r, _mm_and_pd(sign, y));
+        _mm_storeu_pd(phase_deg + i, _mm_mul_pd(r, _mm_set1_pd(DEG_PER_RAD)));
+
+        int valid = _mm_movemask_pd(ok);
+        if (valid != 0x3) {
+            polar_scalar(re + i, im + i, 2, magnitude_db + i, phase_deg + i);
+        }
+    }
+    polar_scalar(re + i, im + i, count - i, magnitude_db + i, phase_deg + i);
+}
+
+__attribute__((target("avx2")))
+static void polar_avx2(const double* re, const double* im, int count, double* magnitude_db, double* phase_deg) {
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d dbl_min = _mm256_set1_pd(DBL_MIN);
+    const __m256d dbl_max = _mm256_set1_pd(DBL_MAX);
+    const __m256i mantissa = _mm256_set1_epi64x((long long)MANTISSA_MASK);
+    const __m256i one_bits = _mm256_set1_epi64x((long long)ONE_BITS);
+    const __m256i magic_bits = _mm256_set1_epi64x((long long)EXPONENT_MAGIC_BITS);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d x = _mm256_loadu_pd(re + i);
+        __m256d y = _mm256_loadu_pd(im + i);
+
+        __m256d power = _mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y));
+        __m256d ok = _mm256_and_pd(_mm256_cmp_pd(power, dbl_min, _CMP_GE_OQ),
+                                   _mm256_cmp_pd(power, dbl_max, _CMP_LE_OQ));
+        __m256i bits = _mm256_castpd_si256(power);
+        __m256d e = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52), magic_bits)),
+                                  _mm256_set1_pd(EXPONENT_MAGIC));
+        e = _mm256_sub_pd(e, _mm256_set1_pd(1023.0));
+        __m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, mantissa), one_bits));
+        __m256d big = _mm256_cmp_pd(m, _mm256_set1_pd(M_SQRT2), _CMP_GT_OQ);
+        m = _mm256_blendv_pd(m, _mm256_mul_pd(m, half), big);
+        e = _mm256_blendv_pd(e, _mm256_add_pd(e, one), big);
+        __m256d t = _mm256_div_pd(_mm256_sub_pd(m, one), _mm256_add_pd(m, one));
+        __m256d t2 = _mm256_mul_pd(t, t);
+        __m256d s = _mm256_set1_pd(LN_C17);
+        s = _mm256_add_pd(_mm256_mul_pd(s, t2), _mm256_set1_pd(LN_C15));
+        s = _mm256_add_pd(_mm256_mul_pd(s, t2), _mm256_set1_pd(LN_C13));
+        s = _mm256_add_pd(_mm256_mul_pd(s, t2), _mm256_set1_pd(LN_C11));
+        s = _mm256_add_pd(_mm256_mul_pd(s, t2), _mm256_set1_pd(LN_C9));
+        s = _mm256_add_pd(_mm256_mul_pd(s, t2), _mm256_set1_pd(LN_C7));
+        s = _mm256_add_pd(_mm256_mul_pd(s, t2), _mm256_set1_pd(LN_C5));
+        s = _mm256_add_pd(_mm256_mul_pd(s, t2), _mm256_set1_pd(LN_C3));
+        s = _mm256_add_pd(_mm256_mul_pd(s, t2), _mm256_set1_pd(2.0));
+        __m256d ln = _mm256_add_pd(_mm256_mul_pd(e, _mm256_set1_pd(LN2)), _mm256_mul_pd(s, t));
+        _mm256_storeu_pd(magnitude_db + i, _mm256_mul_pd(_mm256_set1_pd(DB_PER_LN), ln));
+
+        __m256d ax = _mm256_andnot_pd(sign, x);
+        __m256d ay = _mm256_andnot_pd(sign, y);
+        __m256d swap = _mm256_cmp_pd(ay, ax, _CMP_GT_OQ);
+        __m256d larger_x = _mm256_cmp_pd(ax, ay, _CMP_GT_OQ);
+        __m256d hi = _mm256_blendv_pd(ay, ax, larger_x);
+        __m256d lo = _mm256_blendv_pd(ax, ay, larger_x);
+        ok = _mm256_and_pd(ok, _mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(hi, zero, _CMP_GT_OQ),
+                                                           _mm256_cmp_pd(hi, dbl_max, _CMP_LE_OQ)),
+                                             _mm256_cmp_pd(lo, zero, _CMP_GE_OQ)));
+        __m256d a = _mm256_div_pd(lo, hi);
+        __m256d split = _mm256_cmp_pd(a, _mm256_set1_pd(ATAN_SPLIT), _CMP_GT_OQ);
+        __m256d base = _mm256_and_pd(split, _mm256_set1_pd(M_PI_4));
+        a = _mm256_blendv_pd(a, _mm256_div_pd(_mm256_sub_pd(a, one), _mm256_add_pd(a, one)), split);
+        __m256d z = _mm256_mul_pd(a, a);
+        __m256d p = _mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(ATAN_P0), z), _mm256_set1_pd(ATAN_P1));
+        p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(ATAN_P2));
+        p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(ATAN_P3));
+        p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(ATAN_P4));
+        __m256d q = _mm256_add_pd(z, _mm256_set1_pd(ATAN_Q0));
+        q = _mm256_add_pd(_mm256_mul_pd(q, z), _mm256_set1_pd(ATAN_Q1));
+        q = _mm256_add_pd(_mm256_mul_pd(q, z), _mm256_set1_pd(ATAN_Q2));
+        q = _mm256_add_pd(_mm256_mul_pd(q, z), _mm256_set1_pd(ATAN_Q3));
+        q = _mm256_add_pd(_mm256_mul_pd(q, z), _mm256_set1_pd(ATAN_Q4));
+        __m256d r = _mm256_add_pd(base, _mm256_add_pd(_mm256_mul_pd(a, _mm256_div_pd(_mm256_mul_pd(z, p), q)), a));
+        r = _mm256_blendv_pd(r, _mm256_sub_pd(_mm256_set1_pd(M_PI_2), r), swap);
+        r = _mm256_blendv_pd(r, _mm256_sub_pd(_mm256_set1_pd(M_PI), r), _mm256_cmp_pd(x, zero, _CMP_LT_OQ));
+        r = _mm256_or_pd(r, _mm256_and_pd(sign, y));
+        _mm256_storeu_pd(phase_deg + i, _mm256_mul_pd(r, _mm256_set1_pd(DEG_PER_RAD)));
+
+        int valid = _mm256_movemask_pd(ok);
+        if (valid != 0xf) {
+            polar_scalar(re + i, im + i, 4, magnitude_db + i, phase_deg + i);
+        }
+    }
+    polar_scalar(re + i, im + i, count - i, magnitude_db + i, phase_deg + i);
+}
+
+#endif // COMPLEX_POLAR_X86
+
+static PolarKernel kernel;
+static const char* kernel_name;
+
+static void select_kernel(const char* forced) {
+    CpuLevel level = cpu_dispatch_level(forced);
+    kernel = polar_scalar;
+#ifdef COMPLEX_POLAR_X86
+    if (level == CPU_LEVEL_AVX2) kernel = polar_avx2;
+    if (level == CPU_LEVEL_SSE2) kernel = polar_sse2;
+#endif
+    kernel_name = cpu_level_name(level);
+}
+
+void complex_polar(const double* re, const double* im, int count, double* magnitude_db, double* phase_deg) {
+    // The Bode view converts on the render thread and the bench on its
+    // main thread, never both at once
+    if (!kernel) select_kernel(getenv("COMPLEX_POLAR_KERNEL"));
+    kernel(re, im, count, magnitude_db, phase_deg);
+}
+
+const char* complex_polar_kernel(void) {
+    if (!kernel) select_kernel(getenv("COMPLEX_POLAR_KERNEL"));
+    return kernel_name;
+}
+
+const char* complex_polar_use_kernel(const char* name) {
+    select_kernel(name ? name : getenv("COMPLEX_POLAR_KERNEL"));
+    return kernel_name;
+}
@@ -0,0 +1,28 @@
+#ifndef COMPLEX_POLAR_H
+#define COMPLEX_POLAR_H
+
+// Magnitude and phase of complex samples given as separate real and
+// imaginary columns, for the Bode view of .ac and .noise runs:
+//   magnitude_db[i] = 10 * log10(re[i]^2 + im[i]^2)   (= 20 * log10 |z|)
+//   phase_deg[i]    = atan2(im[i], re[i]) in degrees, [-180, 180]
+// log10 and atan2 are evaluated as polynomials (an atanh series after
+// splitting off the exponent, a Cephes rational approximation after
+// reduction to [0, 1]), good to about 1e-15. Zero, infinite and NaN
+// inputs and squares that under- or overflow go through libm instead.
+// The output is bit-for-bit the same whichever kernel runs: the SSE2 and
+// AVX2 kernels evaluate the scalar code's expressions lane by lane without
+// contraction into FMA, and the bench checks them against it. The kernel
+// is picked through cpu_dispatch.h on the first call, COMPLEX_POLAR_KERNEL
+// names one in the environment. Not thread-safe before that first call.
+
+void complex_polar(const double* re, const double* im, int count, double* magnitude_db, double* phase_deg);
+
+// Name of the kernel in use: "avx2", "sse2" or "scalar"
+const char* complex_polar_kernel(void);
+
+// Switch to the named kernel, or back to the default choice for NULL;
+// returns the name of the kernel now in use, which differs from name if the
+// CPU lacks it. For the bench, not while the Bode view converts.
+const char* complex_polar_use_kernel(const char* name);
+
+#endif // COMPLEX_POLAR_H
@@ -0,0 +1,25 @@
+#include "cpu_dispatch.h"
+#include <stdbool.h>
+#include <string.h>
+
+CpuLevel cpu_dispatch_level(const char* forced) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    bool has_sse2 = __builtin_cpu_supports("sse2");
+    bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (forced && strcmp(forced, "scalar") == 0) return CPU_LEVEL_SCALAR;
+    if (has_avx2 && (!forced || strcmp(forced, "avx2") == 0)) return CPU_LEVEL_AVX2;
+    if (has_sse2) return CPU_LEVEL_SSE2;
+#else
+    (void)forced;
+#endif
+    return CPU_LEVEL_SCALAR;
+}
+
+const char* cpu_level_name(CpuLevel level) {
+    switch (level) {
+        case CPU_LEVEL_AVX2: return "avx2";
+        case CPU_LEVEL_SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+// Which SIMD level a module with scalar, SSE2 and AVX2 kernels should run.
+// On x86-64 the best level the CPU supports is chosen; elsewhere it is
+// always scalar. forced is the name of a level ("scalar", "sse2", "avx2"),
+// normally the module's *_KERNEL environment variable, or NULL: AVX2 is
+// only taken if forced is NULL or "avx2", a level the CPU lacks falls back
+// to SSE2.
+
+typedef enum {
+    CPU_LEVEL_SCALAR = 0,
+    CPU_LEVEL_SSE2,
+    CPU_LEVEL_AVX2
+} CpuLevel;
+
+CpuLevel cpu_dispatch_level(const char* forced);
+
+// "scalar", "sse2" or "avx2"
+const char* cpu_level_name(CpuLevel level);
+
+#endif // CPU_DISPATCH_H
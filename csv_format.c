@@ -0,0 +1,110 @@
+#include "csv_format.h"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// Powers of ten that are exact in a double
+static const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// value * 10^exp
+static double scale_pow10(double value, int exp) {
+    if (exp >= 0) {
+        if (exp <= 22) return value * exact_pow10[exp];
+        if (exp > 308) return value * 1e308 * pow(10.0, exp - 308);
+        return value * pow(10.0, exp);
+    }
+    if (-exp <= 22) return value / exact_pow10[-exp];
+    return value * pow(10.0, exp);
+}
+
+int csv_format_double(char* out, double value) {
+    char* p = out;
+
+    if (isnan(value)) {
+        memcpy(p, "nan", 3);
+        return 3;
+    }
+    if (signbit(value)) {
+        *p++ = '-';
+        value = -value;
+    }
+    if (isinf(value)) {
+        memcpy(p, "inf", 3);
+        return (int)(p - out) + 3;
+    }
+    if (value == 0.0) {
+        *p++ = '0';
+        return (int)(p - out);
+    }
+
+    // Estimate the decimal exponent from the binary one; it is off by at
+    // most one, which the range check below corrects
+    int bin_exp;
+    frexp(value, &bin_exp);
+    int exp10 = (int)floor((bin_exp - 1) * 0.30102999566398120);
+
+    const uint64_t lower = 100000000ull;   // 10^(CSV_SIGNIFICANT_DIGITS - 1)
+    const uint64_t upper = 1000000000ull;  // 10^CSV_SIGNIFICANT_DIGITS
+    double scaled = scale_pow10(value, CSV_SIGNIFICANT_DIGITS - 1 - exp10);
+    if (scaled >= (double)upper - 0.5) {
+        exp10++;
+        scaled = scale_pow10(value, CSV_SIGNIFICANT_DIGITS - 1 - exp10);
+    } else if (scaled < (double)lower - 0.5) {
+        exp10--;
+        scaled = scale_pow10(value, CSV_SIGNIFICANT_DIGITS - 1 - exp10);
+    }
+    uint64_t mantissa = (uint64_t)(scaled + 0.5);
+    if (mantissa >= upper) {
+        // Rounding carried into a new digit, e.g. 9.999999999 -> 10.0000000
+        mantissa /= 10;
+        exp10++;
+    }
+
+    char digits[CSV_SIGNIFICANT_DIGITS];
+    for (int i = CSV_SIGNIFICANT_DIGITS - 1; i >= 0; i--) {
+        digits[i] = (char)('0' + mantissa % 10);
+        mantissa /= 10;
+    }
+    int ndigits = CSV_SIGNIFICANT_DIGITS;
+    while (ndigits > 1 && digits[ndigits - 1] == '0') ndigits--;
+
+    if (exp10 < -4 || exp10 >= CSV_SIGNIFICANT_DIGITS) {
+        *p++ = digits[0];
+        if (ndigits > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, ndigits - 1);
+            p += ndigits - 1;
+        }
+        *p++ = 'e';
+        int e = exp10;
+        if (e < 0) {
+            *p++ = '-';
+            e = -e;
+        } else {
+            *p++ = '+';
+        }
+        if (e >= 100) *p++ = (char)('0' + e / 100);
+        *p++ = (char)('0' + (e / 10) % 10);
+        *p++ = (char)('0' + e % 10);
+    } else if (exp10 >= 0) {
+        int int_digits = exp10 + 1;
+        for (int i = 0; i < int_digits; i++) {
+            *p++ = i < ndigits ? digits[i] : '0';
+        }
+        if (ndigits > int_digits) {
+            *p++ = '.';
+            memcpy(p, digits + int_digits, ndigits - int_digits);
+            p += ndigits - int_digits;
+        }
+    } else {
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = 0; i < -exp10 - 1; i++) *p++ = '0';
+        memcpy(p, digits, ndigits);
+        p += ndigits;
+    }
+    return (int)(p - out);
+}
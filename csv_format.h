@@ -0,0 +1,15 @@
+#ifndef CSV_FORMAT_H
+#define CSV_FORMAT_H
+
+// Fast double-to-text conversion for the CSV writer.
+// Produces %g-style output with CSV_SIGNIFICANT_DIGITS significant digits:
+// fixed notation for exponents in [-4, CSV_SIGNIFICANT_DIGITS), scientific
+// otherwise, trailing zeros removed. Does not go through printf or locale.
+
+#define CSV_SIGNIFICANT_DIGITS 9
+#define CSV_DOUBLE_MAX_LEN 24  // Longest output of csv_format_double, no terminator
+
+// Writes the text for value to out (not NUL-terminated), returns its length
+int csv_format_double(char* out, double value);
+
+#endif // CSV_FORMAT_H
@@ -0,0 +1,194 @@
+#include "history.h"
+#include <stdlib.h>
+
+// Round up to the next cache line
+static size_t align_size(size_t size) {
+    return (size + HISTORY_ALIGNMENT - 1) & ~(size_t)(HISTORY_ALIGNMENT - 1);
+}
+
+size_t history_bytes_per_sample(HistoryStorage storage) {
+    // The raw value plus min and max summaries of half, a quarter, ... of
+    // the samples: just under three values per sample
+    return 3 * (storage == HISTORY_FLOAT32 ? sizeof(float) : sizeof(double));
+}
+
+SignalHistory* history_create(int num_signals, int capacity, HistoryStorage storage) {
+    SignalHistory* history = calloc(1, sizeof(SignalHistory));
+    if (!history) return NULL;
+
+    history->num_signals = num_signals;
+    history->capacity = capacity;
+    history->storage = storage;
+    history->element_size = storage == HISTORY_FLOAT32 ? sizeof(float) : sizeof(double);
+
+    // Only levels whose block size divides the capacity tile the ring exactly
+    while (history->num_levels < HISTORY_MAX_LEVELS &&
+           (capacity % (2 << history->num_levels)) == 0) {
+        history->num_levels++;
+    }
+
+    history->data = calloc(num_signals > 0 ? num_signals : 1, sizeof(void*));
+    history->pyramids = calloc(num_signals > 0 ? num_signals : 1, sizeof(HistoryPyramid));
+    if (!history->data || !history->pyramids) {
+        history_destroy(history);
+        return NULL;
+    }
+
+    // One zero-filled block (so the plot starts as a flat line, as before):
+    // per signal the column, then its pyramid levels, each cache-line aligned
+    size_t per_signal = align_size(capacity * history->element_size);
+    for (int l = 1; l <= history->num_levels; l++) {
+        per_signal += 2 * align_size((size_t)(capacity >> l) * history->element_size);
+    }
+    history->block = calloc(1, per_signal * (num_signals > 0 ? num_signals : 1) + HISTORY_ALIGNMENT);
+    if (!history->block) {
+        history_destroy(history);
+        return NULL;
+    }
+
+    char* p = (char*)align_size((size_t)history->block);
+    for (int s = 0; s < num_signals; s++) {
+        history->data[s] = p;
+        p += align_size(capacity * history->element_size);
+        for (int l = 1; l <= history->num_levels; l++) {
+            size_t level_size = align_size((size_t)(capacity >> l) * history->element_size);
+            history->pyramids[s].min[l] = p;
+            history->pyramids[s].max[l] = p + level_size;
+            p += 2 * level_size;
+        }
+    }
+    return history;
+}
+
+void history_destroy(SignalHistory* history) {
+    if (!history) return;
+    free(history->block);
+    free(history->data);
+    free(history->pyramids);
+    free(history);
+}
+
+// Append and range kernels, instantiated for both element types
+
+#define HISTORY_KERNELS(T, SUFFIX) \
+static void append_##SUFFIX(SignalHistory* history, const double* values) { \
+    int head = history->head; \
+    for (int s = 0; s < history->num_signals; s++) { \
+        T v = (T)values[s]; \
+        ((T*)history->data[s])[head] = v; \
+        \
+        /* The first slot of a block restarts its summary; the older samples */ \
+        /* still in the rest of that block are about to be overwritten and */ \
+        /* are never read through this block (see history_minmax). */ \
+        /* A block's summary covers the one below it, so once v neither */ \
+        /* restarts nor widens a level, the levels above stay as they are. */ \
+        HistoryPyramid* pyramid = &history->pyramids[s]; \
+        for (int l = 1; l <= history->num_levels; l++) { \
+            T* lo = (T*)pyramid->min[l] + (head >> l); \
+            T* hi = (T*)pyramid->max[l] + (head >> l); \
+            if ((head & ((1 << l) - 1)) == 0) { \
+                *lo = v; \
+                *hi = v; \
+            } else if (v < *lo) { \
+                *lo = v; \
+            } else if (v > *hi) { \
+                *hi = v; \
+            } else { \
+                break; \
+            } \
+        } \
+    } \
+} \
+\
+static void physical_minmax_##SUFFIX(const SignalHistory* history, int signal, int begin, int end, \
+                                     double* out_lo, double* out_hi) { \
+    const T* data = history->data[signal]; \
+    const HistoryPyramid* pyramid = &history->pyramids[signal]; \
+    T lo = (T)*out_lo, hi = (T)*out_hi; \
+    \
+    while (begin < end) { \
+        /* Largest aligned block starting at begin that fits in the range */ \
+        int level = 0; \
+        while (level < history->num_levels && \
+               (begin & ((2 << level) - 1)) == 0 && \
+               begin + (2 << level) <= end) { \
+            level++; \
+        } \
+        \
+        if (level == 0) { \
+            T v = data[begin]; \
+            if (v < lo) lo = v; \
+            if (v > hi) hi = v; \
+            begin++; \
+        } else { \
+            int block = begin >> level; \
+            T block_lo = ((const T*)pyramid->min[level])[block]; \
+            T block_hi = ((const T*)pyramid->max[level])[block]; \
+            if (block_lo < lo) lo = block_lo; \
+            if (block_hi > hi) hi = block_hi; \
+            begin += 1 << level; \
+        } \
+    } \
+    *out_lo = lo; \
+    *out_hi = hi; \
+}
+
+HISTORY_KERNELS(double, f64)
+HISTORY_KERNELS(float, f32)
+
+void history_append(SignalHistory* history, const double* values) {
+    if (history->storage == HISTORY_FLOAT32) {
+        append_f32(history, values);
+    } else {
+        append_f64(history, values);
+    }
+    // The slot just written was the oldest sample, so head now points at the
+    // new oldest one
+    history->head = (history->head + 1 == history->capacity) ? 0 : history->head + 1;
+    history->count++;
+}
+
+// Min/max of physical slots [begin, end), which must not contain the head
+// unless begin == head: such a range lies entirely on one side of the
+// write position, so every whole block inside it has a valid summary
+static void physical_minmax(const SignalHistory* history, int signal, int begin, int end,
+                            double* lo, double* hi) {
+    if (history->storage == HISTORY_FLOAT32) {
+        physical_minmax_f32(history, signal, begin, end, lo, hi);
+    } else {
+        physical_minmax_f64(history, signal, begin, end, lo, hi);
+    }
+}
+
+void history_minmax(const SignalHistory* history, int signal, int first, int count,
+                    double* out_min, double* out_max) {
+    double lo = 0.0, hi = 0.0;
+    if (count > 0) {
+        lo = hi = history_get(history, signal, first);
+
+        int begin = history_physical_index(history, first);
+        int end = begin + count;
+        if (end <= history->capacity) {
+            physical_minmax(history, signal, begin, end, &lo, &hi);
+        } else {
+            physical_minmax(history, signal, begin, history->capacity, &lo, &hi);
+            physical_minmax(history, signal, 0, end - history->capacity, &lo, &hi);
+        }
+    }
+    *out_min = lo;
+    *out_max = hi;
+}
+
+void history_envelope(const SignalHistory* history, int signal, int first, int count,
+                      int columns, double* out_min, double* out_max) {
+    for (int c = 0; c < columns; c++) {
+        int begin = first + (int)((long long)count * c / columns);
+        int end = first + (int)((long long)count * (c + 1) / columns);
+        if (end <= begin) end = begin + 1;  // More columns than samples
+        if (end > first + count) {
+            begin = first + count - 1;
+            end = first + count;
+        }
+        history_minmax(history, signal, begin, end - begin, &out_min[c], &out_max[c]);
+    }
+}
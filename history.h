@@ -0,0 +1,77 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Ring buffer holding the most recent samples of every plotted signal.
+// Readers address samples by logical index: 0 is the oldest sample still
+// held, capacity - 1 the newest. Appending is O(1) regardless of capacity.
+//
+// Samples are stored as structure of arrays: one column per signal, each
+// starting on a cache line, in float64 or (halving the memory) float32 as
+// chosen when the history is created. The signal count is not limited.
+//
+// Alongside the raw samples every signal keeps a min/max pyramid: level l
+// stores the minimum and maximum of each aligned block of 2^l ring slots.
+// It is updated on append, so the min/max of any sample range can be
+// answered from O(log capacity) summaries instead of scanning the range.
+
+#define HISTORY_MAX_LEVELS 20
+#define HISTORY_ALIGNMENT 64
+
+typedef enum {
+    HISTORY_FLOAT64,
+    HISTORY_FLOAT32
+} HistoryStorage;
+
+typedef struct {
+    void* min[HISTORY_MAX_LEVELS + 1];  // min[l][block], levels 1..num_levels
+    void* max[HISTORY_MAX_LEVELS + 1];
+} HistoryPyramid;
+
+typedef struct {
+    HistoryStorage storage;
+    size_t element_size;       // 8 or 4 bytes
+    void* block;               // Single aligned allocation behind all columns
+    void** data;               // data[signal]: column of `capacity` elements
+    HistoryPyramid* pyramids;  // One per signal, same element type
+    int num_levels;      // Pyramid levels; 2^num_levels divides capacity
+    int num_signals;
+    int capacity;        // Samples held per signal
+    int head;            // Physical index the next sample is written to
+    long long count;     // Total number of samples appended so far
+} SignalHistory;
+
+SignalHistory* history_create(int num_signals, int capacity, HistoryStorage storage);
+void history_destroy(SignalHistory* history);
+void history_append(SignalHistory* history, const double* values);
+
+// Bytes one sample of one signal costs, raw value plus its pyramid share
+size_t history_bytes_per_sample(HistoryStorage storage);
+
+// Min and max of samples [first, first + count) of one signal (logical indices)
+void history_minmax(const SignalHistory* history, int signal, int first, int count,
+                    double* out_min, double* out_max);
+
+// Split samples [first, first + count) into `columns` equal buckets and
+// store each bucket's min and max, e.g. one bucket per pixel column
+void history_envelope(const SignalHistory* history, int signal, int first, int count,
+                      int columns, double* out_min, double* out_max);
+
+// Map a logical index (0 = oldest) to its position in the ring
+static inline int history_physical_index(const SignalHistory* history, int logical) {
+    int idx = history->head + logical;
+    if (idx >= history->capacity) idx -= history->capacity;
+    return idx;
+}
+
+static inline double history_get(const SignalHistory* history, int signal, int logical) {
+    int idx = history_physical_index(history, logical);
+    if (history->storage == HISTORY_FLOAT32) {
+        return ((const float*)history->data[signal])[idx];
+    }
+    return ((const double*)history->data[signal])[idx];
+}
+
+#endif // HISTORY_H
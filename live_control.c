@@ -0,0 +1,39 @@
+#include "live_control.h"
+#include <strings.h>
+
+int live_control_bind(LiveControls* controls, const char* source_name, double initial) {
+    if (controls->count >= LIVE_CONTROL_MAX || strlen(source_name) >= LIVE_CONTROL_NAME_LEN) {
+        return -1;
+    }
+
+    int index = controls->count++;
+    LiveControl* control = &controls->controls[index];
+    strcpy(control->name, source_name);
+    control->ngspice_name = NULL;
+    atomic_init(&control->bits, 0);
+    live_control_set(controls, index, initial);
+    return index;
+}
+
+bool live_control_lookup(LiveControls* controls, const char* source_name, double* value) {
+    atomic_fetch_add_explicit(&controls->lookups, 1, memory_order_relaxed);
+
+    // ngspice passes the same name pointer for a source on every timestep,
+    // so after the first match a pointer comparison is enough
+    for (int i = 0; i < controls->count; i++) {
+        if (controls->controls[i].ngspice_name == source_name) {
+            *value = live_control_get(controls, i);
+            return true;
+        }
+    }
+    for (int i = 0; i < controls->count; i++) {
+        if (strcasecmp(controls->controls[i].name, source_name) == 0) {
+            controls->controls[i].ngspice_name = source_name;
+            *value = live_control_get(controls, i);
+            return true;
+        }
+    }
+
+    atomic_fetch_add_explicit(&controls->misses, 1, memory_order_relaxed);
+    return false;
+}
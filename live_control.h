@@ -0,0 +1,52 @@
+#ifndef LIVE_CONTROL_H
+#define LIVE_CONTROL_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Values for sources declared `external` in the netlist, e.g.
+//   Vvdc y 0 dc 1.0 external
+// ngspice asks for the value of such a source through the GetVSRCData /
+// GetISRCData callbacks on every timestep, so a control written by the UI
+// thread takes effect at the next timestep without halting the simulation.
+// Values are stored as atomic 64-bit patterns, readers never block writers.
+
+#define LIVE_CONTROL_MAX 16
+#define LIVE_CONTROL_NAME_LEN 32
+
+typedef struct {
+    char name[LIVE_CONTROL_NAME_LEN];  // Source name, matched case-insensitively
+    const char* ngspice_name;          // Name pointer ngspice passed last time (sim thread only)
+    atomic_uint_least64_t bits;        // Current value as a double bit pattern
+} LiveControl;
+
+typedef struct {
+    LiveControl controls[LIVE_CONTROL_MAX];
+    int count;                         // Fixed once the simulation runs
+    atomic_uint_least64_t lookups;     // Source queries answered
+    atomic_uint_least64_t misses;      // Queries for sources without a control
+} LiveControls;
+
+// Register a control for an external source, returns its index or -1
+int live_control_bind(LiveControls* controls, const char* source_name, double initial);
+
+// UI side: publish a new value, picked up at the next timestep
+static inline void live_control_set(LiveControls* controls, int index, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    atomic_store_explicit(&controls->controls[index].bits, bits, memory_order_release);
+}
+
+static inline double live_control_get(LiveControls* controls, int index) {
+    uint64_t bits = atomic_load_explicit(&controls->controls[index].bits, memory_order_acquire);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Simulation side: value for the named source, false if it has no control
+bool live_control_lookup(LiveControls* controls, const char* source_name, double* value);
+
+#endif // LIVE_CONTROL_H
@@ -0,0 +1,478 @@
+#include "log.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Initialize debug level to ERROR by default
+DebugLevel current_debug_level = DEBUG_ERROR;
+
+#define LOG_RECORD_WRAP 1   // Filler up to the end of the ring, skip it
+
+// A record is this header followed by one 8-byte slot per numeric argument
+// (and per '*' width or precision); a string is a 4-byte length, the bytes
+// and padding up to the next slot. Records are multiples of 8 bytes.
+typedef struct {
+    uint32_t size;          // Bytes including the header
+    uint16_t level;
+    uint16_t flags;
+    const char* fmt;
+} LogRecordHeader;
+
+typedef struct LogRing {
+    _Alignas(64) atomic_size_t head;   // Written by the owning thread
+    _Alignas(64) atomic_size_t tail;   // Written by the logger thread
+    unsigned char* data;
+    atomic_bool orphaned;              // Owner exited: free once drained
+    struct LogRing* next;              // Changed only by the draining thread, apart from pushes at the front
+} LogRing;
+
+typedef enum {
+    ARG_NONE,       // %%
+    ARG_INT,
+    ARG_UINT,
+    ARG_DOUBLE,
+    ARG_STRING,
+    ARG_POINTER
+} ArgType;
+
+typedef struct {
+    char prefix[24];        // Flags, width and precision as written, '*' included
+    int stars;
+    char length;            // 0, 'l' (l, ll, z, j, t), 'L' or 'h' (h, hh)
+    char conv;
+    ArgType type;
+} FormatSpec;
+
+static _Atomic(LogRing*) rings;
+static __thread LogRing* thread_ring;
+static pthread_key_t ring_key;      // Its destructor hands an exiting thread's ring back
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static atomic_bool running;
+static atomic_bool stopping;
+static atomic_int writers;          // log_write calls between their running check and their push
+static atomic_bool sleeping;        // The logger thread waits for wake
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static atomic_uint_least64_t dropped;
+static FILE* output;
+static pthread_t logger;
+
+static const char* level_name(int level) {
+    return level == DEBUG_ERROR ? "ERROR" :
+           level == DEBUG_WARN ? "WARN" :
+           level == DEBUG_INFO ? "INFO" :
+           level == DEBUG_VERBOSE ? "VERBOSE" :
+           level == DEBUG_TRACE ? "TRACE" : "UNKNOWN";
+}
+
+// Parse the conversion following a '%', returns the character after it
+static const char* parse_spec(const char* p, FormatSpec* spec) {
+    size_t n = 0;
+    spec->stars = 0;
+    spec->length = 0;
+    while (*p && strchr("-+ #0'", *p)) {
+        if (n < sizeof(spec->prefix) - 1) spec->prefix[n++] = *p;
+        p++;
+    }
+    while (*p && (strchr("0123456789.", *p) || *p == '*')) {
+        if (*p == '*') spec->stars++;
+        if (n < sizeof(spec->prefix) - 1) spec->prefix[n++] = *p;
+        p++;
+    }
+    spec->prefix[n] = '\0';
+
+    while (*p && strchr("hlLqjzt", *p)) {
+        if (*p == 'h') {
+            if (!spec->length) spec->length = 'h';
+        } else if (*p == 'L') {
+            spec->length = 'L';
+        } else {
+            spec->length = 'l';
+        }
+        p++;
+    }
+
+    spec->conv = *p;
+    switch (*p) {
+        case 'd': case 'i': case 'c':
+            spec->type = ARG_INT;
+            break;
+        case 'u': case 'x': case 'X': case 'o':
+            spec->type = ARG_UINT;
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            spec->type = ARG_DOUBLE;
+            break;
+        case 's':
+            spec->type = ARG_STRING;
+            break;
+        case 'p':
+            spec->type = ARG_POINTER;
+            break;
+        default:
+            spec->type = ARG_NONE;
+            break;
+    }
+    return *p ? p + 1 : p;
+}
+
+// Encode the arguments after the header; returns the record size, stops
+// early (leaving the rest of the format unformatted) if the record is full
+static size_t encode_record(unsigned char* record, const char* fmt, va_list ap) {
+    size_t len = sizeof(LogRecordHeader);
+    FormatSpec spec;
+
+    for (const char* p = fmt; *p; ) {
+        if (*p++ != '%') continue;
+        p = parse_spec(p, &spec);
+
+        for (int s = 0; s < spec.stars; s++) {
+            if (len + 8 > LOG_RECORD_MAX) return len;
+            int64_t value = va_arg(ap, int);
+            memcpy(record + len, &value, 8);
+            len += 8;
+        }
+
+        if (spec.type == ARG_STRING) {
+            const char* s = va_arg(ap, const char*);
+            if (!s) s = "(null)";
+            if (len + 8 > LOG_RECORD_MAX) return len;
+            size_t room = LOG_RECORD_MAX - len - 4;
+            uint32_t n = (uint32_t)strnlen(s, room);
+            memcpy(record + len, &n, 4);
+            memcpy(record + len + 4, s, n);
+            len += (4 + n + 7) & ~(size_t)7;
+            continue;
+        }
+        if (spec.type == ARG_NONE) continue;
+
+        if (len + 8 > LOG_RECORD_MAX) return len;
+        unsigned char* slot = record + len;
+        len += 8;
+        if (spec.type == ARG_DOUBLE) {
+            double value = spec.length == 'L' ? (double)va_arg(ap, long double) : va_arg(ap, double);
+            memcpy(slot, &value, 8);
+        } else if (spec.type == ARG_POINTER) {
+            uint64_t value = (uintptr_t)va_arg(ap, void*);
+            memcpy(slot, &value, 8);
+        } else if (spec.type == ARG_UINT) {
+            uint64_t value = spec.length == 'l' ? (uint64_t)va_arg(ap, unsigned long long)
+                                                : (uint64_t)va_arg(ap, unsigned int);
+            memcpy(slot, &value, 8);
+        } else {
+            int64_t value = spec.length == 'l' ? (int64_t)va_arg(ap, long long)
+                                               : (int64_t)va_arg(ap, int);
+            memcpy(slot, &value, 8);
+        }
+    }
+    return len;
+}
+
+// Format a record back into text, the mirror image of encode_record
+static size_t format_record(char* out, size_t size, const unsigned char* record, size_t record_size) {
+    LogRecordHeader header;
+    memcpy(&header, record, sizeof(header));
+    size_t pos = sizeof(LogRecordHeader);
+    size_t n = 0;
+    FormatSpec spec;
+
+#define APPEND(...) do { \
+        int written = snprintf(out + n, size - n, __VA_ARGS__); \
+        if (written > 0) n += (size_t)written < size - n ? (size_t)written : size - n - 1; \
+    } while (0)
+
+    if (header.level != LOG_PLAIN) {
+        APPEND("[%s] ", level_name(header.level));
+    }
+
+    for (const char* p = header.fmt; *p && n < size - 1; ) {
+        if (*p != '%') {
+            out[n++] = *p++;
+            continue;
+        }
+        p = parse_spec(p + 1, &spec);
+        if (spec.type == ARG_NONE) {
+            if (spec.conv == '%') out[n++] = '%';
+            continue;
+        }
+
+        // Rebuild the conversion with the '*' values filled in
+        char conversion[64];
+        size_t c = 0;
+        conversion[c++] = '%';
+        for (const char* q = spec.prefix; *q; q++) {
+            if (*q == '*') {
+                int64_t value;
+                if (pos + 8 > record_size) goto truncated;
+                memcpy(&value, record + pos, 8);
+                pos += 8;
+                c += snprintf(conversion + c, sizeof(conversion) - c, "%d", (int)value);
+            } else {
+                conversion[c++] = *q;
+            }
+        }
+        if (spec.type == ARG_INT || spec.type == ARG_UINT) {
+            if (spec.conv != 'c') {
+                conversion[c++] = 'l';
+                conversion[c++] = 'l';
+            }
+        }
+        conversion[c++] = spec.conv;
+        conversion[c] = '\0';
+
+        if (spec.type == ARG_STRING) {
+            uint32_t len;
+            if (pos + 4 > record_size) goto truncated;
+            memcpy(&len, record + pos, 4);
+            char text[LOG_RECORD_MAX];
+            memcpy(text, record + pos + 4, len);
+            text[len] = '\0';
+            pos += (4 + len + 7) & ~(size_t)7;
+            APPEND(conversion, text);
+            continue;
+        }
+
+        if (pos + 8 > record_size) goto truncated;
+        const unsigned char* slot = record + pos;
+        pos += 8;
+        if (spec.type == ARG_DOUBLE) {
+            double value;
+            memcpy(&value, slot, 8);
+            APPEND(conversion, value);
+        } else if (spec.type == ARG_POINTER) {
+            uint64_t value;
+            memcpy(&value, slot, 8);
+            APPEND(conversion, (void*)(uintptr_t)value);
+        } else if (spec.conv == 'c') {
+            int64_t value;
+            memcpy(&value, slot, 8);
+            APPEND(conversion, (int)value);
+        } else {
+            long long value;
+            memcpy(&value, slot, 8);
+            APPEND(conversion, value);
+        }
+    }
+    goto done;
+
+truncated:
+    APPEND("...");
+done:
+#undef APPEND
+    out[n++] = '\n';
+    return n;
+}
+
+// ngspice starts a new thread for every bg_run and bg_resume; their rings
+// are freed by the draining thread once everything in them is written
+static void release_thread_ring(void* ring) {
+    atomic_store_explicit(&((LogRing*)ring)->orphaned, true, memory_order_release);
+    thread_ring = NULL;
+}
+
+static void create_ring_key(void) {
+    pthread_key_create(&ring_key, release_thread_ring);
+}
+
+static LogRing* get_thread_ring(void) {
+    if (thread_ring) return thread_ring;
+
+    pthread_once(&ring_key_once, create_ring_key);
+    LogRing* ring = calloc(1, sizeof(LogRing));
+    if (!ring) return NULL;
+    ring->data = malloc(LOG_RING_SIZE);
+    if (!ring->data) {
+        free(ring);
+        return NULL;
+    }
+    pthread_setspecific(ring_key, ring);
+
+    LogRing* first = atomic_load(&rings);
+    do {
+        ring->next = first;
+    } while (!atomic_compare_exchange_weak(&rings, &first, ring));
+    thread_ring = ring;
+    return ring;
+}
+
+static bool ring_push(LogRing* ring, const unsigned char* record, size_t size) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t pos = head & (LOG_RING_SIZE - 1);
+    size_t contiguous = LOG_RING_SIZE - pos;
+    size_t needed = size <= contiguous ? size : contiguous + size;
+
+    if (LOG_RING_SIZE - (head - tail) < needed) return false;
+    if (size > contiguous) {
+        LogRecordHeader filler = {.size = (uint32_t)contiguous, .flags = LOG_RECORD_WRAP};
+        memcpy(ring->data + pos, &filler, offsetof(LogRecordHeader, fmt));
+        head += contiguous;
+        pos = 0;
+    }
+    memcpy(ring->data + pos, record, size);
+    atomic_store_explicit(&ring->head, head + size, memory_order_release);
+    return true;
+}
+
+static void wake_logger(void) {
+    pthread_mutex_lock(&wake_lock);
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&wake_lock);
+}
+
+void log_write(DebugLevel level, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+
+    // Counted before running is checked, so log_stop can wait for every
+    // call that still goes to a ring
+    atomic_fetch_add(&writers, 1);
+    if (!atomic_load(&running)) {
+        atomic_fetch_sub(&writers, 1);
+        flockfile(stdout);
+        if (level != LOG_PLAIN) printf("[%s] ", level_name(level));
+        vprintf(fmt, ap);
+        printf("\n");
+        funlockfile(stdout);
+        va_end(ap);
+        return;
+    }
+
+    _Alignas(8) unsigned char record[LOG_RECORD_MAX];
+    size_t size = encode_record(record, fmt, ap);
+    va_end(ap);
+
+    LogRecordHeader header = {
+        .size = (uint32_t)size,
+        .level = (uint16_t)level,
+        .flags = 0,
+        .fmt = fmt
+    };
+    memcpy(record, &header, sizeof(header));
+
+    LogRing* ring = get_thread_ring();
+    if (!ring || !ring_push(ring, record, size)) {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+    } else {
+        // The logger only sleeps with every ring empty; pairs with the
+        // fence in logger_thread so that one of the two sees the other
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&sleeping, memory_order_relaxed)) wake_logger();
+    }
+    atomic_fetch_sub_explicit(&writers, 1, memory_order_release);
+}
+
+// Some ring holds records the logger has not taken yet
+static bool rings_pending(void) {
+    for (LogRing* ring = atomic_load(&rings); ring; ring = ring->next) {
+        if (atomic_load_explicit(&ring->head, memory_order_acquire) !=
+            atomic_load_explicit(&ring->tail, memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Take a drained ring of an exited thread out of the list and free it.
+// Threads only ever push at the front, so only unlinking the first ring
+// can race with them; that one is left for a later pass if it does.
+static bool unlink_ring(LogRing* prev, LogRing* ring) {
+    if (prev) {
+        prev->next = ring->next;
+    } else {
+        LogRing* expected = ring;
+        if (!atomic_compare_exchange_strong(&rings, &expected, ring->next)) return false;
+    }
+    free(ring->data);
+    free(ring);
+    return true;
+}
+
+// Format and write everything queued in all rings, returns the records seen.
+// Called by one thread at a time: the logger thread, or log_stop after it.
+static size_t drain_rings(void) {
+    char line[2 * LOG_RECORD_MAX + 64];
+    size_t records = 0;
+
+    LogRing* prev = NULL;
+    for (LogRing* ring = atomic_load(&rings), *next; ring; ring = next) {
+        next = ring->next;
+        // Checked before head: once set, the owner pushes nothing more
+        bool orphaned = atomic_load_explicit(&ring->orphaned, memory_order_acquire);
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        while (tail != head) {
+            const unsigned char* record = ring->data + (tail & (LOG_RING_SIZE - 1));
+            // A filler may be as short as the fields before fmt
+            LogRecordHeader header;
+            memcpy(&header, record, offsetof(LogRecordHeader, fmt));
+            if (!(header.flags & LOG_RECORD_WRAP)) {
+                size_t len = format_record(line, sizeof(line), record, header.size);
+                fwrite(line, 1, len, output);
+                records++;
+            }
+            tail += header.size;
+            atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        }
+        if (!orphaned || !unlink_ring(prev, ring)) prev = ring;
+    }
+    return records;
+}
+
+// Drains until the rings are empty, then sleeps until log_write or
+// log_stop wakes it
+static void* logger_thread(void* arg) {
+    (void)arg;
+    for (;;) {
+        bool stop = atomic_load(&stopping);
+        if (drain_rings() > 0) continue;
+        fflush(output);
+        if (stop) break;
+
+        pthread_mutex_lock(&wake_lock);
+        atomic_store_explicit(&sleeping, true, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!rings_pending() && !atomic_load(&stopping)) {
+            pthread_cond_wait(&wake, &wake_lock);
+        }
+        atomic_store_explicit(&sleeping, false, memory_order_relaxed);
+        pthread_mutex_unlock(&wake_lock);
+    }
+    return NULL;
+}
+
+int log_start(FILE* out) {
+    if (atomic_load(&running)) return -1;
+    output = out;
+    atomic_store(&stopping, false);
+    if (pthread_create(&logger, NULL, logger_thread, NULL) != 0) {
+        return -1;
+    }
+    atomic_store_explicit(&running, true, memory_order_release);
+    return 0;
+}
+
+void log_stop(void) {
+    if (!atomic_load(&running)) return;
+    atomic_store(&stopping, true);
+    wake_logger();
+    pthread_join(logger, NULL);
+
+    // Calls that saw running before it was cleared finish their push, later
+    // ones print synchronously; then nothing is left behind the last drain
+    atomic_store(&running, false);
+    while (atomic_load(&writers) > 0) {
+        sched_yield();
+    }
+    drain_rings();
+    fflush(output);
+}
+
+unsigned long long log_dropped(void) {
+    return atomic_load_explicit(&dropped, memory_order_relaxed);
+}
@@ -0,0 +1,65 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+// Logging for the ngspice callback threads.
+// A call site more verbose than LOG_MIN_LEVEL is removed by the compiler;
+// the remaining ones are filtered at runtime by current_debug_level. While
+// the logger runs, an enabled call does no formatting: it copies the format
+// pointer and the raw arguments into a lock-free ring owned by the calling
+// thread, and a background thread formats and writes the records. It
+// sleeps while every ring is empty and is woken by the next record. A full
+// ring drops the record instead of blocking. The ring of a thread that exits
+// is freed once it has been written out. Without a running logger, calls
+// print synchronously as before.
+// Only printf conversions without %n are supported; the format must be a
+// string literal (it is kept by pointer), %s arguments are copied.
+
+// Debug levels
+typedef enum {
+    DEBUG_NONE = 0,
+    DEBUG_ERROR = 1,
+    DEBUG_WARN = 2,
+    DEBUG_INFO = 3,
+    DEBUG_VERBOSE = 4,
+    DEBUG_TRACE = 5
+} DebugLevel;
+
+// Build with e.g. -DLOG_MIN_LEVEL=DEBUG_WARN to strip INFO and below
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL DEBUG_TRACE
+#endif
+
+// Records at this level are written as they are, without a [LEVEL] prefix
+#define LOG_PLAIN DEBUG_NONE
+
+#define LOG_RING_SIZE (256 << 10)   // Bytes per thread, power of two
+#define LOG_RECORD_MAX 1024         // Longer records have their strings truncated
+
+extern DebugLevel current_debug_level;
+
+#define DEBUG_PRINT(level, fmt, ...) \
+    do { \
+        if ((level) <= LOG_MIN_LEVEL && (level) <= current_debug_level) { \
+            log_write(level, fmt, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+// Output that is always shown, e.g. the lines ngspice prints
+#define LOG_PRINT(fmt, ...) log_write(LOG_PLAIN, fmt, ##__VA_ARGS__)
+
+void log_write(DebugLevel level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Start the formatting thread writing to out; returns -1 on failure
+int log_start(FILE* out);
+
+// Write everything recorded so far and stop the thread. Later calls print
+// synchronously again.
+void log_stop(void);
+
+// Records lost to full rings since the start
+unsigned long long log_dropped(void);
+
+#endif // LOG_H
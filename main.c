@@ -1,185 +1,844 @@
 #include "plot.h"
 #include "simulation.h"
+#include "sample_queue.h"
+#include "sweep.h"
+#include "alter_pipeline.h"
+#include "metrics.h"
+#include "log.h"
+#include "replay.h"
+#include "measure.h"
+#include "complex_polar.h"
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
 #include <ctype.h>
+#include <stdint.h>
 
-extern SimContext* g_context;
 
+// Frames queued between ngspice's background thread and the render loop;
+// wide layouts get fewer frames so the queue stays within QUEUE_MEMORY_BUDGET
+#define SAMPLE_QUEUE_CAPACITY 65536
+#define QUEUE_MEMORY_BUDGET ((size_t)64 << 20)
 
-SignalValues get_new_values(double t, PlotConfig* config) {
-    SignalValues values;
-    values.values[0] = sin(t) * config->amplitude_slider.value;  // First signal: sine with slider amplitude
-    values.values[1] = cos(t);  // Second signal: cosine
-    return values;
-}
+// A frequency sweep (.ac, .noise) is plotted as 20 log10 |z| and the phase
+// of every complex signal, and the dB of real ones such as noise densities.
+// The render loop gathers such frames column by column and converts
+// POLAR_BATCH of them at a time with complex_polar before they reach the
+// history and the store. Other layouts plot their values as they are,
+// complex ones as real and imaginary part.
+#define POLAR_BATCH 256
+
+// Everything the render loop needs for one vector layout. The producer
+// creates a new channel when ngspice announces a new layout and links it
+// from the old one; the render loop drains the old queue completely before
+// it follows the link, so no frame is lost or applied to the wrong history.
+typedef struct PlotChannel {
+    int num_signals;             // Plotted signals, as subscribed
+    int num_values;              // Values per frame, complex signals twice
+    ScaleKind scale;
+    int num_traces;              // Columns of the history and the store
+    TraceKind* trace_kinds;      // Per trace
+    int* trace_colors;           // Per trace: the signal it belongs to
+    int* trace_source;           // Per trace: value index, or polar index for magnitude and phase
+    int num_polar;               // Signals converted to magnitude and phase, 0 outside sweeps
+    int* polar_re;               // Per polar signal: value index of the real part
+    int* polar_im;               // Value index of the imaginary part, -1 for real signals
+    int batch_count;             // Frames gathered for the next conversion
+    double* batch_times;         // [POLAR_BATCH]
+    double* batch_values;        // [value][POLAR_BATCH]
+    double* batch_magnitude;     // [polar][POLAR_BATCH]
+    double* batch_phase;
+    double* zeros;               // Imaginary part of real signals
+    double* row;                 // One converted frame
+    SampleQueue* queue;
+    unsigned layout_version;
+    _Atomic(struct PlotChannel*) next;
+} PlotChannel;
+
+// Frame pacing of the render loop: without vsync frames are at least
+// FRAME_INTERVAL_NS apart; with nothing to draw it sleeps up to IDLE_WAIT_MS
+#define FRAME_INTERVAL_NS 16000000ull
+#define IDLE_WAIT_MS 1000
 
-// Callback function to update plot buffers with simulation data
 typedef struct {
     PlotConfig* config;
-    double** buffers;
+    SignalHistory* history;
+    WaveformStore* store;        // Whole run of the current layout, for zoom and pan
+    PlotChannel* producer;       // Channel the simulation thread pushes to
+    PlotChannel* consumer;       // Channel the render loop drains
+    MeasureEngine* measure;      // Online analysis ahead of the queue, NULL if unused
+    uint64_t drain_ns;  // Start of the current drain, for the queue lag metric
+    Uint32 wake_event;           // SDL user event posted when samples arrive, 0 if none
+    atomic_bool wake_pending;    // Samples queued since the render loop last drained
 } CallbackData;
 
+static void destroy_plot_channel(PlotChannel* channel) {
+    if (!channel) return;
+    sample_queue_destroy(channel->queue);
+    free(channel->trace_kinds);
+    free(channel->trace_colors);
+    free(channel->trace_source);
+    free(channel->polar_re);
+    free(channel->polar_im);
+    free(channel->batch_times);
+    free(channel->batch_values);
+    free(channel->batch_magnitude);
+    free(channel->batch_phase);
+    free(channel->zeros);
+    free(channel->row);
+    free(channel);
+}
+
+static void add_trace(PlotChannel* channel, TraceKind kind, int signal, int source) {
+    int t = channel->num_traces++;
+    channel->trace_kinds[t] = kind;
+    channel->trace_colors[t] = signal;
+    channel->trace_source[t] = source;
+}
+
+// Columns plotted for the layout, at most one per value, and the buffers of
+// the polar conversion
+static bool build_traces(PlotChannel* channel, const SimulationData* data) {
+    int values = channel->num_values > 0 ? channel->num_values : 1;
+    int signals = data->num_signals > 0 ? data->num_signals : 1;
+    channel->trace_kinds = malloc(values * sizeof(TraceKind));
+    channel->trace_colors = malloc(values * sizeof(int));
+    channel->trace_source = malloc(values * sizeof(int));
+    channel->polar_re = malloc(signals * sizeof(int));
+    channel->polar_im = malloc(signals * sizeof(int));
+    if (!channel->trace_kinds || !channel->trace_colors || !channel->trace_source ||
+        !channel->polar_re || !channel->polar_im) {
+        return false;
+    }
+
+    int v = 0;
+    for (int s = 0; s < data->num_signals; s++) {
+        bool is_complex = data->is_complex && data->is_complex[s];
+        if (channel->scale == SCALE_FREQUENCY) {
+            int k = channel->num_polar++;
+            channel->polar_re[k] = v;
+            channel->polar_im[k] = is_complex ? v + 1 : -1;
+            add_trace(channel, TRACE_MAGNITUDE, s, k);
+            if (is_complex) add_trace(channel, TRACE_PHASE, s, k);
+        } else {
+            add_trace(channel, TRACE_VALUE, s, v);
+            if (is_complex) add_trace(channel, TRACE_VALUE, s, v + 1);
+        }
+        v += is_complex ? 2 : 1;
+    }
+    if (channel->num_polar == 0) return true;
+
+    channel->batch_times = malloc(POLAR_BATCH * sizeof(double));
+    channel->batch_values = malloc((size_t)values * POLAR_BATCH * sizeof(double));
+    channel->batch_magnitude = malloc((size_t)channel->num_polar * POLAR_BATCH * sizeof(double));
+    channel->batch_phase = malloc((size_t)channel->num_polar * POLAR_BATCH * sizeof(double));
+    channel->zeros = calloc(POLAR_BATCH, sizeof(double));
+    channel->row = malloc(values * sizeof(double));
+    return channel->batch_times && channel->batch_values && channel->batch_magnitude &&
+           channel->batch_phase && channel->zeros && channel->row;
+}
+
+static PlotChannel* create_plot_channel(const SimulationData* data) {
+    PlotChannel* channel = calloc(1, sizeof(PlotChannel));
+    if (!channel) return NULL;
+    channel->layout_version = data->layout_version;
+    // The simulation only passes the signals subscribed for plotting
+    channel->num_signals = data->num_signals;
+    channel->num_values = data->num_values;
+    channel->scale = data->scale;
+    if (!build_traces(channel, data)) {
+        destroy_plot_channel(channel);
+        return NULL;
+    }
+
+    size_t frame_bytes = (size_t)(channel->num_values + 2) * sizeof(double);
+    size_t capacity = SAMPLE_QUEUE_CAPACITY;
+    while (capacity > 1024 && capacity * frame_bytes > QUEUE_MEMORY_BUDGET) {
+        capacity >>= 1;
+    }
+    channel->queue = sample_queue_create(capacity, channel->num_values > 0 ? channel->num_values : 1);
+    if (!channel->queue) {
+        destroy_plot_channel(channel);
+        return NULL;
+    }
+    return channel;
+}
+
+// Runs on ngspice's background thread: only enqueues the plotted values,
+// the render loop applies them to the history
 void handle_simulation_data(SimulationData* data, void* user_data) {
     CallbackData* cb_data = (CallbackData*)user_data;
-    PlotConfig* config = cb_data->config;
-    double** buffers = cb_data->buffers;
-    SignalValues new_values;
-    
-    if (!config || !buffers) return;  // Safety check
-    
-    // Count and process actual signals (excluding #branch)
-    int plot_idx = 0;
-    
-    if (!buffers) return;  // Safety check
-    
-    // Second pass: fill in the values
-    plot_idx = 0;  // Reset counter for actual data processing
-    for (int i = 1; i < data->num_signals && plot_idx < 15; i++) {
-        if (data->signal_names && data->signal_names[i] && 
-            strstr(data->signal_names[i], "#branch") == NULL) {
-            new_values.values[plot_idx] = data->signal_values[i];
-            plot_idx++;
+    PlotChannel* channel = cb_data->producer;
+
+    // Measurements see every plotted row, also those the queue would drop
+    if (cb_data->measure) measure_push(cb_data->measure, data);
+
+    if (!channel) return;  // Safety check
+    if (channel->layout_version != data->layout_version) {
+        PlotChannel* next = create_plot_channel(data);
+        if (!next) return;
+        atomic_store_explicit(&channel->next, next, memory_order_release);
+        cb_data->producer = channel = next;
+    }
+
+    sample_queue_push(channel->queue, data->time, data->signal_values, channel->num_values);
+
+    // One wake-up per drain: further samples ride along until the render
+    // loop clears the flag. SDL_PushEvent is safe from this thread.
+    if (cb_data->wake_event && !atomic_exchange(&cb_data->wake_pending, true)) {
+        SDL_Event event = {.type = cb_data->wake_event};
+        SDL_PushEvent(&event);
+    }
+}
+
+// Headless counterpart of handle_simulation_data: nothing is plotted
+static void handle_measure_data(SimulationData* data, void* user_data) {
+    measure_push((MeasureEngine*)user_data, data);
+}
+
+static void apply_row(CallbackData* cb_data, double time, const double* values) {
+    update_buffers(cb_data->history, values, cb_data->config);
+    if (cb_data->store) {
+        waveform_store_append(cb_data->store, time, values);
+    }
+}
+
+// Convert the gathered frames of a sweep and apply them in order
+static void flush_polar_batch(CallbackData* cb_data, PlotChannel* channel) {
+    int count = channel->batch_count;
+    if (count == 0) return;
+    for (int k = 0; k < channel->num_polar; k++) {
+        const double* re = channel->batch_values + (size_t)channel->polar_re[k] * POLAR_BATCH;
+        const double* im = channel->polar_im[k] >= 0
+                           ? channel->batch_values + (size_t)channel->polar_im[k] * POLAR_BATCH
+                           : channel->zeros;
+        complex_polar(re, im, count, channel->batch_magnitude + (size_t)k * POLAR_BATCH,
+                      channel->batch_phase + (size_t)k * POLAR_BATCH);
+    }
+    for (int f = 0; f < count; f++) {
+        for (int t = 0; t < channel->num_traces; t++) {
+            size_t source = (size_t)channel->trace_source[t] * POLAR_BATCH + f;
+            switch (channel->trace_kinds[t]) {
+                case TRACE_MAGNITUDE: channel->row[t] = channel->batch_magnitude[source]; break;
+                case TRACE_PHASE: channel->row[t] = channel->batch_phase[source]; break;
+                default: channel->row[t] = channel->batch_values[source]; break;
+            }
         }
+        apply_row(cb_data, channel->batch_times[f], channel->row);
     }
-    
-    update_buffers(buffers, new_values, config);
+    channel->batch_count = 0;
 }
 
-int main(int argc, char* argv[]) {
+// Runs on the render loop for every frame drained from the sample queue
+void apply_sample_frame(double time, uint64_t enqueue_ns, const double* values, int num_values, void* user_data) {
+    CallbackData* cb_data = (CallbackData*)user_data;
+    PlotChannel* channel = cb_data->consumer;
+
+    metrics_record(METRIC_QUEUE_LAG, cb_data->drain_ns - enqueue_ns);
+    if (channel->num_polar == 0) {
+        apply_row(cb_data, time, values);
+        return;
+    }
+    int f = channel->batch_count++;
+    channel->batch_times[f] = time;
+    for (int v = 0; v < num_values; v++) {
+        channel->batch_values[(size_t)v * POLAR_BATCH + f] = values[v];
+    }
+    if (channel->batch_count == POLAR_BATCH) flush_polar_batch(cb_data, channel);
+}
+
+// Render loop: apply everything queued, following layout changes. Returns
+// false if the history for a new layout could not be allocated.
+static bool drain_plot_channels(CallbackData* cb_data) {
+    for (;;) {
+        PlotChannel* channel = cb_data->consumer;
+        PlotChannel* next = atomic_load_explicit(&channel->next, memory_order_acquire);
+        if (channel->queue) {
+            sample_queue_drain(channel->queue, apply_sample_frame, cb_data, SIZE_MAX);
+        }
+        flush_polar_batch(cb_data, channel);
+        if (!next) return true;
+
+        // The producer no longer touches the old channel. Everything it
+        // pushed before linking the new one has been drained above.
+        destroy_plot_channel(channel);
+        cb_data->consumer = next;
+
+        history_destroy(cb_data->history);
+        waveform_store_destroy(cb_data->store);
+        cb_data->config->num_signals = next->num_traces;
+        cb_data->config->trace_kinds = next->trace_kinds;
+        cb_data->config->trace_colors = next->trace_colors;
+        cb_data->config->canvas.valid = false;
+        cb_data->config->view.active = false;
+        cb_data->config->view.log_scale = next->scale == SCALE_FREQUENCY;
+        cb_data->history = init_buffers(cb_data->config);
+        cb_data->store = waveform_store_create(next->num_traces, NULL);
+        cb_data->config->view.store = cb_data->store;
+        if (!cb_data->history || !cb_data->store) {
+            fprintf(stderr, "Error allocating history for %d signals\n", next->num_traces);
+            cb_data->config->num_signals = 0;
+            return false;
+        }
+        DEBUG_PRINT(DEBUG_INFO, "Plotting %d signals as %d traces, %d samples each (%s)",
+                    next->num_signals, next->num_traces, cb_data->history->capacity,
+                    cb_data->config->storage == HISTORY_FLOAT32 ? "float32" : "float64");
+    }
+}
+
+// ngspice's background thread, or the replay thread in its place
+static int start_simulation(SimContext* context) {
+    if (context->replay) return replay_start(context->replay, context);
+    return ngSpice_Command("bg_run");
+}
+
+// Replay keys: space pauses, left/right seek by a tenth of the plot, +/-
+// double or halve the speed, 0 toggles full speed. Returns true if used.
+static bool handle_replay_event(Replay* replay, const SDL_Event* e) {
+    if (e->type != SDL_KEYDOWN) return false;
+
+    double first, last, current;
+    replay_position(replay, &first, &last, &current);
+    double speed = replay_speed(replay);
+    switch (e->key.keysym.sym) {
+        case SDLK_SPACE:
+            replay_set_paused(replay, !replay_paused(replay));
+            return true;
+        case SDLK_LEFT:
+        case SDLK_RIGHT: {
+            double step = (last - first) * 0.1 * (e->key.keysym.sym == SDLK_LEFT ? -1.0 : 1.0);
+            double target = current + step;
+            replay_seek(replay, target < first ? first : target);
+            return true;
+        }
+        case SDLK_PLUS:
+        case SDLK_KP_PLUS:
+        case SDLK_EQUALS:
+            if (speed > 0.0) replay_set_speed(replay, speed * 2.0);
+            return true;
+        case SDLK_MINUS:
+        case SDLK_KP_MINUS:
+            if (speed > 0.0) replay_set_speed(replay, speed * 0.5);
+            return true;
+        case SDLK_0:
+            replay_set_speed(replay, speed > 0.0 ? REPLAY_MAX_SPEED : 1.0);
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void draw_replay_status(SDL_Renderer* renderer, const PlotConfig* config, const Replay* replay) {
+    double first, last, current;
+    replay_position(replay, &first, &last, &current);
+    char speed[16];
+    if (replay_speed(replay) > 0.0) {
+        snprintf(speed, sizeof(speed), "%gx", replay_speed(replay));
+    } else {
+        snprintf(speed, sizeof(speed), "max");
+    }
+    char text[128];
+    snprintf(text, sizeof(text), "Replay %s%s  %.6g / %.6g   [space] pause  [<-/->] seek  [+/-/0] speed",
+             speed, replay_paused(replay) ? " paused" : "", current, last);
+    stringRGBA(renderer, 10, config->window_height - 34, text, 200, 200, 120, 255);
+}
+
+// Interactive mode: plot the running simulation in an SDL window
+static int run_interactive(SimContext* context, int vvdc_control, HistoryStorage storage, MeasureEngine* measure) {
   //SDL2
     PlotConfig config = setup_config();
-    config.num_signals = 2;  // Initialize with default number of signals
-    double** buffers = init_buffers(&config);
-    
-    // Prepare callback data
+    config.storage = storage;
+    config.measure.engine = measure;
+
+    // The history is created once ngspice has announced its vectors; until
+    // then an empty channel stands in
     CallbackData cb_data = {
         .config = &config,
-        .buffers = buffers
+        .history = NULL,
+        .measure = measure,
+        .producer = calloc(1, sizeof(PlotChannel))
     };
-    
-    SDL_Window* window = init_sdl(&config);
-    if (!window) return 1;
+    cb_data.consumer = cb_data.producer;
+    SDL_Window* window = NULL;
+    SDL_Renderer* renderer = NULL;
+    AlterPipeline* alters = NULL;
+    int ret = 1;
+    if (!cb_data.producer) {
+        fprintf(stderr, "Error allocating sample queue\n");
+        goto done;
+    }
 
-    SDL_Renderer* renderer = create_renderer(window);
-    if (!renderer) return 1;
+    window = init_sdl(&config);
+    if (!window) goto done;
+
+    renderer = create_renderer(window);
+    if (!renderer) goto done;
 
     int quit = 0;
     SDL_Event e;
     int useInterpolation = 1;
 
-  //ngspice
+    // Samples wake the loop through an SDL user event; vsync, if the driver
+    // honours it, paces the frames in SDL_RenderPresent
+    Uint32 wake_event = SDL_RegisterEvents(1);
+    cb_data.wake_event = wake_event != (Uint32)-1 ? wake_event : 0;
+    uint64_t frame_interval_ns = renderer_has_vsync(renderer) ? 0 : FRAME_INTERVAL_NS;
+    int idle_wait_ms = cb_data.wake_event ? IDLE_WAIT_MS : (int)(FRAME_INTERVAL_NS / 1000000);
+    uint64_t next_frame_ns = 0;
+    bool dirty = true;
 
-    // Declare the simulation context
-    SimContext context;
-    g_context = &context;  // Set global pointer for signal handler
-    
-    // Set up signal handlers
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
-    context.simulation_finished = false;
-    context.current_progress = 0;
-    context.voltage_altered = false;
-    context.should_alter_voltage = false;
-    context.is_bg_running = false;
-    context.headers_written = false;
-    
-    // Open CSV file for writing
-    context.csv_file = fopen("simulation_data.csv", "w");
-    if (!context.csv_file) {
-        fprintf(stderr, "Error opening CSV file\n");
+    // Device values have no external source and need a halt/alter/resume
+    // cycle; the pipeline batches them into as few halt windows as possible.
+    // A replay has nothing to alter.
+    if (!context->replay) {
+        alters = alter_pipeline_start(context, ALTER_DEFAULT_COALESCE_MS);
+        if (!alters) {
+            fprintf(stderr, "Error starting alter pipeline\n");
+            goto done;
+        }
+    }
+
+    // Set up the callback
+    set_simulation_callback(context, handle_simulation_data, &cb_data);
+
+    // Run the simulation in background
+    if (start_simulation(context) != 0) {
+        fprintf(stderr, "Error starting simulation\n");
+        goto done;
+    }
+    ret = 0;
+
+    // A frame is drawn only when something changed: samples arrived, an
+    // event touched the UI, or the metrics overlay is due for a refresh.
+    // Otherwise the loop sleeps in SDL_WaitEventTimeout.
+    while (!quit) {
+        int timeout_ms = idle_wait_ms;
+        uint64_t now_ns = monotonic_ns();
+        if (dirty) {
+            timeout_ms = next_frame_ns > now_ns ? (int)((next_frame_ns - now_ns + 999999) / 1000000) : 0;
+        } else if (config.overlay.visible || config.measure.visible) {
+            timeout_ms = (int)(METRICS_OVERLAY_REFRESH_NS / 1000000);
+        }
+
+        int have_event = timeout_ms > 0 ? SDL_WaitEventTimeout(&e, timeout_ms) : SDL_PollEvent(&e);
+        while (have_event) {
+            if (cb_data.wake_event && e.type == cb_data.wake_event) {
+                dirty = true;
+            } else if (context->replay && handle_replay_event(context->replay, &e)) {
+                dirty = true;
+            } else if (handle_events(&e, &config, &quit, &useInterpolation)) {
+                dirty = true;
+            }
+            have_event = SDL_PollEvent(&e);
+        }
+        // Also catches samples whose wake-up event did not fit SDL's queue
+        if (atomic_load(&cb_data.wake_pending)) dirty = true;
+        if (g_shutdown_signal) quit = 1;
+        now_ns = monotonic_ns();
+        if (config.overlay.visible && now_ns - config.overlay.last_ns >= METRICS_OVERLAY_REFRESH_NS) {
+            dirty = true;
+        }
+        if (config.measure.visible && now_ns - config.measure.last_ns >= METRICS_OVERLAY_REFRESH_NS) {
+            dirty = true;
+        }
+
+        // A recording cannot be changed, the sliders have nothing to drive
+        if (context->replay) {
+            config.amplitude_slider.value_changed = false;
+            config.resistance_slider.value_changed = false;
+            config.capacitance_slider.value_changed = false;
+        }
+
+        // The slider drives the external source Vvdc, which ngspice reads
+        // on every timestep: no halt/alter/resume cycle is needed
+        if (config.amplitude_slider.value_changed) {
+            live_control_set(context->live_controls, vvdc_control, config.amplitude_slider.value);
+            config.amplitude_slider.value_changed = false;
+        }
+        if (config.resistance_slider.value_changed) {
+            alter_pipeline_post(alters, ALTER_DEVICE, "Rres1", NULL, config.resistance_slider.value);
+            config.resistance_slider.value_changed = false;
+        }
+        if (config.capacitance_slider.value_changed) {
+            alter_pipeline_post(alters, ALTER_DEVICE, "Ccap1", NULL, config.capacitance_slider.value);
+            config.capacitance_slider.value_changed = false;
+        }
+
+        if (quit || !dirty || now_ns < next_frame_ns) continue;
+        dirty = false;
+        next_frame_ns = now_ns + frame_interval_ns;
+
+        // Apply everything the simulator produced since the last frame.
+        // Clearing the flag first means a sample pushed during the drain
+        // posts a new wake-up instead of being left for the idle timeout.
+        uint64_t frame_start_ns = now_ns;
+        cb_data.drain_ns = frame_start_ns;
+        atomic_store(&cb_data.wake_pending, false);
+        if (!drain_plot_channels(&cb_data)) {
+            quit = 1;
+        }
+
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        SDL_RenderClear(renderer);
+
+        if (config.view.log_scale) {
+            draw_bode_view(renderer, &config, useInterpolation);
+        } else if (config.view.active) {
+            draw_waveform_view(renderer, &config, useInterpolation);
+        } else {
+            draw_plot(renderer, cb_data.history, &config, useInterpolation);
+        }
+        draw_slider(renderer, &config.amplitude_slider);
+        draw_slider(renderer, &config.resistance_slider);
+        draw_slider(renderer, &config.capacitance_slider);
+        draw_metrics_overlay(renderer, &config);
+        draw_measure_panel(renderer, &config);
+        if (context->replay) {
+            draw_replay_status(renderer, &config, context->replay);
+        }
+
+
+        SDL_RenderPresent(renderer);
+        metrics_add(METRIC_FRAMES, 1);
+        metrics_record(METRIC_FRAME, monotonic_ns() - frame_start_ns);
+    }
+
+done:
+    // No alter may race with the final bg_halt in cleanup_simulation
+    AlterStats alter_stats = {0};
+    alter_pipeline_stop(alters, &alter_stats);
+    cleanup_simulation(context);
+
+    if (alter_stats.edits_posted > 0) {
+        printf("Alter pipeline: %llu edits posted, %llu applied in %llu batches (%llu halts)\n",
+               alter_stats.edits_posted, alter_stats.edits_applied,
+               alter_stats.windows, alter_stats.halts);
+        if (alter_stats.halts > 0) {
+            printf("Halt to resume: last %.2f ms, mean %.2f ms, max %.2f ms; edit to apply max %.2f ms\n",
+                   alter_stats.last_halt_ns * 1e-6,
+                   alter_stats.total_halt_ns * 1e-6 / alter_stats.halts,
+                   alter_stats.max_halt_ns * 1e-6,
+                   alter_stats.max_edit_delay_ns * 1e-6);
+        }
+    }
+
+    // The simulation thread is stopped; the last channel is the current one
+    PlotChannel* channel = cb_data.consumer;
+    while (channel && atomic_load(&channel->next)) {
+        PlotChannel* next = atomic_load(&channel->next);
+        destroy_plot_channel(channel);
+        channel = next;
+    }
+    if (channel && channel->queue) {
+        printf("Sample queue: %llu frames queued, %llu dropped, %zu pending\n",
+               (unsigned long long)sample_queue_pushed(channel->queue),
+               (unsigned long long)sample_queue_dropped(channel->queue),
+               sample_queue_depth(channel->queue));
+    }
+    destroy_plot_channel(channel);
+
+    if (cb_data.store) {
+        printf("Waveform store: %lld samples, %.1f MiB in memory, %.1f MiB spilled\n",
+               waveform_store_count(cb_data.store),
+               waveform_store_ram_bytes(cb_data.store) / (1024.0 * 1024.0),
+               waveform_store_spilled_bytes(cb_data.store) / (1024.0 * 1024.0));
+        waveform_store_destroy(cb_data.store);
+    }
+    cleanup(renderer, window, cb_data.history, &config);
+    return ret;
+}
+
+// Headless mode: no SDL and no plot buffers, only the CSV and result file
+// outputs and the measurements. Sleeps until ngspice reports --ready--
+// instead of polling.
+static int run_headless(SimContext* context, MeasureEngine* measure) {
+    uint64_t start_ns = monotonic_ns();
+    if (measure) set_simulation_callback(context, handle_measure_data, measure);
+
+    int ret = start_simulation(context);
+    if (ret != 0) {
+        fprintf(stderr, "Error starting simulation\n");
+        cleanup_simulation(context);
         return 1;
     }
 
+    wait_for_simulation(context);
+
+    double elapsed = (double)(monotonic_ns() - start_ns) * 1e-9;
+    unsigned long long samples = context->samples;
+    cleanup_simulation(context);
+
+    printf("Simulation finished: %llu samples in %.3f s (%.0f samples/s)\n",
+           samples, elapsed, elapsed > 0.0 ? (double)samples / elapsed : 0.0);
+
+    MetricSummary ng_data;
+    char p50[16], p99[16], max[16];
+    metrics_summarize(METRIC_NG_DATA, &ng_data);
+    metrics_format_ns(p50, sizeof(p50), ng_data.p50);
+    metrics_format_ns(p99, sizeof(p99), ng_data.p99);
+    metrics_format_ns(max, sizeof(max), ng_data.max);
+    printf("ng_data: p50 %s, p99 %s, max %s\n", p50, p99, max);
+    return 0;
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr, "Usage: %s [--headless] [--float32] [--metrics FILE] [--shm NAME] [--subscribe FILE] [--measure GLOBS]\n", program);
+    fprintf(stderr, "          [--analysis LINE]\n");
+    fprintf(stderr, "       %s [--replay FILE [--speed X]]\n", program);
+    fprintf(stderr, "       %s --sweep TEMPLATE --param NAME=VALUES [--param ...] [--jobs N] [--out DIR]\n", program);
+    fprintf(stderr, "  --headless  Run without a window and report throughput at the end\n");
+    fprintf(stderr, "  --float32   Keep the plot history in single precision (half the memory)\n");
+    fprintf(stderr, "  --metrics   Append counters and latency percentiles to FILE every second (JSON lines)\n");
+    fprintf(stderr, "  --shm       Publish every sample to the shared-memory ring /NAME (see shm_ring.h)\n");
+    fprintf(stderr, "  --subscribe Record, plot, drop and decimate vectors as FILE says (see subscription.h)\n");
+    fprintf(stderr, "  --measure   Statistics, step response and spectrum of the plotted vectors matching\n");
+    fprintf(stderr, "              GLOBS (comma-separated, * for all), live with 'a' and at exit\n");
+    fprintf(stderr, "  --analysis  Run LINE instead of the transient, e.g. \".ac dec 20 1m 1k\" or\n");
+    fprintf(stderr, "              \".noise v(k) Vvdc dec 20 1m 1k\"; sweeps are plotted as a Bode view\n");
+    fprintf(stderr, "  --replay    Play a binary rawfile or .ngres file instead of running ngspice\n");
+    fprintf(stderr, "  --speed     Replay speed relative to simulated time, or max (default: 1)\n");
+    fprintf(stderr, "  --sweep     Run TEMPLATE once per parameter combination, {NAME} is substituted\n");
+    fprintf(stderr, "  --param     NAME=v1,v2,... or NAME=start:stop:count\n");
+    fprintf(stderr, "  --jobs      Worker processes (default: one per CPU)\n");
+    fprintf(stderr, "  --out       Output directory (default: sweep_results)\n");
+}
+
+// Start ngspice with our callbacks and load the TB8 circuit. analysis
+// replaces its .tran line, NULL keeps it.
+static int load_circuit(SimContext* context, LiveControls* controls, int* vvdc_control, const char* analysis) {
+    // Live values for the netlist's external sources
+    *vvdc_control = live_control_bind(controls, "Vvdc", 1.0);
+    context->live_controls = controls;
 
     // Initialize ngspice
     int ret = ngSpice_Init(ng_getchar, ng_getstat, ng_exit,
-                          ng_data, ng_initdata, ng_bgrunning, &context);
-
-    // Set up the callback
-    set_simulation_callback(&context, handle_simulation_data, &cb_data);
+                          ng_data, ng_initdata, ng_bgrunning, context);
 
     if (ret != 0) {
         fprintf(stderr, "Error initializing ngspice\n");
-        return 1;
+        return -1;
+    }
+
+    // Register the source callbacks; ngspice keeps a single user data
+    // pointer, so this must be the same context as above
+    int ident = 0;
+    ret = ngSpice_Init_Sync(ng_getvsrc, ng_getisrc, NULL, &ident, context);
+    if (ret != 0) {
+        fprintf(stderr, "Error initializing ngspice source callbacks\n");
+        return -1;
     }
 
     // Create the circuit
     const char* circuit[] = {
         ".title TB8",
-        "Vvdc y 0 1.0V",
+        "Vvdc y 0 dc 1.0 external",
         "Ccap1 0 k 1.0 ic=0",
         "Rres1 k y 1.0Ohm",
         ".options TEMP = 25C",
         ".options TNOM = 25C",
         ".tran 0.0001s 120s 0s uic",
+        NULL,               // .save for the subscribed vectors
         ".end",
         NULL
     };
 
+    // Small-signal analyses drive the circuit through Vvdc's AC magnitude;
+    // the slider has nothing to do in them
+    if (analysis) {
+        circuit[1] = "Vvdc y 0 dc 1.0 ac 1";
+        circuit[6] = analysis;
+        DEBUG_PRINT(DEBUG_INFO, "Analysis: %s", analysis);
+    }
+
+    // Without .save ngspice computes and sends every vector; a subscription
+    // naming its vectors explicitly lets it keep only those
+    char save[1024];
+    int save_line = sizeof(circuit) / sizeof(circuit[0]) - 3;
+    if (subscription_save_directive(context->subscription, save, sizeof(save))) {
+        circuit[save_line] = save;
+        DEBUG_PRINT(DEBUG_INFO, "Injected %s", save);
+    } else {
+        circuit[save_line] = circuit[save_line + 1];
+        circuit[save_line + 1] = NULL;
+    }
+
     // Load the circuit
     ret = ngSpice_Circ((char**)circuit);
     if (ret != 0) {
         fprintf(stderr, "Error loading circuit\n");
-        return 1;
+        return -1;
     }
 
     printf("Circuit loaded successfully. Starting simulation...\n\n");
     fflush(stdout); // Ensure output is visible
+    return 0;
+}
 
-    // Run the simulation in background
-    ret = ngSpice_Command("bg_run");
-    if (ret != 0) {
-        fprintf(stderr, "Error starting simulation\n");
+int main(int argc, char* argv[]) {
+    bool headless = false;
+    HistoryStorage storage = HISTORY_FLOAT64;
+    const char* metrics_path = NULL;
+    const char* shm_name = NULL;
+    const char* replay_path = NULL;
+    const char* subscription_path = NULL;
+    const char* measure_patterns = NULL;
+    const char* analysis = NULL;
+    double speed = 1.0;
+    SweepOptions sweep = { .output_dir = "sweep_results" };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--float32") == 0) {
+            storage = HISTORY_FLOAT32;
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metrics_path = argv[++i];
+        } else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+            shm_name = argv[++i];
+        } else if (strcmp(argv[i], "--subscribe") == 0 && i + 1 < argc) {
+            subscription_path = argv[++i];
+        } else if (strcmp(argv[i], "--measure") == 0 && i + 1 < argc) {
+            measure_patterns = argv[++i];
+        } else if (strcmp(argv[i], "--analysis") == 0 && i + 1 < argc && argv[i + 1][0] == '.') {
+            analysis = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            i++;
+            speed = strcmp(argv[i], "max") == 0 ? REPLAY_MAX_SPEED : atof(argv[i]);
+        } else if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc) {
+            sweep.template_path = argv[++i];
+        } else if (strcmp(argv[i], "--param") == 0 && i + 1 < argc) {
+            if (sweep_add_param(&sweep, argv[++i]) != 0) {
+                fprintf(stderr, "Invalid parameter: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            sweep.jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            sweep.output_dir = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Sweeps fork their own ngspice workers, the parent never loads a circuit
+    if (sweep.template_path) {
+        int ret = run_sweep(&sweep);
+        sweep_free_params(&sweep);
+        return ret;
+    }
+
+  //ngspice
+
+    // ngspice output and DEBUG_PRINT records are formatted by a background
+    // thread from here on
+    if (log_start(stdout) != 0) {
+        fprintf(stderr, "Error starting logger\n");
         return 1;
     }
+    // Error returns below still write what is queued, often the reason for
+    // the error; the explicit log_stop at the end makes this a no-op
+    atexit(log_stop);
+
+    // Declare the simulation context
+    SimContext context;
+    init_simulation_context(&context);
+    int ret = 1;
+    MeasureEngine* measure = NULL;
 
- 
+    // Which vectors are recorded and plotted, and how densely
+    Subscription subscription = {0};
+    if (subscription_path) {
+        if (subscription_load(&subscription, subscription_path) != 0) {
+            goto fail;
+        }
+        context.subscription = &subscription;
+    }
 
-    while (!quit) {
+    // Ctrl-C and SIGTERM end the run through the normal shutdown below
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    
+    // A recording stands in for ngspice. It writes no files, so replaying
+    // simulation_data.ngres does not overwrite it.
+    if (replay_path) {
+        context.replay = replay_open(replay_path);
+        if (!context.replay) {
+            fprintf(stderr, "Error opening recording %s\n", replay_path);
+            goto fail;
+        }
+        replay_set_speed(context.replay, speed);
+    } else {
+        // Open CSV file for writing; rows are batched and written by an I/O thread
+        AsyncWriterPolicy csv_policy = async_writer_default_policy();
+        context.csv_file = async_writer_open("simulation_data.csv", &csv_policy);
+        if (!context.csv_file) {
+            fprintf(stderr, "Error opening CSV file\n");
+            goto fail;
+        }
 
-        // Check if slider value changed
-        if (config.amplitude_slider.value_changed && context.is_bg_running) {
-            printf("Halting simulation to alter voltage...\n");
-            ngSpice_Command("bg_halt");
-            
-            // Wait for simulation to actually halt
-            while (context.is_bg_running) {
-                usleep(10000);
-            }
-            
-            char alter_cmd[64];
-            snprintf(alter_cmd, sizeof(alter_cmd), "alter Vvdc=%f", config.amplitude_slider.value);
-            printf("Simulation halted, altering voltage to %f...\n", config.amplitude_slider.value);
-            ngSpice_Command(alter_cmd);
-            
-            printf("Resuming simulation...\n");
-            ngSpice_Command("bg_resume");
-            
-            config.amplitude_slider.value_changed = false;
+        // Lossless compressed binary copy of the same data, see result_file.h
+        context.result_file = result_writer_open("simulation_data.ngres", &csv_policy, RESULT_DEFAULT_CHUNK_ROWS,
+                                                 RESULT_FLAG_COMPRESSED);
+        if (!context.result_file) {
+            fprintf(stderr, "Error opening result file\n");
+            goto fail;
         }
+    }
 
-        while (SDL_PollEvent(&e) != 0) {
-            handle_events(&e, &config, &quit, &useInterpolation);
+    // Live copy for other processes; they attach and detach as they like
+    if (shm_name) {
+        context.shm_ring = shm_ring_create(shm_name, SHM_RING_DEFAULT_BYTES);
+        if (!context.shm_ring) {
+            fprintf(stderr, "Error creating shared-memory ring %s\n", shm_name);
+            goto fail;
         }
+    }
 
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-        SDL_RenderClear(renderer);
+    // ngspice and the circuit; a replay needs neither
+    LiveControls controls = {0};
+    int vvdc_control = -1;
+    if (!context.replay && load_circuit(&context, &controls, &vvdc_control, analysis) != 0) {
+        goto fail;
+    }
 
-        draw_signals(renderer, buffers, &config, useInterpolation);
-        draw_grid(renderer, &config);
-        draw_slider(renderer, &config.amplitude_slider);
-        
-        //SignalValues new_values = get_new_values(t, &config);
-        //t += config.time_increment;
+    // Online analysis of the plotted vectors instead of a post-run pass
+    if (measure_patterns) {
+        measure = measure_create(measure_patterns);
+        if (!measure) {
+            fprintf(stderr, "Error creating measurements\n");
+            goto fail;
+        }
+    }
 
-        SDL_RenderPresent(renderer);
-        SDL_Delay(16); // Cap at roughly 60 FPS
+    if (metrics_path && metrics_dump_start(metrics_path, 1000) != 0) {
+        fprintf(stderr, "Error opening metrics file %s\n", metrics_path);
+        goto fail;
     }
+    ret = headless ? run_headless(&context, measure)
+                   : run_interactive(&context, vvdc_control, storage, measure);
+    metrics_dump_stop();
+    // The simulation thread has stopped
+    measure_finish(measure);
+    measure_print_summary(measure, stdout);
+    goto done;
 
+fail:
+    // Both run functions stop the simulation and close the outputs
     cleanup_simulation(&context);
-    cleanup(renderer, window, buffers, &config);
-    return 0;
+done:
+    measure_destroy(measure);
+    replay_close(context.replay);
+    context.replay = NULL;
+    subscription_free(&subscription);
+    log_stop();
+    if (log_dropped() > 0) {
+        fprintf(stderr, "Logger dropped %llu records\n", log_dropped());
+    }
+
+    // Everything is written; let the signal end the process as it would have
+    if (g_shutdown_signal) raise(g_shutdown_signal);
+    return ret;
 }
@@ -0,0 +1,654 @@
+#include "measure.h"
+#include <ctype.h>
+#include <fnmatch.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Transitions are checked for having settled every this many samples
+#define MEASURE_SETTLE_CHECK 256
+
+// Envelope of a run of consecutive samples
+typedef struct {
+    double t_first;
+    double t_last;
+    double v_first;
+    double v_last;
+    double v_min;
+    double v_max;
+} StepBucket;
+
+typedef struct {
+    int signal;
+    int value;                 // Index into signal_values
+    bool is_complex;           // Measured as its magnitude
+    bool time_domain;          // Step response and spectrum apply, not over a frequency or sweep scale
+    char name[MEASURE_NAME_MAX];
+    long long samples;
+    double t_first;
+    double t_prev;             // Latest sample
+    double v_prev;
+    double min;
+    double max;
+    double integral;           // Integral of v dt
+    double integral_sq;        // Integral of v^2 dt
+
+    bool open;                 // A transition is in progress
+    double anchor;             // Settled value while none is
+    double step_start;
+    double step_from;
+    StepBucket* buckets;
+    int num_buckets;
+    long long bucket_samples;  // Samples per bucket, doubles when they are merged
+    long long in_bucket;       // Samples in the last bucket
+    long long transition_samples;
+    bool departed;             // The transition has left the band around step_from
+    int returns;               // Times the signal came back into it since the last step
+    int steps;
+    bool have_last;            // Last settled step
+    double last_start;
+    double last_from;
+    double last_to;
+    double last_rise;
+    double last_settle;
+
+    double* step_sizes;        // First MEASURE_FFT_SIZE time steps, for the grid
+    int num_step_sizes;
+    double fft_dt;
+    double grid_origin;
+    long long grid_index;      // Next grid point is grid_origin + grid_index * fft_dt
+    double* ring;              // Last MEASURE_FFT_SIZE grid values
+    long long grid_count;      // Grid values written to the ring
+    int since_fft;
+    int peak;                  // Bin of the peak
+    bool spectrum_valid;
+    double peak_frequency;
+    double peak_amplitude;
+    float spectrum[MEASURE_FFT_SIZE / 2];
+} SignalMeasure;
+
+struct MeasureEngine {
+    char** patterns;
+    int num_patterns;
+    bool have_layout;
+    unsigned layout_version;
+    ScaleKind scale;
+    SignalMeasure* signals;
+    int num_signals;
+    long long since_publish;
+
+    double window[MEASURE_FFT_SIZE];        // Hann
+    double window_sum;
+    double cos_table[MEASURE_FFT_SIZE / 2];
+    double sin_table[MEASURE_FFT_SIZE / 2];
+    int bit_reverse[MEASURE_FFT_SIZE];
+    double re[MEASURE_FFT_SIZE];
+    double im[MEASURE_FFT_SIZE];
+
+    pthread_mutex_t lock;      // Guards the results below
+    MeasureResult* published;  // Current layout, one per signal
+    int num_published;
+    MeasureResult* finished;   // Earlier layouts
+    int num_finished;
+    int finished_capacity;
+};
+
+MeasureEngine* measure_create(const char* patterns) {
+    MeasureEngine* engine = calloc(1, sizeof(MeasureEngine));
+    if (!engine) return NULL;
+    pthread_mutex_init(&engine->lock, NULL);
+
+    // Comma-separated globs, lowered like ngspice's names
+    if (patterns && *patterns) {
+        char* copy = strdup(patterns);
+        if (!copy) {
+            measure_destroy(engine);
+            return NULL;
+        }
+        char* save = NULL;
+        for (char* token = strtok_r(copy, ", \t", &save); token; token = strtok_r(NULL, ", \t", &save)) {
+            char** grown = realloc(engine->patterns, (engine->num_patterns + 1) * sizeof(char*));
+            char* pattern = grown ? strdup(token) : NULL;
+            if (grown) engine->patterns = grown;
+            if (!pattern) {
+                free(copy);
+                measure_destroy(engine);
+                return NULL;
+            }
+            for (char* c = pattern; *c; c++) *c = (char)tolower((unsigned char)*c);
+            engine->patterns[engine->num_patterns++] = pattern;
+        }
+        free(copy);
+    }
+
+    int bits = 0;
+    while ((1 << bits) < MEASURE_FFT_SIZE) bits++;
+    for (int i = 0; i < MEASURE_FFT_SIZE; i++) {
+        engine->window[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / MEASURE_FFT_SIZE);
+        engine->window_sum += engine->window[i];
+        int reversed = 0;
+        for (int b = 0; b < bits; b++) {
+            if (i & (1 << b)) reversed |= 1 << (bits - 1 - b);
+        }
+        engine->bit_reverse[i] = reversed;
+    }
+    for (int i = 0; i < MEASURE_FFT_SIZE / 2; i++) {
+        engine->cos_table[i] = cos(2.0 * M_PI * i / MEASURE_FFT_SIZE);
+        engine->sin_table[i] = sin(2.0 * M_PI * i / MEASURE_FFT_SIZE);
+    }
+    return engine;
+}
+
+static void free_signals(MeasureEngine* engine) {
+    for (int i = 0; i < engine->num_signals; i++) {
+        free(engine->signals[i].buckets);
+        free(engine->signals[i].step_sizes);
+        free(engine->signals[i].ring);
+    }
+    free(engine->signals);
+    engine->signals = NULL;
+    engine->num_signals = 0;
+}
+
+void measure_destroy(MeasureEngine* engine) {
+    if (!engine) return;
+    free_signals(engine);
+    for (int i = 0; i < engine->num_patterns; i++) {
+        free(engine->patterns[i]);
+    }
+    free(engine->patterns);
+    free(engine->published);
+    free(engine->finished);
+    pthread_mutex_destroy(&engine->lock);
+    free(engine);
+}
+
+static bool is_selected(const MeasureEngine* engine, const char* name) {
+    if (engine->num_patterns == 0) return true;
+    for (int i = 0; i < engine->num_patterns; i++) {
+        if (fnmatch(engine->patterns[i], name, 0) == 0) return true;
+    }
+    return false;
+}
+
+// Time at which the line from (t0, y0) to (t1, y1) reaches level
+static double interpolate(double t0, double y0, double t1, double y1, double level) {
+    if (y1 == y0) return t1;
+    double f = (level - y0) / (y1 - y0);
+    if (f < 0.0) f = 0.0;
+    if (f > 1.0) f = 1.0;
+    return t0 + f * (t1 - t0);
+}
+
+// First time the transition reaches level; exact while buckets hold single
+// samples, else to within a bucket
+static double crossing_time(const SignalMeasure* m, double level, bool rising) {
+    for (int b = 0; b < m->num_buckets; b++) {
+        const StepBucket* bucket = &m->buckets[b];
+        if (rising ? bucket->v_max < level : bucket->v_min > level) continue;
+        bool at_first = rising ? bucket->v_first >= level : bucket->v_first <= level;
+        if (b > 0 && at_first) {
+            const StepBucket* prev = &m->buckets[b - 1];
+            return interpolate(prev->t_last, prev->v_last, bucket->t_first, bucket->v_first, level);
+        }
+        return at_first ? bucket->t_first : 0.5 * (bucket->t_first + bucket->t_last);
+    }
+    return NAN;
+}
+
+// Rise and settling time of the open transition against final.
+// Returns false if it moved less than the departure band.
+static bool evaluate_step(const SignalMeasure* m, double final, double* rise, double* settle) {
+    double step = final - m->step_from;
+    if (fabs(step) <= MEASURE_SETTLE_BAND * (m->max - m->min) || step == 0.0) return false;
+
+    bool rising = step > 0.0;
+    double t10 = crossing_time(m, m->step_from + 0.1 * step, rising);
+    double t90 = crossing_time(m, m->step_from + 0.9 * step, rising);
+    *rise = t90 - t10;
+
+    // The last bucket outside the band, then where the signal enters it
+    double band = MEASURE_SETTLE_BAND * fabs(step);
+    *settle = 0.0;
+    for (int b = m->num_buckets - 1; b >= 0; b--) {
+        const StepBucket* bucket = &m->buckets[b];
+        if (bucket->v_min >= final - band && bucket->v_max <= final + band) continue;
+        double t = bucket->t_last;
+        double deviation = fabs(bucket->v_last - final);
+        if (deviation > band && b + 1 < m->num_buckets) {
+            const StepBucket* next = &m->buckets[b + 1];
+            t = interpolate(t, deviation, next->t_first, fabs(next->v_first - final), band);
+        }
+        *settle = t - m->step_start;
+        break;
+    }
+    return true;
+}
+
+static void push_bucket(SignalMeasure* m, double time, double value) {
+    if (m->num_buckets > 0 && m->in_bucket < m->bucket_samples) {
+        StepBucket* bucket = &m->buckets[m->num_buckets - 1];
+        bucket->t_last = time;
+        bucket->v_last = value;
+        if (value < bucket->v_min) bucket->v_min = value;
+        if (value > bucket->v_max) bucket->v_max = value;
+        m->in_bucket++;
+        return;
+    }
+
+    // Full: halve the resolution, every merged bucket is complete
+    if (m->num_buckets == MEASURE_STEP_BUCKETS) {
+        for (int i = 0; i < MEASURE_STEP_BUCKETS / 2; i++) {
+            StepBucket a = m->buckets[2 * i];
+            const StepBucket* b = &m->buckets[2 * i + 1];
+            a.t_last = b->t_last;
+            a.v_last = b->v_last;
+            if (b->v_min < a.v_min) a.v_min = b->v_min;
+            if (b->v_max > a.v_max) a.v_max = b->v_max;
+            m->buckets[i] = a;
+        }
+        m->num_buckets = MEASURE_STEP_BUCKETS / 2;
+        m->bucket_samples *= 2;
+    }
+    m->buckets[m->num_buckets++] = (StepBucket){time, time, value, value, value, value};
+    m->in_bucket = 1;
+}
+
+static void open_transition(SignalMeasure* m, double time, double from) {
+    m->open = true;
+    m->step_start = time;
+    m->step_from = from;
+    m->num_buckets = 0;
+    m->bucket_samples = 1;
+    m->in_bucket = 0;
+    m->transition_samples = 0;
+    m->departed = false;
+    push_bucket(m, time, from);
+}
+
+// Close the transition once the signal has stayed in the band at least as
+// long as it took to get there; a transition without a step just ends
+static void check_settled(SignalMeasure* m) {
+    double rise, settle;
+    double final = m->v_prev;
+    if (!evaluate_step(m, final, &rise, &settle)) {
+        m->open = false;
+        m->anchor = final;
+        return;
+    }
+    double in_band = m->t_prev - (m->step_start + settle);
+    if (isnan(rise) || in_band <= 0.0 || in_band < settle) return;
+
+    m->open = false;
+    m->anchor = final;
+    m->returns = 0;
+    m->steps++;
+    m->have_last = true;
+    m->last_start = m->step_start;
+    m->last_from = m->step_from;
+    m->last_to = final;
+    m->last_rise = rise;
+    m->last_settle = settle;
+}
+
+static void run_fft(MeasureEngine* engine, SignalMeasure* m) {
+    const int n = MEASURE_FFT_SIZE;
+    double mean = 0.0;
+    for (int i = 0; i < n; i++) {
+        mean += m->ring[i];
+    }
+    mean /= n;
+
+    // Oldest grid value first; the mean is removed so DC does not leak
+    // into the low bins through the window
+    long long oldest = m->grid_count;
+    for (int i = 0; i < n; i++) {
+        int j = engine->bit_reverse[i];
+        engine->re[j] = (m->ring[(oldest + i) % n] - mean) * engine->window[i];
+        engine->im[j] = 0.0;
+    }
+    for (int size = 2; size <= n; size <<= 1) {
+        int half = size / 2;
+        int stride = n / size;
+        for (int start = 0; start < n; start += size) {
+            for (int k = 0; k < half; k++) {
+                double wr = engine->cos_table[k * stride];
+                double wi = -engine->sin_table[k * stride];
+                int a = start + k;
+                int b = a + half;
+                double tr = wr * engine->re[b] - wi * engine->im[b];
+                double ti = wr * engine->im[b] + wi * engine->re[b];
+                engine->re[b] = engine->re[a] - tr;
+                engine->im[b] = engine->im[a] - ti;
+                engine->re[a] += tr;
+                engine->im[a] += ti;
+            }
+        }
+    }
+
+    // Amplitudes of sines, DC as is
+    double scale = 2.0 / engine->window_sum;
+    m->spectrum[0] = (float)fabs(mean);
+    m->peak_amplitude = 0.0;
+    m->peak_frequency = 0.0;
+    m->peak = 0;
+    for (int k = 1; k < n / 2; k++) {
+        double amplitude = scale * hypot(engine->re[k], engine->im[k]);
+        m->spectrum[k] = (float)amplitude;
+        if (amplitude > m->peak_amplitude) {
+            m->peak_amplitude = amplitude;
+            m->peak = k;
+            m->peak_frequency = k / (n * m->fft_dt);
+        }
+    }
+    // A peak in the lowest bin is a trend or a period longer than the
+    // window, not a frequency
+    m->spectrum_valid = m->peak > 1;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Halve the grid resolution: every second grid value is kept, ending with
+// the newest, and the grid continues from it at twice the step
+static void coarsen_grid(SignalMeasure* m) {
+    const int n = MEASURE_FFT_SIZE;
+    long long count = m->grid_count < n ? m->grid_count : n;
+    long long oldest = m->grid_count - count;
+    int kept = 0;
+    for (long long i = (count - 1) % 2; i < count; i += 2) {
+        m->ring[kept++] = m->ring[(oldest + i) % n];
+    }
+    m->grid_count = kept;
+    m->since_fft = 0;
+    if (m->grid_index > 0) {
+        m->grid_origin += (double)(m->grid_index - 1) * m->fft_dt;
+        m->grid_index = 1;
+    }
+    m->fft_dt *= 2.0;
+}
+
+// Resample the line from the previous sample to (time, value) onto the grid
+static void push_spectrum(MeasureEngine* engine, SignalMeasure* m, double time, double value) {
+    double dt = time - m->t_prev;
+    if (m->fft_dt == 0.0) {
+        m->step_sizes[m->num_step_sizes++] = dt;
+        if (m->num_step_sizes < MEASURE_FFT_SIZE) return;
+        qsort(m->step_sizes, MEASURE_FFT_SIZE, sizeof(double), compare_doubles);
+        m->fft_dt = m->step_sizes[MEASURE_FFT_SIZE / 2];
+        m->grid_origin = time;
+        m->grid_index = 0;
+    }
+
+    // The window covers at least a quarter of the run, so a grid taken from
+    // short start-up steps coarsens as the run grows
+    while (time - m->t_first > 4.0 * MEASURE_FFT_SIZE * m->fft_dt) coarsen_grid(m);
+
+    // Across a long step only the last window of grid points matters
+    double behind = (time - m->grid_origin) / m->fft_dt - (double)m->grid_index;
+    if (behind > MEASURE_FFT_SIZE) {
+        m->grid_index += (long long)behind - (MEASURE_FFT_SIZE - 1);
+    }
+    for (;;) {
+        double grid_time = m->grid_origin + (double)m->grid_index * m->fft_dt;
+        if (grid_time > time) break;
+        double v = m->v_prev + (value - m->v_prev) * (grid_time - m->t_prev) / dt;
+        m->ring[m->grid_count % MEASURE_FFT_SIZE] = v;
+        m->grid_count++;
+        m->grid_index++;
+        if (++m->since_fft >= MEASURE_FFT_SIZE / 2 && m->grid_count >= MEASURE_FFT_SIZE) {
+            run_fft(engine, m);
+            m->since_fft = 0;
+        }
+    }
+}
+
+static void push_sample(MeasureEngine* engine, SignalMeasure* m, double time, double value) {
+    if (m->samples == 0) {
+        m->t_first = time;
+        m->min = m->max = value;
+        m->samples = 1;
+        m->t_prev = time;
+        m->v_prev = value;
+        // The run starts with a transition from its first value
+        if (m->time_domain) open_transition(m, time, value);
+        return;
+    }
+
+    // Repeated or out-of-order times carry no duration
+    double dt = time - m->t_prev;
+    if (dt > 0.0) {
+        // Both integrals are exact for a straight line between the samples
+        m->integral += 0.5 * (m->v_prev + value) * dt;
+        m->integral_sq += dt * (m->v_prev * m->v_prev + m->v_prev * value + value * value) / 3.0;
+        if (m->time_domain) push_spectrum(engine, m, time, value);
+    }
+    if (value < m->min) m->min = value;
+    if (value > m->max) m->max = value;
+
+    if (m->time_domain && !m->open && fabs(value - m->anchor) > MEASURE_SETTLE_BAND * (m->max - m->min)) {
+        open_transition(m, m->t_prev, m->anchor);
+    }
+    m->samples++;
+    if (dt > 0.0) m->t_prev = time;
+    m->v_prev = value;
+    if (m->open) {
+        // Back in the band it left: no step so far, it starts over from here
+        if (fabs(value - m->step_from) > MEASURE_SETTLE_BAND * (m->max - m->min)) {
+            m->departed = true;
+        } else if (m->departed) {
+            m->returns++;
+            open_transition(m, m->t_prev, m->step_from);
+        }
+        push_bucket(m, m->t_prev, value);
+        if (++m->transition_samples % MEASURE_SETTLE_CHECK == 0) check_settled(m);
+    }
+}
+
+static void fill_result(const MeasureEngine* engine, const SignalMeasure* m, MeasureResult* r) {
+    memset(r, 0, sizeof(MeasureResult));
+    snprintf(r->name, sizeof(r->name), "%s", m->name);
+    r->signal = m->signal;
+    r->layout_version = engine->layout_version;
+    r->scale = engine->scale;
+    r->samples = m->samples;
+    r->t_first = m->t_first;
+    r->t_last = m->t_prev;
+    r->min = m->min;
+    r->max = m->max;
+    double span = m->t_prev - m->t_first;
+    r->mean = span > 0.0 ? m->integral / span : m->v_prev;
+    r->rms = span > 0.0 ? sqrt(m->integral_sq / span) : fabs(m->v_prev);
+    r->steps = m->steps;
+
+    // A signal that keeps returning into its band oscillates, it is not in
+    // the middle of a step
+    double rise, settle;
+    if (m->open && m->returns < 2 && m->samples > 1 && evaluate_step(m, m->v_prev, &rise, &settle)) {
+        r->step_valid = true;
+        r->step_settled = false;
+        r->step_start = m->step_start;
+        r->step_from = m->step_from;
+        r->step_to = m->v_prev;
+        r->rise_time = rise;
+        r->settling_time = settle;
+    } else if (m->have_last) {
+        r->step_valid = true;
+        r->step_settled = true;
+        r->step_start = m->last_start;
+        r->step_from = m->last_from;
+        r->step_to = m->last_to;
+        r->rise_time = m->last_rise;
+        r->settling_time = m->last_settle;
+    }
+
+    r->fft_dt = m->fft_dt;
+    r->spectrum_valid = m->spectrum_valid;
+    r->peak_frequency = m->peak_frequency;
+    r->peak_amplitude = m->peak_amplitude;
+    memcpy(r->spectrum, m->spectrum, sizeof(r->spectrum));
+}
+
+static void publish(MeasureEngine* engine) {
+    pthread_mutex_lock(&engine->lock);
+    for (int i = 0; i < engine->num_signals && i < engine->num_published; i++) {
+        fill_result(engine, &engine->signals[i], &engine->published[i]);
+    }
+    pthread_mutex_unlock(&engine->lock);
+    engine->since_publish = 0;
+}
+
+// Keep the results of the ending layout for the summary
+static void retire_layout(MeasureEngine* engine) {
+    publish(engine);
+    pthread_mutex_lock(&engine->lock);
+    int needed = engine->num_finished + engine->num_published;
+    if (needed > engine->finished_capacity) {
+        int capacity = engine->finished_capacity ? engine->finished_capacity : 16;
+        while (capacity < needed) capacity *= 2;
+        MeasureResult* grown = realloc(engine->finished, capacity * sizeof(MeasureResult));
+        if (grown) {
+            engine->finished = grown;
+            engine->finished_capacity = capacity;
+        }
+    }
+    for (int i = 0; i < engine->num_published && engine->num_finished < engine->finished_capacity; i++) {
+        if (engine->published[i].samples > 0) {
+            engine->finished[engine->num_finished++] = engine->published[i];
+        }
+    }
+    engine->num_published = 0;
+    pthread_mutex_unlock(&engine->lock);
+}
+
+static void start_layout(MeasureEngine* engine, const SimulationData* data) {
+    if (engine->have_layout) retire_layout(engine);
+    free_signals(engine);
+    engine->have_layout = true;
+    engine->layout_version = data->layout_version;
+    engine->scale = data->scale;
+
+    int count = 0;
+    for (int i = 0; i < data->num_signals; i++) {
+        if (is_selected(engine, data->signal_names[i])) count++;
+    }
+    engine->signals = calloc(count > 0 ? count : 1, sizeof(SignalMeasure));
+    MeasureResult* published = calloc(count > 0 ? count : 1, sizeof(MeasureResult));
+    if (!engine->signals || !published) {
+        free(published);
+        free(engine->signals);
+        engine->signals = NULL;
+        return;
+    }
+    int value = 0;
+    for (int i = 0; i < data->num_signals; i++) {
+        bool is_complex = data->is_complex && data->is_complex[i];
+        value += is_complex ? 2 : 1;
+        if (!is_selected(engine, data->signal_names[i])) continue;
+        SignalMeasure* m = &engine->signals[engine->num_signals];
+        m->signal = i;
+        m->value = value - (is_complex ? 2 : 1);
+        m->is_complex = is_complex;
+        m->time_domain = data->scale == SCALE_TIME || data->scale == SCALE_NONE;
+        snprintf(m->name, sizeof(m->name), "%s", data->signal_names[i]);
+        m->buckets = malloc(MEASURE_STEP_BUCKETS * sizeof(StepBucket));
+        m->step_sizes = malloc(MEASURE_FFT_SIZE * sizeof(double));
+        m->ring = malloc(MEASURE_FFT_SIZE * sizeof(double));
+        if (!m->buckets || !m->step_sizes || !m->ring) {
+            free(m->buckets);
+            free(m->step_sizes);
+            free(m->ring);
+            break;
+        }
+        engine->num_signals++;
+    }
+
+    pthread_mutex_lock(&engine->lock);
+    free(engine->published);
+    engine->published = published;
+    engine->num_published = engine->num_signals;
+    pthread_mutex_unlock(&engine->lock);
+}
+
+void measure_push(MeasureEngine* engine, const SimulationData* data) {
+    if (!engine->have_layout || data->layout_version != engine->layout_version) {
+        start_layout(engine, data);
+    }
+    for (int i = 0; i < engine->num_signals; i++) {
+        SignalMeasure* m = &engine->signals[i];
+        const double* v = &data->signal_values[m->value];
+        push_sample(engine, m, data->time, m->is_complex ? hypot(v[0], v[1]) : v[0]);
+    }
+    if (++engine->since_publish >= MEASURE_PUBLISH_SAMPLES) publish(engine);
+}
+
+void measure_finish(MeasureEngine* engine) {
+    if (!engine) return;
+    // A transition still open at the end is reported as it stands
+    publish(engine);
+}
+
+int measure_snapshot(MeasureEngine* engine, MeasureResult* results, int capacity) {
+    pthread_mutex_lock(&engine->lock);
+    int count = engine->num_published;
+    for (int i = 0; i < count && i < capacity; i++) {
+        results[i] = engine->published[i];
+    }
+    pthread_mutex_unlock(&engine->lock);
+    return count;
+}
+
+static void format_time(char* buffer, size_t size, bool valid, double seconds) {
+    if (!valid || isnan(seconds)) {
+        snprintf(buffer, size, "-");
+    } else {
+        snprintf(buffer, size, "%.4g s", seconds);
+    }
+}
+
+static void print_result(FILE* out, const MeasureResult* r) {
+    char rise[24], settle[24], peak[24];
+    format_time(rise, sizeof(rise), r->step_valid, r->rise_time);
+    format_time(settle, sizeof(settle), r->step_valid && r->step_settled, r->settling_time);
+    if (r->spectrum_valid && r->peak_amplitude > 0.0) {
+        snprintf(peak, sizeof(peak), "%.4g Hz", r->peak_frequency);
+    } else {
+        snprintf(peak, sizeof(peak), "-");
+    }
+    fprintf(out, "  %-16s %11.5g %11.5g %11.5g %11.5g %11s %11s %11s  %d%s\n",
+            r->name, r->min, r->max, r->mean, r->rms, rise, settle, peak, r->steps,
+            r->step_valid && !r->step_settled ? " (moving)" : "");
+}
+
+void measure_print_summary(MeasureEngine* engine, FILE* out) {
+    if (!engine) return;
+    pthread_mutex_lock(&engine->lock);
+    int total = engine->num_finished + engine->num_published;
+    if (total > 0) {
+        fprintf(out, "Measurements (time-weighted; rise 10-90 %%, settling to %g %% of the last step):\n",
+                MEASURE_SETTLE_BAND * 100.0);
+        fprintf(out, "  %-16s %11s %11s %11s %11s %11s %11s %11s  steps\n",
+                "signal", "min", "max", "mean", "rms", "rise", "settling", "peak");
+    }
+    unsigned version = 0;
+    for (int i = 0; i < total; i++) {
+        const MeasureResult* r = i < engine->num_finished ? &engine->finished[i]
+                                                          : &engine->published[i - engine->num_finished];
+        if (i == 0 || r->layout_version != version) {
+            version = r->layout_version;
+            if (r->scale == SCALE_FREQUENCY) {
+                fprintf(out, " f %.6g .. %.6g Hz, %lld samples\n", r->t_first, r->t_last, r->samples);
+            } else if (r->scale == SCALE_SWEEP) {
+                fprintf(out, " sweep %.6g .. %.6g, %lld samples\n", r->t_first, r->t_last, r->samples);
+            } else {
+                fprintf(out, " t %.6g .. %.6g s, %lld samples\n", r->t_first, r->t_last, r->samples);
+            }
+        }
+        print_result(out, r);
+    }
+    pthread_mutex_unlock(&engine->lock);
+}
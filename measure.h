@@ -0,0 +1,88 @@
+#ifndef MEASURE_H
+#define MEASURE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "simulation.h"
+
+// Online analysis of plotted signals, fed from the SimDataCallback chain on
+// the simulation thread. Per selected signal and sample, amortized O(1):
+//   - min, max, and time-weighted mean and RMS: each step is integrated as a
+//     straight line between samples, so ngspice's adaptive timestep does not
+//     bias them towards the densely sampled edges
+//   - step response: a transition starts when the signal leaves a band of
+//     MEASURE_SETTLE_BAND of the full scale seen so far around its settled
+//     value (and at the start of the run). Its samples are kept as an
+//     envelope of at most MEASURE_STEP_BUCKETS min/max buckets, which halve
+//     when full. Rise time is 10 % to 90 % of the step, settling time is
+//     from the start until the signal stays within MEASURE_SETTLE_BAND of
+//     the step around its final value. A transition counts as settled once
+//     it has stayed there as long again; until then the values are
+//     estimates against the latest value. A transition that comes back into
+//     the band it left starts over; once that keeps happening the signal
+//     oscillates and no step in progress is reported.
+//   - spectrum: the signal is resampled linearly onto a uniform grid (the
+//     median step of its first MEASURE_FFT_SIZE samples, doubled whenever
+//     the window would cover less than a quarter of the run) and a
+//     Hann-windowed FFT of the last MEASURE_FFT_SIZE grid points runs every
+//     half window. A peak in the lowest bin is no spectrum.
+// Complex signals (.ac, .noise) are measured as their magnitude. Over a
+// frequency or sweep scale only min, max, mean and RMS are kept, weighted
+// along the scale; step response and spectrum need time.
+// Results are published every MEASURE_PUBLISH_SAMPLES samples for readers
+// on other threads; results of earlier layouts are kept for the summary.
+
+#define MEASURE_FFT_SIZE 256
+#define MEASURE_STEP_BUCKETS 1024
+#define MEASURE_SETTLE_BAND 0.02
+#define MEASURE_PUBLISH_SAMPLES 4096
+#define MEASURE_NAME_MAX 64
+
+typedef struct {
+    char name[MEASURE_NAME_MAX];
+    int signal;              // Index among the plotted signals of its layout
+    unsigned layout_version;
+    ScaleKind scale;         // What t_first and t_last are
+    long long samples;
+    double t_first;
+    double t_last;
+    double min;
+    double max;
+    double mean;
+    double rms;
+    int steps;               // Settled transitions
+    bool step_valid;         // The fields below describe a step
+    bool step_settled;       // false: the signal is still moving
+    double step_start;       // Time the step began
+    double step_from;
+    double step_to;
+    double rise_time;        // NAN if the step has not reached 90 % yet
+    double settling_time;
+    double fft_dt;           // Grid step of the spectrum, 0 until known
+    bool spectrum_valid;
+    double peak_frequency;   // Strongest bin above DC
+    double peak_amplitude;
+    float spectrum[MEASURE_FFT_SIZE / 2]; // Amplitude of bin k at k / (MEASURE_FFT_SIZE * fft_dt)
+} MeasureResult;
+
+typedef struct MeasureEngine MeasureEngine;
+
+// patterns: comma-separated fnmatch globs for the signal names, NULL or ""
+// for every plotted signal
+MeasureEngine* measure_create(const char* patterns);
+void measure_destroy(MeasureEngine* engine);
+
+// Simulation thread: one row of plotted values
+void measure_push(MeasureEngine* engine, const SimulationData* data);
+
+// Publish the final state once the simulation has stopped
+void measure_finish(MeasureEngine* engine);
+
+// Copy up to capacity results of the current layout; returns their number.
+// Safe from any thread.
+int measure_snapshot(MeasureEngine* engine, MeasureResult* results, int capacity);
+
+// Table of every layout's results
+void measure_print_summary(MeasureEngine* engine, FILE* out);
+
+#endif // MEASURE_H
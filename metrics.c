@@ -0,0 +1,184 @@
+#include "metrics.h"
+#include "sample_queue.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+Metrics g_metrics;
+
+static const char* const histogram_names[METRIC_HISTOGRAM_COUNT] = {
+    [METRIC_NG_DATA] = "ng_data_ns",
+    [METRIC_QUEUE_LAG] = "queue_lag_ns",
+    [METRIC_FRAME] = "frame_ns",
+    [METRIC_DRAW_SIGNALS] = "draw_signals_ns",
+    [METRIC_HALT] = "halt_resume_ns"
+};
+
+static const char* const counter_names[METRIC_COUNTER_COUNT] = {
+    [METRIC_SAMPLES] = "samples",
+    [METRIC_CSV_BYTES] = "csv_bytes",
+    [METRIC_FRAMES] = "frames",
+    [METRIC_ALTERS] = "alters"
+};
+
+const char* metrics_histogram_name(MetricHistogramId id) {
+    return histogram_names[id];
+}
+
+const char* metrics_counter_name(MetricCounterId id) {
+    return counter_names[id];
+}
+
+// Largest value that falls into bucket
+static uint64_t bucket_upper_bound(int bucket) {
+    if (bucket < METRIC_SUB_BUCKETS) return (uint64_t)bucket;
+    int exponent = bucket / METRIC_SUB_BUCKETS;
+    uint64_t mantissa = METRIC_SUB_BUCKETS + (uint64_t)(bucket % METRIC_SUB_BUCKETS);
+    uint64_t lower = mantissa << (exponent - 1);
+    return lower + ((uint64_t)1 << (exponent - 1)) - 1;
+}
+
+void metrics_summarize(MetricHistogramId id, MetricSummary* summary) {
+    MetricHistogram* h = &g_metrics.histograms[id];
+    static const double quantiles[3] = {0.50, 0.90, 0.99};
+    uint64_t* targets[3] = {&summary->p50, &summary->p90, &summary->p99};
+
+    // Walk the buckets once; the bucket total, not the separately updated
+    // count, is what the percentiles are taken from
+    uint64_t counts[METRIC_BUCKETS];
+    uint64_t total = 0;
+    for (int b = 0; b < METRIC_BUCKETS; b++) {
+        counts[b] = atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+        total += counts[b];
+    }
+
+    summary->count = total;
+    summary->max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    uint64_t sum = atomic_load_explicit(&h->sum, memory_order_relaxed);
+    summary->mean = total > 0 ? (double)sum / (double)total : 0.0;
+    summary->p50 = summary->p90 = summary->p99 = 0;
+    if (total == 0) return;
+
+    uint64_t seen = 0;
+    int q = 0;
+    for (int b = 0; b < METRIC_BUCKETS && q < 3; b++) {
+        seen += counts[b];
+        while (q < 3 && (double)seen >= quantiles[q] * (double)total) {
+            uint64_t bound = bucket_upper_bound(b);
+            *targets[q++] = bound < summary->max ? bound : summary->max;
+        }
+    }
+}
+
+void metrics_format_ns(char* buffer, size_t size, uint64_t ns) {
+    if (ns < 1000) {
+        snprintf(buffer, size, "%lluns", (unsigned long long)ns);
+    } else if (ns < 1000000) {
+        snprintf(buffer, size, "%.1fus", ns * 1e-3);
+    } else if (ns < 1000000000) {
+        snprintf(buffer, size, "%.2fms", ns * 1e-6);
+    } else {
+        snprintf(buffer, size, "%.2fs", ns * 1e-9);
+    }
+}
+
+// Periodic dump
+
+static struct {
+    FILE* file;
+    int interval_ms;
+    bool running;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+    uint64_t last_ns;
+    uint64_t last_counters[METRIC_COUNTER_COUNT];
+} dump = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER
+};
+
+static void write_dump_line(void) {
+    uint64_t now_ns = monotonic_ns();
+    double interval = (now_ns - dump.last_ns) * 1e-9;
+
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    fprintf(dump.file, "{\"time\":%.3f,\"counters\":{", wall.tv_sec + wall.tv_nsec * 1e-9);
+    for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+        fprintf(dump.file, "%s\"%s\":%llu", c ? "," : "", counter_names[c],
+                (unsigned long long)metrics_counter(c));
+    }
+    fprintf(dump.file, "},\"rates\":{");
+    for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+        uint64_t value = metrics_counter(c);
+        fprintf(dump.file, "%s\"%s\":%.1f", c ? "," : "", counter_names[c],
+                interval > 0.0 ? (value - dump.last_counters[c]) / interval : 0.0);
+        dump.last_counters[c] = value;
+    }
+    fprintf(dump.file, "},\"histograms\":{");
+    for (int id = 0; id < METRIC_HISTOGRAM_COUNT; id++) {
+        MetricSummary s;
+        metrics_summarize(id, &s);
+        fprintf(dump.file,
+                "%s\"%s\":{\"count\":%llu,\"mean\":%.1f,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"max\":%llu}",
+                id ? "," : "", histogram_names[id], (unsigned long long)s.count, s.mean,
+                (unsigned long long)s.p50, (unsigned long long)s.p90,
+                (unsigned long long)s.p99, (unsigned long long)s.max);
+    }
+    fprintf(dump.file, "}}\n");
+    fflush(dump.file);
+    dump.last_ns = now_ns;
+}
+
+static void* dump_thread(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&dump.lock);
+    while (!dump.stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        long long ns = deadline.tv_nsec + (long long)dump.interval_ms * 1000000ll;
+        deadline.tv_sec += ns / 1000000000ll;
+        deadline.tv_nsec = ns % 1000000000ll;
+        if (pthread_cond_timedwait(&dump.wake, &dump.lock, &deadline) == ETIMEDOUT) {
+            write_dump_line();
+        }
+    }
+    write_dump_line();
+    pthread_mutex_unlock(&dump.lock);
+    return NULL;
+}
+
+int metrics_dump_start(const char* path, int interval_ms) {
+    if (dump.running) return -1;
+    dump.file = fopen(path, "a");
+    if (!dump.file) return -1;
+
+    dump.interval_ms = interval_ms > 0 ? interval_ms : 1000;
+    dump.stop = false;
+    dump.last_ns = monotonic_ns();
+    for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+        dump.last_counters[c] = metrics_counter(c);
+    }
+    if (pthread_create(&dump.thread, NULL, dump_thread, NULL) != 0) {
+        fclose(dump.file);
+        dump.file = NULL;
+        return -1;
+    }
+    dump.running = true;
+    return 0;
+}
+
+void metrics_dump_stop(void) {
+    if (!dump.running) return;
+    pthread_mutex_lock(&dump.lock);
+    dump.stop = true;
+    pthread_cond_signal(&dump.wake);
+    pthread_mutex_unlock(&dump.lock);
+    pthread_join(dump.thread, NULL);
+    fclose(dump.file);
+    dump.file = NULL;
+    dump.running = false;
+}
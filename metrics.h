@@ -0,0 +1,102 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Process-wide counters and latency histograms for the hot paths.
+// Recording is a handful of relaxed atomic adds, safe from any thread and
+// never blocking, so it can stay enabled inside the ngspice callbacks.
+// Histograms are log-linear (HDR style): 16 linear sub-buckets per power of
+// two, i.e. values are kept to within 1/16 (~6%) over the full uint64 range.
+
+#define METRIC_SUB_BITS 4
+#define METRIC_SUB_BUCKETS (1 << METRIC_SUB_BITS)
+#define METRIC_BUCKETS ((64 - METRIC_SUB_BITS + 1) * METRIC_SUB_BUCKETS)
+
+typedef enum {
+    METRIC_NG_DATA,        // ng_data duration
+    METRIC_QUEUE_LAG,      // Sample enqueued -> applied by the render loop
+    METRIC_FRAME,          // Render loop frame, clear to present
+    METRIC_DRAW_SIGNALS,   // draw_signals alone
+    METRIC_HALT,           // bg_halt -> bg_resume of an alter batch
+    METRIC_HISTOGRAM_COUNT
+} MetricHistogramId;
+
+typedef enum {
+    METRIC_SAMPLES,        // ng_data calls
+    METRIC_CSV_BYTES,      // CSV bytes formatted
+    METRIC_FRAMES,         // Frames rendered
+    METRIC_ALTERS,         // alter/altermod commands sent
+    METRIC_COUNTER_COUNT
+} MetricCounterId;
+
+typedef struct {
+    atomic_uint_least64_t buckets[METRIC_BUCKETS];
+    atomic_uint_least64_t count;
+    atomic_uint_least64_t sum;
+    atomic_uint_least64_t max;
+} MetricHistogram;
+
+typedef struct {
+    MetricHistogram histograms[METRIC_HISTOGRAM_COUNT];
+    atomic_uint_least64_t counters[METRIC_COUNTER_COUNT];
+} Metrics;
+
+// Percentiles are the upper bound of the bucket they fall into
+typedef struct {
+    uint64_t count;
+    double mean;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t max;
+} MetricSummary;
+
+extern Metrics g_metrics;
+
+static inline int metric_bucket(uint64_t value) {
+    if (value < METRIC_SUB_BUCKETS) return (int)value;
+    int msb = 63 - __builtin_clzll(value);
+    int exponent = msb - METRIC_SUB_BITS + 1;
+    int mantissa = (int)(value >> (msb - METRIC_SUB_BITS)) & (METRIC_SUB_BUCKETS - 1);
+    return exponent * METRIC_SUB_BUCKETS + mantissa;
+}
+
+static inline void metrics_record(MetricHistogramId id, uint64_t value) {
+    MetricHistogram* h = &g_metrics.histograms[id];
+    atomic_fetch_add_explicit(&h->buckets[metric_bucket(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, value, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (value > max &&
+           !atomic_compare_exchange_weak_explicit(&h->max, &max, value,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static inline void metrics_add(MetricCounterId id, uint64_t amount) {
+    atomic_fetch_add_explicit(&g_metrics.counters[id], amount, memory_order_relaxed);
+}
+
+static inline uint64_t metrics_counter(MetricCounterId id) {
+    return atomic_load_explicit(&g_metrics.counters[id], memory_order_relaxed);
+}
+
+const char* metrics_histogram_name(MetricHistogramId id);
+const char* metrics_counter_name(MetricCounterId id);
+
+// Consistent enough for reporting; concurrent records may be half-counted
+void metrics_summarize(MetricHistogramId id, MetricSummary* summary);
+
+// Human-readable duration, e.g. "850ns", "12.4us", "3.10ms"
+void metrics_format_ns(char* buffer, size_t size, uint64_t ns);
+
+// Append one JSON object per interval to path (JSON lines) from a
+// background thread, plus a final one on stop
+int metrics_dump_start(const char* path, int interval_ms);
+void metrics_dump_stop(void);
+
+#endif // METRICS_H
@@ -0,0 +1,125 @@
+#include "pixel_transform.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu_dispatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PIXEL_TRANSFORM_X86 1
+#include <immintrin.h>
+#endif
+
+// Products are clamped to this many pixels before the conversion to int,
+// which keeps center - product far away from int overflow
+#define PIXEL_LIMIT 1e9
+
+typedef void (*TransformKernel)(const double* values, int count, int center, double scale,
+                                int y_min, int y_max, int* out);
+
+static inline int transform_one(double v, int center, double scale, int y_min, int y_max) {
+    double p = v * scale;
+    // Written so that NaN fails both comparisons like the SIMD max/min do
+    p = p > -PIXEL_LIMIT ? p : -PIXEL_LIMIT;
+    p = p < PIXEL_LIMIT ? p : PIXEL_LIMIT;
+    int y = center - (int)p;
+    if (y < y_min) y = y_min;
+    if (y > y_max) y = y_max;
+    return y;
+}
+
+static void transform_scalar(const double* values, int count, int center, double scale,
+                             int y_min, int y_max, int* out) {
+    for (int i = 0; i < count; i++) {
+        out[i] = transform_one(values[i], center, scale, y_min, y_max);
+    }
+}
+
+#ifdef PIXEL_TRANSFORM_X86
+
+// SSE2 has no 32-bit integer min/max; select with a compare mask instead
+static inline __m128i clamp_epi32_sse2(__m128i y, __m128i lo, __m128i hi) {
+    __m128i below = _mm_cmplt_epi32(y, lo);
+    y = _mm_or_si128(_mm_and_si128(below, lo), _mm_andnot_si128(below, y));
+    __m128i above = _mm_cmpgt_epi32(y, hi);
+    return _mm_or_si128(_mm_and_si128(above, hi), _mm_andnot_si128(above, y));
+}
+
+__attribute__((target("sse2")))
+static void transform_sse2(const double* values, int count, int center, double scale,
+                           int y_min, int y_max, int* out) {
+    const __m128d vscale = _mm_set1_pd(scale);
+    const __m128d vlow = _mm_set1_pd(-PIXEL_LIMIT);
+    const __m128d vhigh = _mm_set1_pd(PIXEL_LIMIT);
+    const __m128i vcenter = _mm_set1_epi32(center);
+    const __m128i vmin = _mm_set1_epi32(y_min);
+    const __m128i vmax = _mm_set1_epi32(y_max);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        // max(p, low) returns low when p is NaN
+        __m128d p0 = _mm_mul_pd(_mm_loadu_pd(values + i), vscale);
+        __m128d p1 = _mm_mul_pd(_mm_loadu_pd(values + i + 2), vscale);
+        p0 = _mm_min_pd(_mm_max_pd(p0, vlow), vhigh);
+        p1 = _mm_min_pd(_mm_max_pd(p1, vlow), vhigh);
+        __m128i t = _mm_unpacklo_epi64(_mm_cvttpd_epi32(p0), _mm_cvttpd_epi32(p1));
+        __m128i y = clamp_epi32_sse2(_mm_sub_epi32(vcenter, t), vmin, vmax);
+        _mm_storeu_si128((__m128i*)(out + i), y);
+    }
+    transform_scalar(values + i, count - i, center, scale, y_min, y_max, out + i);
+}
+
+__attribute__((target("avx2")))
+static void transform_avx2(const double* values, int count, int center, double scale,
+                           int y_min, int y_max, int* out) {
+    const __m256d vscale = _mm256_set1_pd(scale);
+    const __m256d vlow = _mm256_set1_pd(-PIXEL_LIMIT);
+    const __m256d vhigh = _mm256_set1_pd(PIXEL_LIMIT);
+    const __m256i vcenter = _mm256_set1_epi32(center);
+    const __m256i vmin = _mm256_set1_epi32(y_min);
+    const __m256i vmax = _mm256_set1_epi32(y_max);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256d p0 = _mm256_mul_pd(_mm256_loadu_pd(values + i), vscale);
+        __m256d p1 = _mm256_mul_pd(_mm256_loadu_pd(values + i + 4), vscale);
+        p0 = _mm256_min_pd(_mm256_max_pd(p0, vlow), vhigh);
+        p1 = _mm256_min_pd(_mm256_max_pd(p1, vlow), vhigh);
+        __m256i t = _mm256_set_m128i(_mm256_cvttpd_epi32(p1), _mm256_cvttpd_epi32(p0));
+        __m256i y = _mm256_sub_epi32(vcenter, t);
+        y = _mm256_min_epi32(_mm256_max_epi32(y, vmin), vmax);
+        _mm256_storeu_si256((__m256i*)(out + i), y);
+    }
+    transform_scalar(values + i, count - i, center, scale, y_min, y_max, out + i);
+}
+
+#endif // PIXEL_TRANSFORM_X86
+
+static TransformKernel kernel;
+static const char* kernel_name;
+
+static void select_kernel(const char* forced) {
+    CpuLevel level = cpu_dispatch_level(forced);
+    kernel = transform_scalar;
+#ifdef PIXEL_TRANSFORM_X86
+    if (level == CPU_LEVEL_AVX2) kernel = transform_avx2;
+    if (level == CPU_LEVEL_SSE2) kernel = transform_sse2;
+#endif
+    kernel_name = cpu_level_name(level);
+}
+
+void pixel_transform(const double* values, int count, int center, double scale,
+                     int y_min, int y_max, int* out) {
+    // Only the render thread calls this, a plain lazy init is enough
+    if (!kernel) select_kernel(getenv("PIXEL_TRANSFORM_KERNEL"));
+    kernel(values, count, center, scale, y_min, y_max, out);
+}
+
+const char* pixel_transform_kernel(void) {
+    if (!kernel) select_kernel(getenv("PIXEL_TRANSFORM_KERNEL"));
+    return kernel_name;
+}
+
+const char* pixel_transform_use_kernel(const char* name) {
+    select_kernel(name ? name : getenv("PIXEL_TRANSFORM_KERNEL"));
+    return kernel_name;
+}
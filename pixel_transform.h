@@ -0,0 +1,23 @@
+#ifndef PIXEL_TRANSFORM_H
+#define PIXEL_TRANSFORM_H
+
+// Sample-to-screen transform used by draw_signals:
+//   out[i] = clamp(center - (int)(values[i] * scale), y_min, y_max)
+// with the same truncation as the scalar expression it replaces. Values
+// whose product is NaN or beyond +-1e9 pixels end up at y_max / y_min.
+// The kernel is chosen on first use through cpu_dispatch.h: AVX2 or SSE2
+// on x86-64, the scalar loop elsewhere. Set PIXEL_TRANSFORM_KERNEL=scalar,
+// sse2 or avx2 in the environment to force one (if the CPU supports it).
+
+void pixel_transform(const double* values, int count, int center, double scale,
+                     int y_min, int y_max, int* out);
+
+// Name of the kernel in use: "avx2", "sse2" or "scalar"
+const char* pixel_transform_kernel(void);
+
+// Switch to the named kernel, or back to the default choice for NULL, as
+// PIXEL_TRANSFORM_KERNEL would; returns the name of the kernel now in use.
+// For comparing the kernels, not to be called while another thread draws.
+const char* pixel_transform_use_kernel(const char* name);
+
+#endif // PIXEL_TRANSFORM_H
@@ -1,12 +1,10 @@
 #include "plot.h"
+#include "sample_queue.h"
+#include "pixel_transform.h"
+#include <limits.h>
 
-void drawLine(SDL_Renderer *renderer, int x1, int* y1, int x2, int* y2, PlotConfig* config) {
-    for (int s = 0; s < config->num_signals; s++) {
-        lineRGBA(renderer, x1, y1[s], x2, y2[s],
-                 config->colors[s].r, config->colors[s].g,
-                 config->colors[s].b, config->colors[s].a);
-    }
-}
+#define TICK_LENGTH 6
+#define NO_ROW INT_MIN  // last_span of a signal with no column drawn yet
 
 void draw_slider(SDL_Renderer* renderer, Slider* slider) {
     // Draw slider track
@@ -20,6 +18,13 @@ void draw_slider(SDL_Renderer* renderer, Slider* slider) {
     boxRGBA(renderer, handle_pos - 5, slider->y,
             handle_pos + 5, slider->y + slider->height,
             200, 200, 200, 255);
+
+    if (slider->label) {
+        char text[64];
+        snprintf(text, sizeof(text), "%s %.3g", slider->label, slider->value);
+        stringRGBA(renderer, slider->x + slider->width + 15, slider->y + slider->height/2 - 4,
+                   text, 200, 200, 200, 255);
+    }
 }
 
 bool is_point_in_slider(Slider* slider, int x, int y) {
@@ -50,23 +55,7 @@ PlotConfig setup_config() {
         .window_height = 480,
         .center_y = 240,
         .amplitude = 100,
-        .colors = {
-            {255, 255, 0, 255},   // Yellow
-            {255, 0, 0, 255},     // Red
-            {0, 255, 0, 255},     // Green
-            {0, 0, 255, 255},     // Blue
-            {255, 0, 255, 255},   // Magenta
-            {0, 255, 255, 255},   // Cyan
-            {255, 128, 0, 255},   // Orange
-            {128, 0, 255, 255},   // Purple
-            {0, 255, 128, 255},   // Spring Green
-            {255, 255, 255, 255}, // White
-            {128, 128, 255, 255}, // Light Blue
-            {255, 128, 128, 255}, // Light Red
-            {128, 255, 128, 255}, // Light Green
-            {255, 128, 255, 255}, // Light Magenta
-            {192, 192, 192, 255}  // Light Gray
-        },
+        .storage = HISTORY_FLOAT64,
         .amplitude_slider = {
             .x = 50,
             .y = 20,
@@ -77,9 +66,31 @@ PlotConfig setup_config() {
             .min_value = -1.0f,
             .max_value = 1.0f,
             .dragging = false,
-            .value_changed = false
+            .value_changed = false,
+            .label = "Vvdc [V]"
+        },
+        .resistance_slider = {
+            .x = 50,
+            .y = 50,
+            .width = 200,
+            .height = 20,
+            .value = 1.0f,
+            .previous_value = 1.0f,
+            .min_value = 0.1f,
+            .max_value = 10.0f,
+            .label = "Rres1 [Ohm]"
         },
-        .tick_counter = 0
+        .capacitance_slider = {
+            .x = 50,
+            .y = 80,
+            .width = 200,
+            .height = 20,
+            .value = 1.0f,
+            .previous_value = 1.0f,
+            .min_value = 0.1f,
+            .max_value = 10.0f,
+            .label = "Ccap1 [F]"
+        }
     };
     return config;
 }
@@ -100,7 +111,11 @@ SDL_Window* init_sdl(PlotConfig* config) {
 }
 
 SDL_Renderer* create_renderer(SDL_Window* window) {
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    // With vsync, SDL_RenderPresent waits for the display and paces the frames
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (renderer == NULL) {
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    }
     if (renderer == NULL) {
         printf("Renderer konnte nicht erstellt werden! SDL Fehler: %s\n", SDL_GetError());
         SDL_DestroyWindow(window);
@@ -109,108 +124,975 @@ SDL_Renderer* create_renderer(SDL_Window* window) {
     return renderer;
 }
 
-double** init_buffers(PlotConfig* config) {
-    double** buffers = malloc(config->num_signals * sizeof(double*));
-    for (int j = 0; j < config->num_signals; j++) {
-        buffers[j] = malloc(BUFFER_SIZE * sizeof(double));
-        for (int i = 0; i < BUFFER_SIZE; i++) {
-            buffers[j][i] = 0.0;
-        }
+bool renderer_has_vsync(SDL_Renderer* renderer) {
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info) != 0) return false;
+    return (info.flags & SDL_RENDERER_PRESENTVSYNC) != 0;
+}
+
+SDL_Color plot_palette_color(int index) {
+    static const SDL_Color base[] = {
+        {255, 255, 0, 255},   // Yellow
+        {255, 0, 0, 255},     // Red
+        {0, 255, 0, 255},     // Green
+        {0, 0, 255, 255},     // Blue
+        {255, 0, 255, 255},   // Magenta
+        {0, 255, 255, 255},   // Cyan
+        {255, 128, 0, 255},   // Orange
+        {128, 0, 255, 255},   // Purple
+        {0, 255, 128, 255},   // Spring Green
+        {255, 255, 255, 255}, // White
+        {128, 128, 255, 255}, // Light Blue
+        {255, 128, 128, 255}, // Light Red
+        {128, 255, 128, 255}, // Light Green
+        {255, 128, 255, 255}, // Light Magenta
+        {192, 192, 192, 255}  // Light Gray
+    };
+    int num_base = sizeof(base) / sizeof(base[0]);
+    if (index < num_base) return base[index];
+
+    // Golden-angle hue steps keep neighbouring signals apart; saturation and
+    // value alternate so that hues close on the wheel still differ
+    double hue = fmod((index - num_base) * 137.508, 360.0) / 60.0;
+    double saturation = (index & 1) ? 0.55 : 0.85;
+    double value = (index & 2) ? 0.8 : 1.0;
+    double chroma = value * saturation;
+    double x = chroma * (1.0 - fabs(fmod(hue, 2.0) - 1.0));
+    double r = 0, g = 0, b = 0;
+    switch ((int)hue) {
+        case 0: r = chroma; g = x; break;
+        case 1: r = x; g = chroma; break;
+        case 2: g = chroma; b = x; break;
+        case 3: g = x; b = chroma; break;
+        case 4: r = x; b = chroma; break;
+        default: r = chroma; b = x; break;
+    }
+    double m = value - chroma;
+    SDL_Color color = {
+        (Uint8)((r + m) * 255.0 + 0.5),
+        (Uint8)((g + m) * 255.0 + 0.5),
+        (Uint8)((b + m) * 255.0 + 0.5),
+        255
+    };
+    return color;
+}
+
+SignalHistory* init_buffers(PlotConfig* config) {
+    // Full length unless the signals would not fit the memory budget, then
+    // the largest power of two that does (which keeps the pyramid intact)
+    int capacity = BUFFER_SIZE;
+    size_t per_sample = history_bytes_per_sample(config->storage) * (config->num_signals > 0 ? config->num_signals : 1);
+    while (capacity > 1024 && (size_t)capacity * per_sample > HISTORY_MEMORY_BUDGET) {
+        capacity >>= 1;
     }
-    return buffers;
+    return history_create(config->num_signals, capacity, config->storage);
 }
 
-void draw_grid(SDL_Renderer* renderer, PlotConfig* config) {
-    hlineRGBA(renderer, 0, 639, 479, 255, 255, 255, 255);
-    vlineRGBA(renderer, 0, 0, 479, 255, 255, 255, 255);
+void draw_grid(SDL_Renderer* renderer, SignalHistory* history, PlotConfig* config) {
+    int right = config->window_width - 1;
+    int bottom = config->window_height - 1;
+    SDL_Rect ticks[64];
+    int num_ticks = 0;
     
-    for (int x = -config->tick_counter; x < BUFFER_SIZE; x += 50) {
-        if (x >= 0) {
-            vlineRGBA(renderer, x, 474, 479, 255, 255, 255, 255);
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    ticks[num_ticks++] = (SDL_Rect){0, bottom, right + 1, 1};
+    ticks[num_ticks++] = (SDL_Rect){0, 0, 1, bottom + 1};
+    
+    // Ticks scroll along with the samples appended to the history; only the
+    // visible ones are emitted, batched into as few fill calls as possible
+    int tick_offset = history ? (int)(history->count % GRID_SPACING) : 0;
+    for (int x = -tick_offset; x <= right; x += GRID_SPACING) {
+        if (x < 0) continue;
+        ticks[num_ticks++] = (SDL_Rect){x, bottom - TICK_LENGTH + 1, 1, TICK_LENGTH};
+        if (num_ticks == 64) {
+            SDL_RenderFillRects(renderer, ticks, num_ticks);
+            num_ticks = 0;
+        }
+    }
+    for (int y = 0; y <= bottom; y += GRID_SPACING) {
+        ticks[num_ticks++] = (SDL_Rect){0, y, TICK_LENGTH, 1};
+        if (num_ticks == 64) {
+            SDL_RenderFillRects(renderer, ticks, num_ticks);
+            num_ticks = 0;
         }
     }
-    for (int y = 0; y < 480; y += 50) {
-        hlineRGBA(renderer, 0, 5, y, 255, 255, 255, 255);
+    if (num_ticks > 0) {
+        SDL_RenderFillRects(renderer, ticks, num_ticks);
     }
 }
 
-void draw_signals(SDL_Renderer* renderer, double** buffers, PlotConfig* config, int useInterpolation) {
-    if (!buffers) return;  // Safety check
-    // Calculate decimation factor - how many samples to skip per pixel
-    int decimation = (BUFFER_SIZE + config->window_width - 1) / config->window_width;
-    if (decimation < 1) decimation = 1;
+// Make sure the scratch buffers hold at least `columns` columns
+static bool reserve_scratch(RenderScratch* scratch, int columns) {
+    if (columns <= scratch->columns_capacity) return true;
+
+    double* col_min = realloc(scratch->col_min, columns * sizeof(double));
+    if (!col_min) return false;
+    scratch->col_min = col_min;
+    double* col_max = realloc(scratch->col_max, columns * sizeof(double));
+    if (!col_max) return false;
+    scratch->col_max = col_max;
+    int* col_top = realloc(scratch->col_top, columns * sizeof(int));
+    if (!col_top) return false;
+    scratch->col_top = col_top;
+    int* col_bottom = realloc(scratch->col_bottom, columns * sizeof(int));
+    if (!col_bottom) return false;
+    scratch->col_bottom = col_bottom;
+    int* col_x = realloc(scratch->col_x, columns * sizeof(int));
+    if (!col_x) return false;
+    scratch->col_x = col_x;
+    long long* col_first = realloc(scratch->col_first, (columns + 1) * sizeof(long long));
+    if (!col_first) return false;
+    scratch->col_first = col_first;
+    SDL_Point* points = realloc(scratch->points, 2 * columns * sizeof(SDL_Point));
+    if (!points) return false;
+    scratch->points = points;
+
+    scratch->columns_capacity = columns;
+    scratch->points_capacity = 2 * columns;
+    return true;
+}
+
+void free_render_scratch(RenderScratch* scratch) {
+    free(scratch->col_min);
+    free(scratch->col_max);
+    free(scratch->col_top);
+    free(scratch->col_bottom);
+    free(scratch->col_x);
+    free(scratch->col_first);
+    free(scratch->points);
+    memset(scratch, 0, sizeof(RenderScratch));
+}
+
+void draw_signals(SDL_Renderer* renderer, SignalHistory* history, PlotConfig* config, int useInterpolation) {
+    if (!history) return;  // Safety check
+    uint64_t start_ns = monotonic_ns();
+    // One min/max bucket per pixel column, so spikes between the samples
+    // that used to be picked are no longer lost
+    int columns = config->window_width;
+    RenderScratch* scratch = &config->scratch;
+    if (!reserve_scratch(scratch, columns)) return;
     
-    if (useInterpolation) {
-        for (int x = 0; x < config->window_width - 1; x++) {
-            int buffer_idx = x * decimation;
-            int next_buffer_idx = (x + 1) * decimation;
-            
-            if (next_buffer_idx >= BUFFER_SIZE) break;
-            
-            int* y1 = malloc(config->num_signals * sizeof(int));
-            int* y2 = malloc(config->num_signals * sizeof(int));
+    for (int s = 0; s < config->num_signals && s < history->num_signals; s++) {
+        history_envelope(history, s, 0, history->capacity, columns, scratch->col_min, scratch->col_max);
+
+        // Whole envelope to screen rows in one vectorized pass. Rows just
+        // outside the window still leave the clipping to SDL.
+        pixel_transform(scratch->col_max, columns, config->center_y, config->amplitude,
+                        -1, config->window_height, scratch->col_top);
+        pixel_transform(scratch->col_min, columns, config->center_y, config->amplitude,
+                        -1, config->window_height, scratch->col_bottom);
+        
+        // Two points per column: the end of the span nearest to where the
+        // previous column ended comes first, so one polyline traces the
+        // whole envelope
+        SDL_Point* points = scratch->points;
+        int num_points = 0;
+        int prev_y = 0;
+        for (int x = 0; x < columns; x++) {
+            int top = scratch->col_top[x];
+            int bottom = scratch->col_bottom[x];
             
-            for (int s = 0; s < config->num_signals; s++) {
-                y1[s] = config->center_y - (int)(buffers[s][buffer_idx] * config->amplitude);
-                y2[s] = config->center_y - (int)(buffers[s][next_buffer_idx] * config->amplitude);
+            if (x > 0 && abs(bottom - prev_y) < abs(top - prev_y)) {
+                int tmp = top;
+                top = bottom;
+                bottom = tmp;
             }
-            
-            drawLine(renderer, x, y1, x + 1, y2, config);
-            free(y1);
-            free(y2);
+            points[num_points++] = (SDL_Point){x, top};
+            if (bottom != top || useInterpolation) {
+                points[num_points++] = (SDL_Point){x, bottom};
+            }
+            prev_y = bottom;
+        }
+        
+        SDL_Color color = plot_palette_color(s);
+        SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+        if (useInterpolation) {
+            SDL_RenderDrawLines(renderer, points, num_points);
+        } else {
+            SDL_RenderDrawPoints(renderer, points, num_points);
+        }
+    }
+    metrics_record(METRIC_DRAW_SIGNALS, monotonic_ns() - start_ns);
+}
+
+void destroy_plot_canvas(PlotCanvas* canvas) {
+    if (canvas->plot) SDL_DestroyTexture(canvas->plot);
+    if (canvas->grid) SDL_DestroyTexture(canvas->grid);
+    if (canvas->ticks) SDL_DestroyTexture(canvas->ticks);
+    free(canvas->last_span);
+    free(canvas->rects);
+    memset(canvas, 0, sizeof(PlotCanvas));
+}
+
+static bool create_canvas(SDL_Renderer* renderer, PlotConfig* config) {
+    PlotCanvas* canvas = &config->canvas;
+    int width = config->window_width;
+    int height = config->window_height;
+    if (!SDL_RenderTargetSupported(renderer)) return false;
+
+    canvas->plot = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+                                     width, height);
+    canvas->grid = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+                                     width, height);
+    canvas->ticks = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+                                      width + GRID_SPACING, TICK_LENGTH);
+    if (!canvas->plot || !canvas->grid || !canvas->ticks) {
+        printf("Plot-Textur konnte nicht erstellt werden, zeichne ohne Cache! SDL Fehler: %s\n", SDL_GetError());
+        destroy_plot_canvas(canvas);
+        return false;
+    }
+    SDL_SetTextureBlendMode(canvas->grid, SDL_BLENDMODE_BLEND);
+    SDL_SetTextureBlendMode(canvas->ticks, SDL_BLENDMODE_BLEND);
+    return true;
+}
+
+static bool reserve_canvas(PlotCanvas* canvas, int num_signals, int rects) {
+    if (num_signals > canvas->last_span_capacity) {
+        int* last_span = realloc(canvas->last_span, 2 * num_signals * sizeof(int));
+        if (!last_span) return false;
+        canvas->last_span = last_span;
+        canvas->last_span_capacity = num_signals;
+    }
+    if (rects > canvas->rects_capacity) {
+        SDL_Rect* buffer = realloc(canvas->rects, rects * sizeof(SDL_Rect));
+        if (!buffer) return false;
+        canvas->rects = buffer;
+        canvas->rects_capacity = rects;
+    }
+    return true;
+}
+
+// Same lines as draw_grid, split into the part that stays put and a strip
+// of x ticks that is shifted by the scroll position when composited
+static void render_grid_layers(SDL_Renderer* renderer, PlotConfig* config) {
+    PlotCanvas* canvas = &config->canvas;
+    SDL_Rect* rects = canvas->rects;
+    int right = config->window_width - 1;
+    int bottom = config->window_height - 1;
+    int num_rects = 0;
+
+    SDL_SetRenderTarget(renderer, canvas->grid);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
+    rects[num_rects++] = (SDL_Rect){0, bottom, right + 1, 1};
+    rects[num_rects++] = (SDL_Rect){0, 0, 1, bottom + 1};
+    for (int y = 0; y <= bottom; y += GRID_SPACING) {
+        rects[num_rects++] = (SDL_Rect){0, y, TICK_LENGTH, 1};
+    }
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    SDL_RenderFillRects(renderer, rects, num_rects);
+
+    SDL_SetRenderTarget(renderer, canvas->ticks);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
+    num_rects = 0;
+    for (int x = 0; x <= right + GRID_SPACING; x += GRID_SPACING) {
+        rects[num_rects++] = (SDL_Rect){x, 0, 1, TICK_LENGTH};
+    }
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    SDL_RenderFillRects(renderer, rects, num_rects);
+
+    SDL_SetRenderTarget(renderer, NULL);
+    canvas->layers_valid = true;
+}
+
+static inline int ring_position(long long column, int width) {
+    int x = (int)(column % width);
+    return x < 0 ? x + width : x;
+}
+
+// Rects for one column spanning rows [top, bottom]. With interpolation the
+// span is stretched until it touches the previous column's span, which
+// joins neighbouring columns without depending on anything further back,
+// so a column looks the same however the ring was filled.
+static int column_rects(int x, int top, int bottom, int* prev_span, int interpolation, SDL_Rect* out) {
+    int n = 0;
+    if (interpolation) {
+        int lo = top;
+        int hi = bottom;
+        if (prev_span[0] != NO_ROW) {
+            if (prev_span[1] < lo) lo = prev_span[1];
+            if (prev_span[0] > hi) hi = prev_span[0];
         }
+        out[n++] = (SDL_Rect){x, lo, 1, hi - lo + 1};
     } else {
-        for (int x = 0; x < config->window_width; x++) {
-            int buffer_idx = x * decimation;
-            if (buffer_idx >= BUFFER_SIZE) break;
-            
-            for (int s = 0; s < config->num_signals; s++) {
-                int y = config->center_y - (int)(buffers[s][buffer_idx] * config->amplitude);
-                pixelRGBA(renderer, x, y,
-                         config->colors[s].r, config->colors[s].g, 
-                         config->colors[s].b, config->colors[s].a);
+        out[n++] = (SDL_Rect){x, top, 1, 1};
+        if (bottom != top) out[n++] = (SDL_Rect){x, bottom, 1, 1};
+    }
+    prev_span[0] = top;
+    prev_span[1] = bottom;
+    return n;
+}
+
+// Rasterize absolute columns [first, first + count) into the plot ring,
+// which the caller has made the render target
+static void rasterize_columns(SDL_Renderer* renderer, const SignalHistory* history, PlotConfig* config,
+                              long long first, int count) {
+    PlotCanvas* canvas = &config->canvas;
+    RenderScratch* scratch = &config->scratch;
+    SDL_Rect* rects = canvas->rects;
+    int width = config->window_width;
+    int height = config->window_height;
+    int spc = canvas->samples_per_column;
+    // Logical index of the first sample of column `first`
+    int first_sample = (int)(first * spc - (history->count - history->capacity));
+
+    // The slots still hold columns that have scrolled out of view
+    int x0 = ring_position(first, width);
+    int span = count < width - x0 ? count : width - x0;
+    rects[0] = (SDL_Rect){x0, 0, span, height};
+    rects[1] = (SDL_Rect){0, 0, count - span, height};
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderFillRects(renderer, rects, count > span ? 2 : 1);
+
+    for (int s = 0; s < config->num_signals && s < history->num_signals; s++) {
+        history_envelope(history, s, first_sample, count * spc, count, scratch->col_min, scratch->col_max);
+        pixel_transform(scratch->col_max, count, config->center_y, config->amplitude,
+                        -1, height, scratch->col_top);
+        pixel_transform(scratch->col_min, count, config->center_y, config->amplitude,
+                        -1, height, scratch->col_bottom);
+
+        int num_rects = 0;
+        for (int i = 0; i < count; i++) {
+            num_rects += column_rects(ring_position(first + i, width), scratch->col_top[i],
+                                      scratch->col_bottom[i], &canvas->last_span[2 * s],
+                                      canvas->interpolation, rects + num_rects);
+        }
+        SDL_Color color = plot_palette_color(s);
+        SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+        SDL_RenderFillRects(renderer, rects, num_rects);
+    }
+}
+
+// The column still being filled is drawn straight to the screen each frame
+static void draw_partial_column(SDL_Renderer* renderer, const SignalHistory* history, PlotConfig* config,
+                                long long completed) {
+    PlotCanvas* canvas = &config->canvas;
+    int filled = (int)(history->count - completed * canvas->samples_per_column);
+    if (filled <= 0) return;
+
+    for (int s = 0; s < config->num_signals && s < history->num_signals; s++) {
+        double values[2];
+        int rows[2];
+        history_minmax(history, s, history->capacity - filled, filled, &values[1], &values[0]);
+        pixel_transform(values, 2, config->center_y, config->amplitude, -1, config->window_height, rows);
+
+        SDL_Rect rects[2];
+        int prev_span[2] = {canvas->last_span[2 * s], canvas->last_span[2 * s + 1]};
+        int num_rects = column_rects(config->window_width - 1, rows[0], rows[1], prev_span,
+                                     canvas->interpolation, rects);
+        SDL_Color color = plot_palette_color(s);
+        SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+        SDL_RenderFillRects(renderer, rects, num_rects);
+    }
+}
+
+void draw_plot(SDL_Renderer* renderer, SignalHistory* history, PlotConfig* config, int useInterpolation) {
+    PlotCanvas* canvas = &config->canvas;
+    int width = config->window_width;
+    int height = config->window_height;
+    int grid_rects = height / GRID_SPACING + width / GRID_SPACING + 5;
+
+    if (!canvas->unsupported && !canvas->plot && !create_canvas(renderer, config)) {
+        canvas->unsupported = true;
+    }
+    if (canvas->unsupported || !history ||
+        !reserve_scratch(&config->scratch, width) ||
+        !reserve_canvas(canvas, config->num_signals, 2 * width > grid_rects ? 2 * width : grid_rects)) {
+        draw_signals(renderer, history, config, useInterpolation);
+        draw_grid(renderer, history, config);
+        return;
+    }
+    uint64_t start_ns = monotonic_ns();
+    if (!canvas->layers_valid) render_grid_layers(renderer, config);
+
+    // A whole number of samples per column keeps column boundaries fixed
+    // while the history scrolls. The screen shows width - 1 completed
+    // columns plus the one being filled, one column short of the history.
+    int spc = history->capacity / (width + 1);
+    if (spc < 1) spc = 1;
+    long long completed = history->count / spc;
+    long long oldest = completed - (width - 1);
+
+    // Start over on a new history or mode, and when more than a screen
+    // behind: the skipped columns would not be visible anyway
+    if (!canvas->valid || canvas->samples_per_column != spc ||
+        canvas->interpolation != useInterpolation || canvas->next_column < oldest) {
+        canvas->samples_per_column = spc;
+        canvas->interpolation = useInterpolation;
+        canvas->next_column = oldest;
+        for (int s = 0; s < config->num_signals; s++) {
+            canvas->last_span[2 * s] = NO_ROW;
+        }
+        canvas->valid = true;
+    }
+
+    if (canvas->next_column < completed) {
+        SDL_SetRenderTarget(renderer, canvas->plot);
+        rasterize_columns(renderer, history, config, canvas->next_column,
+                          (int)(completed - canvas->next_column));
+        SDL_SetRenderTarget(renderer, NULL);
+        canvas->next_column = completed;
+    }
+
+    // Composite the ring starting at the oldest visible column; the slot
+    // after the newest one is left out, the partial column goes there
+    int start = ring_position(oldest, width);
+    int span = width - start < width - 1 ? width - start : width - 1;
+    SDL_Rect src = {start, 0, span, height};
+    SDL_Rect dst = {0, 0, span, height};
+    SDL_RenderCopy(renderer, canvas->plot, &src, &dst);
+    if (span < width - 1) {
+        src = (SDL_Rect){0, 0, width - 1 - span, height};
+        dst = (SDL_Rect){span, 0, width - 1 - span, height};
+        SDL_RenderCopy(renderer, canvas->plot, &src, &dst);
+    }
+    draw_partial_column(renderer, history, config, completed);
+
+    SDL_RenderCopy(renderer, canvas->grid, NULL, NULL);
+    SDL_Rect tick_src = {(int)(completed % GRID_SPACING), 0, width, TICK_LENGTH};
+    SDL_Rect tick_dst = {0, height - TICK_LENGTH, width, TICK_LENGTH};
+    SDL_RenderCopy(renderer, canvas->ticks, &tick_src, &tick_dst);
+    metrics_record(METRIC_DRAW_SIGNALS, monotonic_ns() - start_ns);
+}
+
+// Frequencies at or below this are drawn at its position on a log axis
+#define LOG_AXIS_FLOOR 1e-30
+// Bode view: panes between these margins, at most this many dB tall
+#define BODE_TOP 110
+#define BODE_BOTTOM_MARGIN 50
+#define BODE_PANE_GAP 10
+#define BODE_MAX_DB_RANGE 200.0
+
+// Position of a scale value on the view's x axis: log10 of the frequency on
+// a log axis, the value itself otherwise
+static double view_axis(const PlotView* view, double scale) {
+    if (!view->log_scale) return scale;
+    return log10(scale > LOG_AXIS_FLOOR ? scale : LOG_AXIS_FLOOR);
+}
+
+static double view_scale(const PlotView* view, double axis) {
+    return view->log_scale ? pow(10.0, axis) : axis;
+}
+
+// Recorded range in axis units
+static bool view_range(const PlotView* view, double* first, double* last) {
+    if (!view->store || !waveform_store_time_range(view->store, first, last)) return false;
+    *first = view_axis(view, *first);
+    *last = view_axis(view, *last);
+    return true;
+}
+
+// x of a time in the view; far-away samples are pinned well off screen
+static int view_x(const PlotView* view, double time, int width) {
+    double x = (view_axis(view, time) - view->t_start) / (view->t_end - view->t_start) * width;
+    if (x < -width) return -width;
+    if (x > 2.0 * width) return 2 * width;
+    return (int)x;
+}
+
+// First sample of every pixel column into scratch->col_first
+static bool view_columns(PlotConfig* config) {
+    PlotView* view = &config->view;
+    int width = config->window_width;
+    // The columns plus the samples just outside the view on either side
+    if (!view->store || !reserve_scratch(&config->scratch, width + 2)) return false;
+    double span = view->t_end - view->t_start;
+    for (int c = 0; c <= width; c++) {
+        config->scratch.col_first[c] =
+            waveform_store_lower_bound(view->store, view_scale(view, view->t_start + span * c / width));
+    }
+    return true;
+}
+
+// One column of the store over the columns found by view_columns: a min/max
+// span per non-empty pixel column, y = center - value * scale clamped to
+// [y_min, y_max]
+static void draw_view_trace(SDL_Renderer* renderer, PlotConfig* config, int s, int center, double scale,
+                            int y_min, int y_max, SDL_Color color, int useInterpolation) {
+    const PlotView* view = &config->view;
+    const WaveformStore* store = view->store;
+    int width = config->window_width;
+    RenderScratch* scratch = &config->scratch;
+    const long long* col_first = scratch->col_first;
+    long long count = waveform_store_count(store);
+
+    // Non-empty columns only; with few samples in view the polyline
+    // runs straight from one sample to the next
+    int n = 0;
+    if (col_first[0] > 0) {
+        long long i = col_first[0] - 1;
+        scratch->col_min[n] = scratch->col_max[n] = waveform_store_value(store, s, i);
+        scratch->col_x[n++] = view_x(view, waveform_store_time_at(store, i), width);
+    }
+    for (int c = 0; c < width; c++) {
+        if (col_first[c + 1] == col_first[c]) continue;
+        waveform_store_minmax(store, s, col_first[c], col_first[c + 1] - col_first[c],
+                              &scratch->col_min[n], &scratch->col_max[n]);
+        scratch->col_x[n++] = c;
+    }
+    if (col_first[width] < count) {
+        long long i = col_first[width];
+        scratch->col_min[n] = scratch->col_max[n] = waveform_store_value(store, s, i);
+        scratch->col_x[n++] = view_x(view, waveform_store_time_at(store, i), width);
+    }
+
+    pixel_transform(scratch->col_max, n, center, scale, y_min, y_max, scratch->col_top);
+    pixel_transform(scratch->col_min, n, center, scale, y_min, y_max, scratch->col_bottom);
+
+    // Same nearest-end ordering as draw_signals
+    SDL_Point* points = scratch->points;
+    int num_points = 0;
+    int prev_y = 0;
+    for (int i = 0; i < n; i++) {
+        int top = scratch->col_top[i];
+        int bottom = scratch->col_bottom[i];
+        if (i > 0 && abs(bottom - prev_y) < abs(top - prev_y)) {
+            int tmp = top;
+            top = bottom;
+            bottom = tmp;
+        }
+        points[num_points++] = (SDL_Point){scratch->col_x[i], top};
+        if (bottom != top) {
+            points[num_points++] = (SDL_Point){scratch->col_x[i], bottom};
+        }
+        prev_y = bottom;
+    }
+
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+    if (useInterpolation) {
+        SDL_RenderDrawLines(renderer, points, num_points);
+    } else {
+        SDL_RenderDrawPoints(renderer, points, num_points);
+    }
+}
+
+void draw_waveform_view(SDL_Renderer* renderer, PlotConfig* config, int useInterpolation) {
+    PlotView* view = &config->view;
+    if (!view_columns(config)) return;
+    uint64_t start_ns = monotonic_ns();
+
+    for (int s = 0; s < config->num_signals && s < waveform_store_num_signals(view->store); s++) {
+        draw_view_trace(renderer, config, s, config->center_y, config->amplitude, -1, config->window_height,
+                        plot_palette_color(s), useInterpolation);
+    }
+    draw_grid(renderer, NULL, config);
+
+    char text[96];
+    snprintf(text, sizeof(text), "t %.6g s .. %.6g s   [f] live", view->t_start, view->t_end);
+    stringRGBA(renderer, 10, config->window_height - 20, text, 200, 200, 200, 255);
+    metrics_record(METRIC_DRAW_SIGNALS, monotonic_ns() - start_ns);
+}
+
+static void format_frequency(char* text, size_t size, double hz) {
+    static const char* prefixes[] = {"", "k", "M", "G", "T"};
+    int p = 0;
+    while (p < 4 && fabs(hz) >= 1000.0) {
+        hz /= 1000.0;
+        p++;
+    }
+    snprintf(text, size, "%g%sHz", hz, prefixes[p]);
+}
+
+// Decade lines (and 2..9 within them when few decades are in view) across
+// both panes, labelled below the phase pane
+static void draw_bode_grid(SDL_Renderer* renderer, const PlotConfig* config, int top, int bottom) {
+    const PlotView* view = &config->view;
+    int width = config->window_width;
+    double span = view->t_end - view->t_start;
+    bool minor = span <= 4.0;
+    char text[32];
+    for (double decade = floor(view->t_start); decade <= view->t_end; decade += 1.0) {
+        for (int m = 1; m <= 9; m++) {
+            if (m > 1 && !minor) break;
+            double axis = decade + log10((double)m);
+            if (axis < view->t_start || axis > view->t_end) continue;
+            int x = (int)((axis - view->t_start) / span * width);
+            Uint8 level = m == 1 ? 90 : 45;
+            SDL_SetRenderDrawColor(renderer, level, level, level, 255);
+            SDL_RenderDrawLine(renderer, x, top, x, bottom);
+            if (m == 1) {
+                format_frequency(text, sizeof(text), pow(10.0, decade));
+                stringRGBA(renderer, x + 2, bottom + 4, text, 200, 200, 200, 255);
+            }
+        }
+    }
+}
+
+// Horizontal lines every step units of a pane, labelled at the left edge
+static void draw_pane_ticks(SDL_Renderer* renderer, const PlotConfig* config, double lo, double hi, double step,
+                            int top, int bottom, const char* unit) {
+    double scale = (bottom - top) / (hi - lo);
+    char text[32];
+    for (double v = ceil(lo / step) * step; v <= hi; v += step) {
+        int y = bottom - (int)((v - lo) * scale);
+        SDL_SetRenderDrawColor(renderer, 60, 60, 60, 255);
+        SDL_RenderDrawLine(renderer, 0, y, config->window_width - 1, y);
+        snprintf(text, sizeof(text), "%g %s", v, unit);
+        stringRGBA(renderer, 4, y - 9, text, 160, 160, 160, 255);
+    }
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    SDL_Rect frame = {0, top, config->window_width, bottom - top + 1};
+    SDL_RenderDrawRect(renderer, &frame);
+}
+
+void draw_bode_view(SDL_Renderer* renderer, PlotConfig* config, int useInterpolation) {
+    PlotView* view = &config->view;
+    const WaveformStore* store = view->store;
+    uint64_t start_ns = monotonic_ns();
+
+    // Without zoom the whole sweep so far; a single point gets a decade
+    if (!view->active) {
+        double first, last;
+        if (!view_range(view, &first, &last)) return;
+        view->t_start = last > first ? first : first - 0.5;
+        view->t_end = last > first ? last : first + 0.5;
+    }
+    if (!view_columns(config)) return;
+
+    int width = config->window_width;
+    int phase_bottom = config->window_height - BODE_BOTTOM_MARGIN;
+    int split = BODE_TOP + (phase_bottom - BODE_TOP) * 3 / 5;
+    int magnitude_bottom = split - BODE_PANE_GAP / 2;
+    int phase_top = split + BODE_PANE_GAP / 2;
+    int traces = config->num_signals < waveform_store_num_signals(store)
+                 ? config->num_signals : waveform_store_num_signals(store);
+
+    // dB range of what is in view, in whole 10 dB steps; -inf (exact zeros)
+    // sits at the bottom edge
+    const long long* col_first = config->scratch.col_first;
+    long long first = col_first[0] > 0 ? col_first[0] - 1 : 0;
+    long long last = col_first[width] < waveform_store_count(store) ? col_first[width] + 1 : col_first[width];
+    double lo = INFINITY;
+    double hi = -INFINITY;
+    for (int s = 0; s < traces && last > first; s++) {
+        if (config->trace_kinds && config->trace_kinds[s] == TRACE_PHASE) continue;
+        double min, max;
+        waveform_store_minmax(store, s, first, last - first, &min, &max);
+        if (isfinite(min) && min < lo) lo = min;
+        if (isfinite(max) && max > hi) hi = max;
+    }
+    if (!(hi >= lo)) {
+        lo = -60.0;
+        hi = 0.0;
+    }
+    hi = ceil(hi / 10.0) * 10.0;
+    lo = floor(lo / 10.0) * 10.0;
+    if (lo < hi - BODE_MAX_DB_RANGE) lo = hi - BODE_MAX_DB_RANGE;
+    if (hi - lo < 10.0) lo = hi - 10.0;
+    double db_step = 10.0;
+    while ((hi - lo) / db_step > 8.0) db_step *= 2.0;
+
+    draw_pane_ticks(renderer, config, lo, hi, db_step, BODE_TOP, magnitude_bottom, "dB");
+    draw_pane_ticks(renderer, config, -180.0, 180.0, 90.0, phase_top, phase_bottom, "deg");
+    draw_bode_grid(renderer, config, BODE_TOP, phase_bottom);
+
+    double magnitude_scale = (magnitude_bottom - BODE_TOP) / (hi - lo);
+    int magnitude_center = magnitude_bottom + (int)lround(lo * magnitude_scale);
+    double phase_scale = (phase_bottom - phase_top) / 360.0;
+    int phase_center = (phase_top + phase_bottom) / 2;
+    for (int s = 0; s < traces; s++) {
+        SDL_Color color = plot_palette_color(config->trace_colors ? config->trace_colors[s] : s);
+        if (config->trace_kinds && config->trace_kinds[s] == TRACE_PHASE) {
+            draw_view_trace(renderer, config, s, phase_center, phase_scale, phase_top, phase_bottom,
+                            color, useInterpolation);
+        } else {
+            draw_view_trace(renderer, config, s, magnitude_center, magnitude_scale, BODE_TOP, magnitude_bottom,
+                            color, useInterpolation);
+        }
+    }
+
+    char from[32];
+    char to[32];
+    char text[128];
+    format_frequency(from, sizeof(from), pow(10.0, view->t_start));
+    format_frequency(to, sizeof(to), pow(10.0, view->t_end));
+    snprintf(text, sizeof(text), "f %s .. %s%s", from, to, view->active ? "   [f] whole sweep" : "");
+    stringRGBA(renderer, 10, config->window_height - 20, text, 200, 200, 200, 255);
+    metrics_record(METRIC_DRAW_SIGNALS, monotonic_ns() - start_ns);
+}
+
+// Leave the live view: start from the time range it currently shows, or
+// from the whole sweep on a log axis
+static bool begin_view(PlotConfig* config) {
+    PlotView* view = &config->view;
+    if (view->active) return true;
+    double first, last;
+    if (!view_range(view, &first, &last) || last <= first) {
+        return false;
+    }
+    long long count = waveform_store_count(view->store);
+    long long shown = config->canvas.samples_per_column > 0
+                      ? (long long)config->canvas.samples_per_column * (config->window_width - 1)
+                      : BUFFER_SIZE;
+    view->t_start = count > shown && !view->log_scale
+                    ? waveform_store_time_at(view->store, count - shown) : first;
+    view->t_end = last;
+    view->active = true;
+    return true;
+}
+
+// Keep the view within sensible bounds of the recorded time range: a span
+// between a billionth and 1.5 times the run, and at least a tenth of the
+// view over data. Zoomed out past the whole run, the run is centred.
+static void clamp_view(PlotView* view, double anchor, double fraction) {
+    double first, last;
+    if (!view_range(view, &first, &last)) return;
+    double range = last - first;
+    double span = view->t_end - view->t_start;
+    double min_span = range * 1e-9 > 1e-18 ? range * 1e-9 : 1e-18;
+    if (span < min_span) span = min_span;
+    if (span > 1.5 * range) span = 1.5 * range;
+
+    view->t_start = anchor - fraction * span;
+    if (span >= range) {
+        view->t_start = first - (span - range) / 2;
+    } else if (view->t_start > last - 0.1 * span) {
+        view->t_start = last - 0.1 * span;
+    } else if (view->t_start < first - 0.9 * span) {
+        view->t_start = first - 0.9 * span;
+    }
+    view->t_end = view->t_start + span;
+}
+
+static void zoom_view(PlotConfig* config, int mouse_x, int steps) {
+    PlotView* view = &config->view;
+    double fraction = (double)mouse_x / config->window_width;
+    double span = view->t_end - view->t_start;
+    double anchor = view->t_start + fraction * span;
+    view->t_start = anchor - fraction * span;
+    view->t_end = view->t_start + span * pow(0.8, steps);
+    clamp_view(view, anchor, fraction);
+}
+
+void draw_metrics_overlay(SDL_Renderer* renderer, PlotConfig* config) {
+    static const struct {
+        MetricHistogramId id;
+        const char* label;
+    } rows[] = {
+        {METRIC_NG_DATA, "ng_data"},
+        {METRIC_QUEUE_LAG, "queue lag"},
+        {METRIC_FRAME, "frame"},
+        {METRIC_DRAW_SIGNALS, "draw_signals"},
+        {METRIC_HALT, "halt/resume"}
+    };
+    int num_rows = sizeof(rows) / sizeof(rows[0]);
+    MetricsOverlay* overlay = &config->overlay;
+    if (!overlay->visible) return;
+
+    uint64_t now_ns = monotonic_ns();
+    if (now_ns - overlay->last_ns >= METRICS_OVERLAY_REFRESH_NS) {
+        uint64_t samples = metrics_counter(METRIC_SAMPLES);
+        uint64_t csv_bytes = metrics_counter(METRIC_CSV_BYTES);
+        if (overlay->last_ns != 0) {
+            double elapsed = (now_ns - overlay->last_ns) * 1e-9;
+            overlay->sample_rate = (samples - overlay->last_samples) / elapsed;
+            overlay->csv_rate = (csv_bytes - overlay->last_csv_bytes) / elapsed;
+        }
+        overlay->last_ns = now_ns;
+        overlay->last_samples = samples;
+        overlay->last_csv_bytes = csv_bytes;
+    }
+
+    int width = 320;
+    int x = config->window_width - width - 10;
+    int y = 10;
+    boxRGBA(renderer, x - 5, y - 5, x + width, y + (num_rows + 2) * 12 + 2, 0, 0, 0, 180);
+
+    char line[96];
+    stringRGBA(renderer, x, y, "              p50      p99      max", 160, 160, 160, 255);
+    for (int i = 0; i < num_rows; i++) {
+        MetricSummary summary;
+        char p50[16], p99[16], max[16];
+        metrics_summarize(rows[i].id, &summary);
+        metrics_format_ns(p50, sizeof(p50), summary.p50);
+        metrics_format_ns(p99, sizeof(p99), summary.p99);
+        metrics_format_ns(max, sizeof(max), summary.max);
+        snprintf(line, sizeof(line), "%-13s %-8s %-8s %s", rows[i].label,
+                 summary.count ? p50 : "-", summary.count ? p99 : "-", summary.count ? max : "-");
+        stringRGBA(renderer, x, y + (i + 1) * 12, line, 220, 220, 220, 255);
+    }
+    snprintf(line, sizeof(line), "%.0f samples/s  CSV %.1f MB/s",
+             overlay->sample_rate, overlay->csv_rate / (1024.0 * 1024.0));
+    stringRGBA(renderer, x, y + (num_rows + 1) * 12, line, 220, 220, 220, 255);
+}
+
+// Table of the measured signals at the bottom, their spectra above it on
+// the right, each in its signal's colour
+void draw_measure_panel(SDL_Renderer* renderer, PlotConfig* config) {
+    MeasurePanel* panel = &config->measure;
+    if (!panel->visible || !panel->engine) return;
+
+    uint64_t now_ns = monotonic_ns();
+    if (panel->last_ns == 0 || now_ns - panel->last_ns >= METRICS_OVERLAY_REFRESH_NS) {
+        int count = measure_snapshot(panel->engine, NULL, 0);
+        if (count > panel->capacity) {
+            MeasureResult* results = realloc(panel->results, count * sizeof(MeasureResult));
+            if (results) {
+                panel->results = results;
+                panel->capacity = count;
             }
         }
+        count = measure_snapshot(panel->engine, panel->results, panel->capacity);
+        panel->count = count < panel->capacity ? count : panel->capacity;
+        panel->last_ns = now_ns;
+    }
+
+    int rows = panel->count < MEASURE_PANEL_ROWS ? panel->count : MEASURE_PANEL_ROWS;
+    int x = 10;
+    int y = config->window_height - 48 - (rows + 1) * 12;
+    boxRGBA(renderer, x - 5, y - 5, x + 590, y + (rows + 1) * 12, 0, 0, 0, 180);
+    stringRGBA(renderer, x, y, "signal        min      max     mean      rms     rise   settle      peak",
+               160, 160, 160, 255);
+    char line[128];
+    for (int i = 0; i < rows; i++) {
+        const MeasureResult* r = &panel->results[i];
+        char rise[16] = "-", settle[16] = "-", peak[16] = "-";
+        if (r->step_valid && !isnan(r->rise_time)) snprintf(rise, sizeof(rise), "%.3gs", r->rise_time);
+        if (r->step_valid) {
+            snprintf(settle, sizeof(settle), "%s%.3gs", r->step_settled ? "" : "~", r->settling_time);
+        }
+        if (r->spectrum_valid && r->peak_amplitude > 0.0) snprintf(peak, sizeof(peak), "%.3gHz", r->peak_frequency);
+        snprintf(line, sizeof(line), "%-8.8s %8.3g %8.3g %8.3g %8.3g %8s %8s %9s",
+                 r->name, r->min, r->max, r->mean, r->rms, rise, settle, peak);
+        SDL_Color color = plot_palette_color(r->signal);
+        stringRGBA(renderer, x, y + (i + 1) * 12, line, color.r, color.g, color.b, 255);
+    }
+
+    // Spectra in dB below the strongest bin shown
+    const int bins = MEASURE_FFT_SIZE / 2;
+    const int box_w = 2 * (bins - 1);
+    const int box_h = 80;
+    const double range_db = 60.0;
+    int box_x = config->window_width - box_w - 15;
+    int box_y = y - box_h - 20;
+    double reference = 0.0;
+    double nyquist = 0.0;
+    for (int i = 0; i < rows; i++) {
+        const MeasureResult* r = &panel->results[i];
+        if (!r->spectrum_valid) continue;
+        for (int k = 1; k < bins; k++) {
+            if (r->spectrum[k] > reference) reference = r->spectrum[k];
+        }
+        if (nyquist == 0.0) nyquist = 0.5 / r->fft_dt;
+    }
+    if (reference <= 0.0) return;
+
+    boxRGBA(renderer, box_x - 5, box_y - 15, box_x + box_w + 5, box_y + box_h + 5, 0, 0, 0, 180);
+    snprintf(line, sizeof(line), "spectrum 0..%.3g Hz, %g dB", nyquist, range_db);
+    stringRGBA(renderer, box_x, box_y - 12, line, 160, 160, 160, 255);
+    SDL_Point points[MEASURE_FFT_SIZE / 2];
+    for (int i = 0; i < rows; i++) {
+        const MeasureResult* r = &panel->results[i];
+        if (!r->spectrum_valid) continue;
+        for (int k = 1; k < bins; k++) {
+            double db = r->spectrum[k] > 0.0f ? 20.0 * log10(r->spectrum[k] / reference) : -range_db;
+            if (db < -range_db) db = -range_db;
+            points[k - 1] = (SDL_Point){box_x + 2 * (k - 1), box_y + (int)(-db / range_db * box_h)};
+        }
+        SDL_Color color = plot_palette_color(r->signal);
+        SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 255);
+        SDL_RenderDrawLines(renderer, points, bins - 1);
     }
 }
 
-void handle_events(SDL_Event* e, PlotConfig* config, int* quit, int* useInterpolation) {
+bool handle_events(SDL_Event* e, PlotConfig* config, int* quit, int* useInterpolation) {
+    Slider* sliders[] = {
+        &config->amplitude_slider,
+        &config->resistance_slider,
+        &config->capacitance_slider
+    };
+    int num_sliders = sizeof(sliders) / sizeof(sliders[0]);
+    bool changed = false;
+
     if (e->type == SDL_QUIT) {
         *quit = 1;
     } else if (e->type == SDL_KEYDOWN) {
         if (e->key.keysym.sym == SDLK_i) {
             *useInterpolation = !(*useInterpolation);
+            changed = true;
+        } else if (e->key.keysym.sym == SDLK_m) {
+            config->overlay.visible = !config->overlay.visible;
+            changed = true;
+        } else if (e->key.keysym.sym == SDLK_a) {
+            config->measure.visible = !config->measure.visible;
+            changed = true;
+        } else if (e->key.keysym.sym == SDLK_f || e->key.keysym.sym == SDLK_HOME) {
+            changed = config->view.active;
+            config->view.active = false;
+        }
+    } else if (e->type == SDL_MOUSEWHEEL) {
+        int steps = e->wheel.direction == SDL_MOUSEWHEEL_FLIPPED ? -e->wheel.y : e->wheel.y;
+        int mouse_x = 0;
+        SDL_GetMouseState(&mouse_x, NULL);
+        if (steps != 0 && begin_view(config)) {
+            zoom_view(config, mouse_x, steps);
+            changed = true;
         }
+    } else if (e->type == SDL_WINDOWEVENT) {
+        // Exposed, restored, resized: the window content has to be redrawn
+        changed = true;
+    } else if (e->type == SDL_RENDER_TARGETS_RESET) {
+        // Texture contents are gone, render the layers and columns again
+        config->canvas.layers_valid = false;
+        config->canvas.valid = false;
+        changed = true;
     } else if (e->type == SDL_MOUSEBUTTONDOWN) {
-        if (is_point_in_slider(&config->amplitude_slider, e->button.x, e->button.y)) {
-            config->amplitude_slider.dragging = true;
-            update_slider_value(&config->amplitude_slider, e->button.x);
+        bool on_slider = false;
+        for (int i = 0; i < num_sliders; i++) {
+            if (is_point_in_slider(sliders[i], e->button.x, e->button.y)) {
+                sliders[i]->dragging = true;
+                update_slider_value(sliders[i], e->button.x);
+                on_slider = true;
+                changed = true;
+            }
+        }
+        // Dragging anywhere else pans; the live view is left on the first move
+        if (!on_slider && e->button.button == SDL_BUTTON_LEFT) {
+            config->view.panning = true;
+            config->view.pan_x = e->button.x;
+            config->view.pan_t_start = config->view.t_start;
         }
     } else if (e->type == SDL_MOUSEBUTTONUP) {
-        config->amplitude_slider.dragging = false;
+        for (int i = 0; i < num_sliders; i++) {
+            sliders[i]->dragging = false;
+        }
+        config->view.panning = false;
     } else if (e->type == SDL_MOUSEMOTION) {
-        if (config->amplitude_slider.dragging) {
-            update_slider_value(&config->amplitude_slider, e->motion.x);
+        for (int i = 0; i < num_sliders; i++) {
+            if (sliders[i]->dragging) {
+                update_slider_value(sliders[i], e->motion.x);
+                changed = true;
+            }
+        }
+        PlotView* view = &config->view;
+        if (view->panning && e->motion.x != view->pan_x) {
+            if (!view->active) {
+                if (!begin_view(config)) return changed;
+                view->pan_t_start = view->t_start;
+            }
+            double span = view->t_end - view->t_start;
+            view->t_start = view->pan_t_start - (e->motion.x - view->pan_x) * span / config->window_width;
+            view->t_end = view->t_start + span;
+            clamp_view(view, view->t_start, 0.0);
+            changed = true;
         }
     }
+    return changed;
 }
 
-void cleanup(SDL_Renderer* renderer, SDL_Window* window, double** buffers, PlotConfig* config) {
-    for (int i = 0; i < config->num_signals; i++) {
-        free(buffers[i]);
-    }
-    free(buffers);
+void cleanup(SDL_Renderer* renderer, SDL_Window* window, SignalHistory* history, PlotConfig* config) {
+    history_destroy(history);
+    free_render_scratch(&config->scratch);
+    free(config->measure.results);
+    destroy_plot_canvas(&config->canvas);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
 }
 
-void update_buffers(double** buffers, SignalValues values, PlotConfig* config) {
-    if (!buffers || config->num_signals == 0) return;  // Safety check
-    for (int i = 0; i < config->num_signals; i++) {
-        memmove(buffers[i], buffers[i] + 1, (BUFFER_SIZE - 1) * sizeof(double));
-        buffers[i][BUFFER_SIZE - 1] = values.values[i];
-    }
-    config->tick_counter = (config->tick_counter + 1) % 50;
+void update_buffers(SignalHistory* history, const double* values, PlotConfig* config) {
+    if (!history || config->num_signals == 0) return;  // Safety check
+    history_append(history, values);
 }
 
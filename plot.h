@@ -8,8 +8,14 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include "history.h"
+#include "metrics.h"
+#include "measure.h"
+#include "waveform_store.h"
 
-#define BUFFER_SIZE 128000
+#define BUFFER_SIZE (1 << 17)  // Power of two so the min/max pyramid tiles the ring
+#define HISTORY_MEMORY_BUDGET ((size_t)512 << 20)  // Wide circuits get a shorter history
+#define GRID_SPACING 50
 
 typedef struct {
     int x;
@@ -22,40 +28,149 @@ typedef struct {
     float max_value;
     bool dragging;
     bool value_changed;
+    const char* label;  // Drawn next to the track with the current value, may be NULL
 } Slider;
 
+// Per-frame working memory of draw_signals, grown on demand and reused
+typedef struct {
+    double* col_min;
+    double* col_max;
+    int* col_top;      // Screen y of col_max / col_min
+    int* col_bottom;
+    int* col_x;        // Screen x of each entry (waveform view, skips empty columns)
+    long long* col_first;  // Waveform view: first sample index of each column
+    int columns_capacity;
+    SDL_Point* points;
+    int points_capacity;
+} RenderScratch;
+
+// Incremental renderer: every completed pixel column of the plot is
+// rasterized once into a texture used as a ring, the frame only composites
+// it. Column k covers samples [k * samples_per_column, (k + 1) * ...), so
+// scrolling is a change of the ring offset; the static grid and the scrolling
+// x ticks are cached layers as well.
+typedef struct {
+    SDL_Texture* plot;          // window_width x window_height ring of columns
+    SDL_Texture* grid;          // Axes and y ticks, transparent elsewhere
+    SDL_Texture* ticks;         // x ticks, GRID_SPACING wider than the window
+    bool unsupported;           // No render targets: full redraws every frame
+    bool layers_valid;          // Grid layers rendered (lost on a device reset)
+    bool valid;                 // Plot ring matches the fields below
+    int samples_per_column;
+    int interpolation;
+    long long next_column;      // Absolute index of the next column to rasterize
+    int* last_span;             // Per signal: top and bottom row of the previous column
+    int last_span_capacity;
+    SDL_Rect* rects;
+    int rects_capacity;
+} PlotCanvas;
+
+// Zoomed or panned view of the whole run, drawn from the WaveformStore with
+// a time-linear x axis, or a log-frequency axis for sweeps (log_scale).
+// Wheel zooms around the mouse, dragging the plot pans, 'f' or Home returns
+// to the live view, or to the whole sweep.
+typedef struct {
+    bool active;                 // false: the live history scrolls
+    bool log_scale;              // Frequency sweep: t_start and t_end are log10(Hz), see draw_bode_view
+    double t_start;              // Visible time range
+    double t_end;
+    bool panning;
+    int pan_x;                   // Mouse x and t_start when the drag began
+    double pan_t_start;
+    const WaveformStore* store;  // Set by the render loop, NULL before the first layout
+} PlotView;
+
+// What a plotted column holds. Frequency sweeps plot magnitude and phase,
+// which the Bode view puts into panes of their own.
+typedef enum {
+    TRACE_VALUE = 0,             // The signal's value (or real or imaginary part)
+    TRACE_MAGNITUDE,             // 20 log10 |z| in dB
+    TRACE_PHASE                  // arg z in degrees
+} TraceKind;
+
+// Metrics overlay, toggled with 'm'; rates are refreshed twice a second
+#define METRICS_OVERLAY_REFRESH_NS 500000000ull
+
+typedef struct {
+    bool visible;
+    uint64_t last_ns;
+    uint64_t last_samples;
+    uint64_t last_csv_bytes;
+    double sample_rate;
+    double csv_rate;
+} MetricsOverlay;
+
+// Measurement panel, toggled with 'a': the table of measure.h results and
+// their spectra, refreshed like the metrics overlay
+#define MEASURE_PANEL_ROWS 6
+
+typedef struct {
+    bool visible;
+    MeasureEngine* engine;       // NULL without --measure
+    MeasureResult* results;      // Last snapshot
+    int count;
+    int capacity;
+    uint64_t last_ns;
+} MeasurePanel;
+
 typedef struct {
     double time_increment;
     int window_width;
     int window_height;
     int center_y;
     int amplitude;
-    int num_signals;
-    SDL_Color colors[15];  // Basic color palette for plotting
+    int num_signals;         // Plotted columns (traces)
+    const TraceKind* trace_kinds; // Per column, NULL if all are TRACE_VALUE
+    const int* trace_colors; // Per column: palette index of its signal, NULL for the column index
+    HistoryStorage storage;  // Sample precision of the plot history
     Slider amplitude_slider;
-    int tick_counter;
+    Slider resistance_slider;
+    Slider capacitance_slider;
+    MetricsOverlay overlay;
+    MeasurePanel measure;
+    RenderScratch scratch;
+    PlotCanvas canvas;       // Reset `valid` whenever the history is replaced
+    PlotView view;
 } PlotConfig;
 
-typedef struct {
-    double values[15];  // Fixed size matching colors array
-} SignalValues;
-
-void drawLine(SDL_Renderer *renderer, int x1, int* y1, int x2, int* y2, PlotConfig* config);
 void draw_slider(SDL_Renderer* renderer, Slider* slider);
 bool is_point_in_slider(Slider* slider, int x, int y);
 void update_slider_value(Slider* slider, int x);
 PlotConfig setup_config(void);
-void update_buffers(double** buffers, SignalValues values, PlotConfig* config);
+void update_buffers(SignalHistory* history, const double* values, PlotConfig* config);
+
+// Color of the index-th signal: a fixed base palette, then generated hues
+SDL_Color plot_palette_color(int index);
 
 // SDL initialization functions
 SDL_Window* init_sdl(PlotConfig* config);
 SDL_Renderer* create_renderer(SDL_Window* window);
-double** init_buffers(PlotConfig* config);
+bool renderer_has_vsync(SDL_Renderer* renderer);
+SignalHistory* init_buffers(PlotConfig* config);
 
 // Drawing functions
-void draw_grid(SDL_Renderer* renderer, PlotConfig* config);
-void draw_signals(SDL_Renderer* renderer, double** buffers, PlotConfig* config, int useInterpolation);
-void handle_events(SDL_Event* e, PlotConfig* config, int* quit, int* useInterpolation);
-void cleanup(SDL_Renderer* renderer, SDL_Window* window, double** buffers, PlotConfig* config);
+void draw_grid(SDL_Renderer* renderer, SignalHistory* history, PlotConfig* config);
+void draw_signals(SDL_Renderer* renderer, SignalHistory* history, PlotConfig* config, int useInterpolation);
+void free_render_scratch(RenderScratch* scratch);
+
+// Signals and grid through the PlotCanvas: only columns completed since the
+// last frame are rasterized. Falls back to draw_signals + draw_grid when the
+// renderer has no render targets.
+void draw_plot(SDL_Renderer* renderer, SignalHistory* history, PlotConfig* config, int useInterpolation);
+void destroy_plot_canvas(PlotCanvas* canvas);
+
+// Signals of config->view: one min/max span per pixel column of time,
+// columns found by binary search in the store
+void draw_waveform_view(SDL_Renderer* renderer, PlotConfig* config, int useInterpolation);
+
+// Frequency sweep on a log axis: magnitudes in dB above, phases below, each
+// column a min/max span as in draw_waveform_view. Shows the whole sweep
+// unless the view was zoomed or panned.
+void draw_bode_view(SDL_Renderer* renderer, PlotConfig* config, int useInterpolation);
+void draw_metrics_overlay(SDL_Renderer* renderer, PlotConfig* config);
+void draw_measure_panel(SDL_Renderer* renderer, PlotConfig* config);
+// Returns true if the event changed what is on screen
+bool handle_events(SDL_Event* e, PlotConfig* config, int* quit, int* useInterpolation);
+void cleanup(SDL_Renderer* renderer, SDL_Window* window, SignalHistory* history, PlotConfig* config);
 
 #endif // PLOT_H
@@ -1,13 +1,253 @@
-import pandas as pd
+import mmap
+import os
+import struct
+import sys
+import time
+
+import numpy as np
 import matplotlib.pyplot as plt
 
-# Read the CSV file
-df = pd.read_csv('simulation_data.csv')
+RESULT_FILE = 'simulation_data.ngres'
+
+# Layout of the binary result format, see result_file.h
+HEADER = struct.Struct('<8sIIIIQ')       # magic, version, flags, vectors, columns, header size
+CHUNK_HEADER = struct.Struct('<IIQ')     # magic, rows, bytes (0 in version 1)
+CHUNK_INFO = struct.Struct('<QQdd')      # offset, rows, first scale, last scale
+TRAILER = struct.Struct('<QQQ8s')        # index offset, chunks, rows, magic
+CHUNK_MAGIC = 0x4b4e4843
+FLAG_COMPRESSED = 0x2
+
+# Compressed column blocks, see column_codec.h
+BLOCK_HEADER = struct.Struct('<IIII')    # codec, values, stream bytes, reserved
+CODEC_XOR, CODEC_DOD = 1, 2
+DOD_WIDTHS = (7, 9, 12, 32, 64)
+MASK64 = (1 << 64) - 1
+
+
+class BitReader:
+    """Most significant bit first across native little-endian 64-bit words."""
+
+    def __init__(self, words):
+        self.words = words
+        self.next = 0
+        self.acc = 0
+        self.avail = 0
+
+    def read(self, n):
+        while self.avail < n:
+            self.acc = (self.acc << 64) | self.words[self.next]
+            self.next += 1
+            self.avail += 64
+        self.avail -= n
+        value = self.acc >> self.avail
+        self.acc &= (1 << self.avail) - 1
+        return value
+
+
+def decode_block(data, offset):
+    """Decode the column block at offset, return (float64 array, bytes used)."""
+    codec, count, nbytes, _ = BLOCK_HEADER.unpack_from(data, offset)
+    stream = np.frombuffer(data, dtype='<u8', count=nbytes // 8, offset=offset + BLOCK_HEADER.size)
+    bits = np.empty(count, dtype=np.uint64)
+    if count:
+        reader = BitReader(stream.tolist())
+        prev = reader.read(64)
+        bits[0] = prev
+        if codec == CODEC_DOD:
+            delta = 0
+            for i in range(1, count):
+                ones = 0
+                while ones < 5 and reader.read(1):
+                    ones += 1
+                if ones:
+                    width = DOD_WIDTHS[ones - 1]
+                    dod = reader.read(width)
+                    if width < 64 and dod >> (width - 1):
+                        dod -= 1 << width
+                    delta = (delta + dod) & MASK64
+                prev = (prev + delta) & MASK64
+                bits[i] = prev
+        else:
+            leading = meaningful = 0
+            for i in range(1, count):
+                if reader.read(1):
+                    if reader.read(1):
+                        leading = reader.read(5)
+                        meaningful = reader.read(6) + 1
+                    prev ^= reader.read(meaningful) << (64 - leading - meaningful)
+                bits[i] = prev
+    return bits.view('<f8'), BLOCK_HEADER.size + nbytes
+
+
+def load_results(path):
+    """Map a .ngres file and return {vector name: numpy array}.
+
+    Column blocks are read straight from a numpy.memmap of the file at full
+    float64 precision; compressed files are decoded losslessly (in Python,
+    so noticeably slower). Complex vectors come back as complex arrays.
+    """
+    data = np.memmap(path, dtype=np.uint8, mode='r')
+    magic, version, flags, num_vectors, num_columns, header_size = HEADER.unpack_from(data, 0)
+    if magic != b'NGRES01\0' or version not in (1, 2):
+        raise ValueError(f'{path} is not a result file')
+    compressed = bool(flags & FLAG_COMPRESSED)
+
+    names, is_complex = [], []
+    offset = HEADER.size
+    for _ in range(num_vectors):
+        vec_flags, length = struct.unpack_from('<HH', data, offset)
+        names.append(bytes(data[offset + 4:offset + 4 + length]).decode())
+        is_complex.append(bool(vec_flags & 1))
+        offset += (4 + length + 7) & ~7
+
+    # Chunk index from the trailer, or walk the chunks of an unfinished file
+    chunks = []
+    index_offset, num_chunks, _, end_magic = TRAILER.unpack_from(data, len(data) - TRAILER.size)
+    if end_magic == b'NGEND01\0':
+        for i in range(num_chunks):
+            chunk_offset, rows, _, _ = CHUNK_INFO.unpack_from(data, index_offset + i * CHUNK_INFO.size)
+            chunks.append((chunk_offset, rows))
+    else:
+        offset = header_size
+        while offset + CHUNK_HEADER.size <= len(data):
+            chunk_magic, rows, nbytes = CHUNK_HEADER.unpack_from(data, offset)
+            end = offset + CHUNK_HEADER.size + (nbytes or rows * num_columns * 8)
+            if chunk_magic != CHUNK_MAGIC or rows == 0 or end > len(data):
+                break
+            chunks.append((offset, rows))
+            offset = end
+
+    columns = [[] for _ in range(num_columns)]
+    for chunk_offset, rows in chunks:
+        if compressed:
+            offset = chunk_offset + CHUNK_HEADER.size
+            for c in range(num_columns):
+                values, used = decode_block(data, offset)
+                columns[c].append(values)
+                offset += used
+            continue
+        block = np.ndarray((num_columns, rows), dtype='<f8', buffer=data,
+                           offset=chunk_offset + CHUNK_HEADER.size)
+        for c in range(num_columns):
+            columns[c].append(block[c])
+
+    result = {}
+    column = 0
+    for name, cplx in zip(names, is_complex):
+        values = np.concatenate(columns[column]) if chunks else np.empty(0)
+        column += 1
+        if cplx:
+            imag = np.concatenate(columns[column]) if chunks else np.empty(0)
+            values = values + 1j * imag
+            column += 1
+        result[name] = values
+    return result
+
+
+# Layout of the shared-memory ring, see shm_ring.h
+SHM_HEADER = struct.Struct('<8sIIQQQ')   # magic, version, header size, total size, data offset, data size
+SHM_LAYOUT = struct.Struct('<QIIIII')    # first row, vectors, columns, capacity, slot size, flags
+SHM_LAYOUT_OFFSET = 56
+# Indices of the fields the writer updates, as uint32 and uint64 words
+SHM_LAYOUT_SEQ, SHM_STATE = 10, 11
+SHM_LAYOUT_VERSION, SHM_WRITE_INDEX = 6, 11
+
+
+def load_shm(name, poll=0.05):
+    """Follow the ring /name that `simulation_plot --shm NAME` writes and
+    return {vector name: numpy array} of the last vector layout once the
+    simulation has finished.
+
+    Rows are copied in batches through a structured numpy view of the slots
+    and kept only if their sequence was 2 * row + 2 before and after the
+    copy. Rows the writer overwrote before they were copied are counted and
+    reported, the writer never waits for us.
+    """
+    path = '/dev/shm/' + name.lstrip('/')
+    while not os.path.exists(path):
+        time.sleep(poll)
+    with open(path, 'rb') as f:
+        data = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    magic, version, header_size, _, data_offset, _ = SHM_HEADER.unpack_from(data, 0)
+    if magic != b'NGSHM01\0' or version != 1:
+        raise ValueError(f'{path} is not a sample ring')
+    words32 = np.ndarray(24, dtype='<u4', buffer=data)
+    words64 = np.ndarray(12, dtype='<u8', buffer=data)
+
+    layout_version = None
+    names, is_complex, blocks = [], [], []
+    cursor = lost = 0
+    while True:
+        finished = words32[SHM_STATE] == 1
+        seq = int(words32[SHM_LAYOUT_SEQ])
+        if seq & 1:
+            time.sleep(poll)
+            continue
+
+        if int(words64[SHM_LAYOUT_VERSION]) != layout_version:
+            layout_version = int(words64[SHM_LAYOUT_VERSION])
+            first_row, num_vectors, num_columns, capacity, _, _ = SHM_LAYOUT.unpack_from(data, SHM_LAYOUT_OFFSET)
+            names, is_complex, blocks = [], [], []
+            offset = header_size
+            for _ in range(num_vectors):
+                vec_flags, length = struct.unpack_from('<HH', data, offset)
+                names.append(bytes(data[offset + 4:offset + 4 + length]).decode())
+                is_complex.append(bool(vec_flags & 1))
+                offset += (4 + length + 7) & ~7
+            slots = None
+            if capacity:
+                slot_type = np.dtype([('seq', '<u8'), ('values', '<f8', (num_columns,))])
+                slots = np.ndarray(capacity, dtype=slot_type, buffer=data, offset=data_offset)
+            if int(words32[SHM_LAYOUT_SEQ]) != seq:
+                layout_version = None     # Rewritten while we read it
+                continue
+            lost += max(first_row - cursor, 0)
+            cursor = max(cursor, first_row)
+
+        written = int(words64[SHM_WRITE_INDEX])
+        if slots is not None and written > cursor:
+            start = max(cursor, written - capacity)
+            rows = np.arange(start, written, dtype=np.uint64)
+            index = rows & np.uint64(capacity - 1)
+            # Fancy indexing copies; the loads stay in order on x86
+            before = slots['seq'][index]
+            values = slots['values'][index]
+            after = slots['seq'][index]
+            if int(words32[SHM_LAYOUT_SEQ]) == seq:
+                valid = (before == 2 * rows + 2) & (after == before)
+                blocks.append(values[valid])
+                lost += (start - cursor) + int(np.count_nonzero(~valid))
+                cursor = written
+
+        if finished and cursor == int(words64[SHM_WRITE_INDEX]):
+            break
+        time.sleep(poll)
+
+    if lost:
+        print(f'{lost} rows were overwritten before they could be read', file=sys.stderr)
+    table = np.concatenate(blocks) if blocks else np.empty((0, sum(2 if c else 1 for c in is_complex)))
+    result = {}
+    column = 0
+    for name, cplx in zip(names, is_complex):
+        values = table[:, column]
+        column += 1
+        if cplx:
+            values = values + 1j * table[:, column]
+            column += 1
+        result[name] = values
+    return result
+
+
+# Follow a running simulation with --shm NAME, otherwise read the result file
+if len(sys.argv) == 3 and sys.argv[1] == '--shm':
+    results = load_shm(sys.argv[2])
+else:
+    results = load_results(RESULT_FILE)
 
 # Create the plot
 plt.figure(figsize=(10, 6))
-plt.plot(df['Time'], df['k'], label='Voltage at node k')
-plt.plot(df['Time'], df['y'], label='Input voltage (y)')
+plt.plot(results['time'], results['k'], label='Voltage at node k')
+plt.plot(results['time'], results['y'], label='Input voltage (y)')
 
 # Customize the plot
 plt.title('Circuit Simulation Results')
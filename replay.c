@@ -0,0 +1,592 @@
+#include "replay.h"
+#include "metrics.h"
+#include "result_file.h"
+#include "sample_queue.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Rows due sooner than this are sent right away, the pacing catches up later
+#define REPLAY_MIN_SLEEP_NS 1000000.0
+
+typedef struct {
+    char* name;                 // Plotname of the rawfile plot
+    int num_vectors;
+    char** names;
+    bool* is_complex;
+    int* first_column;
+    int num_columns;
+    uint64_t rows;
+    bool has_scale;             // Vector 0 is the scale
+    bool paced;                 // The scale is time
+    double first_scale;         // Scale of the first and last row (row numbers without a scale)
+    double last_scale;
+    const unsigned char* data;  // Rawfile: rows of num_columns float64, not necessarily aligned
+} ReplayPlot;
+
+struct Replay {
+    unsigned char* map;         // Rawfile mapping, NULL for a .ngres source
+    size_t size;
+    ResultFile result;
+    uint64_t* chunk_first;      // .ngres: first row of every chunk, num_chunks + 1 entries
+    uint64_t chunk;             // .ngres: chunk of the last row read (replay thread only)
+    ReplayPlot* plots;
+    int num_plots;
+    int max_vectors;
+    int max_columns;
+
+    SimContext* context;
+    pthread_t thread;
+    bool started;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     // CLOCK_MONOTONIC; wakes the pacing and pause waits
+    atomic_bool stop;
+    atomic_bool paused;
+    _Atomic double speed;
+    atomic_uint control_seq;    // Bumped by every control change, the thread then re-anchors its clock
+    bool seek_pending;          // Guarded by lock
+    double seek_scale;
+    atomic_int current_plot;
+    _Atomic double current_scale;
+    _Atomic uint64_t rows_sent;
+};
+
+// Rawfiles name node voltages v(x) and branch currents i(x); the shared
+// library sends x and x#branch, which is what the plot expects
+static char* vector_name(const char* raw) {
+    size_t len = strlen(raw);
+    if (len > 3 && raw[1] == '(' && raw[len - 1] == ')') {
+        if (raw[0] == 'v' || raw[0] == 'V') {
+            return strndup(raw + 2, len - 3);
+        }
+        if (raw[0] == 'i' || raw[0] == 'I') {
+            char* name = malloc(len - 3 + sizeof("#branch"));
+            if (name) sprintf(name, "%.*s#branch", (int)(len - 3), raw + 2);
+            return name;
+        }
+    }
+    return strdup(raw);
+}
+
+static void free_plot(ReplayPlot* plot) {
+    if (plot->names) {
+        for (int v = 0; v < plot->num_vectors; v++) {
+            free(plot->names[v]);
+        }
+    }
+    free(plot->name);
+    free(plot->names);
+    free(plot->is_complex);
+    free(plot->first_column);
+}
+
+static int add_plot(Replay* replay, const ReplayPlot* plot) {
+    ReplayPlot* plots = realloc(replay->plots, (replay->num_plots + 1) * sizeof(ReplayPlot));
+    if (!plots) return -1;
+    replay->plots = plots;
+    replay->plots[replay->num_plots++] = *plot;
+    if (plot->num_vectors > replay->max_vectors) replay->max_vectors = plot->num_vectors;
+    if (plot->num_columns > replay->max_columns) replay->max_columns = plot->num_columns;
+    return 0;
+}
+
+static int alloc_vectors(ReplayPlot* plot, int num_vectors) {
+    plot->names = calloc(num_vectors, sizeof(char*));
+    plot->is_complex = calloc(num_vectors, sizeof(bool));
+    plot->first_column = calloc(num_vectors, sizeof(int));
+    if (!plot->names || !plot->is_complex || !plot->first_column) return -1;
+    plot->num_vectors = num_vectors;
+    return 0;
+}
+
+static double rawfile_value(const ReplayPlot* plot, uint64_t row, int column) {
+    double value;
+    memcpy(&value, plot->data + (row * plot->num_columns + column) * sizeof(double), sizeof(double));
+    return value;
+}
+
+// Header lines up to "Binary:", then No. Points rows; further plots follow
+// directly. ASCII rawfiles ("Values:") are not supported.
+static int parse_rawfile(Replay* replay) {
+    size_t offset = 0;
+    while (offset < replay->size) {
+        ReplayPlot plot = {0};
+        int num_vars = -1;
+        uint64_t points = 0;
+        bool is_complex = false;
+        bool have_vars = false;
+        bool binary = false;
+
+        while (!binary) {
+            const unsigned char* start = replay->map + offset;
+            const unsigned char* end = memchr(start, '\n', replay->size - offset);
+            if (!end) break;
+            char* line = strndup((const char*)start, (size_t)(end - start));
+            offset = (size_t)(end - replay->map) + 1;
+            if (!line) break;
+
+            if (strncasecmp(line, "Plotname:", 9) == 0) {
+                free(plot.name);
+                plot.name = strdup(line + 9 + strspn(line + 9, " \t"));
+            } else if (strncasecmp(line, "Flags:", 6) == 0) {
+                is_complex = strstr(line, "complex") != NULL;
+            } else if (strncasecmp(line, "No. Variables:", 14) == 0) {
+                num_vars = atoi(line + 14);
+            } else if (strncasecmp(line, "No. Points:", 11) == 0) {
+                points = strtoull(line + 11, NULL, 10);
+            } else if (strncasecmp(line, "Variables:", 10) == 0 && num_vars > 0 && !have_vars) {
+                free(line);
+                if (alloc_vectors(&plot, num_vars) != 0) break;
+                have_vars = true;
+                for (int v = 0; v < num_vars && have_vars; v++) {
+                    start = replay->map + offset;
+                    end = memchr(start, '\n', replay->size - offset);
+                    line = end ? strndup((const char*)start, (size_t)(end - start)) : NULL;
+                    char name[256], type[64];
+                    int index;
+                    if (!line || sscanf(line, "%d %255s %63s", &index, name, type) != 3) {
+                        have_vars = false;
+                    } else {
+                        plot.names[v] = vector_name(name);
+                        plot.is_complex[v] = is_complex;
+                        plot.first_column[v] = is_complex ? 2 * v : v;
+                        if (v == 0) plot.paced = strcmp(type, "time") == 0;
+                        offset = (size_t)(end - replay->map) + 1;
+                    }
+                    free(line);
+                }
+                continue;
+            } else if (strncasecmp(line, "Binary:", 7) == 0) {
+                binary = true;
+            } else if (strncasecmp(line, "Values:", 7) == 0) {
+                fprintf(stderr, "ASCII rawfiles are not supported, write them with `set filetype=binary`\n");
+                free(line);
+                break;
+            }
+            free(line);
+        }
+        if (!binary || !have_vars) {
+            free_plot(&plot);
+            break;
+        }
+
+        plot.has_scale = true;
+        plot.num_columns = is_complex ? 2 * num_vars : num_vars;
+        size_t row_bytes = (size_t)plot.num_columns * sizeof(double);
+        uint64_t available = (replay->size - offset) / row_bytes;
+        plot.rows = points < available ? points : available;
+        plot.data = replay->map + offset;
+        if (!plot.name) plot.name = strdup("rawfile");
+        if (plot.rows > 0) {
+            plot.first_scale = rawfile_value(&plot, 0, 0);
+            plot.last_scale = rawfile_value(&plot, plot.rows - 1, 0);
+        }
+        offset += plot.rows * row_bytes;
+        if (add_plot(replay, &plot) != 0) {
+            free_plot(&plot);
+            return -1;
+        }
+        if (plot.rows < points) break;  // Cut short, nothing can follow
+
+        // Some writers end the data with a newline before the next header
+        while (offset < replay->size && replay->map[offset] == '\n') offset++;
+    }
+    return replay->num_plots > 0 ? 0 : -1;
+}
+
+static int open_result(Replay* replay, const char* path) {
+    ResultFile* file = &replay->result;
+    if (result_file_open(file, path) != 0) return -1;
+
+    ReplayPlot plot = {.name = strdup("ngres")};
+    if (!plot.name || alloc_vectors(&plot, file->num_vectors > 0 ? file->num_vectors : 1) != 0) {
+        free_plot(&plot);
+        return -1;
+    }
+    plot.num_vectors = file->num_vectors;
+    for (int v = 0; v < file->num_vectors; v++) {
+        plot.names[v] = strdup(file->names[v]);
+        plot.is_complex[v] = file->is_complex[v];
+        plot.first_column[v] = file->first_column[v];
+    }
+    plot.num_columns = file->num_columns;
+    plot.rows = file->total_rows;
+    plot.has_scale = file->has_scale;
+    plot.paced = file->has_scale && file->num_vectors > 0 && strcmp(file->names[0], "time") == 0;
+
+    replay->chunk_first = malloc((file->num_chunks + 1) * sizeof(uint64_t));
+    if (!replay->chunk_first) {
+        free_plot(&plot);
+        return -1;
+    }
+    replay->chunk_first[0] = 0;
+    for (uint64_t c = 0; c < file->num_chunks; c++) {
+        replay->chunk_first[c + 1] = replay->chunk_first[c] + file->chunks[c].rows;
+    }
+    if (plot.rows > 0) {
+        plot.first_scale = plot.has_scale ? file->chunks[0].first_scale : 0.0;
+        plot.last_scale = plot.has_scale ? file->chunks[file->num_chunks - 1].last_scale : (double)(plot.rows - 1);
+    }
+    if (add_plot(replay, &plot) != 0) {
+        free_plot(&plot);
+        return -1;
+    }
+    return 0;
+}
+
+Replay* replay_open(const char* path) {
+    Replay* replay = calloc(1, sizeof(Replay));
+    if (!replay) return NULL;
+    pthread_mutex_init(&replay->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&replay->changed, &attr);
+    pthread_condattr_destroy(&attr);
+    atomic_init(&replay->speed, 1.0);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        replay_close(replay);
+        return NULL;
+    }
+    char magic[8] = {0};
+    ssize_t got = read(fd, magic, sizeof(magic));
+    if (got == (ssize_t)sizeof(magic) && memcmp(magic, RESULT_FILE_MAGIC, sizeof(magic)) == 0) {
+        close(fd);
+        if (open_result(replay, path) != 0) {
+            replay_close(replay);
+            return NULL;
+        }
+        return replay;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        replay_close(replay);
+        return NULL;
+    }
+    replay->size = (size_t)st.st_size;
+    void* map = mmap(NULL, replay->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        replay_close(replay);
+        return NULL;
+    }
+    replay->map = map;
+    madvise(map, replay->size, MADV_SEQUENTIAL);
+    if (parse_rawfile(replay) != 0) {
+        replay_close(replay);
+        return NULL;
+    }
+    return replay;
+}
+
+void replay_close(Replay* replay) {
+    if (!replay) return;
+    replay_stop(replay);
+    for (int p = 0; p < replay->num_plots; p++) {
+        free_plot(&replay->plots[p]);
+    }
+    free(replay->plots);
+    free(replay->chunk_first);
+    if (replay->map) munmap(replay->map, replay->size);
+    result_file_close(&replay->result);
+    pthread_mutex_destroy(&replay->lock);
+    pthread_cond_destroy(&replay->changed);
+    free(replay);
+}
+
+// .ngres chunk holding row; sequential reads stay in the cached chunk or
+// step to the next one, seeks search
+static uint64_t locate_chunk(Replay* replay, uint64_t row) {
+    const uint64_t* first = replay->chunk_first;
+    uint64_t chunk = replay->chunk;
+    if (row >= first[chunk] && row < first[chunk + 1]) return chunk;
+    if (chunk + 1 < replay->result.num_chunks && row >= first[chunk + 1] && row < first[chunk + 2]) {
+        return replay->chunk = chunk + 1;
+    }
+    uint64_t lo = 0, hi = replay->result.num_chunks;
+    while (hi - lo > 1) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (first[mid] <= row) lo = mid;
+        else hi = mid;
+    }
+    return replay->chunk = lo;
+}
+
+static void read_row(Replay* replay, const ReplayPlot* plot, uint64_t row, double* out) {
+    if (plot->data) {
+        memcpy(out, plot->data + row * plot->num_columns * sizeof(double), plot->num_columns * sizeof(double));
+        return;
+    }
+    uint64_t chunk = locate_chunk(replay, row);
+    uint64_t offset = row - replay->chunk_first[chunk];
+    for (int c = 0; c < plot->num_columns; c++) {
+        const double* column = result_file_chunk_column(&replay->result, chunk, c);
+        out[c] = column ? column[offset] : 0.0;
+    }
+}
+
+static double scale_at(Replay* replay, const ReplayPlot* plot, uint64_t row) {
+    if (!plot->has_scale) return (double)row;
+    if (plot->data) return rawfile_value(plot, row, 0);
+    uint64_t chunk = locate_chunk(replay, row);
+    const double* scale = result_file_chunk_column(&replay->result, chunk, 0);
+    return scale ? scale[row - replay->chunk_first[chunk]] : 0.0;
+}
+
+// First row with a scale >= scale, rows if there is none
+static uint64_t lower_bound(Replay* replay, const ReplayPlot* plot, double scale) {
+    uint64_t lo = 0, hi = plot->rows;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (scale_at(replay, plot, mid) < scale) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// What ngspice would hand the callbacks for one plot: vector infos for
+// ng_initdata, the value array ng_data reads
+typedef struct {
+    vecinfo* infos;
+    pvecinfo* info_ptrs;
+    vecinfoall info_all;
+    vecvalues* values;
+    pvecvalues* value_ptrs;
+    vecvaluesall value_all;
+    double* row;
+} ReplayFrame;
+
+static void announce_plot(Replay* replay, const ReplayPlot* plot, ReplayFrame* frame) {
+    for (int v = 0; v < plot->num_vectors; v++) {
+        frame->infos[v] = (vecinfo){
+            .number = v,
+            .vecname = plot->names[v],
+            .is_real = !plot->is_complex[v]
+        };
+        frame->info_ptrs[v] = &frame->infos[v];
+        frame->values[v] = (vecvalues){
+            .name = plot->names[v],
+            .is_scale = plot->has_scale && v == 0,
+            .is_complex = plot->is_complex[v]
+        };
+        frame->value_ptrs[v] = &frame->values[v];
+    }
+    frame->info_all = (vecinfoall){
+        .name = plot->name,
+        .title = "replay",
+        .date = "",
+        .type = plot->name,
+        .veccount = plot->num_vectors,
+        .vecs = frame->info_ptrs
+    };
+    frame->value_all = (vecvaluesall){
+        .veccount = plot->num_vectors,
+        .vecindex = 0,
+        .vecsa = frame->value_ptrs
+    };
+    ng_initdata(&frame->info_all, 0, replay->context);
+}
+
+// Sleep until due_ns unless a control changes first
+static void wait_until(Replay* replay, double due_ns, unsigned control) {
+    struct timespec deadline = {
+        .tv_sec = (time_t)(due_ns / 1e9),
+        .tv_nsec = (long)(due_ns - (double)(time_t)(due_ns / 1e9) * 1e9)
+    };
+    pthread_mutex_lock(&replay->lock);
+    while (atomic_load(&replay->control_seq) == control && (double)monotonic_ns() < due_ns) {
+        if (pthread_cond_timedwait(&replay->changed, &replay->lock, &deadline) == ETIMEDOUT) break;
+    }
+    pthread_mutex_unlock(&replay->lock);
+}
+
+static void send_row(Replay* replay, const ReplayPlot* plot, ReplayFrame* frame, uint64_t row, double scale) {
+    read_row(replay, plot, row, frame->row);
+    for (int v = 0; v < plot->num_vectors; v++) {
+        const double* value = frame->row + plot->first_column[v];
+        frame->values[v].creal = value[0];
+        frame->values[v].cimag = plot->is_complex[v] ? value[1] : 0.0;
+    }
+    ng_data(&frame->value_all, plot->num_vectors, 0, replay->context);
+    atomic_store_explicit(&replay->current_scale, scale, memory_order_relaxed);
+    atomic_fetch_add_explicit(&replay->rows_sent, 1, memory_order_relaxed);
+}
+
+// Jump to the first row at or after scale. A fresh layout, so the plot does
+// not draw a line across the jump; the row there is sent at once so that
+// a paused replay shows where it now stands. Returns the next row to send,
+// plot->rows if the seek went past the end.
+static uint64_t seek_to(Replay* replay, const ReplayPlot* plot, ReplayFrame* frame, double scale) {
+    uint64_t row = lower_bound(replay, plot, scale);
+    if (row >= plot->rows) return plot->rows;
+    announce_plot(replay, plot, frame);
+    send_row(replay, plot, frame, row, scale_at(replay, plot, row));
+    return row + 1;
+}
+
+static void send_plot(Replay* replay, const ReplayPlot* plot, ReplayFrame* frame) {
+    announce_plot(replay, plot, frame);
+
+    uint64_t row = 0;
+    unsigned control = atomic_load(&replay->control_seq) - 1;  // Anchor before the first row
+    double anchor_ns = 0.0;
+    double anchor_scale = 0.0;
+    while (row < plot->rows && !atomic_load_explicit(&replay->stop, memory_order_relaxed)) {
+        unsigned now_control = atomic_load_explicit(&replay->control_seq, memory_order_acquire);
+        if (now_control != control) {
+            control = now_control;
+            // Seeks are applied as they come, also while paused
+            pthread_mutex_lock(&replay->lock);
+            for (;;) {
+                if (replay->seek_pending) {
+                    double seek_scale = replay->seek_scale;
+                    replay->seek_pending = false;
+                    pthread_mutex_unlock(&replay->lock);
+                    row = seek_to(replay, plot, frame, seek_scale);
+                    pthread_mutex_lock(&replay->lock);
+                    if (row >= plot->rows) break;
+                    continue;
+                }
+                if (!atomic_load(&replay->paused) || atomic_load(&replay->stop)) break;
+                pthread_cond_wait(&replay->changed, &replay->lock);
+            }
+            pthread_mutex_unlock(&replay->lock);
+            if (row >= plot->rows) break;
+
+            anchor_ns = (double)monotonic_ns();
+            anchor_scale = scale_at(replay, plot, row);
+            continue;
+        }
+
+        double scale = scale_at(replay, plot, row);
+        double speed = atomic_load_explicit(&replay->speed, memory_order_relaxed);
+        if (plot->paced && speed > 0.0) {
+            double due_ns = anchor_ns + (scale - anchor_scale) / speed * 1e9;
+            if (due_ns > (double)monotonic_ns() + REPLAY_MIN_SLEEP_NS) {
+                wait_until(replay, due_ns, control);
+                continue;
+            }
+        }
+
+        send_row(replay, plot, frame, row, scale);
+        row++;
+    }
+}
+
+// Stands in for ngspice's background thread
+static void* replay_thread(void* arg) {
+    Replay* replay = (Replay*)arg;
+    int vectors = replay->max_vectors > 0 ? replay->max_vectors : 1;
+    ReplayFrame frame = {
+        .infos = calloc(vectors, sizeof(vecinfo)),
+        .info_ptrs = calloc(vectors, sizeof(pvecinfo)),
+        .values = calloc(vectors, sizeof(vecvalues)),
+        .value_ptrs = calloc(vectors, sizeof(pvecvalues)),
+        .row = calloc(replay->max_columns > 0 ? replay->max_columns : 1, sizeof(double))
+    };
+
+    ng_bgrunning(false, 0, replay->context);
+    if (frame.infos && frame.info_ptrs && frame.values && frame.value_ptrs && frame.row) {
+        for (int p = 0; p < replay->num_plots && !atomic_load(&replay->stop); p++) {
+            atomic_store(&replay->current_plot, p);
+            send_plot(replay, &replay->plots[p], &frame);
+        }
+    } else {
+        DEBUG_PRINT(DEBUG_ERROR, "Out of memory starting replay");
+    }
+    if (!atomic_load(&replay->stop)) {
+        char ready[] = "--ready--";
+        ng_getstat(ready, 0, replay->context);
+    }
+    ng_bgrunning(true, 0, replay->context);
+
+    free(frame.infos);
+    free(frame.info_ptrs);
+    free(frame.values);
+    free(frame.value_ptrs);
+    free(frame.row);
+    return NULL;
+}
+
+int replay_start(Replay* replay, SimContext* context) {
+    if (replay->started) return -1;
+    replay->context = context;
+    atomic_store(&replay->stop, false);
+    if (pthread_create(&replay->thread, NULL, replay_thread, replay) != 0) return -1;
+    replay->started = true;
+    return 0;
+}
+
+// Every control change wakes the thread and makes it re-anchor its clock
+static void control_changed(Replay* replay) {
+    atomic_fetch_add(&replay->control_seq, 1);
+    pthread_cond_broadcast(&replay->changed);
+}
+
+void replay_stop(Replay* replay) {
+    if (!replay->started) return;
+    pthread_mutex_lock(&replay->lock);
+    atomic_store(&replay->stop, true);
+    control_changed(replay);
+    pthread_mutex_unlock(&replay->lock);
+    pthread_join(replay->thread, NULL);
+    replay->started = false;
+}
+
+void replay_set_speed(Replay* replay, double speed) {
+    pthread_mutex_lock(&replay->lock);
+    atomic_store(&replay->speed, speed > 0.0 ? speed : REPLAY_MAX_SPEED);
+    control_changed(replay);
+    pthread_mutex_unlock(&replay->lock);
+}
+
+double replay_speed(const Replay* replay) {
+    return atomic_load(&((Replay*)replay)->speed);
+}
+
+void replay_set_paused(Replay* replay, bool paused) {
+    pthread_mutex_lock(&replay->lock);
+    atomic_store(&replay->paused, paused);
+    control_changed(replay);
+    pthread_mutex_unlock(&replay->lock);
+}
+
+bool replay_paused(const Replay* replay) {
+    return atomic_load(&((Replay*)replay)->paused);
+}
+
+void replay_seek(Replay* replay, double scale) {
+    pthread_mutex_lock(&replay->lock);
+    replay->seek_pending = true;
+    replay->seek_scale = scale;
+    control_changed(replay);
+    pthread_mutex_unlock(&replay->lock);
+}
+
+void replay_position(const Replay* replay, double* first, double* last, double* current) {
+    Replay* r = (Replay*)replay;
+    const ReplayPlot* plot = &r->plots[atomic_load(&r->current_plot)];
+    if (first) *first = plot->first_scale;
+    if (last) *last = plot->last_scale;
+    if (current) *current = atomic_load_explicit(&r->current_scale, memory_order_relaxed);
+}
+
+int replay_num_plots(const Replay* replay) {
+    return replay->num_plots;
+}
+
+uint64_t replay_rows_sent(const Replay* replay) {
+    return atomic_load_explicit(&((Replay*)replay)->rows_sent, memory_order_relaxed);
+}
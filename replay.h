@@ -0,0 +1,55 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "simulation.h"
+
+// Replays a recorded run through the ngspice callbacks of simulation.c, in
+// place of ngspice's background thread: ng_bgrunning and ng_initdata when a
+// plot starts (and again after every seek), ng_data once per row, --ready--
+// at the end. The plot, the outputs and the shared-memory ring downstream
+// cannot tell the difference.
+//
+// Sources are memory-mapped:
+//   ngspice binary rawfiles (`write` / -r), every plot in file order;
+//     v(x) and i(x) are renamed to x and x#branch as ngspice's shared
+//     library calls them
+//   .ngres result files written by this program (one plot)
+//
+// Rows are paced by the scale when it is "time": speed 1 is real time, N is
+// N times faster, 0 sends rows as fast as the callbacks take them. Other
+// scales (frequency sweeps) are always sent at full speed.
+
+#define REPLAY_MAX_SPEED 0.0
+
+typedef struct Replay Replay;
+
+// Returns NULL if the file is neither a binary rawfile nor a .ngres file
+Replay* replay_open(const char* path);
+void replay_close(Replay* replay);  // Stops a running replay first
+
+// Start the replay thread; the callbacks get context as user data
+int replay_start(Replay* replay, SimContext* context);
+
+// Stop and join the replay thread. Safe to call more than once.
+void replay_stop(Replay* replay);
+
+// Controls, callable from any thread while the replay runs
+void replay_set_speed(Replay* replay, double speed);
+double replay_speed(const Replay* replay);
+void replay_set_paused(Replay* replay, bool paused);
+bool replay_paused(const Replay* replay);
+
+// Continue the current plot at its first row with a scale >= scale. The plot
+// is announced again, so consumers start from an empty history. Applied at
+// once, also while paused: the row found is sent right away.
+void replay_seek(Replay* replay, double scale);
+
+// Scale range of the current plot and the scale of the last row sent
+void replay_position(const Replay* replay, double* first, double* last, double* current);
+
+int replay_num_plots(const Replay* replay);
+uint64_t replay_rows_sent(const Replay* replay);
+
+#endif // REPLAY_H
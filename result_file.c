@@ -0,0 +1,425 @@
+#include "result_file.h"
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+ResultWriter* result_writer_open(const char* path, const AsyncWriterPolicy* policy, int chunk_rows,
+                                 unsigned flags) {
+    ResultWriter* writer = calloc(1, sizeof(ResultWriter));
+    if (!writer) return NULL;
+
+    writer->chunk_rows = chunk_rows > 0 ? chunk_rows : RESULT_DEFAULT_CHUNK_ROWS;
+    writer->flags = flags & RESULT_FLAG_COMPRESSED;
+    writer->out = async_writer_open(path, policy);
+    if (!writer->out) {
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+int result_writer_begin(ResultWriter* writer, int num_vectors, const char* const* names,
+                        const bool* is_complex, bool has_scale) {
+    if (writer->header_written) return -1;
+
+    int num_columns = 0;
+    for (int v = 0; v < num_vectors; v++) {
+        num_columns += is_complex[v] ? 2 : 1;
+    }
+    writer->num_columns = num_columns;
+    writer->has_scale = has_scale;
+    if (writer->flags & RESULT_FLAG_COMPRESSED) {
+        writer->encoders = calloc(num_columns > 0 ? num_columns : 1, sizeof(ColumnEncoder));
+        if (!writer->encoders) return -1;
+        for (int c = 0; c < num_columns; c++) {
+            column_encoder_init(&writer->encoders[c], c == 0 && has_scale ? COLUMN_CODEC_DOD : COLUMN_CODEC_XOR);
+        }
+    } else {
+        writer->columns = malloc((size_t)num_columns * writer->chunk_rows * sizeof(double));
+        if (num_columns > 0 && !writer->columns) return -1;
+    }
+
+    // Header size first, so the fixed part can be written in one go
+    uint64_t header_size = sizeof(ResultFileHeader);
+    for (int v = 0; v < num_vectors; v++) {
+        size_t entry = 4 + strlen(names[v]);
+        header_size += (entry + 7) & ~(size_t)7;
+    }
+
+    ResultFileHeader header = {
+        .magic = RESULT_FILE_MAGIC,
+        .version = RESULT_FILE_VERSION,
+        .flags = (has_scale ? RESULT_FLAG_HAS_SCALE : 0) | writer->flags,
+        .num_vectors = (uint32_t)num_vectors,
+        .num_columns = (uint32_t)num_columns,
+        .header_size = header_size
+    };
+    async_writer_write(writer->out, &header, sizeof(header));
+
+    static const char padding[8] = {0};
+    for (int v = 0; v < num_vectors; v++) {
+        size_t len = strlen(names[v]);
+        uint16_t entry[2] = {
+            (uint16_t)(is_complex[v] ? RESULT_VEC_COMPLEX : 0),
+            (uint16_t)len
+        };
+        async_writer_write(writer->out, entry, sizeof(entry));
+        async_writer_write(writer->out, names[v], len);
+        size_t used = 4 + len;
+        async_writer_write(writer->out, padding, ((used + 7) & ~(size_t)7) - used);
+    }
+
+    writer->header_written = true;
+    return 0;
+}
+
+static void write_chunk(ResultWriter* writer) {
+    if (writer->rows == 0) return;
+
+    ResultChunkHeader chunk = {
+        .magic = RESULT_CHUNK_MAGIC,
+        .rows = (uint32_t)writer->rows,
+        .bytes = (uint64_t)writer->rows * writer->num_columns * sizeof(double)
+    };
+    if (writer->encoders && !writer->failed) {
+        // Each column's encoder holds one block, only its last word is open
+        chunk.bytes = 0;
+        for (int c = 0; c < writer->num_columns && !writer->failed; c++) {
+            size_t bytes = 0;
+            if (!column_encoder_finish(&writer->encoders[c], &bytes)) writer->failed = true;
+            chunk.bytes += bytes;
+        }
+    }
+    // A chunk missing a column would shift every later one; rows after a
+    // gap are not written at all, the file ends with the last whole chunk
+    if (writer->failed) {
+        for (int c = 0; c < writer->num_columns; c++) {
+            column_encoder_reset(&writer->encoders[c]);
+        }
+        writer->rows = 0;
+        return;
+    }
+
+    // Without room in the index the chunk is still written: readers find
+    // it by walking the chunk headers, as in a file cut short
+    if (!writer->index_lost && writer->num_chunks == writer->index_capacity) {
+        uint64_t capacity = writer->index_capacity ? writer->index_capacity * 2 : 256;
+        ResultChunkInfo* index = realloc(writer->index, capacity * sizeof(ResultChunkInfo));
+        if (index) {
+            writer->index = index;
+            writer->index_capacity = capacity;
+        } else {
+            writer->index_lost = true;
+        }
+    }
+
+    if (!writer->index_lost) {
+        ResultChunkInfo* info = &writer->index[writer->num_chunks++];
+        info->offset = async_writer_offset(writer->out);
+        info->rows = (uint64_t)writer->rows;
+        info->first_scale = writer->has_scale ? writer->first_scale : 0.0;
+        info->last_scale = writer->has_scale ? writer->last_scale : 0.0;
+    }
+
+    async_writer_write(writer->out, &chunk, sizeof(chunk));
+    for (int c = 0; c < writer->num_columns; c++) {
+        if (writer->encoders) {
+            size_t bytes = 0;
+            const void* block = column_encoder_finish(&writer->encoders[c], &bytes);
+            async_writer_write(writer->out, block, bytes);
+            column_encoder_reset(&writer->encoders[c]);  // Keeps the buffer
+        } else {
+            async_writer_write(writer->out, writer->columns + (size_t)c * writer->chunk_rows,
+                               (size_t)writer->rows * sizeof(double));
+        }
+    }
+
+    writer->total_rows += (uint64_t)writer->rows;
+    writer->rows = 0;
+}
+
+void result_writer_end_row(ResultWriter* writer) {
+    if (++writer->rows == writer->chunk_rows) {
+        write_chunk(writer);
+    }
+}
+
+int result_writer_close(ResultWriter* writer) {
+    if (!writer) return 0;
+
+    if (writer->header_written) {
+        write_chunk(writer);
+    }
+    if (writer->header_written && !writer->index_lost) {
+        ResultFileTrailer trailer = {
+            .index_offset = async_writer_offset(writer->out),
+            .num_chunks = writer->num_chunks,
+            .total_rows = writer->total_rows,
+            .magic = RESULT_TRAILER_MAGIC
+        };
+        if (writer->num_chunks > 0) {
+            async_writer_write(writer->out, writer->index, writer->num_chunks * sizeof(ResultChunkInfo));
+        }
+        async_writer_write(writer->out, &trailer, sizeof(trailer));
+    }
+
+    int ret = async_writer_close(writer->out);
+    if (writer->encoders) {
+        for (int c = 0; c < writer->num_columns; c++) {
+            column_encoder_free(&writer->encoders[c]);
+        }
+    }
+    free(writer->encoders);
+    free(writer->columns);
+    free(writer->index);
+    bool failed = writer->failed;
+    free(writer);
+    return failed ? -1 : ret;
+}
+
+// Bytes of column data after a chunk header, 0 if the chunk is incomplete
+static uint64_t chunk_data_bytes(const ResultFile* file, const ResultChunkHeader* chunk, uint64_t offset) {
+    uint64_t bytes = chunk->bytes;
+    if (!file->compressed && bytes == 0) {
+        bytes = (uint64_t)chunk->rows * file->num_columns * sizeof(double);  // Version 1
+    }
+    uint64_t start = offset + sizeof(ResultChunkHeader);
+    return start + bytes <= file->size ? bytes : 0;
+}
+
+// Scale of the first and last row of a chunk found by scanning
+static void scan_scale(const ResultFile* file, ResultChunkInfo* info, const ResultChunkHeader* header,
+                       uint64_t bytes) {
+    info->first_scale = 0.0;
+    info->last_scale = 0.0;
+    if (!file->has_scale) return;
+
+    const double* scale = (const double*)(header + 1);
+    if (!file->compressed) {
+        info->first_scale = scale[0];
+        info->last_scale = scale[header->rows - 1];
+        return;
+    }
+    double* decoded = malloc(header->rows * sizeof(double));
+    size_t block = column_block_size(header + 1, bytes);
+    if (decoded && block && column_block_decode(header + 1, block, decoded, header->rows) == (long)header->rows) {
+        info->first_scale = decoded[0];
+        info->last_scale = decoded[header->rows - 1];
+    } else {
+        info->first_scale = info->last_scale = NAN;
+    }
+    free(decoded);
+}
+
+// Rebuild the chunk index of a file that has no trailer by walking the chunks
+static int scan_chunks(ResultFile* file, uint64_t offset) {
+    uint64_t capacity = 0;
+
+    while (offset + sizeof(ResultChunkHeader) <= file->size) {
+        const ResultChunkHeader* chunk = (const ResultChunkHeader*)(file->map + offset);
+        if (chunk->magic != RESULT_CHUNK_MAGIC || chunk->rows == 0) break;
+        uint64_t bytes = chunk_data_bytes(file, chunk, offset);
+        if (bytes == 0) break;  // Partially written chunk
+
+        if (file->num_chunks == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            ResultChunkInfo* chunks = realloc(file->chunks, capacity * sizeof(ResultChunkInfo));
+            if (!chunks) return -1;
+            file->chunks = chunks;
+        }
+        ResultChunkInfo* info = &file->chunks[file->num_chunks++];
+        info->offset = offset;
+        info->rows = chunk->rows;
+        scan_scale(file, info, chunk, bytes);
+        file->total_rows += chunk->rows;
+        offset += sizeof(ResultChunkHeader) + bytes;
+    }
+    return 0;
+}
+
+int result_file_open(ResultFile* file, const char* path) {
+    memset(file, 0, sizeof(ResultFile));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ResultFileHeader)) {
+        close(fd);
+        return -1;
+    }
+    file->size = (size_t)st.st_size;
+    void* map = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    file->map = map;
+
+    const ResultFileHeader* header = (const ResultFileHeader*)file->map;
+    if (memcmp(header->magic, RESULT_FILE_MAGIC, 8) != 0 || header->version == 0 ||
+        header->version > RESULT_FILE_VERSION || header->header_size > file->size) {
+        result_file_close(file);
+        return -1;
+    }
+
+    file->num_vectors = (int)header->num_vectors;
+    file->num_columns = (int)header->num_columns;
+    file->has_scale = (header->flags & RESULT_FLAG_HAS_SCALE) != 0;
+    file->compressed = (header->flags & RESULT_FLAG_COMPRESSED) != 0;
+    file->decoded_chunk = UINT64_MAX;
+    file->names = calloc(file->num_vectors + 1, sizeof(char*));
+    file->is_complex = calloc(file->num_vectors + 1, sizeof(bool));
+    file->first_column = calloc(file->num_vectors + 1, sizeof(int));
+    if (!file->names || !file->is_complex || !file->first_column) {
+        result_file_close(file);
+        return -1;
+    }
+
+    uint64_t offset = sizeof(ResultFileHeader);
+    int column = 0;
+    for (int v = 0; v < file->num_vectors; v++) {
+        if (offset + 4 > header->header_size) {
+            result_file_close(file);
+            return -1;
+        }
+        const uint16_t* entry = (const uint16_t*)(file->map + offset);
+        uint16_t len = entry[1];
+        if (offset + 4 + len > header->header_size) {
+            result_file_close(file);
+            return -1;
+        }
+        file->names[v] = strndup((const char*)(file->map + offset + 4), len);
+        file->is_complex[v] = (entry[0] & RESULT_VEC_COMPLEX) != 0;
+        file->first_column[v] = column;
+        column += file->is_complex[v] ? 2 : 1;
+        offset += (4 + (uint64_t)len + 7) & ~(uint64_t)7;
+    }
+
+    // Prefer the index written at close, fall back to scanning the chunks
+    const ResultFileTrailer* trailer = NULL;
+    if (file->size >= header->header_size + sizeof(ResultFileTrailer)) {
+        trailer = (const ResultFileTrailer*)(file->map + file->size - sizeof(ResultFileTrailer));
+        if (memcmp(trailer->magic, RESULT_TRAILER_MAGIC, 8) != 0 ||
+            trailer->index_offset + trailer->num_chunks * sizeof(ResultChunkInfo) >
+                file->size - sizeof(ResultFileTrailer)) {
+            trailer = NULL;
+        }
+    }
+    if (trailer) {
+        file->num_chunks = trailer->num_chunks;
+        file->total_rows = trailer->total_rows;
+        file->chunks = malloc((trailer->num_chunks ? trailer->num_chunks : 1) * sizeof(ResultChunkInfo));
+        if (!file->chunks) {
+            result_file_close(file);
+            return -1;
+        }
+        memcpy(file->chunks, file->map + trailer->index_offset, trailer->num_chunks * sizeof(ResultChunkInfo));
+    } else if (scan_chunks(file, header->header_size) != 0) {
+        result_file_close(file);
+        return -1;
+    }
+
+    for (uint64_t c = 0; c < file->num_chunks; c++) {
+        if (file->chunks[c].rows > file->max_chunk_rows) file->max_chunk_rows = file->chunks[c].rows;
+    }
+    return 0;
+}
+
+void result_file_close(ResultFile* file) {
+    if (file->map) munmap((void*)file->map, file->size);
+    if (file->names) {
+        for (int v = 0; v < file->num_vectors; v++) {
+            free(file->names[v]);
+        }
+    }
+    free(file->names);
+    free(file->is_complex);
+    free(file->first_column);
+    free(file->chunks);
+    free(file->decoded);
+    free(file->column_decoded);
+    memset(file, 0, sizeof(ResultFile));
+}
+
+// Decode one column of a compressed chunk into the cache
+static const double* decode_column(ResultFile* file, uint64_t chunk, int column) {
+    if (!file->decoded) {
+        file->decoded = malloc((size_t)file->num_columns * file->max_chunk_rows * sizeof(double));
+        file->column_decoded = calloc(file->num_columns, sizeof(bool));
+        if (!file->decoded || !file->column_decoded) {
+            free(file->decoded);
+            free(file->column_decoded);
+            file->decoded = NULL;
+            file->column_decoded = NULL;
+            return NULL;
+        }
+    }
+    if (file->decoded_chunk != chunk) {
+        memset(file->column_decoded, 0, file->num_columns * sizeof(bool));
+        file->decoded_chunk = chunk;
+    }
+
+    double* out = file->decoded + (size_t)column * file->max_chunk_rows;
+    if (file->column_decoded[column]) return out;
+
+    // Blocks follow each other, the column is found by skipping its predecessors
+    const ResultChunkInfo* info = &file->chunks[chunk];
+    const ResultChunkHeader* header = (const ResultChunkHeader*)(file->map + info->offset);
+    const uint8_t* block = (const uint8_t*)(header + 1);
+    size_t left = chunk_data_bytes(file, header, info->offset);
+    long count = -1;
+    for (int c = 0; left > 0; c++) {
+        size_t bytes = column_block_size(block, left);
+        if (bytes == 0) break;
+        if (c == column) {
+            count = column_block_decode(block, bytes, out, file->max_chunk_rows);
+            break;
+        }
+        block += bytes;
+        left -= bytes;
+    }
+    for (uint64_t r = count < 0 ? 0 : (uint64_t)count; r < info->rows; r++) {
+        out[r] = NAN;
+    }
+    file->column_decoded[column] = true;
+    return out;
+}
+
+const double* result_file_chunk_column(ResultFile* file, uint64_t chunk, int column) {
+    const ResultChunkInfo* info = &file->chunks[chunk];
+    if (file->compressed) {
+        return decode_column(file, chunk, column);
+    }
+    return (const double*)(file->map + info->offset + sizeof(ResultChunkHeader)) +
+           (size_t)column * info->rows;
+}
+
+uint64_t result_file_read_column(ResultFile* file, int column, uint64_t first_row,
+                                 double* out, uint64_t count) {
+    uint64_t copied = 0;
+    uint64_t chunk_start = 0;
+
+    for (uint64_t c = 0; c < file->num_chunks && copied < count; c++) {
+        uint64_t rows = file->chunks[c].rows;
+        if (first_row + copied < chunk_start + rows) {
+            uint64_t from = first_row + copied - chunk_start;
+            uint64_t n = rows - from;
+            if (n > count - copied) n = count - copied;
+            const double* values = result_file_chunk_column(file, c, column);
+            if (!values) break;
+            memcpy(out + copied, values + from, n * sizeof(double));
+            copied += n;
+        }
+        chunk_start += rows;
+    }
+    return copied;
+}
+
+int result_file_find_vector(const ResultFile* file, const char* name) {
+    for (int v = 0; v < file->num_vectors; v++) {
+        if (strcmp(file->names[v], name) == 0) return v;
+    }
+    return -1;
+}
@@ -0,0 +1,155 @@
+#ifndef RESULT_FILE_H
+#define RESULT_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "async_writer.h"
+#include "column_codec.h"
+
+// Chunked binary columnar result format (.ngres), native little-endian:
+//
+//   ResultFileHeader
+//   per vector: uint16 flags, uint16 name length, name bytes, zero padding
+//               up to the next multiple of 8
+//   chunks:     ResultChunkHeader, then num_columns blocks of rows float64,
+//               or with RESULT_FLAG_COMPRESSED num_columns column_codec.h
+//               blocks (delta-of-delta for the scale, XOR for the rest)
+//   index:      ResultChunkInfo per chunk
+//   ResultFileTrailer
+//
+// Vector 0 is the scale (time) when the header has RESULT_FLAG_HAS_SCALE.
+// Real vectors take one column, complex vectors two (real, then imaginary).
+// A file cut short before the index was written can still be read by
+// walking the chunk headers. Version 1 files (never compressed, no chunk
+// byte count) are still read.
+
+#define RESULT_FILE_MAGIC   "NGRES01\0"
+#define RESULT_TRAILER_MAGIC "NGEND01\0"
+#define RESULT_CHUNK_MAGIC  0x4b4e4843u  // "CHNK"
+#define RESULT_FILE_VERSION 2
+
+#define RESULT_FLAG_HAS_SCALE  0x1u  // Header flag
+#define RESULT_FLAG_COMPRESSED 0x2u  // Header flag
+#define RESULT_VEC_COMPLEX     0x1u  // Per-vector flag
+
+#define RESULT_DEFAULT_CHUNK_ROWS 4096
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t num_vectors;
+    uint32_t num_columns;
+    uint64_t header_size;   // Offset of the first chunk
+} ResultFileHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t rows;
+    uint64_t bytes;         // Column data after this header, 0 in version 1
+} ResultChunkHeader;
+
+typedef struct {
+    uint64_t offset;        // File offset of the ResultChunkHeader
+    uint64_t rows;
+    double first_scale;     // Scale range covered, 0 without a scale vector
+    double last_scale;
+} ResultChunkInfo;
+
+typedef struct {
+    uint64_t index_offset;
+    uint64_t num_chunks;
+    uint64_t total_rows;
+    char magic[8];
+} ResultFileTrailer;
+
+// Writer, used from the simulation thread
+typedef struct {
+    AsyncWriter* out;
+    int num_columns;
+    int chunk_rows;
+    int rows;               // Rows in the chunk being filled
+    double* columns;        // num_columns * chunk_rows staging values, uncompressed only
+    ColumnEncoder* encoders; // Per column, with RESULT_FLAG_COMPRESSED: values are encoded as they are put
+    double first_scale;     // Column 0 of the chunk's first and latest row
+    double last_scale;
+    unsigned flags;         // RESULT_FLAG_COMPRESSED or 0
+    ResultChunkInfo* index;
+    uint64_t num_chunks;
+    uint64_t index_capacity;
+    uint64_t total_rows;
+    bool has_scale;
+    bool header_written;
+    bool index_lost;        // Out of memory for the index: close leaves it and the trailer out
+    bool failed;            // Out of memory encoding a chunk: nothing after the last whole chunk is written
+} ResultWriter;
+
+// flags: RESULT_FLAG_COMPRESSED to encode every value as it is put, so that
+// completing a chunk only copies its finished blocks to the writer
+ResultWriter* result_writer_open(const char* path, const AsyncWriterPolicy* policy, int chunk_rows,
+                                 unsigned flags);
+
+// Write the header. names/is_complex describe num_vectors vectors; when
+// has_scale is set, vector 0 is the scale.
+int result_writer_begin(ResultWriter* writer, int num_vectors, const char* const* names,
+                        const bool* is_complex, bool has_scale);
+
+// Store one value of the current row; columns follow the vector order with
+// complex vectors taking two consecutive columns
+static inline void result_writer_put(ResultWriter* writer, int column, double value) {
+    if (column == 0) {
+        if (writer->rows == 0) writer->first_scale = value;
+        writer->last_scale = value;
+    }
+    if (writer->encoders) {
+        column_encoder_put(&writer->encoders[column], value);
+    } else {
+        writer->columns[(size_t)column * writer->chunk_rows + writer->rows] = value;
+    }
+}
+
+void result_writer_end_row(ResultWriter* writer);
+
+// Write the pending chunk, the index and the trailer, then close the file.
+// Returns -1 if rows were lost because a chunk could not be encoded.
+int result_writer_close(ResultWriter* writer);
+
+// Memory-mapped reader. Compressed chunks are decoded into a one-chunk
+// cache, column by column as they are asked for; such files must not be
+// read from several threads at once.
+typedef struct {
+    const uint8_t* map;
+    size_t size;
+    int num_vectors;
+    int num_columns;
+    bool has_scale;
+    bool compressed;
+    char** names;
+    bool* is_complex;
+    int* first_column;      // Vector -> its first column
+    ResultChunkInfo* chunks;
+    uint64_t num_chunks;
+    uint64_t total_rows;
+    uint64_t max_chunk_rows;
+    double* decoded;        // num_columns * max_chunk_rows values of decoded_chunk
+    bool* column_decoded;
+    uint64_t decoded_chunk; // UINT64_MAX if none
+} ResultFile;
+
+int result_file_open(ResultFile* file, const char* path);
+void result_file_close(ResultFile* file);
+
+// Column block of one chunk, pointing into the mapping or, for compressed
+// files, into the cache (valid until another chunk is read). A block that
+// fails to decode reads as NaN.
+const double* result_file_chunk_column(ResultFile* file, uint64_t chunk, int column);
+
+// Copy count values of a column starting at row first_row into out,
+// returns the number of values copied
+uint64_t result_file_read_column(ResultFile* file, int column, uint64_t first_row,
+                                 double* out, uint64_t count);
+
+int result_file_find_vector(const ResultFile* file, const char* name);
+
+#endif // RESULT_FILE_H
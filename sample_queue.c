@@ -0,0 +1,100 @@
+#include "sample_queue.h"
+#include <stdlib.h>
+#include <string.h>
+
+SampleQueue* sample_queue_create(size_t capacity, int num_values) {
+    if (num_values < 1) num_values = 1;
+
+    // Round up to a power of two so indices wrap with a mask
+    size_t cap = 1;
+    while (cap < capacity) cap <<= 1;
+
+    SampleQueue* queue = aligned_alloc(SAMPLE_QUEUE_CACHE_LINE,
+        (sizeof(SampleQueue) + SAMPLE_QUEUE_CACHE_LINE - 1) & ~(size_t)(SAMPLE_QUEUE_CACHE_LINE - 1));
+    if (!queue) return NULL;
+    memset(queue, 0, sizeof(SampleQueue));
+
+    queue->capacity = cap;
+    queue->mask = cap - 1;
+    queue->stride = num_values;
+    queue->times = malloc(cap * sizeof(double));
+    queue->stamps = malloc(cap * sizeof(uint64_t));
+    queue->values = calloc(cap * (size_t)num_values, sizeof(double));
+    if (!queue->times || !queue->stamps || !queue->values) {
+        sample_queue_destroy(queue);
+        return NULL;
+    }
+
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->dropped, 0);
+    atomic_init(&queue->pushed, 0);
+    return queue;
+}
+
+void sample_queue_destroy(SampleQueue* queue) {
+    if (!queue) return;
+    free(queue->times);
+    free(queue->stamps);
+    free(queue->values);
+    free(queue);
+}
+
+bool sample_queue_push(SampleQueue* queue, double time, const double* values, int num_values) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    // Only refresh the consumer's index when the cached one says we're full
+    if (head - queue->cached_tail >= queue->capacity) {
+        queue->cached_tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+        if (head - queue->cached_tail >= queue->capacity) {
+            atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+            return false;
+        }
+    }
+
+    size_t slot = head & queue->mask;
+    int n = num_values < queue->stride ? num_values : queue->stride;
+    double* dst = queue->values + slot * (size_t)queue->stride;
+    memcpy(dst, values, (size_t)n * sizeof(double));
+    if (n < queue->stride) {
+        memset(dst + n, 0, (size_t)(queue->stride - n) * sizeof(double));
+    }
+    queue->times[slot] = time;
+    queue->stamps[slot] = monotonic_ns();
+
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    atomic_fetch_add_explicit(&queue->pushed, 1, memory_order_relaxed);
+    return true;
+}
+
+size_t sample_queue_drain(SampleQueue* queue, SampleFrameSink sink, void* user_data, size_t max_frames) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    queue->cached_head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    size_t available = queue->cached_head - tail;
+    if (available > max_frames) available = max_frames;
+
+    for (size_t i = 0; i < available; i++) {
+        size_t slot = (tail + i) & queue->mask;
+        sink(queue->times[slot], queue->stamps[slot],
+             queue->values + slot * (size_t)queue->stride, queue->stride, user_data);
+    }
+
+    // Release the slots in one store once the sink is done with them
+    atomic_store_explicit(&queue->tail, tail + available, memory_order_release);
+    return available;
+}
+
+size_t sample_queue_depth(SampleQueue* queue) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    return head - tail;
+}
+
+uint64_t sample_queue_dropped(SampleQueue* queue) {
+    return atomic_load_explicit(&queue->dropped, memory_order_relaxed);
+}
+
+uint64_t sample_queue_pushed(SampleQueue* queue) {
+    return atomic_load_explicit(&queue->pushed, memory_order_relaxed);
+}
@@ -0,0 +1,61 @@
+#ifndef SAMPLE_QUEUE_H
+#define SAMPLE_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Bounded single-producer/single-consumer queue of sample frames.
+// The ngspice background thread is the only producer and the render loop the
+// only consumer; neither side ever takes a lock. When the queue is full the
+// producer drops the frame and counts it instead of waiting.
+
+#define SAMPLE_QUEUE_CACHE_LINE 64
+
+typedef struct {
+    // Producer-owned
+    _Alignas(SAMPLE_QUEUE_CACHE_LINE) atomic_size_t head;  // Next slot to write
+    size_t cached_tail;
+    atomic_uint_least64_t dropped;
+    atomic_uint_least64_t pushed;
+
+    // Consumer-owned
+    _Alignas(SAMPLE_QUEUE_CACHE_LINE) atomic_size_t tail;  // Next slot to read
+    size_t cached_head;
+
+    // Immutable after creation
+    _Alignas(SAMPLE_QUEUE_CACHE_LINE) size_t capacity;     // Power of two
+    size_t mask;
+    int stride;              // Values per frame
+    double* times;           // Simulation time per slot
+    uint64_t* stamps;        // Monotonic enqueue time per slot (ns)
+    double* values;          // capacity * stride signal values
+} SampleQueue;
+
+// Called by sample_queue_drain for every frame, oldest first
+typedef void (*SampleFrameSink)(double time, uint64_t enqueue_ns,
+                                const double* values, int num_values, void* user_data);
+
+SampleQueue* sample_queue_create(size_t capacity, int num_values);
+void sample_queue_destroy(SampleQueue* queue);
+
+// Producer side
+bool sample_queue_push(SampleQueue* queue, double time, const double* values, int num_values);
+
+// Consumer side: hands up to max_frames queued frames to sink, returns the count
+size_t sample_queue_drain(SampleQueue* queue, SampleFrameSink sink, void* user_data, size_t max_frames);
+
+// Statistics, safe to read from any thread
+size_t sample_queue_depth(SampleQueue* queue);
+uint64_t sample_queue_dropped(SampleQueue* queue);
+uint64_t sample_queue_pushed(SampleQueue* queue);
+
+static inline uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#endif // SAMPLE_QUEUE_H
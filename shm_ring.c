@@ -0,0 +1,396 @@
+#include "shm_ring.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SHM_RING_ALIGN 64
+
+_Static_assert(sizeof(ShmRingHeader) == 96, "ShmRingHeader layout is part of the format");
+_Static_assert(offsetof(ShmRingHeader, layout_seq) == 40, "ShmRingHeader layout is part of the format");
+_Static_assert(offsetof(ShmRingHeader, write_index) == 88, "ShmRingHeader layout is part of the format");
+
+struct ShmRing {
+    char* name;
+    unsigned char* map;
+    size_t size;
+    ShmRingHeader* header;
+    unsigned char* slots;
+    uint64_t row;           // Next row, only the writer changes write_index
+    uint64_t mask;
+    uint32_t slot_size;
+};
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static size_t table_offset(void) {
+    return align_up(sizeof(ShmRingHeader), SHM_RING_ALIGN);
+}
+
+static _Atomic uint64_t* slot_seq(unsigned char* slots, uint32_t slot_size, uint64_t mask, uint64_t row) {
+    return (_Atomic uint64_t*)(slots + (row & mask) * slot_size);
+}
+
+ShmRing* shm_ring_create(const char* name, size_t size) {
+    if (size == 0) size = SHM_RING_DEFAULT_BYTES;
+    size_t data_offset = align_up(table_offset() + SHM_RING_TABLE_BYTES, SHM_RING_ALIGN);
+    size = align_up(size, (size_t)sysconf(_SC_PAGESIZE));
+    if (size <= data_offset) return NULL;
+
+    ShmRing* ring = calloc(1, sizeof(ShmRing));
+    if (!ring) return NULL;
+
+    // shm_open wants exactly one leading slash
+    ring->name = malloc(strlen(name) + 2);
+    if (!ring->name) {
+        free(ring);
+        return NULL;
+    }
+    sprintf(ring->name, "%s%s", name[0] == '/' ? "" : "/", name);
+
+    // A fresh object each run, readers of a previous one keep their mapping
+    shm_unlink(ring->name);
+    int fd = shm_open(ring->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        free(ring->name);
+        free(ring);
+        return NULL;
+    }
+    if (ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        shm_unlink(ring->name);
+        free(ring->name);
+        free(ring);
+        return NULL;
+    }
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        shm_unlink(ring->name);
+        free(ring->name);
+        free(ring);
+        return NULL;
+    }
+
+    ring->map = map;
+    ring->size = size;
+    ring->header = (ShmRingHeader*)ring->map;
+    ring->slots = ring->map + data_offset;
+
+    // The object starts zeroed: no layout, no rows
+    ShmRingHeader* header = ring->header;
+    header->version = SHM_RING_VERSION;
+    header->header_size = (uint32_t)table_offset();
+    header->total_size = size;
+    header->data_offset = data_offset;
+    header->data_size = size - data_offset;
+    atomic_store_explicit(&header->state, SHM_RING_RUNNING, memory_order_relaxed);
+    // Magic last, a reader that sees it sees the rest
+    atomic_thread_fence(memory_order_release);
+    memcpy(header->magic, SHM_RING_MAGIC, sizeof(header->magic));
+    return ring;
+}
+
+void shm_ring_close(ShmRing* ring) {
+    if (!ring) return;
+    atomic_store_explicit(&ring->header->state, SHM_RING_FINISHED, memory_order_release);
+    munmap(ring->map, ring->size);
+    shm_unlink(ring->name);
+    free(ring->name);
+    free(ring);
+}
+
+int shm_ring_set_layout(ShmRing* ring, int num_vectors, const char* const* names,
+                        const bool* is_complex, bool has_scale) {
+    ShmRingHeader* header = ring->header;
+    ring->slot_size = 0;    // No rows until a layout fits
+
+    size_t table_size = 0;
+    int num_columns = 0;
+    for (int v = 0; v < num_vectors; v++) {
+        table_size += align_up(4 + strlen(names[v]), 8);
+        num_columns += is_complex[v] ? 2 : 1;
+    }
+    if (table_size > SHM_RING_TABLE_BYTES) return -1;
+
+    uint32_t slot_size = (uint32_t)(sizeof(uint64_t) + (size_t)num_columns * sizeof(double));
+    uint64_t slots = header->data_size / slot_size;
+    uint64_t capacity = 1;
+    while (capacity * 2 <= slots) capacity *= 2;
+    if (slots == 0) return -1;
+
+    // Seqlock writer side: odd while the table and the geometry change
+    uint32_t seq = atomic_load_explicit(&header->layout_seq, memory_order_relaxed);
+    atomic_store_explicit(&header->layout_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    unsigned char* table = ring->map + header->header_size;
+    for (int v = 0; v < num_vectors; v++) {
+        size_t len = strlen(names[v]);
+        uint16_t entry[2] = {
+            (uint16_t)(is_complex[v] ? SHM_RING_VEC_COMPLEX : 0),
+            (uint16_t)len
+        };
+        size_t used = align_up(4 + len, 8);
+        memcpy(table, entry, sizeof(entry));
+        memcpy(table + 4, names[v], len);
+        memset(table + 4 + len, 0, used - 4 - len);
+        table += used;
+    }
+
+    // Slots change their size, so no sequence of the old layout may
+    // accidentally match a row of the new one
+    for (uint64_t s = 0; s < capacity; s++) {
+        atomic_store_explicit(slot_seq(ring->slots, slot_size, capacity - 1, s), 0, memory_order_relaxed);
+    }
+
+    header->num_vectors = (uint32_t)num_vectors;
+    header->num_columns = (uint32_t)num_columns;
+    header->capacity = (uint32_t)capacity;
+    header->slot_size = slot_size;
+    header->flags = has_scale ? SHM_RING_HAS_SCALE : 0;
+    header->layout_first_row = ring->row;
+    atomic_fetch_add_explicit(&header->layout_version, 1, memory_order_relaxed);
+    atomic_store_explicit(&header->layout_seq, seq + 2, memory_order_release);
+
+    ring->slot_size = slot_size;
+    ring->mask = capacity - 1;
+    return 0;
+}
+
+double* shm_ring_begin_row(ShmRing* ring) {
+    if (ring->slot_size == 0) return NULL;
+    _Atomic uint64_t* seq = slot_seq(ring->slots, ring->slot_size, ring->mask, ring->row);
+    atomic_store_explicit(seq, 2 * ring->row + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    return (double*)(seq + 1);
+}
+
+void shm_ring_end_row(ShmRing* ring) {
+    _Atomic uint64_t* seq = slot_seq(ring->slots, ring->slot_size, ring->mask, ring->row);
+    atomic_store_explicit(seq, 2 * ring->row + 2, memory_order_release);
+    ring->row++;
+    atomic_store_explicit(&ring->header->write_index, ring->row, memory_order_release);
+}
+
+uint64_t shm_ring_rows(const ShmRing* ring) {
+    return ring->row;
+}
+
+static void free_reader_layout(ShmRingReader* reader) {
+    if (reader->names) {
+        for (int v = 0; v < reader->num_vectors; v++) {
+            free(reader->names[v]);
+        }
+    }
+    free(reader->names);
+    free(reader->is_complex);
+    reader->names = NULL;
+    reader->is_complex = NULL;
+    reader->num_vectors = 0;
+    reader->num_columns = 0;
+    reader->capacity = 0;
+    reader->slot_size = 0;
+}
+
+// Copy the vector table and geometry under the layout seqlock. The table is
+// parsed while the writer may be changing it, so every length is checked.
+static int load_layout(ShmRingReader* reader, uint64_t* first_row) {
+    const ShmRingHeader* header = reader->header;
+    const unsigned char* table = (const unsigned char*)reader->map + header->header_size;
+
+    for (;;) {
+        free_reader_layout(reader);
+        uint32_t seq = atomic_load_explicit(&header->layout_seq, memory_order_acquire);
+        if (seq & 1) {
+            sched_yield();
+            continue;
+        }
+
+        uint64_t version = atomic_load_explicit(&header->layout_version, memory_order_relaxed);
+        uint32_t num_vectors = header->num_vectors;
+        uint32_t num_columns = header->num_columns;
+        uint32_t capacity = header->capacity;
+        uint32_t slot_size = header->slot_size;
+        uint32_t flags = header->flags;
+        uint64_t first = header->layout_first_row;
+
+        bool ok = num_vectors <= SHM_RING_TABLE_BYTES / 8;
+        if (ok) {
+            reader->names = calloc(num_vectors + 1, sizeof(char*));
+            reader->is_complex = calloc(num_vectors + 1, sizeof(bool));
+            if (!reader->names || !reader->is_complex) return -1;
+        }
+        size_t offset = 0;
+        for (uint32_t v = 0; ok && v < num_vectors; v++) {
+            uint16_t entry[2];
+            memcpy(entry, table + offset, sizeof(entry));
+            if (offset + 4 + entry[1] > SHM_RING_TABLE_BYTES) {
+                ok = false;
+                break;
+            }
+            reader->names[v] = strndup((const char*)table + offset + 4, entry[1]);
+            reader->is_complex[v] = (entry[0] & SHM_RING_VEC_COMPLEX) != 0;
+            reader->num_vectors = (int)v + 1;
+            offset += align_up(4 + (size_t)entry[1], 8);
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&header->layout_seq, memory_order_relaxed) != seq) continue;
+        // Version 0 is a ring whose writer has not announced vectors yet
+        if (!ok || (version != 0 && ((capacity & (capacity - 1)) != 0 ||
+            (uint64_t)capacity * slot_size > header->data_size ||
+            slot_size != sizeof(uint64_t) + (uint64_t)num_columns * sizeof(double)))) {
+            free_reader_layout(reader);
+            return -1;
+        }
+
+        reader->layout_version = version;
+        reader->num_columns = (int)num_columns;
+        reader->capacity = capacity;
+        reader->slot_size = slot_size;
+        reader->has_scale = (flags & SHM_RING_HAS_SCALE) != 0;
+        *first_row = first;
+        return 0;
+    }
+}
+
+int shm_ring_reader_open(ShmRingReader* reader, const char* name, bool from_oldest) {
+    memset(reader, 0, sizeof(ShmRingReader));
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ShmRingHeader)) {
+        close(fd);
+        return -1;
+    }
+    reader->size = (size_t)st.st_size;
+    void* map = mmap(NULL, reader->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    reader->map = map;
+    reader->header = (const ShmRingHeader*)map;
+
+    const ShmRingHeader* header = reader->header;
+    atomic_thread_fence(memory_order_acquire);
+    if (memcmp(header->magic, SHM_RING_MAGIC, 8) != 0 || header->version != SHM_RING_VERSION ||
+        header->total_size > reader->size || header->data_offset + header->data_size > reader->size ||
+        (uint64_t)header->header_size + SHM_RING_TABLE_BYTES > header->data_offset) {
+        shm_ring_reader_close(reader);
+        return -1;
+    }
+
+    uint64_t first_row = 0;
+    if (load_layout(reader, &first_row) != 0) {
+        shm_ring_reader_close(reader);
+        return -1;
+    }
+    uint64_t written = atomic_load_explicit(&header->write_index, memory_order_acquire);
+    reader->cursor = written;
+    if (from_oldest) {
+        uint64_t oldest = written > reader->capacity ? written - reader->capacity : 0;
+        reader->cursor = oldest > first_row ? oldest : first_row;
+    }
+    return 0;
+}
+
+void shm_ring_reader_close(ShmRingReader* reader) {
+    free_reader_layout(reader);
+    if (reader->map) munmap(reader->map, reader->size);
+    memset(reader, 0, sizeof(ShmRingReader));
+}
+
+int shm_ring_read(ShmRingReader* reader, double* out, int max_rows) {
+    const ShmRingHeader* header = reader->header;
+
+    uint32_t layout_seq = atomic_load_explicit(&header->layout_seq, memory_order_acquire);
+    if (layout_seq & 1) return 0;
+    if (atomic_load_explicit(&header->layout_version, memory_order_relaxed) != reader->layout_version) {
+        // Rows of the old layout not read yet are gone with its geometry
+        uint64_t first_row = 0;
+        if (load_layout(reader, &first_row) != 0) return -1;
+        if (reader->cursor < first_row) {
+            reader->lost += first_row - reader->cursor;
+            reader->cursor = first_row;
+        }
+        return 0;
+    }
+    if (reader->capacity == 0) return 0;
+
+    uint64_t written = atomic_load_explicit(&header->write_index, memory_order_acquire);
+    if (written > reader->cursor + reader->capacity) {
+        reader->lost += written - reader->capacity - reader->cursor;
+        reader->cursor = written - reader->capacity;
+    }
+
+    unsigned char* slots = (unsigned char*)reader->map + header->data_offset;
+    uint64_t mask = reader->capacity - 1;
+    size_t row_bytes = (size_t)reader->num_columns * sizeof(double);
+    uint64_t cursor = reader->cursor;
+    uint64_t lost = 0;
+    int rows = 0;
+    while (rows < max_rows && cursor < written) {
+        _Atomic uint64_t* seq = slot_seq(slots, reader->slot_size, mask, cursor);
+        uint64_t expected = 2 * cursor + 2;
+        if (atomic_load_explicit(seq, memory_order_acquire) == expected) {
+            memcpy(out + (size_t)rows * reader->num_columns, seq + 1, row_bytes);
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(seq, memory_order_relaxed) == expected) {
+                rows++;
+            } else {
+                lost++;     // Overwritten while copying
+            }
+        } else {
+            lost++;         // Overwritten before we got to it
+        }
+        cursor++;
+    }
+
+    // A layout change during the copy invalidates the slot geometry used
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&header->layout_seq, memory_order_relaxed) != layout_seq) return 0;
+    reader->cursor = cursor;
+    reader->lost += lost;
+    return rows;
+}
+
+const double* shm_ring_peek(const ShmRingReader* reader, uint64_t row) {
+    const ShmRingHeader* header = reader->header;
+    if (reader->capacity == 0 ||
+        atomic_load_explicit(&header->layout_version, memory_order_acquire) != reader->layout_version) {
+        return NULL;
+    }
+    unsigned char* slots = (unsigned char*)reader->map + header->data_offset;
+    _Atomic uint64_t* seq = slot_seq(slots, reader->slot_size, reader->capacity - 1, row);
+    if (atomic_load_explicit(seq, memory_order_acquire) != 2 * row + 2) return NULL;
+    return (const double*)(seq + 1);
+}
+
+bool shm_ring_row_valid(const ShmRingReader* reader, uint64_t row) {
+    const ShmRingHeader* header = reader->header;
+    atomic_thread_fence(memory_order_acquire);
+    if (reader->capacity == 0 ||
+        atomic_load_explicit(&header->layout_version, memory_order_relaxed) != reader->layout_version) {
+        return false;
+    }
+    unsigned char* slots = (unsigned char*)reader->map + header->data_offset;
+    _Atomic uint64_t* seq = slot_seq(slots, reader->slot_size, reader->capacity - 1, row);
+    return atomic_load_explicit(seq, memory_order_relaxed) == 2 * row + 2;
+}
+
+uint64_t shm_ring_reader_available(const ShmRingReader* reader) {
+    return atomic_load_explicit(&reader->header->write_index, memory_order_acquire);
+}
+
+bool shm_ring_reader_finished(const ShmRingReader* reader) {
+    return atomic_load_explicit(&reader->header->state, memory_order_acquire) == SHM_RING_FINISHED;
+}
@@ -0,0 +1,131 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Live sample frames in POSIX shared memory for other processes.
+// One writer (the simulation thread) publishes every row into a ring of
+// fixed-size slots; any number of readers map the same object and follow
+// at their own pace. The writer never looks at the readers: a reader that
+// falls a whole ring behind loses the overwritten rows and notices it.
+//
+// Mapping layout, native little-endian:
+//   ShmRingHeader
+//   vector table at header_size, SHM_RING_TABLE_BYTES: per vector uint16
+//     flags, uint16 name length, name bytes, zero padding to a multiple of
+//     8 (the same encoding as the .ngres header)
+//   slots at data_offset: capacity * slot_size bytes, each slot a uint64
+//     sequence followed by num_columns float64
+//
+// Rows use the .ngres column order: the scale (time) first if
+// SHM_RING_HAS_SCALE is set, complex vectors take two columns (real, imag).
+// Row r lives in slot r & (capacity - 1). Its slot sequence is 2r + 1 while
+// the writer fills it and 2r + 2 once it is complete, so a reader copies the
+// slot and accepts it only if the sequence read before and after the copy
+// is 2r + 2 (a per-slot seqlock).
+// A new vector layout is written under layout_seq (odd while rewritten),
+// then layout_version is incremented. Row numbers keep counting across
+// layouts; layout_first_row is the first row of the current one.
+
+#define SHM_RING_MAGIC "NGSHM01\0"
+#define SHM_RING_VERSION 1
+#define SHM_RING_TABLE_BYTES (64 << 10)
+#define SHM_RING_DEFAULT_BYTES ((size_t)64 << 20)
+
+#define SHM_RING_HAS_SCALE 0x1u     // Header flag
+#define SHM_RING_VEC_COMPLEX 0x1u   // Per-vector flag, as in .ngres
+
+enum {
+    SHM_RING_RUNNING = 0,
+    SHM_RING_FINISHED = 1           // Writer closed, no more rows will come
+};
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;           // Offset of the vector table
+    uint64_t total_size;            // Size of the mapping
+    uint64_t data_offset;           // Offset of slot 0
+    uint64_t data_size;
+    _Atomic uint32_t layout_seq;
+    _Atomic uint32_t state;
+    _Atomic uint64_t layout_version;  // 0 until the first layout
+    uint64_t layout_first_row;
+    uint32_t num_vectors;
+    uint32_t num_columns;
+    uint32_t capacity;              // Slots, a power of two
+    uint32_t slot_size;             // 8 + 8 * num_columns
+    uint32_t flags;
+    uint32_t reserved;
+    _Atomic uint64_t write_index;   // Rows published so far
+} ShmRingHeader;
+
+// Writer, used from the simulation thread
+
+typedef struct ShmRing ShmRing;
+
+// Create (or replace) the object /name of the given total size
+ShmRing* shm_ring_create(const char* name, size_t size);
+
+// Mark the ring finished and remove its name; attached readers keep their
+// mapping until they close it
+void shm_ring_close(ShmRing* ring);
+
+// Publish a new vector layout; has_scale says vector 0 is the scale.
+// Returns -1 if the names overflow the table or not even one row fits the
+// data area; rows are then dropped until the next layout.
+int shm_ring_set_layout(ShmRing* ring, int num_vectors, const char* const* names,
+                        const bool* is_complex, bool has_scale);
+
+// Values of the next row are written straight into its slot: begin returns
+// num_columns doubles to fill (NULL without a layout), end publishes them
+double* shm_ring_begin_row(ShmRing* ring);
+void shm_ring_end_row(ShmRing* ring);
+
+uint64_t shm_ring_rows(const ShmRing* ring);
+
+// Reader library
+
+typedef struct {
+    void* map;
+    size_t size;
+    const ShmRingHeader* header;
+    uint64_t layout_version;        // Layout the fields below describe
+    uint64_t cursor;                // Next row to read
+    uint64_t lost;                  // Rows overwritten before they were read
+    int num_vectors;
+    int num_columns;
+    uint32_t capacity;
+    uint32_t slot_size;
+    bool has_scale;
+    char** names;
+    bool* is_complex;
+} ShmRingReader;
+
+// Attach to /name read-only. Starts at the oldest row still in the ring
+// if from_oldest is set, otherwise with the next row published.
+int shm_ring_reader_open(ShmRingReader* reader, const char* name, bool from_oldest);
+void shm_ring_reader_close(ShmRingReader* reader);
+
+// Copy up to max_rows rows of num_columns doubles into out and advance the
+// cursor; returns the rows copied, -1 if the header is damaged. When the
+// writer switched to a new layout, the call loads it, moves the cursor to
+// its first row and returns 0, so check layout_version between calls. Rows
+// overwritten before they could be copied, including unread rows of the
+// old layout, are added to lost.
+int shm_ring_read(ShmRingReader* reader, double* out, int max_rows);
+
+// Zero-copy access: the row's values in the mapping, or NULL if it is not
+// (or no longer) available. Whatever was read from the pointer is only
+// valid if shm_ring_row_valid() still returns true afterwards.
+const double* shm_ring_peek(const ShmRingReader* reader, uint64_t row);
+bool shm_ring_row_valid(const ShmRingReader* reader, uint64_t row);
+
+// Rows published so far, and whether the writer has finished
+uint64_t shm_ring_reader_available(const ShmRingReader* reader);
+bool shm_ring_reader_finished(const ShmRingReader* reader);
+
+#endif // SHM_RING_H
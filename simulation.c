@@ -1,15 +1,69 @@
 #include "simulation.h"
+#include "csv_format.h"
+#include "metrics.h"
+#include "replay.h"
+#include "sample_queue.h"
 #include <stdlib.h>
-
-// Initialize debug level to ERROR by default
-DebugLevel current_debug_level = DEBUG_ERROR;
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
 #include <ctype.h>
+#include <errno.h>
+#include <time.h>
+
+volatile sig_atomic_t g_shutdown_signal = 0;
+
+static void flush_decimators(SimContext* context);
+
+void init_simulation_context(SimContext* context) {
+    memset(context, 0, sizeof(SimContext));
+    context->layout.scale_index = -1;
+    pthread_mutex_init(&context->state_lock, NULL);
+    pthread_cond_init(&context->state_changed, NULL);
+}
+
+static void mark_simulation_finished(SimContext* context) {
+    pthread_mutex_lock(&context->state_lock);
+    context->simulation_finished = true;
+    context->current_progress = 100;
+    pthread_cond_broadcast(&context->state_changed);
+    pthread_mutex_unlock(&context->state_lock);
+}
 
-// Global context pointer for signal handler
-SimContext* g_context = NULL;
+// How often wait_for_simulation looks at g_shutdown_signal
+#define SHUTDOWN_POLL_MS 100
+
+void wait_for_simulation(SimContext* context) {
+    pthread_mutex_lock(&context->state_lock);
+    while (!context->simulation_finished && !g_shutdown_signal) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        long long ns = deadline.tv_nsec + SHUTDOWN_POLL_MS * 1000000ll;
+        deadline.tv_sec += ns / 1000000000ll;
+        deadline.tv_nsec = ns % 1000000000ll;
+        pthread_cond_timedwait(&context->state_changed, &context->state_lock, &deadline);
+    }
+    pthread_mutex_unlock(&context->state_lock);
+}
+
+bool wait_for_halt(SimContext* context, int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    long long ns = deadline.tv_nsec + (long long)timeout_ms * 1000000ll;
+    deadline.tv_sec += ns / 1000000000ll;
+    deadline.tv_nsec = ns % 1000000000ll;
+
+    bool halted = true;
+    pthread_mutex_lock(&context->state_lock);
+    while (atomic_load(&context->is_bg_running)) {
+        if (pthread_cond_timedwait(&context->state_changed, &context->state_lock, &deadline) == ETIMEDOUT) {
+            halted = !atomic_load(&context->is_bg_running);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&context->state_lock);
+    return halted;
+}
 
 void set_simulation_callback(SimContext* context, SimDataCallback callback, void* user_data) {
     context->data_callback = callback;
@@ -20,32 +74,62 @@ void cleanup_simulation(SimContext* context) {
     if (!context) return;
 
     // Halt any running simulation
-    if (context->is_bg_running) {
+    if (context->replay) {
+        replay_stop(context->replay);
+    } else if (atomic_load(&context->is_bg_running)) {
         ngSpice_Command("bg_halt");
-        // Small delay to allow halt to complete
-        usleep(10000);
+        if (!wait_for_halt(context, 1000)) {
+            fprintf(stderr, "Simulation did not halt\n");
+        }
     }
 
-    // Close CSV file if open
+    // A halted run may leave a min/max bucket open
+    flush_decimators(context);
+    decimator_free(&context->decimators[SUBSCRIBER_RECORD]);
+    decimator_free(&context->decimators[SUBSCRIBER_PLOT]);
+
+    // Flush and close the CSV file if open
     if (context->csv_file) {
-        fflush(context->csv_file);
-        fclose(context->csv_file);
+        if (async_writer_close(context->csv_file) != 0) {
+            fprintf(stderr, "Error writing CSV file\n");
+        }
         context->csv_file = NULL;
     }
+
+    // Writes the last chunk and the chunk index
+    if (context->result_file) {
+        if (result_writer_close(context->result_file) != 0) {
+            fprintf(stderr, "Error writing result file\n");
+        }
+        context->result_file = NULL;
+    }
+
+    // Readers see the ring finished and keep their mapping
+    if (context->shm_ring) {
+        shm_ring_close(context->shm_ring);
+        context->shm_ring = NULL;
+    }
+
+    free_vector_layout(&context->layout);
+
+    // Pairs with init_simulation_context; ngspice is halted, so none of its
+    // callbacks waits on these any more
+    pthread_mutex_destroy(&context->state_lock);
+    pthread_cond_destroy(&context->state_changed);
 }
 
+// Only async-signal-safe work here: closing the outputs takes locks and
+// joins threads, which the main loop does once it sees the flag. A second
+// signal gets the default action and ends the process at once.
 void signal_handler(int signum) {
-    if (g_context) {
-        cleanup_simulation(g_context);
-    }
-    signal(signum, SIG_DFL);  // Reset to default handler
-    raise(signum);  // Re-raise the signal
+    g_shutdown_signal = signum;
+    signal(signum, SIG_DFL);
 }
 
 int ng_getchar(char* outputchar, int ident, void* userdata) {
     (void)userdata;  // Suppress unused parameter warning
     (void)ident;     // Suppress unused parameter warning
-    printf("%s\n", outputchar);
+    LOG_PRINT("%s", outputchar);
     return 0;
 }
 
@@ -54,8 +138,8 @@ int ng_getstat(char* outputstat, int ident, void* userdata) {
     
     // Check for completion
     if (strcmp(outputstat, "--ready--") == 0) {
-        context->simulation_finished = true;
-        context->current_progress = 100;
+        flush_decimators(context);
+        mark_simulation_finished(context);
         return 0;
     }
 
@@ -80,7 +164,7 @@ int ng_getstat(char* outputstat, int ident, void* userdata) {
 
 int ng_exit(int exitstatus, NG_BOOL immediate, NG_BOOL quitexit, int ident, void* userdata) {
     SimContext* context = (SimContext*)userdata;
-    context->simulation_finished = true;
+    mark_simulation_finished(context);
     
     if (quitexit) {
         printf("Received quit request from ngspice\n");
@@ -90,94 +174,292 @@ int ng_exit(int exitstatus, NG_BOOL immediate, NG_BOOL quitexit, int ident, void
     return exitstatus;
 }
 
+void free_vector_layout(VectorLayout* layout) {
+    if (!layout) return;
+    if (layout->signal_names) {
+        for (int i = 0; i < layout->num_signals; i++) {
+            free(layout->signal_names[i]);
+        }
+    }
+    free(layout->signal_index);
+    free(layout->signal_names);
+    free(layout->is_branch);
+    free(layout->is_complex);
+    free(layout->consumers);
+    free(layout->record_slot);
+    free(layout->record_is_complex);
+    free(layout->record_values);
+    free(layout->plot_slot);
+    free(layout->plot_names);
+    free(layout->plot_is_branch);
+    free(layout->plot_is_complex);
+    free(layout->signal_values);
+    free(layout->scale_name);
+    memset(layout, 0, sizeof(VectorLayout));
+    layout->scale_index = -1;
+}
+
+// ngspice names the scale after the analysis: "time" for .tran, "frequency"
+// for .ac and .noise, "v-sweep", "i-sweep", "temp-sweep", ... for .dc
+static ScaleKind scale_kind(const char* name) {
+    if (strcmp(name, "time") == 0) return SCALE_TIME;
+    if (strcmp(name, "frequency") == 0) return SCALE_FREQUENCY;
+    size_t len = strlen(name);
+    if (len > 6 && strcmp(name + len - 6, "-sweep") == 0) return SCALE_SWEEP;
+    return SCALE_NONE;
+}
+
+int build_vector_layout(VectorLayout* layout, int count, const char* const* names, const bool* is_real,
+                        const Subscription* subscription) {
+    free_vector_layout(layout);
+    if (count <= 0) return 0;
+
+    layout->veccount = count;
+    layout->signal_index = malloc(count * sizeof(int));
+    layout->signal_names = calloc(count, sizeof(char*));
+    layout->is_branch = calloc(count, sizeof(bool));
+    layout->is_complex = calloc(count, sizeof(bool));
+    layout->consumers = calloc(count, sizeof(unsigned));
+    layout->record_slot = malloc(count * sizeof(int));
+    layout->record_is_complex = calloc(count, sizeof(bool));
+    layout->record_values = calloc(2 * count, sizeof(double));
+    layout->plot_slot = malloc(count * sizeof(int));
+    layout->plot_names = calloc(count, sizeof(char*));
+    layout->plot_is_branch = calloc(count, sizeof(bool));
+    layout->plot_is_complex = calloc(count, sizeof(bool));
+    layout->signal_values = calloc(2 * count, sizeof(double));
+    if (!layout->signal_index || !layout->signal_names || !layout->is_branch ||
+        !layout->is_complex || !layout->consumers || !layout->record_slot || !layout->record_is_complex ||
+        !layout->record_values || !layout->plot_slot || !layout->plot_names || !layout->plot_is_branch ||
+        !layout->plot_is_complex || !layout->signal_values) {
+        free_vector_layout(layout);
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        const char* name = names[i] ? names[i] : "";
+        ScaleKind scale = scale_kind(name);
+        if (layout->scale_index < 0 && scale != SCALE_NONE) {
+            layout->scale_index = i;
+            layout->scale = scale;
+            layout->scale_name = strdup(name);
+            continue;
+        }
+
+        // Unsubscribed vectors get no slot, ng_data never touches them
+        unsigned consumers = subscription_match(subscription, name);
+        if (!consumers) continue;
+
+        int slot = layout->num_signals++;
+        layout->signal_index[slot] = i;
+        layout->signal_names[slot] = strdup(name);
+        layout->is_branch[slot] = strstr(name, "#branch") != NULL;
+        layout->is_complex[slot] = is_real ? !is_real[i] : false;
+        layout->consumers[slot] = consumers;
+        if (consumers & SUBSCRIBE_RECORD) {
+            layout->record_is_complex[layout->num_recorded] = layout->is_complex[slot];
+            layout->record_slot[layout->num_recorded++] = slot;
+            layout->num_columns += layout->is_complex[slot] ? 2 : 1;
+        }
+        if (consumers & SUBSCRIBE_PLOT) {
+            int k = layout->num_plotted++;
+            layout->plot_slot[k] = slot;
+            layout->plot_names[k] = layout->signal_names[slot];
+            layout->plot_is_branch[k] = layout->is_branch[slot];
+            layout->plot_is_complex[k] = layout->is_complex[slot];
+            layout->num_plot_values += layout->is_complex[slot] ? 2 : 1;
+        }
+    }
+    if (layout->scale_index >= 0) layout->num_columns++;
+    return 0;
+}
+
+// Decimator output for the recording consumer: one row to every output
+static void record_row(double time, const double* values, void* user_data) {
+    SimContext* context = (SimContext*)user_data;
+    const VectorLayout* layout = &context->layout;
+
+    // Format the row straight into the writer's block: worst case every
+    // signal is complex ("," re "+j" im) plus the time and the newline
+    if (context->csv_file) {
+        char* row = async_writer_reserve(context->csv_file,
+                                         (size_t)(layout->num_recorded * 2 + 1) * (CSV_DOUBLE_MAX_LEN + 2) + 1);
+        char* p = row;
+        if (p) {
+            if (layout->scale_index >= 0) {
+                p += csv_format_double(p, time);
+            }
+            const double* value = values;
+            for (int k = 0; k < layout->num_recorded; k++) {
+                *p++ = ',';
+                p += csv_format_double(p, *value++);
+                if (layout->is_complex[layout->record_slot[k]]) {
+                    *p++ = '+';
+                    *p++ = 'j';
+                    p += csv_format_double(p, *value++);
+                }
+            }
+            *p++ = '\n';
+            async_writer_commit(context->csv_file, (size_t)(p - row));
+            metrics_add(METRIC_CSV_BYTES, (uint64_t)(p - row));
+        }
+    }
+
+    int width = layout->num_columns - (layout->scale_index >= 0 ? 1 : 0);
+
+    // Only rows matching the layout the result header was written for
+    ResultWriter* result = context->result_file;
+    if (result && result->header_written && result->num_columns == layout->num_columns) {
+        int column = 0;
+        if (layout->scale_index >= 0) {
+            result_writer_put(result, column++, time);
+        }
+        for (int c = 0; c < width; c++) {
+            result_writer_put(result, column++, values[c]);
+        }
+        result_writer_end_row(result);
+    }
+
+    // Same column order, written straight into the shared-memory slot
+    double* shm_row = context->shm_ring ? shm_ring_begin_row(context->shm_ring) : NULL;
+    if (shm_row) {
+        if (layout->scale_index >= 0) {
+            *shm_row++ = time;
+        }
+        memcpy(shm_row, values, (size_t)width * sizeof(double));
+        shm_ring_end_row(context->shm_ring);
+    }
+}
+
+// Decimator output for the plotting consumer
+static void plot_row(double time, const double* values, void* user_data) {
+    SimContext* context = (SimContext*)user_data;
+    const VectorLayout* layout = &context->layout;
+    SimulationData sim_data = {
+        .time = time,
+        .scale = layout->scale,
+        .num_signals = layout->num_plotted,
+        .num_values = layout->num_plot_values,
+        .signal_names = layout->plot_names,
+        .is_branch = layout->plot_is_branch,
+        .is_complex = layout->plot_is_complex,
+        .signal_values = (double*)values,
+        .layout_version = context->layout_version
+    };
+    context->data_callback(&sim_data, context->callback_data);
+}
+
+// Emit what the min/max decimators still hold, before a new layout or at the end
+static void flush_decimators(SimContext* context) {
+    if (context->csv_file || context->result_file || context->shm_ring) {
+        decimator_flush(&context->decimators[SUBSCRIBER_RECORD], record_row, context);
+    }
+    if (context->data_callback) {
+        decimator_flush(&context->decimators[SUBSCRIBER_PLOT], plot_row, context);
+    }
+}
+
 int ng_data(pvecvaluesall vecdata, int numvecs, int ident, void* userdata) {
     SimContext* context = (SimContext*)userdata;
+    VectorLayout* layout = &context->layout;
+    uint64_t start_ns = monotonic_ns();
     
     if (!vecdata || !vecdata->vecsa) {
         DEBUG_PRINT(DEBUG_ERROR, "Received null vector data");
         return 0;
     }
+    if (vecdata->veccount != layout->veccount) {
+        DEBUG_PRINT(DEBUG_ERROR, "Vector count %d does not match layout (%d)",
+                    vecdata->veccount, layout->veccount);
+        return 0;
+    }
 
-    // Prepare simulation data for callback
-    SimulationData sim_data = {0};
-    sim_data.num_signals = vecdata->veccount - 1;  // Subtract 1 to exclude time
-    sim_data.signal_values = malloc(sim_data.num_signals * sizeof(double));
-    sim_data.signal_names = malloc(sim_data.num_signals * sizeof(char*));
+    pvecvalues* vecs = vecdata->vecsa;
+    double time = 0.0;
+    context->samples++;
 
-    // Find the time vector
-    pvecvalues timeValue = NULL;
-    for (int i = 0; i < vecdata->veccount; i++) {
-        if (vecdata->vecsa[i] && vecdata->vecsa[i]->name && 
-            strcmp(vecdata->vecsa[i]->name, "time") == 0) {
-            timeValue = vecdata->vecsa[i];
-            break;
-        }
-    }
-    
-    if (timeValue) {
-        DEBUG_PRINT(DEBUG_VERBOSE, "Time = %g", timeValue->creal);
+    if (layout->scale_index >= 0) {
+        time = vecs[layout->scale_index]->creal;
+        DEBUG_PRINT(DEBUG_VERBOSE, "%s = %g", layout->scale_name, time);
         
-        if (!context->voltage_altered && !context->should_alter_voltage && timeValue->creal >= 6.0) {
+        if (layout->scale == SCALE_TIME && !context->voltage_altered && !context->should_alter_voltage &&
+            time >= 6.0) {
             context->should_alter_voltage = true;
-            DEBUG_PRINT(DEBUG_INFO, "Time threshold reached at t=%g, preparing to alter voltage", timeValue->creal);
+            DEBUG_PRINT(DEBUG_INFO, "Time threshold reached at t=%g, preparing to alter voltage", time);
         }
-        
-        fprintf(context->csv_file, "%g", timeValue->creal);
     }
-    
-    for (int i = 0; i < vecdata->veccount; i++) {
-        pvecvalues value = vecdata->vecsa[i];
-        if (!value || !value->name) continue;
-        
-        if (value->is_complex) {
-            DEBUG_PRINT(DEBUG_VERBOSE, "%s = %g + j%g%s", value->name, 
-                       value->creal, value->cimag, 
-                       value->is_scale ? " (scale)" : "");
-        } else {
-            DEBUG_PRINT(DEBUG_VERBOSE, "%s = %g%s", value->name, 
-                       value->creal,
-                       value->is_scale ? " (scale)" : "");
-        }
-        
-        if (strcmp(value->name, "time") != 0) {
-            if (value->is_complex) {
-                fprintf(context->csv_file, ",%g+j%g", value->creal, value->cimag);
-            } else {
-                fprintf(context->csv_file, ",%g", value->creal);
+
+    // Decimation that needs no values decides before anything is read
+    bool record = (context->csv_file || context->result_file || context->shm_ring) &&
+                  decimator_admit(&context->decimators[SUBSCRIBER_RECORD]);
+    bool plot = context->data_callback && decimator_admit(&context->decimators[SUBSCRIBER_PLOT]);
+
+    if (record) {
+        double* value = layout->record_values;
+        for (int k = 0; k < layout->num_recorded; k++) {
+            int slot = layout->record_slot[k];
+            pvecvalues vec = vecs[layout->signal_index[slot]];
+            DEBUG_PRINT(DEBUG_VERBOSE, "%s = %g + j%g", layout->signal_names[slot], vec->creal, vec->cimag);
+            *value++ = vec->creal;
+            if (layout->is_complex[slot]) {
+                *value++ = vec->cimag;
             }
         }
+        decimator_push(&context->decimators[SUBSCRIBER_RECORD], time, layout->record_values, record_row, context);
     }
-    fprintf(context->csv_file, "\n");
-    fflush(context->csv_file);
 
-    // Fill simulation data
-    int signal_index = 0;
-    for (int i = 0; i < vecdata->veccount; i++) {
-        pvecvalues value = vecdata->vecsa[i];
-        if (!value || !value->name) continue;
-
-        if (strcmp(value->name, "time") == 0) {
-            sim_data.time = value->creal;
-        } else {
-            sim_data.signal_values[signal_index] = value->creal;
-            sim_data.signal_names[signal_index] = strdup(value->name);
-            signal_index++;
+    if (plot) {
+        double* value = layout->signal_values;
+        for (int k = 0; k < layout->num_plotted; k++) {
+            pvecvalues vec = vecs[layout->signal_index[layout->plot_slot[k]]];
+            *value++ = vec->creal;
+            if (layout->plot_is_complex[k]) {
+                *value++ = vec->cimag;
+            }
         }
+        decimator_push(&context->decimators[SUBSCRIBER_PLOT], time, layout->signal_values, plot_row, context);
     }
 
-    // Call the callback if set
-    if (context->data_callback) {
-        context->data_callback(&sim_data, context->callback_data);
+    metrics_add(METRIC_SAMPLES, 1);
+    metrics_record(METRIC_NG_DATA, monotonic_ns() - start_ns);
+    return 0;
+}
+
+// The result file and the shared-memory ring list the scale vector first,
+// then the recorded signals in layout order. The result file keeps the first layout,
+// the ring announces every one.
+static void publish_layout(SimContext* context) {
+    const VectorLayout* layout = &context->layout;
+    int count = layout->num_recorded + (layout->scale_index >= 0 ? 1 : 0);
+    const char** names = malloc((count > 0 ? count : 1) * sizeof(char*));
+    bool* is_complex = malloc((count > 0 ? count : 1) * sizeof(bool));
+    if (!names || !is_complex) {
+        DEBUG_PRINT(DEBUG_ERROR, "Out of memory publishing vector layout");
+        free(names);
+        free(is_complex);
+        return;
     }
 
-    // Clean up
-    for (int i = 0; i < sim_data.num_signals; i++) {
-        free(sim_data.signal_names[i]);
+    int v = 0;
+    if (layout->scale_index >= 0) {
+        names[v] = layout->scale_name ? layout->scale_name : "time";
+        is_complex[v++] = false;
     }
-    free(sim_data.signal_values);
-    free(sim_data.signal_names);
-    
-    return 0;
+    for (int k = 0; k < layout->num_recorded; k++) {
+        names[v] = layout->signal_names[layout->record_slot[k]];
+        is_complex[v++] = layout->is_complex[layout->record_slot[k]];
+    }
+    bool has_scale = layout->scale_index >= 0;
+    if (context->result_file && !context->result_file->header_written &&
+        result_writer_begin(context->result_file, count, names, is_complex, has_scale) != 0) {
+        DEBUG_PRINT(DEBUG_ERROR, "Could not write result header");
+    }
+    if (context->shm_ring &&
+        shm_ring_set_layout(context->shm_ring, count, names, is_complex, has_scale) != 0) {
+        DEBUG_PRINT(DEBUG_ERROR, "Vector layout does not fit the shared-memory ring");
+    }
+    free(names);
+    free(is_complex);
 }
 
 int ng_initdata(pvecinfoall initdata, int ident, void* userdata) {
@@ -194,37 +476,113 @@ int ng_initdata(pvecinfoall initdata, int ident, void* userdata) {
     DEBUG_PRINT(DEBUG_INFO, "Date: %s", initdata->date ? initdata->date : "unknown");
     DEBUG_PRINT(DEBUG_INFO, "Type: %s", initdata->type ? initdata->type : "unknown");
     
+    int count = initdata->veccount > 0 ? initdata->veccount : 0;
+    const char** names = calloc(count > 0 ? count : 1, sizeof(char*));
+    bool* is_real = calloc(count > 0 ? count : 1, sizeof(bool));
+    if (!names || !is_real) {
+        DEBUG_PRINT(DEBUG_ERROR, "Out of memory building vector layout");
+        free(names);
+        free(is_real);
+        return 0;
+    }
+
     DEBUG_PRINT(DEBUG_VERBOSE, "Available vectors:");
-    for (int i = 0; i < initdata->veccount; i++) {
+    for (int i = 0; i < count; i++) {
         pvecinfo vec = initdata->vecs[i];
-        if (!vec || !vec->vecname) continue;
+        if (!vec || !vec->vecname) {
+            is_real[i] = true;
+            continue;
+        }
+        names[i] = vec->vecname;
+        is_real[i] = vec->is_real;
         
         DEBUG_PRINT(DEBUG_VERBOSE, "  %d: %s (%s)", 
                    i, 
                    vec->vecname,
                    vec->is_real ? "real" : "complex");
     }
-    printf("\n");
+
+    // Rows still held for the old layout go out under the old layout
+    flush_decimators(context);
+    if (build_vector_layout(&context->layout, count, names, is_real, context->subscription) != 0) {
+        DEBUG_PRINT(DEBUG_ERROR, "Out of memory building vector layout");
+    }
+    context->layout_version++;
+
+    const VectorLayout* layout = &context->layout;
+    const Subscription* subscription = context->subscription;
+    // Without its decimator a consumer gets nothing rather than every row
+    if (decimator_init(&context->decimators[SUBSCRIBER_RECORD],
+                       subscription ? &subscription->policy[SUBSCRIBER_RECORD] : NULL,
+                       layout->record_is_complex, layout->num_recorded) != 0) {
+        DEBUG_PRINT(DEBUG_ERROR, "Out of memory building the record decimator, nothing is recorded for this plot");
+    }
+    if (decimator_init(&context->decimators[SUBSCRIBER_PLOT],
+                       subscription ? &subscription->policy[SUBSCRIBER_PLOT] : NULL,
+                       layout->plot_is_complex, layout->num_plotted) != 0) {
+        DEBUG_PRINT(DEBUG_ERROR, "Out of memory building the plot decimator, nothing is plotted for this plot");
+    }
+    DEBUG_PRINT(DEBUG_INFO, "Subscribed to %d of %d vectors: %d recorded, %d plotted",
+                layout->num_signals, count, layout->num_recorded, layout->num_plotted);
+    free(names);
+    free(is_real);
     
-    if (!context->headers_written) {
-        fprintf(context->csv_file, "Time");
-        for (int i = 0; i < initdata->veccount; i++) {
-            pvecinfo vec = initdata->vecs[i];
-            if (!vec || !vec->vecname) continue;
-            if (strcmp(vec->vecname, "time") != 0) {
-                fprintf(context->csv_file, ",%s", vec->vecname);
-            }
+    if (!context->headers_written && context->csv_file) {
+        // "Time" as before for transients, else the scale's own name
+        const char* scale = layout->scale == SCALE_TIME || !layout->scale_name ? "Time" : layout->scale_name;
+        async_writer_write(context->csv_file, scale, strlen(scale));
+        for (int k = 0; k < layout->num_recorded; k++) {
+            const char* name = layout->signal_names[layout->record_slot[k]];
+            async_writer_write(context->csv_file, ",", 1);
+            async_writer_write(context->csv_file, name, strlen(name));
         }
-        fprintf(context->csv_file, "\n");
+        async_writer_write(context->csv_file, "\n", 1);
         context->headers_written = true;
     }
+
+    if ((context->result_file && !context->result_file->header_written) || context->shm_ring) {
+        publish_layout(context);
+    }
     
     return 0;
 }
 
 int ng_bgrunning(NG_BOOL running, int ident, void* userdata) {
     SimContext* context = (SimContext*)userdata;
-    context->is_bg_running = !running;
+    // ngspice passes true once the background thread has stopped
+    pthread_mutex_lock(&context->state_lock);
+    atomic_store(&context->is_bg_running, !running);
+    pthread_cond_broadcast(&context->state_changed);
+    pthread_mutex_unlock(&context->state_lock);
     DEBUG_PRINT(DEBUG_INFO, "Background thread status: %s", !running ? "running" : "stopped");
     return 0;
 }
+
+// Shared by both source callbacks: ngspice asks once per source per timestep
+static int get_external_source(double* value, char* name, SimContext* context) {
+    LiveControls* controls = context->live_controls;
+    if (controls && live_control_lookup(controls, name, value)) {
+        return 0;
+    }
+
+    // Warned once, ngspice asks again on every timestep
+    *value = 0.0;
+    bool first = controls ? atomic_load_explicit(&controls->misses, memory_order_relaxed) == 1
+                          : !atomic_exchange_explicit(&context->warned_no_controls, true, memory_order_relaxed);
+    if (first) {
+        DEBUG_PRINT(DEBUG_WARN, "No live control for external source %s, using 0", name);
+    }
+    return 0;
+}
+
+int ng_getvsrc(double* voltage, double time, char* nodename, int ident, void* userdata) {
+    (void)time;
+    (void)ident;
+    return get_external_source(voltage, nodename, (SimContext*)userdata);
+}
+
+int ng_getisrc(double* current, double time, char* nodename, int ident, void* userdata) {
+    (void)time;
+    (void)ident;
+    return get_external_source(current, nodename, (SimContext*)userdata);
+}
@@ -2,63 +2,119 @@
 #define SIMULATION_H
 
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include <ngspice/sharedspice.h>
 #include <stdio.h>
+#include <signal.h>
+#include "async_writer.h"
+#include "result_file.h"
+#include "shm_ring.h"
+#include "subscription.h"
+#include "live_control.h"
+#include "log.h"
 
-// Debug levels
+// What the scale vector of a plot runs over, recognised by its name
 typedef enum {
-    DEBUG_NONE = 0,
-    DEBUG_ERROR = 1,
-    DEBUG_WARN = 2,
-    DEBUG_INFO = 3,
-    DEBUG_VERBOSE = 4,
-    DEBUG_TRACE = 5
-} DebugLevel;
-
-extern DebugLevel current_debug_level;
-
-#define DEBUG_PRINT(level, fmt, ...) \
-    do { \
-        if (level <= current_debug_level) { \
-            printf("[%s] " fmt "\n", \
-                   level == DEBUG_ERROR ? "ERROR" : \
-                   level == DEBUG_WARN ? "WARN" : \
-                   level == DEBUG_INFO ? "INFO" : \
-                   level == DEBUG_VERBOSE ? "VERBOSE" : \
-                   level == DEBUG_TRACE ? "TRACE" : "UNKNOWN", \
-                   ##__VA_ARGS__); \
-        } \
-    } while (0)
+    SCALE_NONE = 0,        // No scale vector (.op): rows are only counted
+    SCALE_TIME,            // "time": .tran
+    SCALE_FREQUENCY,       // "frequency": .ac, .noise, .sp; plotted on a log axis
+    SCALE_SWEEP            // "*-sweep": .dc
+} ScaleKind;
 
 // Structure to hold simulation context
 // Structure to hold simulation vector data
 typedef struct {
-    double time;           // Current simulation time
+    double time;           // Current simulation time, or the frequency or sweep value
+    ScaleKind scale;       // What time holds
     int num_signals;       // Number of signals (excluding time)
-    char** signal_names;   // Array of signal names
-    double* signal_values; // Array of signal values at current time
+    int num_values;        // Entries in signal_values: complex signals take two
+    const char* const* signal_names; // Signal names, stable until the next ng_initdata
+    const bool* is_branch; // Per signal: true for #branch currents
+    const bool* is_complex; // Per signal: true for complex vectors, NULL if all are real
+    double* signal_values; // Values at the current scale point in signal order, complex ones as re, im
+    unsigned layout_version; // Changes whenever ng_initdata announced a new vector list
 } SimulationData;
 
+// Vector layout of the current plot. Built once in ng_initdata so that
+// ng_data can copy values by index without allocating or comparing names.
+// Only subscribed vectors get a slot (see subscription.h).
+typedef struct {
+    int veccount;          // Vectors ngspice sends with every ng_data call
+    int scale_index;       // Index of the scale vector ("time", "frequency", ...), -1 if there is none
+    ScaleKind scale;
+    char* scale_name;      // Name of the scale vector, NULL if there is none
+    int num_signals;       // Subscribed vectors other than time
+    int num_columns;       // Values per recorded row: time plus recorded signals, complex ones twice
+    int* signal_index;     // Signal slot -> ngspice vector index
+    char** signal_names;   // Signal slot -> vector name
+    bool* is_branch;       // Signal slot -> #branch current
+    bool* is_complex;      // Signal slot -> complex vector
+    unsigned* consumers;   // Signal slot -> SUBSCRIBE_* bits
+    int num_recorded;      // Signals written to CSV, .ngres and the shm ring
+    int* record_slot;      // Recorded signal -> signal slot
+    bool* record_is_complex; // Recorded signal -> complex vector
+    double* record_values; // One recorded row without the time, filled by ng_data
+    int num_plotted;       // Signals passed to the data callback
+    int* plot_slot;        // Plotted signal -> signal slot
+    const char** plot_names; // Plotted signal -> name, points into signal_names
+    bool* plot_is_branch;  // Plotted signal -> #branch current
+    bool* plot_is_complex; // Plotted signal -> complex vector
+    int num_plot_values;   // Plotted values per row, complex signals twice
+    double* signal_values; // Plotted values, filled by ng_data
+} VectorLayout;
+
 // Callback function type
 typedef void (*SimDataCallback)(SimulationData* data, void* user_data);
 
 typedef struct {
-    bool simulation_finished;
+    bool simulation_finished;       // Guarded by state_lock once the simulation runs
     int current_progress;
-    FILE* csv_file;
+    AsyncWriter* csv_file;          // Batched CSV output, written by its own I/O thread
+    ResultWriter* result_file;      // Full-precision binary columnar output (.ngres)
+    ShmRing* shm_ring;              // Live rows for other processes, NULL if unused
+    struct Replay* replay;          // Recording that stands in for ngspice, see replay.h
     bool voltage_altered;
     bool should_alter_voltage;
-    bool is_bg_running;
+    atomic_bool is_bg_running;      // Written by ng_bgrunning, which also signals state_changed
     bool headers_written;
+    VectorLayout layout;            // Built by ng_initdata, used by ng_data
+    const Subscription* subscription; // Which vectors go where, NULL for the defaults
+    Decimator decimators[SUBSCRIBER_COUNT]; // Per consumer, reset with every layout
+    unsigned layout_version;        // Incremented with every new layout
+    LiveControls* live_controls;    // Values for `external` sources, NULL if unused
+    atomic_bool warned_no_controls; // An external source was asked for without live_controls
     SimDataCallback data_callback;  // Callback function pointer
     void* callback_data;           // User data for callback
+    pthread_mutex_t state_lock;     // Lets other threads wait for the simulation to finish or halt
+    pthread_cond_t state_changed;
+    unsigned long long samples;     // ng_data calls, written by the simulation thread only
 } SimContext;
 
+// Initialize a context with no outputs and no callback. Each call is paired
+// with one cleanup_simulation, which also destroys the lock; a context is
+// initialized again only after that.
+void init_simulation_context(SimContext* context);
+
+// Block until ngspice reports --ready-- or exits, or a signal asks for shutdown
+void wait_for_simulation(SimContext* context);
+
+// Block until ngspice's background thread has stopped, at most timeout_ms.
+// Returns false on timeout.
+bool wait_for_halt(SimContext* context, int timeout_ms);
+
 // Function to set the callback
 void set_simulation_callback(SimContext* context, SimDataCallback callback, void* user_data);
 
-// Global context pointer declaration
-extern SimContext* g_context;
+// Build the layout from a plot's vector names; is_real may be NULL for all-real
+// and subscription NULL for the defaults
+int build_vector_layout(VectorLayout* layout, int count, const char* const* names, const bool* is_real,
+                        const Subscription* subscription);
+void free_vector_layout(VectorLayout* layout);
+
+// Set to the signal number by signal_handler. The handler does nothing else;
+// the main loops poll this and shut down through cleanup_simulation.
+extern volatile sig_atomic_t g_shutdown_signal;
 
 // Function declarations
 void cleanup_simulation(SimContext* context);
@@ -70,4 +126,8 @@ int ng_data(pvecvaluesall vecdata, int numvecs, int ident, void* userdata);
 int ng_initdata(pvecinfoall initdata, int ident, void* userdata);
 int ng_bgrunning(NG_BOOL running, int ident, void* userdata);
 
+// ngSpice_Init_Sync callbacks for `external` voltage and current sources
+int ng_getvsrc(double* voltage, double time, char* nodename, int ident, void* userdata);
+int ng_getisrc(double* current, double time, char* nodename, int ident, void* userdata);
+
 #endif // SIMULATION_H
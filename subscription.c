@@ -0,0 +1,326 @@
+#include "subscription.h"
+#include <ctype.h>
+#include <fnmatch.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SUBSCRIPTION_MAX_TOKENS 256
+
+// v(x) -> x and i(x) -> x#branch, the names the shared library sends
+static char* normalize_pattern(const char* token) {
+    bool exclude = token[0] == '!';
+    const char* name = token + exclude;
+    size_t len = strlen(name);
+    char* pattern;
+    if (len > 3 && (tolower((unsigned char)name[0]) == 'v' || tolower((unsigned char)name[0]) == 'i') &&
+        name[1] == '(' && name[len - 1] == ')') {
+        bool branch = tolower((unsigned char)name[0]) == 'i';
+        pattern = malloc(len + sizeof("!#branch"));
+        if (pattern) {
+            sprintf(pattern, "%s%.*s%s", exclude ? "!" : "", (int)(len - 3), name + 2, branch ? "#branch" : "");
+        }
+    } else {
+        pattern = strdup(token);
+    }
+    // ngspice names vectors in lower case
+    for (char* c = pattern; c && *c; c++) *c = (char)tolower((unsigned char)*c);
+    return pattern;
+}
+
+static bool is_wildcard(const char* pattern) {
+    return strpbrk(pattern, "*?[") != NULL;
+}
+
+// Scale vector names as scale_kind in simulation.c knows them. ngspice
+// sends the scale with every plot; v(time) in .save would name a node.
+static bool is_scale(const char* name) {
+    size_t len = strlen(name);
+    return strcmp(name, "time") == 0 || strcmp(name, "frequency") == 0 ||
+           (len > 6 && strcmp(name + len - 6, "-sweep") == 0);
+}
+
+static int parse_consumer(const char* word, Subscriber* subscriber) {
+    if (strcmp(word, "record") == 0) {
+        *subscriber = SUBSCRIBER_RECORD;
+    } else if (strcmp(word, "plot") == 0) {
+        *subscriber = SUBSCRIBER_PLOT;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_decimation(Subscription* subscription, char** tokens, int count) {
+    Subscriber subscriber;
+    if (count != 4 || parse_consumer(tokens[1], &subscriber) != 0) return -1;
+
+    char* end;
+    double param = strtod(tokens[3], &end);
+    if (*end || !isfinite(param) || param < 0.0) return -1;
+
+    DecimationPolicy* policy = &subscription->policy[subscriber];
+    if (strcmp(tokens[2], "every") == 0 && param >= 1.0 && param == floor(param)) {
+        policy->kind = param > 1.0 ? DECIMATE_EVERY : DECIMATE_NONE;
+    } else if (strcmp(tokens[2], "minmax") == 0 && param > 0.0) {
+        policy->kind = DECIMATE_MINMAX;
+    } else if (strcmp(tokens[2], "deadband") == 0) {
+        policy->kind = DECIMATE_DEADBAND;
+    } else {
+        return -1;
+    }
+    policy->param = param;
+    return 0;
+}
+
+int subscription_parse_line(Subscription* subscription, const char* line) {
+    char buffer[4096];
+    snprintf(buffer, sizeof(buffer), "%s", line);
+    char* comment = strchr(buffer, '#');
+    // '#' starts a comment only at the beginning of a word, x#branch is a name
+    while (comment && comment != buffer && !isspace((unsigned char)comment[-1])) {
+        comment = strchr(comment + 1, '#');
+    }
+    if (comment) *comment = '\0';
+
+    char* tokens[SUBSCRIPTION_MAX_TOKENS];
+    int count = 0;
+    char* save = NULL;
+    for (char* token = strtok_r(buffer, " \t\r\n", &save); token; token = strtok_r(NULL, " \t\r\n", &save)) {
+        if (count == SUBSCRIPTION_MAX_TOKENS) return -1;
+        tokens[count++] = token;
+    }
+    if (count == 0) return 0;
+    if (strcmp(tokens[0], "decimate") == 0) return parse_decimation(subscription, tokens, count);
+
+    unsigned consumers;
+    Subscriber subscriber;
+    if (strcmp(tokens[0], "drop") == 0) {
+        consumers = 0;
+    } else if (parse_consumer(tokens[0], &subscriber) == 0) {
+        consumers = subscriber == SUBSCRIBER_RECORD ? SUBSCRIBE_RECORD : SUBSCRIBE_PLOT;
+    } else {
+        return -1;
+    }
+    if (count < 2) return -1;
+
+    SubscriptionRule* rules = realloc(subscription->rules, (subscription->num_rules + 1) * sizeof(SubscriptionRule));
+    if (!rules) return -1;
+    subscription->rules = rules;
+    SubscriptionRule* rule = &rules[subscription->num_rules];
+    rule->consumers = consumers;
+    rule->num_patterns = 0;
+    rule->patterns = calloc(count - 1, sizeof(char*));
+    if (!rule->patterns) return -1;
+    subscription->num_rules++;
+    for (int i = 1; i < count; i++) {
+        char* pattern = normalize_pattern(tokens[i]);
+        if (!pattern) return -1;
+        rule->patterns[rule->num_patterns++] = pattern;
+    }
+    return 0;
+}
+
+int subscription_load(Subscription* subscription, const char* path) {
+    memset(subscription, 0, sizeof(Subscription));
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Error opening subscription file %s\n", path);
+        return -1;
+    }
+
+    char line[4096];
+    int number = 0;
+    int ret = 0;
+    while (fgets(line, sizeof(line), file)) {
+        number++;
+        if (subscription_parse_line(subscription, line) != 0) {
+            fprintf(stderr, "%s:%d: invalid subscription: %s", path, number, line);
+            ret = -1;
+            break;
+        }
+    }
+    fclose(file);
+    if (ret != 0) subscription_free(subscription);
+    return ret;
+}
+
+void subscription_free(Subscription* subscription) {
+    if (!subscription) return;
+    for (int r = 0; r < subscription->num_rules; r++) {
+        for (int i = 0; i < subscription->rules[r].num_patterns; i++) {
+            free(subscription->rules[r].patterns[i]);
+        }
+        free(subscription->rules[r].patterns);
+    }
+    free(subscription->rules);
+    memset(subscription, 0, sizeof(Subscription));
+}
+
+// A rule applies if one of its patterns matches and none of its exclusions
+static bool rule_matches(const SubscriptionRule* rule, const char* name) {
+    bool matched = false;
+    for (int i = 0; i < rule->num_patterns; i++) {
+        const char* pattern = rule->patterns[i];
+        if (pattern[0] == '!') {
+            if (fnmatch(pattern + 1, name, 0) == 0) return false;
+        } else if (!matched) {
+            matched = fnmatch(pattern, name, 0) == 0;
+        }
+    }
+    return matched;
+}
+
+unsigned subscription_match(const Subscription* subscription, const char* name) {
+    if (!subscription) {
+        return SUBSCRIBE_RECORD | (strstr(name, "#branch") ? 0 : SUBSCRIBE_PLOT);
+    }
+
+    unsigned consumers = 0;
+    for (int r = 0; r < subscription->num_rules; r++) {
+        const SubscriptionRule* rule = &subscription->rules[r];
+        if (!rule_matches(rule, name)) continue;
+        if (rule->consumers == 0) return 0;
+        consumers |= rule->consumers;
+    }
+    return consumers;
+}
+
+bool subscription_save_directive(const Subscription* subscription, char* line, size_t size) {
+    if (!subscription) return false;
+
+    size_t len = (size_t)snprintf(line, size, ".save");
+    int saved = 0;
+    for (int r = 0; r < subscription->num_rules; r++) {
+        const SubscriptionRule* rule = &subscription->rules[r];
+        if (rule->consumers == 0) continue;
+        for (int i = 0; i < rule->num_patterns; i++) {
+            const char* name = rule->patterns[i];
+            if (name[0] == '!') continue;
+            if (is_wildcard(name)) return false;
+            if (is_scale(name)) continue;
+            // Dropped by a later rule: ngspice need not compute it either
+            if (subscription_match(subscription, name) == 0) continue;
+
+            const char* branch = strstr(name, "#branch");
+            if (len < size) {
+                if (branch) {
+                    len += (size_t)snprintf(line + len, size - len, " i(%.*s)", (int)(branch - name), name);
+                } else {
+                    len += (size_t)snprintf(line + len, size - len, " v(%s)", name);
+                }
+            }
+            saved++;
+        }
+    }
+    return saved > 0 && len < size;
+}
+
+int decimator_init(Decimator* decimator, const DecimationPolicy* policy, const bool* is_complex,
+                   int num_signals) {
+    decimator_free(decimator);
+    if (policy) decimator->policy = *policy;
+    int width = 0;
+    for (int s = 0; s < num_signals; s++) {
+        width += is_complex && is_complex[s] ? 2 : 1;
+    }
+    decimator->width = width;
+    decimator->num_signals = num_signals;
+    if (decimator->policy.kind == DECIMATE_MINMAX || decimator->policy.kind == DECIMATE_DEADBAND) {
+        decimator->low = calloc(width > 0 ? width : 1, sizeof(double));
+        decimator->high = calloc(width > 0 ? width : 1, sizeof(double));
+        decimator->is_complex = calloc(num_signals > 0 ? num_signals : 1, sizeof(bool));
+        if (!decimator->low || !decimator->high || !decimator->is_complex) {
+            decimator_free(decimator);
+            decimator->failed = true;
+            return -1;
+        }
+        if (is_complex) memcpy(decimator->is_complex, is_complex, num_signals * sizeof(bool));
+    }
+    return 0;
+}
+
+void decimator_free(Decimator* decimator) {
+    free(decimator->low);
+    free(decimator->high);
+    free(decimator->is_complex);
+    memset(decimator, 0, sizeof(Decimator));
+}
+
+void decimator_flush(Decimator* decimator, DecimatorEmit emit, void* user_data) {
+    if (decimator->policy.kind != DECIMATE_MINMAX || !decimator->open) return;
+    decimator->open = false;
+    emit(decimator->first_time, decimator->low, user_data);
+    if (decimator->last_time > decimator->first_time) {
+        emit(decimator->last_time, decimator->high, user_data);
+    }
+}
+
+void decimator_push(Decimator* decimator, double time, const double* values,
+                    DecimatorEmit emit, void* user_data) {
+    int width = decimator->width;
+    switch (decimator->policy.kind) {
+        case DECIMATE_NONE:
+        case DECIMATE_EVERY:
+            emit(time, values, user_data);
+            return;
+
+        case DECIMATE_DEADBAND: {
+            bool moved = !decimator->open;
+            const double* last = decimator->low;
+            for (int s = 0, i = 0; s < decimator->num_signals && !moved; s++) {
+                if (decimator->is_complex[s]) {
+                    moved = hypot(values[i] - last[i], values[i + 1] - last[i + 1]) > decimator->policy.param;
+                    i += 2;
+                } else {
+                    moved = fabs(values[i] - last[i]) > decimator->policy.param;
+                    i++;
+                }
+            }
+            if (!moved) return;
+            memcpy(decimator->low, values, width * sizeof(double));
+            decimator->open = true;
+            emit(time, values, user_data);
+            return;
+        }
+
+        case DECIMATE_MINMAX: {
+            double bucket = floor(time / decimator->policy.param);
+            if (decimator->open && bucket != decimator->bucket) {
+                decimator_flush(decimator, emit, user_data);
+            }
+            if (!decimator->open) {
+                memcpy(decimator->low, values, width * sizeof(double));
+                memcpy(decimator->high, values, width * sizeof(double));
+                decimator->bucket = bucket;
+                decimator->first_time = time;
+                decimator->open = true;
+            } else {
+                double* low = decimator->low;
+                double* high = decimator->high;
+                for (int s = 0, i = 0; s < decimator->num_signals; s++) {
+                    if (!decimator->is_complex[s]) {
+                        if (values[i] < low[i]) low[i] = values[i];
+                        if (values[i] > high[i]) high[i] = values[i];
+                        i++;
+                        continue;
+                    }
+                    // The whole pair, so the kept rows are points the signal went through
+                    double magnitude = hypot(values[i], values[i + 1]);
+                    if (magnitude < hypot(low[i], low[i + 1])) {
+                        low[i] = values[i];
+                        low[i + 1] = values[i + 1];
+                    }
+                    if (magnitude > hypot(high[i], high[i + 1])) {
+                        high[i] = values[i];
+                        high[i + 1] = values[i + 1];
+                    }
+                    i += 2;
+                }
+            }
+            decimator->last_time = time;
+            return;
+        }
+    }
+}
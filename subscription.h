@@ -0,0 +1,111 @@
+#ifndef SUBSCRIPTION_H
+#define SUBSCRIPTION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Which vectors go to which consumer, read from a small text file:
+//
+//   # comment
+//   record k y vvdc#branch       written to CSV, .ngres and the shm ring
+//   plot * !*#branch             sent to the data callback
+//   drop big*                    never copied anywhere, wins over the above
+//   decimate record every 10     keep every 10th step
+//   decimate plot minmax 1e-3    min and max per 1 ms of simulated time
+//   decimate plot deadband 0.01  only steps where a value moved by > 0.01
+//
+// Patterns are fnmatch globs, lowered like ngspice's names; a leading ! excludes
+// from that line. v(x) and i(x) are accepted for x and x#branch. Lines add
+// up, a vector nobody subscribes to is left out of the layout. Without a
+// subscription every vector is recorded and all but #branch currents plotted.
+
+#define SUBSCRIBE_RECORD 0x1u
+#define SUBSCRIBE_PLOT   0x2u
+
+typedef enum {
+    SUBSCRIBER_RECORD = 0,
+    SUBSCRIBER_PLOT,
+    SUBSCRIBER_COUNT
+} Subscriber;
+
+// Complex signals stay re, im pairs: DECIMATE_MINMAX keeps the pairs of least
+// and greatest magnitude, DECIMATE_DEADBAND measures the distance in the
+// complex plane
+typedef enum {
+    DECIMATE_NONE = 0,
+    DECIMATE_EVERY,      // Every Nth step
+    DECIMATE_MINMAX,     // Per time bucket: first time with the minima, last time with the maxima
+    DECIMATE_DEADBAND    // Steps where any value moved more than the band since the last one kept
+} DecimationKind;
+
+typedef struct {
+    DecimationKind kind;
+    double param;        // N, bucket width or band
+} DecimationPolicy;
+
+typedef struct {
+    unsigned consumers;  // SUBSCRIBE_* bits, 0 for drop
+    int num_patterns;
+    char** patterns;     // Normalized, exclusions keep their !
+} SubscriptionRule;
+
+typedef struct {
+    SubscriptionRule* rules;
+    int num_rules;
+    DecimationPolicy policy[SUBSCRIBER_COUNT];
+} Subscription;
+
+// Returns 0, or -1 after printing the offending line
+int subscription_load(Subscription* subscription, const char* path);
+int subscription_parse_line(Subscription* subscription, const char* line);
+void subscription_free(Subscription* subscription);
+
+// SUBSCRIBE_* bits for a vector; subscription may be NULL for the defaults
+unsigned subscription_match(const Subscription* subscription, const char* name);
+
+// A ".save ..." line naming every subscribed vector, so that ngspice stores
+// and sends nothing else. The scale vector is left out, ngspice always sends
+// it. Returns false if a wildcard needs all vectors or nothing else is named.
+bool subscription_save_directive(const Subscription* subscription, char* line, size_t size);
+
+// Per-consumer decimation state, applied in ng_data before values are copied
+typedef void (*DecimatorEmit)(double time, const double* values, void* user_data);
+
+typedef struct {
+    DecimationPolicy policy;
+    bool failed;         // Could not be built: its consumer gets no rows for this layout
+    int width;           // Values per row
+    int num_signals;
+    bool* is_complex;    // Signal -> takes two values, for DECIMATE_MINMAX and DECIMATE_DEADBAND
+    uint64_t steps;      // DECIMATE_EVERY: steps seen
+    bool open;           // DECIMATE_MINMAX: bucket has values / DECIMATE_DEADBAND: last is set
+    double bucket;       // Index of the open bucket
+    double first_time;
+    double last_time;
+    double* low;         // Minima, or the last kept row for DECIMATE_DEADBAND
+    double* high;
+} Decimator;
+
+// Rows hold num_signals signals, complex ones (is_complex may be NULL if
+// none are) as re, im. policy may be NULL for no decimation. Returns -1 if
+// out of memory; the decimator then admits nothing until the next init.
+int decimator_init(Decimator* decimator, const DecimationPolicy* policy, const bool* is_complex,
+                   int num_signals);
+void decimator_free(Decimator* decimator);
+
+// Decides what can be decided without values: false means skip this step
+static inline bool decimator_admit(Decimator* decimator) {
+    if (decimator->failed) return false;
+    if (decimator->policy.kind != DECIMATE_EVERY) return true;
+    return decimator->steps++ % (uint64_t)decimator->policy.param == 0;
+}
+
+// Feed an admitted row; emit is called for every row that survives
+void decimator_push(Decimator* decimator, double time, const double* values,
+                    DecimatorEmit emit, void* user_data);
+
+// Emit a pending min/max bucket, e.g. at the end of a run
+void decimator_flush(Decimator* decimator, DecimatorEmit emit, void* user_data);
+
+#endif // SUBSCRIPTION_H
@@ -0,0 +1,491 @@
+#include "sweep.h"
+#include "simulation.h"
+#include "sample_queue.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+typedef enum {
+    RUN_PENDING = 0,
+    RUN_RUNNING,
+    RUN_DONE,
+    RUN_FAILED
+} SweepRunState;
+
+typedef struct {
+    atomic_int state;
+    int worker;
+    int exit_code;
+    unsigned long long samples;
+    double seconds;
+} SweepRunStatus;
+
+// A worker's remaining runs [lo, hi), packed as hi << 32 | lo so that owner
+// pops and thief steals are single compare-and-swaps
+typedef struct {
+    _Alignas(64) atomic_uint_least64_t range;
+} SweepDeque;
+
+// Lives in an anonymous shared mapping visible to all workers
+typedef struct {
+    int num_runs;
+    int num_workers;
+    SweepDeque* deques;          // num_workers entries
+    SweepRunStatus* runs;        // num_runs entries
+} SweepShared;
+
+// Exit status of a worker whose ngSpice_Init failed. Every replacement would
+// fail the same way, so the parent stops instead of respawning.
+#define WORKER_EXIT_FATAL 3
+
+// Crashes after which a worker slot is no longer restarted; the rest of its
+// range is left to the other workers
+#define SWEEP_MAX_RESPAWNS 3
+
+static inline uint64_t pack_range(uint32_t lo, uint32_t hi) {
+    return ((uint64_t)hi << 32) | lo;
+}
+
+int sweep_add_param(SweepOptions* options, const char* spec) {
+    if (options->num_params >= SWEEP_MAX_PARAMS) return -1;
+    const char* eq = strchr(spec, '=');
+    if (!eq || eq == spec || !eq[1]) return -1;
+
+    SweepParam* param = &options->params[options->num_params];
+    memset(param, 0, sizeof(SweepParam));
+    param->name = strndup(spec, eq - spec);
+    const char* list = eq + 1;
+
+    double start, stop;
+    int count;
+    char tail;
+    if (sscanf(list, "%lf:%lf:%d%c", &start, &stop, &count, &tail) == 3 && count > 0) {
+        // Linear range, endpoints included
+        param->values = calloc(count, sizeof(char*));
+        if (!param->values) return -1;
+        for (int i = 0; i < count; i++) {
+            double value = count == 1 ? start : start + (stop - start) * i / (count - 1);
+            char text[32];
+            snprintf(text, sizeof(text), "%.12g", value);
+            param->values[param->num_values++] = strdup(text);
+        }
+    } else {
+        int commas = 0;
+        for (const char* p = list; *p; p++) commas += *p == ',';
+        param->values = calloc(commas + 1, sizeof(char*));
+        if (!param->values) return -1;
+        const char* p = list;
+        for (;;) {
+            const char* comma = strchr(p, ',');
+            size_t len = comma ? (size_t)(comma - p) : strlen(p);
+            if (len > 0) param->values[param->num_values++] = strndup(p, len);
+            if (!comma) break;
+            p = comma + 1;
+        }
+        if (param->num_values == 0) return -1;
+    }
+
+    options->num_params++;
+    return 0;
+}
+
+void sweep_free_params(SweepOptions* options) {
+    for (int i = 0; i < options->num_params; i++) {
+        SweepParam* param = &options->params[i];
+        for (int v = 0; v < param->num_values; v++) {
+            free(param->values[v]);
+        }
+        free(param->values);
+        free(param->name);
+    }
+    options->num_params = 0;
+}
+
+// Value index of every parameter for a run; the last parameter varies fastest
+static void run_coordinates(const SweepOptions* options, int run, int* coords) {
+    for (int p = options->num_params - 1; p >= 0; p--) {
+        coords[p] = run % options->params[p].num_values;
+        run /= options->params[p].num_values;
+    }
+}
+
+static void free_lines(char** lines, int num_lines) {
+    if (!lines) return;
+    for (int i = 0; i < num_lines; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+}
+
+// NULL if the file cannot be read completely
+static char** read_template(const char* path, int* num_lines) {
+    FILE* file = fopen(path, "r");
+    if (!file) return NULL;
+
+    int capacity = 64;
+    int count = 0;
+    bool ok = true;
+    char** lines = malloc(capacity * sizeof(char*));
+    char buffer[4096];
+    while (lines && ok && fgets(buffer, sizeof(buffer), file)) {
+        buffer[strcspn(buffer, "\r\n")] = '\0';
+        if (count + 1 >= capacity) {
+            capacity *= 2;
+            char** grown = realloc(lines, capacity * sizeof(char*));
+            if (!grown) {
+                ok = false;
+                break;
+            }
+            lines = grown;
+        }
+        lines[count] = strdup(buffer);
+        ok = lines[count] != NULL;
+        if (ok) count++;
+    }
+    if (ferror(file)) ok = false;
+    fclose(file);
+    if (!lines || !ok) {
+        free_lines(lines, count);
+        return NULL;
+    }
+    lines[count] = NULL;
+    *num_lines = count;
+    return lines;
+}
+
+// Replace every {NAME} of a known parameter; unknown placeholders are kept
+static char* substitute_line(const char* line, const SweepOptions* options, const int* coords) {
+    size_t capacity = strlen(line) + 64;
+    size_t used = 0;
+    char* out = malloc(capacity);
+    if (!out) return NULL;
+
+    for (const char* p = line; *p; ) {
+        const char* value = NULL;
+        size_t skip = 1;
+        if (*p == '{') {
+            const char* close = strchr(p, '}');
+            for (int i = 0; close && i < options->num_params; i++) {
+                size_t len = strlen(options->params[i].name);
+                if ((size_t)(close - p - 1) == len && strncmp(p + 1, options->params[i].name, len) == 0) {
+                    value = options->params[i].values[coords[i]];
+                    skip = len + 2;
+                    break;
+                }
+            }
+        }
+        size_t add = value ? strlen(value) : 1;
+        if (used + add + 1 > capacity) {
+            capacity = (used + add + 1) * 2;
+            char* grown = realloc(out, capacity);
+            if (!grown) {
+                free(out);
+                return NULL;
+            }
+            out = grown;
+        }
+        if (value) {
+            memcpy(out + used, value, add);
+        } else {
+            out[used] = *p;
+        }
+        used += add;
+        p += skip;
+    }
+    out[used] = '\0';
+    return out;
+}
+
+static int run_one(SimContext* context, const SweepOptions* options, char** template_lines,
+                   int num_lines, int run, SweepRunStatus* status) {
+    int coords[SWEEP_MAX_PARAMS];
+    run_coordinates(options, run, coords);
+
+    char csv_path[4096], result_path[4096];
+    snprintf(csv_path, sizeof(csv_path), "%s/run_%05d.csv", options->output_dir, run);
+    snprintf(result_path, sizeof(result_path), "%s/run_%05d.ngres", options->output_dir, run);
+
+    // A missing line would end the netlist early: fail the run instead
+    char** circuit = calloc(num_lines + 1, sizeof(char*));
+    if (!circuit) return -1;
+    for (int i = 0; i < num_lines; i++) {
+        circuit[i] = substitute_line(template_lines[i], options, coords);
+        if (!circuit[i]) {
+            free_lines(circuit, i);
+            return -1;
+        }
+    }
+
+    context->csv_file = async_writer_open(csv_path, NULL);
+    context->result_file = result_writer_open(result_path, NULL, RESULT_DEFAULT_CHUNK_ROWS,
+                                               RESULT_FLAG_COMPRESSED);
+
+    int ret = -1;
+    uint64_t start_ns = monotonic_ns();
+    if (context->csv_file && context->result_file && ngSpice_Circ(circuit) == 0) {
+        ret = ngSpice_Command("run");
+    }
+    status->seconds = (double)(monotonic_ns() - start_ns) * 1e-9;
+    status->samples = context->samples;
+    cleanup_simulation(context);
+
+    // Fresh context for the next run; ngspice keeps the pointer from ngSpice_Init
+    init_simulation_context(context);
+
+    // Drop the circuit and its plots before the next run
+    ngSpice_Command("remcirc");
+    ngSpice_Command("destroy all");
+
+    free_lines(circuit, num_lines);
+    return ret;
+}
+
+// Take the next run from our own range, or steal half of another worker's
+static int next_run(SweepShared* shared, int worker) {
+    atomic_uint_least64_t* own = &shared->deques[worker].range;
+
+    for (;;) {
+        uint64_t range = atomic_load(own);
+        uint32_t lo = (uint32_t)range, hi = (uint32_t)(range >> 32);
+        if (lo < hi) {
+            if (atomic_compare_exchange_weak(own, &range, pack_range(lo + 1, hi))) {
+                return (int)lo;
+            }
+            continue;
+        }
+
+        // Own range is empty: steal from the victim with the most work left
+        int victim = -1;
+        uint32_t best = 0;
+        for (int i = 1; i < shared->num_workers; i++) {
+            int w = (worker + i) % shared->num_workers;
+            uint64_t r = atomic_load(&shared->deques[w].range);
+            uint32_t left = (uint32_t)(r >> 32) - (uint32_t)r;
+            if ((uint32_t)(r >> 32) > (uint32_t)r && left > best) {
+                best = left;
+                victim = w;
+            }
+        }
+        if (victim < 0) return -1;  // Nothing left anywhere
+
+        atomic_uint_least64_t* theirs = &shared->deques[victim].range;
+        uint64_t r = atomic_load(theirs);
+        uint32_t vlo = (uint32_t)r, vhi = (uint32_t)(r >> 32);
+        if (vlo >= vhi) continue;
+        uint32_t take = (vhi - vlo + 1) / 2;
+        if (atomic_compare_exchange_strong(theirs, &r, pack_range(vlo, vhi - take))) {
+            // Keep the first stolen run, the rest becomes our range
+            atomic_store(own, pack_range(vhi - take + 1, vhi));
+            return (int)(vhi - take);
+        }
+    }
+}
+
+// template_lines was read by the parent before forking
+static void worker_main(SweepShared* shared, int worker, const SweepOptions* options,
+                        char** template_lines, int num_lines) {
+    // ngspice's console output goes to a per-worker log instead of the terminal
+    char log_path[4096];
+    snprintf(log_path, sizeof(log_path), "%s/worker_%02d.log", options->output_dir, worker);
+    if (!freopen(log_path, "a", stdout)) {
+        fprintf(stderr, "Worker %d: cannot open %s\n", worker, log_path);
+    }
+
+    SimContext context;
+    init_simulation_context(&context);
+    if (ngSpice_Init(ng_getchar, ng_getstat, ng_exit, ng_data, ng_initdata, ng_bgrunning, &context) != 0) {
+        fprintf(stderr, "Worker %d: error initializing ngspice\n", worker);
+        _exit(WORKER_EXIT_FATAL);
+    }
+
+    int run;
+    while ((run = next_run(shared, worker)) >= 0) {
+        SweepRunStatus* status = &shared->runs[run];
+        status->worker = worker;
+        atomic_store(&status->state, RUN_RUNNING);
+        status->exit_code = run_one(&context, options, template_lines, num_lines, run, status);
+        atomic_store(&status->state, status->exit_code == 0 ? RUN_DONE : RUN_FAILED);
+        fflush(stdout);
+    }
+
+    fflush(stdout);
+    _exit(0);
+}
+
+static pid_t spawn_worker(SweepShared* shared, int worker, const SweepOptions* options,
+                          char** template_lines, int num_lines) {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        worker_main(shared, worker, options, template_lines, num_lines);
+    } else if (pid < 0) {
+        perror("fork");
+    }
+    return pid;
+}
+
+static int write_index(const SweepOptions* options, SweepShared* shared) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/index.csv", options->output_dir);
+    FILE* index = fopen(path, "w");
+    if (!index) return -1;
+
+    fprintf(index, "run");
+    for (int p = 0; p < options->num_params; p++) {
+        fprintf(index, ",%s", options->params[p].name);
+    }
+    fprintf(index, ",status,worker,samples,seconds,csv,result\n");
+
+    static const char* state_names[] = { "pending", "running", "done", "failed" };
+    int failed = 0;
+    for (int run = 0; run < shared->num_runs; run++) {
+        SweepRunStatus* status = &shared->runs[run];
+        int coords[SWEEP_MAX_PARAMS];
+        run_coordinates(options, run, coords);
+
+        int state = atomic_load(&status->state);
+        // A run still marked running belonged to a worker that died
+        if (state != RUN_DONE) failed++;
+
+        fprintf(index, "%d", run);
+        for (int p = 0; p < options->num_params; p++) {
+            fprintf(index, ",%s", options->params[p].values[coords[p]]);
+        }
+        fprintf(index, ",%s,%d,%llu,%.6f,run_%05d.csv,run_%05d.ngres\n",
+                state == RUN_RUNNING ? "crashed" : state_names[state],
+                status->worker, status->samples, status->seconds, run, run);
+    }
+    fclose(index);
+    return failed;
+}
+
+int run_sweep(const SweepOptions* options) {
+    long total = 1;
+    for (int p = 0; p < options->num_params; p++) {
+        total *= options->params[p].num_values;
+        if (total > INT32_MAX) {
+            fprintf(stderr, "Sweep grid too large\n");
+            return 1;
+        }
+    }
+    int num_runs = (int)total;
+
+    // Read once here: a template that cannot be read fails every worker alike
+    int num_lines = 0;
+    char** template_lines = read_template(options->template_path, &num_lines);
+    if (!template_lines) {
+        perror(options->template_path);
+        return 1;
+    }
+
+    if (mkdir(options->output_dir, 0755) != 0 && errno != EEXIST) {
+        perror(options->output_dir);
+        free_lines(template_lines, num_lines);
+        return 1;
+    }
+
+    int jobs = options->jobs > 0 ? options->jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1) jobs = 1;
+    if (jobs > num_runs) jobs = num_runs;
+
+    size_t deques_size = (size_t)jobs * sizeof(SweepDeque);
+    size_t shared_size = sizeof(SweepShared) + 64 + deques_size + (size_t)num_runs * sizeof(SweepRunStatus);
+    void* mapping = mmap(NULL, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        perror("mmap");
+        free_lines(template_lines, num_lines);
+        return 1;
+    }
+    SweepShared* shared = mapping;
+    shared->num_runs = num_runs;
+    shared->num_workers = jobs;
+    shared->deques = (SweepDeque*)(((uintptr_t)(shared + 1) + 63) & ~(uintptr_t)63);
+    shared->runs = (SweepRunStatus*)((char*)shared->deques + deques_size);
+
+    // Start with equal contiguous slices; stealing evens out the rest
+    for (int w = 0; w < jobs; w++) {
+        uint32_t lo = (uint32_t)((long)num_runs * w / jobs);
+        uint32_t hi = (uint32_t)((long)num_runs * (w + 1) / jobs);
+        atomic_init(&shared->deques[w].range, pack_range(lo, hi));
+    }
+    for (int r = 0; r < num_runs; r++) {
+        atomic_init(&shared->runs[r].state, RUN_PENDING);
+        shared->runs[r].worker = -1;
+    }
+
+    printf("Sweep: %d runs on %d workers, output in %s\n", num_runs, jobs, options->output_dir);
+    fflush(stdout);
+
+    pid_t* pids = calloc(jobs, sizeof(pid_t));
+    int* respawns = calloc(jobs, sizeof(int));
+    if (!pids || !respawns) {
+        free(pids);
+        free(respawns);
+        munmap(mapping, shared_size);
+        free_lines(template_lines, num_lines);
+        return 1;
+    }
+    int alive = 0;
+    for (int w = 0; w < jobs; w++) {
+        pids[w] = spawn_worker(shared, w, options, template_lines, num_lines);
+        if (pids[w] > 0) alive++;
+    }
+
+    bool fatal = false;
+    while (alive > 0) {
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        int w = 0;
+        while (w < jobs && pids[w] != pid) w++;
+        if (w == jobs) continue;
+        alive--;
+        pids[w] = 0;
+
+        if (WIFEXITED(status) && WEXITSTATUS(status) == WORKER_EXIT_FATAL) {
+            fprintf(stderr, "Worker %d could not start, not restarting workers\n", w);
+            fatal = true;
+        } else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            // The run it was on is lost; the rest of its range is not
+            uint64_t range = atomic_load(&shared->deques[w].range);
+            fprintf(stderr, "Worker %d exited abnormally\n", w);
+            if (!fatal && (uint32_t)range < (uint32_t)(range >> 32)) {
+                if (respawns[w] < SWEEP_MAX_RESPAWNS) {
+                    respawns[w]++;
+                    pids[w] = spawn_worker(shared, w, options, template_lines, num_lines);
+                    if (pids[w] > 0) alive++;
+                } else {
+                    fprintf(stderr, "Worker %d crashed %d times, not restarting it\n", w, respawns[w] + 1);
+                }
+            }
+        }
+    }
+    free(pids);
+    free(respawns);
+    free_lines(template_lines, num_lines);
+
+    // Runs no worker got to, e.g. after a fatal exit or with every slot given up
+    for (int r = 0; r < num_runs; r++) {
+        int pending = RUN_PENDING;
+        atomic_compare_exchange_strong(&shared->runs[r].state, &pending, RUN_FAILED);
+    }
+
+    int failed = write_index(options, shared);
+    if (failed < 0) {
+        fprintf(stderr, "Error writing sweep index\n");
+    } else {
+        printf("Sweep finished: %d of %d runs succeeded\n", num_runs - failed, num_runs);
+    }
+    munmap(mapping, shared_size);
+    return failed == 0 ? 0 : 1;
+}
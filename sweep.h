@@ -0,0 +1,44 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdbool.h>
+
+// Parameter sweeps over a pool of forked worker processes.
+// libngspice keeps global state and is not re-entrant, so every worker is a
+// separate process with its own ngSpice_Init and SimContext. Runs are
+// distributed as per-worker index ranges in shared memory; an idle worker
+// steals half of the largest remaining range of another worker. A worker
+// that crashes is restarted on the rest of its range a few times; one that
+// cannot initialize ngspice stops all restarts, and runs that no worker got
+// to are reported as failed.
+//
+// The netlist template is read once before the workers are forked. It is a
+// regular netlist where every {NAME} is replaced by the current value of
+// parameter NAME. Each run writes run_NNNNN.csv and run_NNNNN.ngres into the
+// output directory, and index.csv lists every run with its parameter values,
+// status and output files.
+
+#define SWEEP_MAX_PARAMS 16
+
+typedef struct {
+    char* name;
+    char** values;       // Substituted verbatim
+    int num_values;
+} SweepParam;
+
+typedef struct {
+    const char* template_path;
+    const char* output_dir;
+    int jobs;            // Worker processes, 0 = one per online CPU
+    SweepParam params[SWEEP_MAX_PARAMS];
+    int num_params;
+} SweepOptions;
+
+// Add a parameter from "NAME=v1,v2,..." or "NAME=start:stop:count" (linear)
+int sweep_add_param(SweepOptions* options, const char* spec);
+void sweep_free_params(SweepOptions* options);
+
+// Run the whole grid, returns 0 if every run succeeded
+int run_sweep(const SweepOptions* options);
+
+#endif // SWEEP_H
@@ -0,0 +1,486 @@
+#include "waveform_store.h"
+#include "column_codec.h"
+#include "log.h"
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define BLOCKS_PER_CHUNK (WAVEFORM_CHUNK_SAMPLES / WAVEFORM_BLOCK_SAMPLES)
+
+// Layout of a chunk while it is in memory:
+//   double times[WAVEFORM_CHUNK_SAMPLES]
+//   double values[num_signals][WAVEFORM_CHUNK_SAMPLES]
+//   double block_min[num_signals][BLOCKS_PER_CHUNK]
+//   double block_max[num_signals][BLOCKS_PER_CHUNK]
+// and once it is packed:
+//   uint32_t block_offset[num_signals + 1][BLOCKS_PER_CHUNK], from the start,
+//            padded to 8 bytes
+//   double block_min[num_signals][BLOCKS_PER_CHUNK]
+//   double block_max[num_signals][BLOCKS_PER_CHUNK]
+//   one column_codec.h block per column and block of samples: delta-of-delta
+//   for the times, XOR for the values
+// so a lookup decodes WAVEFORM_BLOCK_SAMPLES values, not the whole chunk.
+typedef struct {
+    double* base;       // Raw chunk while it is among the newest, else NULL
+    uint8_t* packed;    // Packed chunk, a read-only mapping of the spill file or malloc'ed
+    size_t packed_bytes;
+    size_t mapped_bytes; // Length of the mapping, 0 if packed is malloc'ed
+    int count;
+    double t_first;
+    double t_last;
+} WaveformChunk;
+
+// One decoded block of a packed chunk. The cache is direct-mapped on
+// (chunk, block, column), so the times and the signals of a block coexist.
+typedef struct {
+    int chunk;          // -1 if empty
+    int block;
+    int column;         // 0 for the times, signal + 1
+    double values[WAVEFORM_BLOCK_SAMPLES];
+} DecodedBlock;
+
+struct WaveformStore {
+    int num_signals;
+    int fd;                 // Spill file, -1 if it could not be used
+    size_t page;
+    size_t chunk_bytes;
+    off_t spill_offset;     // End of the spill file
+    WaveformChunk* chunks;
+    double* chunk_min;      // [chunk * num_signals + signal], always in memory
+    double* chunk_max;
+    int num_chunks;
+    int chunks_capacity;
+    int num_packed;
+    size_t packed_ram_bytes;
+    size_t spilled_bytes;
+    ColumnEncoder time_encoder;
+    ColumnEncoder value_encoder;
+    DecodedBlock* cache;   // Filled by const queries, not part of the store's state
+    int cache_slots;
+    long long count;
+    double last_time;
+};
+
+static inline size_t summary_offset(const WaveformStore* store) {
+    size_t offsets = ((size_t)store->num_signals + 1) * BLOCKS_PER_CHUNK * sizeof(uint32_t);
+    return (offsets + 7) & ~(size_t)7;
+}
+
+static inline const uint8_t* packed_block(const WaveformChunk* chunk, int column, int block, size_t* size) {
+    uint32_t offset;
+    memcpy(&offset, chunk->packed + ((size_t)column * BLOCKS_PER_CHUNK + block) * sizeof(uint32_t),
+           sizeof(offset));
+    *size = offset < chunk->packed_bytes ? chunk->packed_bytes - offset : 0;
+    return chunk->packed + offset;
+}
+
+static const double* decode_block(const WaveformStore* store, int c, int column, int block) {
+    size_t key = ((size_t)c * BLOCKS_PER_CHUNK + block) * (store->num_signals + 1) + column;
+    DecodedBlock* slot = &store->cache[key % store->cache_slots];
+    if (slot->chunk == c && slot->block == block && slot->column == column) return slot->values;
+
+    const WaveformChunk* chunk = &store->chunks[c];
+    int expected = chunk->count - block * WAVEFORM_BLOCK_SAMPLES;
+    if (expected > WAVEFORM_BLOCK_SAMPLES) expected = WAVEFORM_BLOCK_SAMPLES;
+    size_t size;
+    const uint8_t* data = packed_block(chunk, column, block, &size);
+    if (column_block_decode(data, size, slot->values, WAVEFORM_BLOCK_SAMPLES) != expected) {
+        DEBUG_PRINT(DEBUG_ERROR, "Waveform chunk %d block %d column %d does not decode", c, block, column);
+        for (int i = 0; i < WAVEFORM_BLOCK_SAMPLES; i++) slot->values[i] = NAN;
+    }
+    slot->chunk = c;
+    slot->block = block;
+    slot->column = column;
+    return slot->values;
+}
+
+// Sample i of a chunk's column, 0 for the times
+static inline double chunk_sample(const WaveformStore* store, int c, int column, int i) {
+    const WaveformChunk* chunk = &store->chunks[c];
+    if (chunk->base) return chunk->base[(size_t)WAVEFORM_CHUNK_SAMPLES * column + i];
+    return decode_block(store, c, column, i / WAVEFORM_BLOCK_SAMPLES)[i % WAVEFORM_BLOCK_SAMPLES];
+}
+
+// First time of a block, which a codec block stores as is after its header
+static inline double block_first_time(const WaveformStore* store, int c, int block) {
+    const WaveformChunk* chunk = &store->chunks[c];
+    if (chunk->base) return chunk->base[block * WAVEFORM_BLOCK_SAMPLES];
+    size_t size;
+    const uint8_t* data = packed_block(chunk, 0, block, &size);
+    if (size < sizeof(ColumnBlockHeader) + sizeof(double)) return NAN;
+    double time;
+    memcpy(&time, data + sizeof(ColumnBlockHeader), sizeof(time));
+    return time;
+}
+
+// Block summaries are stored raw in either form
+static inline const double* chunk_block_min(const WaveformStore* store, const WaveformChunk* chunk, int signal) {
+    const double* summaries = chunk->base
+        ? chunk->base + (size_t)WAVEFORM_CHUNK_SAMPLES * (store->num_signals + 1)
+        : (const double*)(chunk->packed + summary_offset(store));
+    return summaries + (size_t)BLOCKS_PER_CHUNK * signal;
+}
+
+static inline const double* chunk_block_max(const WaveformStore* store, const WaveformChunk* chunk, int signal) {
+    return chunk_block_min(store, chunk, signal) + (size_t)BLOCKS_PER_CHUNK * store->num_signals;
+}
+
+WaveformStore* waveform_store_create(int num_signals, const char* dir) {
+    WaveformStore* store = calloc(1, sizeof(WaveformStore));
+    if (!store) return NULL;
+    store->num_signals = num_signals;
+    column_encoder_init(&store->time_encoder, COLUMN_CODEC_DOD);
+    column_encoder_init(&store->value_encoder, COLUMN_CODEC_XOR);
+
+    store->cache_slots = 4 * (num_signals + 1);
+    store->cache = malloc((size_t)store->cache_slots * sizeof(DecodedBlock));
+    if (!store->cache) {
+        free(store);
+        return NULL;
+    }
+    for (int i = 0; i < store->cache_slots; i++) {
+        store->cache[i].chunk = -1;
+    }
+
+    long page = sysconf(_SC_PAGESIZE);
+    if (page <= 0) page = 4096;
+    store->page = (size_t)page;
+    size_t bytes = sizeof(double) * ((size_t)WAVEFORM_CHUNK_SAMPLES * (num_signals + 1) +
+                                     2 * (size_t)BLOCKS_PER_CHUNK * num_signals);
+    store->chunk_bytes = (bytes + page - 1) / page * page;
+
+    if (!dir) dir = getenv("TMPDIR");
+    if (!dir || !*dir) dir = "/tmp";
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/ngspice-waveform.XXXXXX", dir);
+    store->fd = mkstemp(path);
+    if (store->fd >= 0) {
+        // The file lives on until the descriptor and the mappings are gone
+        unlink(path);
+    } else {
+        DEBUG_PRINT(DEBUG_WARN, "Cannot create waveform spill file in %s: %s, keeping the run in memory",
+                    dir, strerror(errno));
+    }
+    return store;
+}
+
+void waveform_store_destroy(WaveformStore* store) {
+    if (!store) return;
+    for (int c = 0; c < store->num_chunks; c++) {
+        WaveformChunk* chunk = &store->chunks[c];
+        free(chunk->base);
+        if (chunk->mapped_bytes) {
+            munmap(chunk->packed, chunk->mapped_bytes);
+        } else {
+            free(chunk->packed);
+        }
+    }
+    if (store->fd >= 0) close(store->fd);
+    column_encoder_free(&store->time_encoder);
+    column_encoder_free(&store->value_encoder);
+    free(store->cache);
+    free(store->chunks);
+    free(store->chunk_min);
+    free(store->chunk_max);
+    free(store);
+}
+
+static bool write_packed(WaveformStore* store, const uint8_t* data, size_t bytes, off_t offset) {
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t n = pwrite(store->fd, data + done, bytes - done, offset + (off_t)done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        done += (size_t)n;
+    }
+    return true;
+}
+
+// Encode values of one column and block and append them to the packed chunk
+static bool append_block(uint8_t** packed, size_t* size, ColumnEncoder* encoder,
+                         const double* values, int count) {
+    column_encoder_reset(encoder);
+    for (int i = 0; i < count; i++) {
+        column_encoder_put(encoder, values[i]);
+    }
+    size_t bytes = 0;
+    const void* block = column_encoder_finish(encoder, &bytes);
+    uint8_t* grown = block ? realloc(*packed, *size + bytes) : NULL;
+    if (!grown) return false;
+    memcpy(grown + *size, block, bytes);
+    *packed = grown;
+    *size += bytes;
+    return true;
+}
+
+// Compress a complete chunk once it is no longer among the newest, then move
+// it to the spill file and map it back. Without a spill file the packed
+// chunk stays in memory; if packing fails the raw chunk does.
+static void pack_chunk(WaveformStore* store, int index) {
+    WaveformChunk* chunk = &store->chunks[index];
+    if (!chunk->base) return;
+
+    size_t summaries = 2 * (size_t)BLOCKS_PER_CHUNK * store->num_signals * sizeof(double);
+    size_t size = summary_offset(store) + summaries;
+    uint8_t* packed = malloc(size);
+    if (!packed) return;
+    memcpy(packed + summary_offset(store), chunk_block_min(store, chunk, 0), summaries);
+
+    memset(packed, 0, summary_offset(store));
+    for (int column = 0; column <= store->num_signals; column++) {
+        ColumnEncoder* encoder = column == 0 ? &store->time_encoder : &store->value_encoder;
+        for (int b = 0; b * WAVEFORM_BLOCK_SAMPLES < chunk->count; b++) {
+            uint32_t offset = (uint32_t)size;
+            memcpy(packed + ((size_t)column * BLOCKS_PER_CHUNK + b) * sizeof(uint32_t), &offset, sizeof(offset));
+            int first = b * WAVEFORM_BLOCK_SAMPLES;
+            int n = chunk->count - first < WAVEFORM_BLOCK_SAMPLES ? chunk->count - first : WAVEFORM_BLOCK_SAMPLES;
+            if (!append_block(&packed, &size, encoder,
+                              chunk->base + (size_t)WAVEFORM_CHUNK_SAMPLES * column + first, n)) {
+                free(packed);
+                return;
+            }
+        }
+    }
+
+    free(chunk->base);
+    chunk->base = NULL;
+    chunk->packed = packed;
+    chunk->packed_bytes = size;
+    store->num_packed++;
+
+    if (store->fd >= 0) {
+        size_t mapped = (size + store->page - 1) / store->page * store->page;
+        void* map = MAP_FAILED;
+        if (write_packed(store, packed, size, store->spill_offset)) {
+            map = mmap(NULL, mapped, PROT_READ, MAP_SHARED, store->fd, store->spill_offset);
+        }
+        if (map == MAP_FAILED) {
+            DEBUG_PRINT(DEBUG_WARN, "Waveform spill failed: %s, keeping the rest of the run in memory",
+                        strerror(errno));
+            close(store->fd);
+            store->fd = -1;
+        } else {
+            free(packed);
+            chunk->packed = map;
+            chunk->mapped_bytes = mapped;
+            store->spill_offset += (off_t)mapped;
+            store->spilled_bytes += mapped;
+            return;
+        }
+    }
+    store->packed_ram_bytes += size;
+}
+
+static int add_chunk(WaveformStore* store) {
+    if (store->num_chunks == store->chunks_capacity) {
+        int capacity = store->chunks_capacity ? 2 * store->chunks_capacity : 64;
+        WaveformChunk* chunks = realloc(store->chunks, capacity * sizeof(WaveformChunk));
+        if (!chunks) return -1;
+        store->chunks = chunks;
+        size_t summary_bytes = (size_t)capacity * (store->num_signals > 0 ? store->num_signals : 1) * sizeof(double);
+        double* chunk_min = realloc(store->chunk_min, summary_bytes);
+        if (!chunk_min) return -1;
+        store->chunk_min = chunk_min;
+        double* chunk_max = realloc(store->chunk_max, summary_bytes);
+        if (!chunk_max) return -1;
+        store->chunk_max = chunk_max;
+        store->chunks_capacity = capacity;
+    }
+
+    double* base = aligned_alloc(64, store->chunk_bytes);
+    if (!base) return -1;
+    store->chunks[store->num_chunks++] = (WaveformChunk){.base = base};
+
+    // Only the newest chunks stay raw
+    int oldest_raw = store->num_chunks - WAVEFORM_RAM_CHUNKS;
+    if (oldest_raw > 0) {
+        pack_chunk(store, oldest_raw - 1);
+    }
+    return 0;
+}
+
+int waveform_store_append(WaveformStore* store, double time, const double* values) {
+    if (store->num_chunks == 0 || store->chunks[store->num_chunks - 1].count == WAVEFORM_CHUNK_SAMPLES) {
+        if (add_chunk(store) != 0) return -1;
+    }
+    int c = store->num_chunks - 1;
+    WaveformChunk* chunk = &store->chunks[c];
+    int i = chunk->count;
+    int block = i / WAVEFORM_BLOCK_SAMPLES;
+    bool block_start = i % WAVEFORM_BLOCK_SAMPLES == 0;
+
+    // Binary search needs sorted times
+    if (store->count > 0 && time < store->last_time) time = store->last_time;
+    chunk->base[i] = time;
+
+    // The newest chunk is always raw
+    double* summaries = chunk->base + (size_t)WAVEFORM_CHUNK_SAMPLES * (store->num_signals + 1);
+    double* summary_min = store->chunk_min + (size_t)c * store->num_signals;
+    double* summary_max = store->chunk_max + (size_t)c * store->num_signals;
+    for (int s = 0; s < store->num_signals; s++) {
+        double v = values[s];
+        chunk->base[(size_t)WAVEFORM_CHUNK_SAMPLES * (s + 1) + i] = v;
+        double* block_min = &summaries[(size_t)BLOCKS_PER_CHUNK * s + block];
+        double* block_max = &summaries[(size_t)BLOCKS_PER_CHUNK * (store->num_signals + s) + block];
+        if (block_start || v < *block_min) *block_min = v;
+        if (block_start || v > *block_max) *block_max = v;
+        if (i == 0 || v < summary_min[s]) summary_min[s] = v;
+        if (i == 0 || v > summary_max[s]) summary_max[s] = v;
+    }
+
+    if (i == 0) chunk->t_first = time;
+    chunk->t_last = time;
+    chunk->count++;
+    store->count++;
+    store->last_time = time;
+    return 0;
+}
+
+long long waveform_store_count(const WaveformStore* store) {
+    return store->count;
+}
+
+int waveform_store_num_signals(const WaveformStore* store) {
+    return store->num_signals;
+}
+
+bool waveform_store_time_range(const WaveformStore* store, double* first, double* last) {
+    if (store->count == 0) return false;
+    *first = store->chunks[0].t_first;
+    *last = store->last_time;
+    return true;
+}
+
+double waveform_store_time_at(const WaveformStore* store, long long index) {
+    return chunk_sample(store, (int)(index / WAVEFORM_CHUNK_SAMPLES), 0, (int)(index % WAVEFORM_CHUNK_SAMPLES));
+}
+
+double waveform_store_value(const WaveformStore* store, int signal, long long index) {
+    return chunk_sample(store, (int)(index / WAVEFORM_CHUNK_SAMPLES), signal + 1,
+                        (int)(index % WAVEFORM_CHUNK_SAMPLES));
+}
+
+long long waveform_store_lower_bound(const WaveformStore* store, double time) {
+    // First chunk that ends at or after time, then within that chunk
+    int lo = 0;
+    int hi = store->num_chunks;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (store->chunks[mid].t_last < time) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == store->num_chunks) return store->count;
+
+    // Then the blocks that start before time, which a packed chunk has
+    // without decoding, and the last of those
+    const WaveformChunk* chunk = &store->chunks[lo];
+    int num_blocks = (chunk->count + WAVEFORM_BLOCK_SAMPLES - 1) / WAVEFORM_BLOCK_SAMPLES;
+    int before = 0;
+    int b = num_blocks;
+    while (before < b) {
+        int mid = before + (b - before) / 2;
+        if (block_first_time(store, lo, mid) < time) {
+            before = mid + 1;
+        } else {
+            b = mid;
+        }
+    }
+    long long base = (long long)lo * WAVEFORM_CHUNK_SAMPLES;
+    if (before == 0) return base;
+
+    int a = (before - 1) * WAVEFORM_BLOCK_SAMPLES;
+    int end = before * WAVEFORM_BLOCK_SAMPLES < chunk->count ? before * WAVEFORM_BLOCK_SAMPLES : chunk->count;
+    while (a < end) {
+        int mid = a + (end - a) / 2;
+        if (chunk_sample(store, lo, 0, mid) < time) {
+            a = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    return base + a;
+}
+
+// Samples [first, first + count) of one chunk: raw values up to the next
+// block boundary, block summaries in between, raw values for the rest.
+// A packed chunk decodes at most the two edge blocks.
+static void chunk_minmax(const WaveformStore* store, int c, int signal,
+                         int first, int count, double* lo, double* hi) {
+    const WaveformChunk* chunk = &store->chunks[c];
+    int end = first + count;
+    const double* block_min = chunk_block_min(store, chunk, signal);
+    const double* block_max = chunk_block_max(store, chunk, signal);
+    int i = first;
+
+    while (i < end && i % WAVEFORM_BLOCK_SAMPLES != 0) {
+        double v = chunk_sample(store, c, signal + 1, i);
+        if (v < *lo) *lo = v;
+        if (v > *hi) *hi = v;
+        i++;
+    }
+    while (i + WAVEFORM_BLOCK_SAMPLES <= end) {
+        int b = i / WAVEFORM_BLOCK_SAMPLES;
+        if (block_min[b] < *lo) *lo = block_min[b];
+        if (block_max[b] > *hi) *hi = block_max[b];
+        i += WAVEFORM_BLOCK_SAMPLES;
+    }
+    for (; i < end; i++) {
+        double v = chunk_sample(store, c, signal + 1, i);
+        if (v < *lo) *lo = v;
+        if (v > *hi) *hi = v;
+    }
+}
+
+void waveform_store_minmax(const WaveformStore* store, int signal, long long first, long long count,
+                           double* out_min, double* out_max) {
+    long long end = first + count;
+    if (first < 0) first = 0;
+    if (end > store->count) end = store->count;
+    if (first >= end) {
+        *out_min = 0.0;
+        *out_max = 0.0;
+        return;
+    }
+
+    double lo = INFINITY;
+    double hi = -INFINITY;
+    while (first < end) {
+        int c = (int)(first / WAVEFORM_CHUNK_SAMPLES);
+        const WaveformChunk* chunk = &store->chunks[c];
+        int i = (int)(first % WAVEFORM_CHUNK_SAMPLES);
+        int n = end - first < chunk->count - i ? (int)(end - first) : chunk->count - i;
+        if (i == 0 && n == chunk->count) {
+            // Whole chunk: its summary is in memory, nothing is read from disk
+            double cmin = store->chunk_min[(size_t)c * store->num_signals + signal];
+            double cmax = store->chunk_max[(size_t)c * store->num_signals + signal];
+            if (cmin < lo) lo = cmin;
+            if (cmax > hi) hi = cmax;
+        } else {
+            chunk_minmax(store, c, signal, i, n, &lo, &hi);
+        }
+        first += n;
+    }
+    *out_min = lo;
+    *out_max = hi;
+}
+
+size_t waveform_store_ram_bytes(const WaveformStore* store) {
+    size_t summaries = (size_t)store->chunks_capacity * (sizeof(WaveformChunk) +
+                       2 * sizeof(double) * (store->num_signals > 0 ? store->num_signals : 1));
+    size_t cache = (size_t)store->cache_slots * sizeof(DecodedBlock);
+    return (size_t)(store->num_chunks - store->num_packed) * store->chunk_bytes +
+           store->packed_ram_bytes + cache + summaries;
+}
+
+size_t waveform_store_spilled_bytes(const WaveformStore* store) {
+    return store->spilled_bytes;
+}
@@ -0,0 +1,56 @@
+#ifndef WAVEFORM_STORE_H
+#define WAVEFORM_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Complete, time-indexed record of a run for zooming and panning, next to
+// the fixed-length SignalHistory that feeds the live view.
+// Samples are appended in chunks of WAVEFORM_CHUNK_SAMPLES: the time column
+// plus one column per signal, and min/max summaries per block of
+// WAVEFORM_BLOCK_SAMPLES. The newest WAVEFORM_RAM_CHUNKS chunks stay raw in
+// memory; older ones are compressed column by column (column_codec.h), written
+// to an unlinked temporary file and mapped back read-only, so the kernel can
+// drop their pages under memory pressure. Reads decode one block of one
+// column at a time into a small cache.
+// Per-chunk time bounds and min/max stay in memory, which lets time ranges
+// be found by binary search and min/max queries touch only the raw samples
+// at the edges of a range.
+// Indices are absolute (0 = first sample of the run). Not thread-safe: the
+// render loop appends and queries.
+
+#define WAVEFORM_CHUNK_SAMPLES 4096
+#define WAVEFORM_BLOCK_SAMPLES 64
+#define WAVEFORM_RAM_CHUNKS 8
+
+typedef struct WaveformStore WaveformStore;
+
+// Spill file in dir, or $TMPDIR (else /tmp) if dir is NULL
+WaveformStore* waveform_store_create(int num_signals, const char* dir);
+void waveform_store_destroy(WaveformStore* store);
+
+// Times must not decrease; an earlier time is stored as the previous one.
+// Returns -1 if memory ran out, the sample is then lost.
+int waveform_store_append(WaveformStore* store, double time, const double* values);
+
+long long waveform_store_count(const WaveformStore* store);
+int waveform_store_num_signals(const WaveformStore* store);
+
+// Time of the first and last sample; false while the store is empty
+bool waveform_store_time_range(const WaveformStore* store, double* first, double* last);
+
+double waveform_store_time_at(const WaveformStore* store, long long index);
+double waveform_store_value(const WaveformStore* store, int signal, long long index);
+
+// Index of the first sample at or after time (count if there is none)
+long long waveform_store_lower_bound(const WaveformStore* store, double time);
+
+// Min and max of samples [first, first + count) of one signal
+void waveform_store_minmax(const WaveformStore* store, int signal, long long first, long long count,
+                           double* out_min, double* out_max);
+
+// Bytes held in memory and written to the spill file
+size_t waveform_store_ram_bytes(const WaveformStore* store);
+size_t waveform_store_spilled_bytes(const WaveformStore* store);
+
+#endif // WAVEFORM_STORE_H